@@ -0,0 +1,827 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include "acl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_DOMAIN 255
+#define MAX_LABEL 63
+#define MAX_LINE 512
+
+/* índice 0 de los arreglos de nodos: no hay nodo */
+#define NIL 0
+
+struct ip_node {
+    uint32_t child[2];
+    uint8_t key[16];
+    /* largo del prefijo que representa el nodo */
+    uint8_t bits;
+    /* enum acl_verdict; ACL_NO_MATCH en los nodos intermedios */
+    int8_t verdict;
+};
+
+/* arista del trie de dominios: etiqueta que lleva de `parent' a `child' */
+struct dom_edge {
+    uint32_t parent;
+    uint32_t child;
+    uint32_t hash;
+    uint32_t label;
+    uint8_t len;
+};
+
+struct acl_set {
+    char *user;
+    uint32_t v4;
+    uint32_t v6;
+    /* raíz del trie de dominios */
+    uint32_t dom;
+    int8_t fallback;
+};
+
+struct acl {
+    struct ip_node *ip;
+    size_t ip_count;
+    size_t ip_cap;
+
+    /* veredicto de cada nodo de dominio */
+    int8_t *dom;
+    size_t dom_count;
+    size_t dom_cap;
+
+    /* tabla hash de aristas, potencia de 2, a lo sumo a medio llenar */
+    struct dom_edge *edges;
+    size_t edge_count;
+    size_t edge_slots;
+
+    /* etiquetas de las aristas, en minúsculas y sin separador */
+    char *labels;
+    size_t labels_len;
+    size_t labels_cap;
+
+    /* el conjunto 0 es el global */
+    struct acl_set *sets;
+    size_t set_count;
+    size_t set_cap;
+    /* índice de conjuntos por usuario: (número de conjunto + 1), 0 vacío */
+    uint32_t *users;
+    size_t user_slots;
+
+    size_t rules;
+};
+
+static uint32_t fnv(uint32_t h, const void *p, size_t n) {
+    const uint8_t *s = p;
+    for (size_t i = 0; i < n; i++) {
+        h ^= s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool grow(void **p, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap) {
+        return true;
+    }
+    size_t n = *cap == 0 ? 64 : *cap;
+    while (n < need) {
+        n *= 2;
+    }
+    void *q = realloc(*p, n * elem);
+    if (q == NULL) {
+        return false;
+    }
+    *p = q;
+    *cap = n;
+    return true;
+}
+
+/* ----- trie de direcciones -------------------------------------------- */
+
+static unsigned bit_at(const uint8_t *key, unsigned i) {
+    return (key[i / 8] >> (7 - i % 8)) & 1;
+}
+
+static bool prefix_equal(const uint8_t *a, const uint8_t *b, unsigned bits) {
+    unsigned bytes = bits / 8;
+    if (memcmp(a, b, bytes) != 0) {
+        return false;
+    }
+    unsigned rest = bits % 8;
+    if (rest == 0) {
+        return true;
+    }
+    uint8_t mask = (uint8_t)(0xFF << (8 - rest));
+    return ((a[bytes] ^ b[bytes]) & mask) == 0;
+}
+
+static unsigned common_bits(const uint8_t *a, const uint8_t *b, unsigned max) {
+    unsigned i = 0;
+    while (i + 8 <= max && a[i / 8] == b[i / 8]) {
+        i += 8;
+    }
+    while (i < max && bit_at(a, i) == bit_at(b, i)) {
+        i++;
+    }
+    return i;
+}
+
+static uint32_t ip_node_new(struct acl *acl, const uint8_t *key, unsigned bits, int verdict) {
+    if (!grow((void **)&acl->ip, &acl->ip_cap, acl->ip_count + 1, sizeof(*acl->ip))) {
+        return NIL;
+    }
+    uint32_t i = (uint32_t)acl->ip_count++;
+    struct ip_node *n = &acl->ip[i];
+    memset(n, 0, sizeof(*n));
+    // solo se guardan los bits del prefijo
+    memcpy(n->key, key, (bits + 7) / 8);
+    if (bits % 8 != 0) {
+        n->key[bits / 8] &= (uint8_t)(0xFF << (8 - bits % 8));
+    }
+    n->bits = (uint8_t)bits;
+    n->verdict = (int8_t)verdict;
+    return i;
+}
+
+/*
+ * Inserta el prefijo en el trie que cuelga de `*root'. Los nodos se guardan
+ * en un arreglo que puede moverse al crecer, así que el enlace a actualizar
+ * se sigue como (nodo, hijo) en lugar de un puntero.
+ */
+static bool ip_insert(struct acl *acl, uint32_t *root, const uint8_t *key, unsigned bits, int verdict) {
+    uint32_t parent = NIL;
+    unsigned side = 0;
+    uint32_t cur = *root;
+
+    while (cur != NIL) {
+        const struct ip_node *n = &acl->ip[cur];
+        unsigned max = n->bits < bits ? n->bits : bits;
+        unsigned common = common_bits(n->key, key, max);
+
+        if (common == n->bits) {
+            if (bits == n->bits) {
+                acl->ip[cur].verdict = (int8_t)verdict;
+                return true;
+            }
+            parent = cur;
+            side = bit_at(key, n->bits);
+            cur = n->child[side];
+            continue;
+        }
+
+        // el nodo actual diverge del prefijo nuevo: se intercala uno
+        unsigned old_side = bit_at(n->key, common);
+        uint32_t mid;
+        if (common == bits) {
+            mid = ip_node_new(acl, key, bits, verdict);
+            if (mid == NIL) {
+                return false;
+            }
+        } else {
+            mid = ip_node_new(acl, key, common, ACL_NO_MATCH);
+            uint32_t leaf = mid == NIL ? NIL : ip_node_new(acl, key, bits, verdict);
+            if (leaf == NIL) {
+                return false;
+            }
+            acl->ip[mid].child[!old_side] = leaf;
+        }
+        acl->ip[mid].child[old_side] = cur;
+        cur = mid;
+        break;
+    }
+
+    if (cur == NIL) {
+        cur = ip_node_new(acl, key, bits, verdict);
+        if (cur == NIL) {
+            return false;
+        }
+    }
+    if (parent == NIL) {
+        *root = cur;
+    } else {
+        acl->ip[parent].child[side] = cur;
+    }
+    return true;
+}
+
+static int ip_lookup(const struct acl *acl, uint32_t root, const uint8_t *addr, unsigned width) {
+    int verdict = ACL_NO_MATCH;
+    uint32_t cur = root;
+    while (cur != NIL) {
+        const struct ip_node *n = &acl->ip[cur];
+        if (!prefix_equal(n->key, addr, n->bits)) {
+            break;
+        }
+        if (n->verdict != ACL_NO_MATCH) {
+            verdict = n->verdict;
+        }
+        if (n->bits >= width) {
+            break;
+        }
+        cur = n->child[bit_at(addr, n->bits)];
+    }
+    return verdict;
+}
+
+/* ----- trie de dominios ------------------------------------------------ */
+
+static uint32_t dom_node_new(struct acl *acl) {
+    if (!grow((void **)&acl->dom, &acl->dom_cap, acl->dom_count + 1, sizeof(*acl->dom))) {
+        return NIL;
+    }
+    acl->dom[acl->dom_count] = ACL_NO_MATCH;
+    return (uint32_t)acl->dom_count++;
+}
+
+static uint32_t edge_hash(uint32_t parent, const char *label, size_t len) {
+    return fnv(fnv(2166136261u, &parent, sizeof(parent)), label, len);
+}
+
+/* posición de la arista (parent, label) o de la entrada vacía donde iría */
+static size_t edge_find(const struct acl *acl, uint32_t parent, const char *label, size_t len, uint32_t h) {
+    size_t mask = acl->edge_slots - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        const struct dom_edge *e = &acl->edges[i];
+        if (e->child == NIL) {
+            return i;
+        }
+        if (e->hash == h && e->parent == parent && e->len == len &&
+            memcmp(acl->labels + e->label, label, len) == 0) {
+            return i;
+        }
+    }
+}
+
+static uint32_t dom_find(const struct acl *acl, uint32_t parent, const char *label, size_t len) {
+    if (acl->edge_slots == 0) {
+        return NIL;
+    }
+    return acl->edges[edge_find(acl, parent, label, len, edge_hash(parent, label, len))].child;
+}
+
+static bool edges_rehash(struct acl *acl) {
+    size_t slots = acl->edge_slots == 0 ? 256 : acl->edge_slots * 2;
+    struct dom_edge *old = acl->edges;
+    size_t old_slots = acl->edge_slots;
+
+    acl->edges = calloc(slots, sizeof(*acl->edges));
+    if (acl->edges == NULL) {
+        acl->edges = old;
+        return false;
+    }
+    acl->edge_slots = slots;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].child != NIL) {
+            size_t mask = slots - 1;
+            size_t j = old[i].hash & mask;
+            while (acl->edges[j].child != NIL) {
+                j = (j + 1) & mask;
+            }
+            acl->edges[j] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/* hijo de `parent' por `label'; lo crea si no existe */
+static uint32_t dom_child(struct acl *acl, uint32_t parent, const char *label, size_t len) {
+    uint32_t child = dom_find(acl, parent, label, len);
+    if (child != NIL) {
+        return child;
+    }
+
+    if (2 * (acl->edge_count + 1) > acl->edge_slots && !edges_rehash(acl)) {
+        return NIL;
+    }
+    uint32_t h = edge_hash(parent, label, len);
+    struct dom_edge *e = &acl->edges[edge_find(acl, parent, label, len, h)];
+    if (!grow((void **)&acl->labels, &acl->labels_cap, acl->labels_len + len, 1)) {
+        return NIL;
+    }
+    child = dom_node_new(acl);
+    if (child == NIL) {
+        return NIL;
+    }
+    memcpy(acl->labels + acl->labels_len, label, len);
+    e->parent = parent;
+    e->child = child;
+    e->hash = h;
+    e->label = (uint32_t)acl->labels_len;
+    e->len = (uint8_t)len;
+    acl->labels_len += len;
+    acl->edge_count++;
+    return child;
+}
+
+/* copia `domain' en minúsculas sin el punto final; false si no es válido */
+static bool normalize_domain(const char *domain, char *out) {
+    size_t len = strlen(domain);
+    if (len > 0 && domain[len - 1] == '.') {
+        len--;
+    }
+    if (len == 0 || len > MAX_DOMAIN - 1) {
+        return false;
+    }
+    size_t label = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = domain[i];
+        if (c == '.') {
+            if (label == 0) {
+                return false;
+            }
+            label = 0;
+        } else if (isalnum((unsigned char)c) || c == '-' || c == '_') {
+            if (++label > MAX_LABEL) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        out[i] = (char)tolower((unsigned char)c);
+    }
+    out[len] = '\0';
+    return label > 0;
+}
+
+static bool dom_insert(struct acl *acl, uint32_t root, const char *domain, int verdict) {
+    char name[MAX_DOMAIN];
+    if (!normalize_domain(domain, name)) {
+        return false;
+    }
+    uint32_t cur = root;
+    size_t end = strlen(name);
+    while (cur != NIL) {
+        size_t start = end;
+        while (start > 0 && name[start - 1] != '.') {
+            start--;
+        }
+        cur = dom_child(acl, cur, name + start, end - start);
+        if (start == 0) {
+            break;
+        }
+        end = start - 1;
+    }
+    if (cur == NIL) {
+        return false;
+    }
+    acl->dom[cur] = (int8_t)verdict;
+    return true;
+}
+
+static int dom_lookup(const struct acl *acl, uint32_t root, const char *name) {
+    int verdict = ACL_NO_MATCH;
+    uint32_t cur = root;
+    size_t end = strlen(name);
+    // las etiquetas se recorren de derecha a izquierda
+    while (end > 0) {
+        size_t start = end;
+        while (start > 0 && name[start - 1] != '.') {
+            start--;
+        }
+        cur = dom_find(acl, cur, name + start, end - start);
+        if (cur == NIL) {
+            break;
+        }
+        if (acl->dom[cur] != ACL_NO_MATCH) {
+            verdict = acl->dom[cur];
+        }
+        if (start == 0) {
+            break;
+        }
+        end = start - 1;
+    }
+    return verdict;
+}
+
+/* ----- conjuntos --------------------------------------------------------- */
+
+static const struct acl_set *set_find(const struct acl *acl, const char *user) {
+    if (user == NULL || *user == '\0' || acl->user_slots == 0) {
+        return NULL;
+    }
+    size_t mask = acl->user_slots - 1;
+    for (size_t i = fnv(2166136261u, user, strlen(user)) & mask; ; i = (i + 1) & mask) {
+        uint32_t v = acl->users[i];
+        if (v == 0) {
+            return NULL;
+        }
+        if (strcmp(acl->sets[v - 1].user, user) == 0) {
+            return &acl->sets[v - 1];
+        }
+    }
+}
+
+static bool users_rehash(struct acl *acl) {
+    size_t slots = acl->user_slots == 0 ? 16 : acl->user_slots * 2;
+    uint32_t *users = calloc(slots, sizeof(*users));
+    if (users == NULL) {
+        return false;
+    }
+    for (size_t s = 1; s < acl->set_count; s++) {
+        const char *u = acl->sets[s].user;
+        size_t i = fnv(2166136261u, u, strlen(u)) & (slots - 1);
+        while (users[i] != 0) {
+            i = (i + 1) & (slots - 1);
+        }
+        users[i] = (uint32_t)s + 1;
+    }
+    free(acl->users);
+    acl->users = users;
+    acl->user_slots = slots;
+    return true;
+}
+
+static struct acl_set *set_get(struct acl *acl, const char *user) {
+    if (user == NULL) {
+        return &acl->sets[0];
+    }
+    const struct acl_set *found = set_find(acl, user);
+    if (found != NULL) {
+        return (struct acl_set *)found;
+    }
+
+    if (!grow((void **)&acl->sets, &acl->set_cap, acl->set_count + 1, sizeof(*acl->sets))) {
+        return NULL;
+    }
+    struct acl_set *s = &acl->sets[acl->set_count];
+    memset(s, 0, sizeof(*s));
+    s->fallback = ACL_NO_MATCH;
+    s->user = strdup(user);
+    s->dom = dom_node_new(acl);
+    if (s->user == NULL || s->dom == NIL) {
+        free(s->user);
+        return NULL;
+    }
+    acl->set_count++;
+    if (2 * acl->set_count > acl->user_slots) {
+        if (!users_rehash(acl)) {
+            acl->set_count--;
+            free(s->user);
+            return NULL;
+        }
+    } else {
+        size_t mask = acl->user_slots - 1;
+        size_t i = fnv(2166136261u, user, strlen(user)) & mask;
+        while (acl->users[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        acl->users[i] = (uint32_t)acl->set_count;
+    }
+    return &acl->sets[acl->set_count - 1];
+}
+
+static struct acl *acl_new(void) {
+    struct acl *acl = calloc(1, sizeof(*acl));
+    if (acl == NULL) {
+        return NULL;
+    }
+    // los índices 0 quedan reservados como NIL
+    uint8_t zero[16] = {0};
+    if (ip_node_new(acl, zero, 0, ACL_NO_MATCH) != NIL || dom_node_new(acl) != NIL ||
+        !grow((void **)&acl->sets, &acl->set_cap, 1, sizeof(*acl->sets))) {
+        acl_free(acl);
+        return NULL;
+    }
+    acl->set_count = 1;
+    memset(&acl->sets[0], 0, sizeof(acl->sets[0]));
+    acl->sets[0].fallback = ACL_NO_MATCH;
+    acl->sets[0].dom = dom_node_new(acl);
+    if (acl->sets[0].dom == NIL) {
+        acl_free(acl);
+        return NULL;
+    }
+    return acl;
+}
+
+void acl_free(struct acl *acl) {
+    if (acl == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < acl->set_count; i++) {
+        free(acl->sets[i].user);
+    }
+    free(acl->sets);
+    free(acl->users);
+    free(acl->ip);
+    free(acl->dom);
+    free(acl->edges);
+    free(acl->labels);
+    free(acl);
+}
+
+size_t acl_rules(const struct acl *acl) {
+    return acl == NULL ? 0 : acl->rules;
+}
+
+/* ----- compilación ----------------------------------------------------- */
+
+static bool parse_cidr(const char *s, uint8_t *key, unsigned *bits, int *family) {
+    char addr[INET6_ADDRSTRLEN];
+    const char *slash = strchr(s, '/');
+    size_t len = slash != NULL ? (size_t)(slash - s) : strlen(s);
+    if (len == 0 || len >= sizeof(addr)) {
+        return false;
+    }
+    memcpy(addr, s, len);
+    addr[len] = '\0';
+
+    unsigned width;
+    if (inet_pton(AF_INET, addr, key) == 1) {
+        *family = AF_INET;
+        width = 32;
+    } else if (inet_pton(AF_INET6, addr, key) == 1) {
+        *family = AF_INET6;
+        width = 128;
+    } else {
+        return false;
+    }
+
+    *bits = width;
+    if (slash != NULL) {
+        char *end;
+        long n = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || n < 0 || n > (long)width) {
+            return false;
+        }
+        *bits = (unsigned)n;
+    }
+    return true;
+}
+
+static bool looks_like_ip(const char *s) {
+    if (strchr(s, ':') != NULL) {
+        return true;
+    }
+    for (; *s && *s != '/'; s++) {
+        if (!isdigit((unsigned char)*s) && *s != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int parse_verdict(const char *s) {
+    if (strcmp(s, "allow") == 0) {
+        return ACL_ALLOW;
+    }
+    if (strcmp(s, "deny") == 0) {
+        return ACL_DENY;
+    }
+    return ACL_NO_MATCH;
+}
+
+/* compila una línea ya separada en palabras; NULL o el motivo del error */
+static const char *compile_rule(struct acl *acl, char **words, int n) {
+    const char *user = NULL;
+    if (n > 0 && words[0][0] == '@') {
+        user = words[0] + 1;
+        if (*user == '\0') {
+            return "empty user name";
+        }
+        words++;
+        n--;
+    }
+    if (n != 2) {
+        return "expected '[@user] allow|deny <destination>' or '[@user] default allow|deny'";
+    }
+
+    struct acl_set *set = set_get(acl, user);
+    if (set == NULL) {
+        return "out of memory";
+    }
+
+    if (strcmp(words[0], "default") == 0) {
+        int v = parse_verdict(words[1]);
+        if (v == ACL_NO_MATCH) {
+            return "default must be allow or deny";
+        }
+        set->fallback = (int8_t)v;
+        return NULL;
+    }
+
+    int verdict = parse_verdict(words[0]);
+    if (verdict == ACL_NO_MATCH) {
+        return "action must be allow, deny or default";
+    }
+
+    const char *dest = words[1];
+    if (looks_like_ip(dest)) {
+        uint8_t key[16];
+        unsigned bits;
+        int family;
+        if (!parse_cidr(dest, key, &bits, &family)) {
+            return "invalid address or prefix";
+        }
+        uint32_t *root = family == AF_INET ? &set->v4 : &set->v6;
+        if (!ip_insert(acl, root, key, bits, verdict)) {
+            return "out of memory";
+        }
+    } else {
+        if (strncmp(dest, "*.", 2) == 0) {
+            dest += 2;
+        } else if (dest[0] == '.') {
+            dest++;
+        }
+        // la raíz del conjunto puede moverse si crece el arreglo de nodos,
+        // pero es un índice: sigue siendo válida
+        if (!dom_insert(acl, set->dom, dest, verdict)) {
+            return "invalid domain";
+        }
+    }
+    acl->rules++;
+    return NULL;
+}
+
+struct acl *acl_compile(const char *text, size_t len, char *err, size_t err_len) {
+    struct acl *acl = acl_new();
+    if (acl == NULL) {
+        snprintf(err, err_len, "out of memory");
+        return NULL;
+    }
+
+    size_t line_no = 0;
+    const char *p = text;
+    const char *end = text + len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (eol == NULL) {
+            eol = end;
+        }
+        line_no++;
+
+        char line[MAX_LINE];
+        size_t n = (size_t)(eol - p);
+        if (n >= sizeof(line)) {
+            snprintf(err, err_len, "line %zu: too long", line_no);
+            acl_free(acl);
+            return NULL;
+        }
+        memcpy(line, p, n);
+        line[n] = '\0';
+        p = eol + 1;
+
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+
+        char *words[4];
+        int count = 0;
+        char *save;
+        for (char *w = strtok_r(line, " \t\r", &save); w != NULL; w = strtok_r(NULL, " \t\r", &save)) {
+            if (count == 4) {
+                count++;
+                break;
+            }
+            words[count++] = w;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        const char *why = count > 3 ? "too many words" : compile_rule(acl, words, count);
+        if (why != NULL) {
+            snprintf(err, err_len, "line %zu: %s", line_no, why);
+            acl_free(acl);
+            return NULL;
+        }
+    }
+    return acl;
+}
+
+struct acl *acl_compile_file(const char *path, char *err, size_t err_len) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        snprintf(err, err_len, "%s: cannot open", path);
+        return NULL;
+    }
+
+    char *text = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    char chunk[8192];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (!grow((void **)&text, &cap, len + n, 1)) {
+            free(text);
+            fclose(f);
+            snprintf(err, err_len, "out of memory");
+            return NULL;
+        }
+        memcpy(text + len, chunk, n);
+        len += n;
+    }
+    fclose(f);
+
+    struct acl *acl = acl_compile(text == NULL ? "" : text, len, err, err_len);
+    free(text);
+    return acl;
+}
+
+/* ----- consultas ------------------------------------------------------- */
+
+static int set_check_addr(const struct acl *acl, const struct acl_set *set, const struct sockaddr *addr) {
+    if (addr->sa_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)addr;
+        return ip_lookup(acl, set->v4, (const uint8_t *)&sin->sin_addr, 32);
+    }
+    if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)addr;
+        const uint8_t *a = sin6->sin6_addr.s6_addr;
+        // las IPv4 mapeadas se juzgan con las reglas IPv4
+        static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+        if (memcmp(a, mapped, sizeof(mapped)) == 0) {
+            return ip_lookup(acl, set->v4, a + 12, 32);
+        }
+        return ip_lookup(acl, set->v6, a, 128);
+    }
+    return ACL_NO_MATCH;
+}
+
+bool acl_default_allows(const struct acl *acl, const char *user) {
+    if (acl == NULL) {
+        return true;
+    }
+    const struct acl_set *set = set_find(acl, user);
+    if (set != NULL && set->fallback != ACL_NO_MATCH) {
+        return set->fallback == ACL_ALLOW;
+    }
+    return acl->sets[0].fallback != ACL_DENY;
+}
+
+bool acl_check_addr(const struct acl *acl, const char *user, const struct sockaddr *addr) {
+    if (acl == NULL) {
+        return true;
+    }
+    const struct acl_set *set = set_find(acl, user);
+    int v = set != NULL ? set_check_addr(acl, set, addr) : ACL_NO_MATCH;
+    if (v == ACL_NO_MATCH) {
+        v = set_check_addr(acl, &acl->sets[0], addr);
+    }
+    if (v == ACL_NO_MATCH) {
+        return acl_default_allows(acl, user);
+    }
+    return v == ACL_ALLOW;
+}
+
+enum acl_verdict acl_check_domain(const struct acl *acl, const char *user, const char *domain) {
+    char name[MAX_DOMAIN];
+    if (acl == NULL || !normalize_domain(domain, name)) {
+        return ACL_NO_MATCH;
+    }
+    const struct acl_set *set = set_find(acl, user);
+    int v = set != NULL ? dom_lookup(acl, set->dom, name) : ACL_NO_MATCH;
+    if (v == ACL_NO_MATCH) {
+        v = dom_lookup(acl, acl->sets[0].dom, name);
+    }
+    return (enum acl_verdict)v;
+}
+
+/* ----- conjunto del servidor ------------------------------------------- */
+
+static _Atomic(struct acl *) current = NULL;
+static char *current_path = NULL;
+
+int acl_init(const char *path, char *err, size_t err_len) {
+    acl_destroy();
+    if (path == NULL) {
+        return 0;
+    }
+    current_path = strdup(path);
+    if (current_path == NULL) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    return acl_reload(err, err_len);
+}
+
+int acl_reload(char *err, size_t err_len) {
+    if (current_path == NULL) {
+        snprintf(err, err_len, "no access control file configured");
+        return -1;
+    }
+    struct acl *acl = acl_compile_file(current_path, err, err_len);
+    if (acl == NULL) {
+        return -1;
+    }
+    // las consultas corren en el hilo del selector, igual que la recarga:
+    // ninguna puede estar usando el conjunto anterior al liberarlo
+    acl_free(atomic_exchange(&current, acl));
+    return 0;
+}
+
+const struct acl *acl_current(void) {
+    return atomic_load_explicit(&current, memory_order_acquire);
+}
+
+void acl_destroy(void) {
+    acl_free(atomic_exchange(&current, NULL));
+    free(current_path);
+    current_path = NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef ACL_H
+#define ACL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * Control de acceso a destinos.
+ *
+ * Las reglas se leen de un archivo de texto, una por línea:
+ *
+ *     # comentario
+ *     [@usuario] allow|deny <destino>
+ *     [@usuario] default allow|deny
+ *
+ * donde el destino es un CIDR IPv4 o IPv6 (sin prefijo es una sola dirección)
+ * o un dominio, que cubre también a sus subdominios (`example.com' cubre a
+ * `www.example.com'; `.example.com' y `*.example.com' son equivalentes).
+ * Las reglas sin usuario son globales.
+ *
+ * Entre las reglas de un conjunto gana la más específica (prefijo más largo,
+ * dominio con más etiquetas); a igual especificidad, la última. Se consultan
+ * primero las reglas del usuario y después las globales; si ninguna aplica,
+ * decide el default del usuario, el global o, si no hay, se permite.
+ *
+ * Las reglas se compilan en un trie con compresión de caminos (Patricia) por
+ * familia y un trie de etiquetas invertidas para los dominios, indexado con
+ * una tabla hash de (nodo, etiqueta). Una consulta recorre a lo sumo tantos
+ * nodos como bits tiene la dirección o etiquetas el dominio, sin importar
+ * cuántas reglas haya.
+ *
+ * Un conjunto compilado no se modifica: recargar arma uno nuevo y lo publica
+ * reemplazando el puntero, de modo que una consulta ve el conjunto anterior
+ * o el nuevo completo. Si el archivo tiene errores se conserva el anterior.
+ */
+
+enum acl_verdict {
+    ACL_NO_MATCH = -1,
+    ACL_DENY = 0,
+    ACL_ALLOW = 1,
+};
+
+struct acl;
+
+/** compila las reglas de `text'; NULL y el motivo en `err' si hay errores */
+struct acl *acl_compile(const char *text, size_t len, char *err, size_t err_len);
+
+/** compila las reglas del archivo `path' */
+struct acl *acl_compile_file(const char *path, char *err, size_t err_len);
+
+void acl_free(struct acl *acl);
+
+/** cantidad de reglas compiladas */
+size_t acl_rules(const struct acl *acl);
+
+/** true si `user' (o las reglas globales y los defaults) permiten la dirección */
+bool acl_check_addr(const struct acl *acl, const char *user, const struct sockaddr *addr);
+
+/** regla más específica para el dominio, o ACL_NO_MATCH si ninguna lo cubre */
+enum acl_verdict acl_check_domain(const struct acl *acl, const char *user, const char *domain);
+
+/** lo que se decide sin ninguna regla que aplique */
+bool acl_default_allows(const struct acl *acl, const char *user);
+
+/*
+ * Conjunto del servidor. Sin archivo no hay reglas y todo se permite.
+ */
+
+/** carga `path' (o nada si es NULL). -1 si falla, con el motivo en `err' */
+int acl_init(const char *path, char *err, size_t err_len);
+
+/** vuelve a leer el archivo y publica el conjunto nuevo. -1 si falla */
+int acl_reload(char *err, size_t err_len);
+
+/** conjunto vigente; NULL si no hay reglas */
+const struct acl *acl_current(void);
+
+void acl_destroy(void);
+
+#endif
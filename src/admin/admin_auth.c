@@ -1,6 +1,12 @@
 #include "admin_auth.h"
 #include "../users/users.h"
 #include <string.h>
+#include <time.h>
+
+/* logins fallidos (o en curso) en la ventana actual */
+static time_t window_start = 0;
+static unsigned window_failures = 0;
+static unsigned in_flight = 0;
 
 void admin_auth_init(struct admin_auth_data *auth) {
     memset(auth, 0, sizeof(*auth));
@@ -75,3 +81,27 @@ bool admin_auth_validate(const char *username, const char *password, char *out_u
     
     return true;
 }
+
+bool admin_auth_begin(void) {
+    time_t now = time(NULL);
+    if (now - window_start >= ADMIN_AUTH_WINDOW) {
+        window_start = now;
+        window_failures = 0;
+    }
+    // los que están en curso cuentan como fallidos: si no, una ráfaga de
+    // intentos simultáneos pasaría entera
+    if (window_failures + in_flight >= ADMIN_AUTH_MAX_FAILURES) {
+        return false;
+    }
+    in_flight++;
+    return true;
+}
+
+void admin_auth_end(bool ok) {
+    if (in_flight > 0) {
+        in_flight--;
+    }
+    if (!ok) {
+        window_failures++;
+    }
+}
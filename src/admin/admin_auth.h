@@ -7,6 +7,9 @@
 
 #define MAX_AUTH_USERNAME 256
 #define MAX_AUTH_PASSWORD 256
+/* logins de administración que pueden fallar por ventana; después se rechazan sin verificar */
+#define ADMIN_AUTH_MAX_FAILURES 10
+#define ADMIN_AUTH_WINDOW 60
 
 struct admin_auth_data {
     uint8_t version;
@@ -31,4 +34,12 @@ void admin_auth_init(struct admin_auth_data *auth);
 int admin_auth_process_byte(struct admin_auth_data *auth, uint8_t byte, auth_state_t *state);
 bool admin_auth_validate(const char *username, const char *password, char *out_username);
 
+/*
+ * límite de intentos: false si se agotaron los de la ventana y el login debe
+ * rechazarse sin verificar. Si retorna true hay que llamar a admin_auth_end
+ * con el resultado.
+ */
+bool admin_auth_begin(void);
+void admin_auth_end(bool ok);
+
 #endif
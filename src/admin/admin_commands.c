@@ -12,8 +12,15 @@
 #include "admin_commands.h"
 #include "../users/users.h"
 #include "../metrics/metrics.h"
+#include "../upgrade/upgrade.h"
+#include "../acl/acl.h"
+#include "../socks5/socks5.h"
+#include "../socks5/origin.h"
+#include "../socks5/egress.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <arpa/inet.h>
 
 bool admin_command_requires_admin(uint8_t command) {
@@ -22,10 +29,18 @@ bool admin_command_requires_admin(uint8_t command) {
         case ADMIN_CMD_DEL_USER:
         case ADMIN_CMD_CHANGE_PASSWORD:
         case ADMIN_CMD_CHANGE_ROLE:
+        case ADMIN_CMD_LIST_CREDENTIALS:
+        case ADMIN_CMD_UPGRADE:
+        case ADMIN_CMD_SET_LIMITS:
+        case ADMIN_CMD_RELOAD_ACL:
             return true;
         case ADMIN_CMD_GET_METRICS:
         case ADMIN_CMD_LIST_USERS:
         case ADMIN_CMD_LIST_CONNECTIONS:
+        case ADMIN_CMD_GET_LIMITS:
+        case ADMIN_CMD_LIST_SESSIONS:
+        case ADMIN_CMD_LIST_ORIGINS:
+        case ADMIN_CMD_LIST_EGRESS:
             return false;
         default:
             return false;
@@ -53,13 +68,56 @@ void admin_process_get_metrics(struct admin_response *response) {
     memcpy(ptr, &net64, 8);
     ptr += 8;
 
+    net64 = htobe64(m.tfo_attempts);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.tfo_syn_data);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.listener_pauses);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.limit_refusals);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.acl_denials);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    for (int i = 0; i < METRICS_BUFFER_CLASSES; i++) {
+        net64 = htobe64(m.buffer_sizes[i]);
+        memcpy(ptr, &net64, 8);
+        ptr += 8;
+    }
+
+    net64 = htobe64(m.zerocopy_sends);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.zerocopy_copied);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.origin_trips);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(m.origin_fastfails);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
     response->status = ADMIN_STATUS_OK;
-    response->length = 32;
+    response->length = ptr - response->data;
 }
 
 void admin_process_list_users(struct admin_response *response) {
-    struct user *users_array[MAX_USERS_DB];
-    int count = user_list(users_array, MAX_USERS_DB);
+    // la cantidad viaja en un byte
+    struct user *users_array[UINT8_MAX];
+    int count = user_list(users_array, UINT8_MAX);
 
     uint8_t *ptr = response->data;
     uint8_t *end = response->data + sizeof(response->data);
@@ -93,19 +151,26 @@ void admin_process_list_users(struct admin_response *response) {
     response->length = ptr - response->data;
 }
 
-void admin_process_add_user(struct admin_response *response, const char *data) {
+const char *admin_user_password_args(struct admin_response *response, const char *data) {
+    response->length = 0;
     size_t username_len = strlen(data);
     if (username_len == 0 || username_len >= 256) {
         response->status = ADMIN_STATUS_INVALID_ARGS;
-        response->length = 0;
-        return;
+        return NULL;
     }
 
     const char *password = data + username_len + 1;
     size_t password_len = strlen(password);
     if (password_len == 0 || password_len >= 256) {
         response->status = ADMIN_STATUS_INVALID_ARGS;
-        response->length = 0;
+        return NULL;
+    }
+    return password;
+}
+
+void admin_process_add_user(struct admin_response *response, const char *data) {
+    const char *password = admin_user_password_args(response, data);
+    if (password == NULL) {
         return;
     }
 
@@ -114,7 +179,17 @@ void admin_process_add_user(struct admin_response *response, const char *data) {
     } else {
         response->status = ADMIN_STATUS_USER_EXISTS;
     }
+}
+
+void admin_finish_add_user(struct admin_response *response, const char *username, const char *encoded) {
     response->length = 0;
+    if (encoded == NULL) {
+        response->status = ADMIN_STATUS_ERROR;
+    } else if (user_add_encoded(username, encoded, ROLE_USER)) {
+        response->status = ADMIN_STATUS_OK;
+    } else {
+        response->status = ADMIN_STATUS_USER_EXISTS;
+    }
 }
 
 void admin_process_del_user(struct admin_response *response, const char *data) {
@@ -178,18 +253,8 @@ void admin_process_list_connections(struct admin_response *response) {
 }
 
 void admin_process_change_password(struct admin_response *response, const char *data) {
-    size_t username_len = strlen(data);
-    if (username_len == 0 || username_len >= 256) {
-        response->status = ADMIN_STATUS_INVALID_ARGS;
-        response->length = 0;
-        return;
-    }
-
-    const char *new_password = data + username_len + 1;
-    size_t password_len = strlen(new_password);
-    if (password_len == 0 || password_len >= 256) {
-        response->status = ADMIN_STATUS_INVALID_ARGS;
-        response->length = 0;
+    const char *new_password = admin_user_password_args(response, data);
+    if (new_password == NULL) {
         return;
     }
 
@@ -198,7 +263,17 @@ void admin_process_change_password(struct admin_response *response, const char *
     } else {
         response->status = ADMIN_STATUS_USER_NOT_FOUND;
     }
+}
+
+void admin_finish_change_password(struct admin_response *response, const char *username, const char *encoded) {
     response->length = 0;
+    if (encoded == NULL) {
+        response->status = ADMIN_STATUS_ERROR;
+    } else if (user_change_password_encoded(username, encoded)) {
+        response->status = ADMIN_STATUS_OK;
+    } else {
+        response->status = ADMIN_STATUS_USER_NOT_FOUND;
+    }
 }
 
 void admin_process_change_role(struct admin_response *response, const char *data) {
@@ -229,3 +304,335 @@ void admin_process_change_role(struct admin_response *response, const char *data
     }
     response->length = 0;
 }
+
+static uint8_t *put_string(uint8_t *ptr, const char *s, size_t len) {
+    *ptr++ = (uint8_t)len;
+    memcpy(ptr, s, len);
+    return ptr + len;
+}
+
+void admin_process_list_credentials(struct admin_response *response) {
+    struct user_credential entries[MAX_CREDENTIALS_LOG];
+    int count = user_get_credentials(entries, MAX_CREDENTIALS_LOG);
+
+    uint8_t *ptr = response->data;
+    uint8_t *end = response->data + sizeof(response->data);
+
+    if (count > 255) count = 255;
+    *ptr++ = (uint8_t)count;
+
+    for (int i = 0; i < count; i++) {
+        size_t username_len = strnlen(entries[i].username, 255);
+        size_t dest_len = strnlen(entries[i].destination, 255);
+        size_t protocol_len = strnlen(entries[i].protocol, 255);
+        size_t cuser_len = strnlen(entries[i].captured_user, 255);
+        size_t cpass_len = strnlen(entries[i].captured_pass, 255);
+
+        size_t needed = 1 + username_len + 1 + dest_len + 2 + 1 + protocol_len +
+                        1 + cuser_len + 1 + cpass_len + 8;
+        if (ptr + needed > end) {
+            response->data[0] = (uint8_t)i;
+            break;
+        }
+
+        ptr = put_string(ptr, entries[i].username, username_len);
+        ptr = put_string(ptr, entries[i].destination, dest_len);
+
+        uint16_t port_net = htobe16(entries[i].port);
+        memcpy(ptr, &port_net, 2);
+        ptr += 2;
+
+        ptr = put_string(ptr, entries[i].protocol, protocol_len);
+        ptr = put_string(ptr, entries[i].captured_user, cuser_len);
+        ptr = put_string(ptr, entries[i].captured_pass, cpass_len);
+
+        uint64_t ts_net = htobe64((uint64_t)entries[i].timestamp);
+        memcpy(ptr, &ts_net, 8);
+        ptr += 8;
+    }
+
+    response->status = ADMIN_STATUS_OK;
+    response->length = ptr - response->data;
+}
+
+void admin_process_upgrade(struct admin_response *response) {
+    upgrade_request();
+    response->status = ADMIN_STATUS_OK;
+    response->length = 0;
+}
+
+/* lee un número decimal terminado en '\0'; retorna el siguiente o NULL */
+static const char *parse_number(const char *s, uint64_t max, uint64_t *out) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || *end != '\0' || *s == '-' || errno == ERANGE || v > max) {
+        return NULL;
+    }
+    *out = v;
+    return end + 1;
+}
+
+void admin_process_set_limits(struct admin_response *response, const char *data) {
+    response->length = 0;
+
+    size_t username_len = strlen(data);
+    if (username_len == 0 || username_len >= 256) {
+        response->status = ADMIN_STATUS_INVALID_ARGS;
+        return;
+    }
+
+    // sesiones, conexiones por minuto, cuota diaria y mensual en decimal
+    uint64_t values[4];
+    const uint64_t max[4] = {UINT32_MAX, UINT32_MAX, UINT64_MAX, UINT64_MAX};
+    const char *p = data + username_len + 1;
+    for (int i = 0; i < 4; i++) {
+        if ((p = parse_number(p, max[i], &values[i])) == NULL) {
+            response->status = ADMIN_STATUS_INVALID_ARGS;
+            return;
+        }
+    }
+
+    struct user_limits limits = {
+        .max_sessions = (uint32_t)values[0],
+        .max_rate = (uint32_t)values[1],
+        .quota_daily = values[2],
+        .quota_monthly = values[3],
+    };
+    if (user_set_limits(data, &limits)) {
+        response->status = ADMIN_STATUS_OK;
+    } else {
+        response->status = ADMIN_STATUS_USER_NOT_FOUND;
+    }
+}
+
+void admin_process_get_limits(struct admin_response *response, const char *data) {
+    response->length = 0;
+
+    size_t username_len = strlen(data);
+    if (username_len == 0 || username_len >= 256) {
+        response->status = ADMIN_STATUS_INVALID_ARGS;
+        return;
+    }
+
+    struct user_limits limits;
+    struct user_usage usage;
+    if (!user_get_limits(data, &limits, &usage)) {
+        response->status = ADMIN_STATUS_USER_NOT_FOUND;
+        return;
+    }
+
+    uint8_t *ptr = response->data;
+    uint32_t net32 = htonl(limits.max_sessions);
+    memcpy(ptr, &net32, 4);
+    ptr += 4;
+
+    net32 = htonl(limits.max_rate);
+    memcpy(ptr, &net32, 4);
+    ptr += 4;
+
+    uint64_t net64 = htobe64(limits.quota_daily);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(limits.quota_monthly);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net32 = htonl(usage.active_sessions);
+    memcpy(ptr, &net32, 4);
+    ptr += 4;
+
+    net64 = htobe64(usage.bytes_day);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    net64 = htobe64(usage.bytes_month);
+    memcpy(ptr, &net64, 8);
+    ptr += 8;
+
+    response->status = ADMIN_STATUS_OK;
+    response->length = ptr - response->data;
+}
+
+void admin_process_reload_acl(struct admin_response *response) {
+    char err[sizeof(response->data)];
+    if (acl_reload(err, sizeof(err)) != 0) {
+        // el motivo viaja como texto para que el operador vea la línea mala
+        response->status = ADMIN_STATUS_ERROR;
+        response->length = strlen(err);
+        memcpy(response->data, err, response->length);
+        return;
+    }
+
+    uint32_t net32 = htonl((uint32_t)acl_rules(acl_current()));
+    memcpy(response->data, &net32, 4);
+    response->status = ADMIN_STATUS_OK;
+    response->length = 4;
+}
+
+/* sesiones que se listan como máximo; la cantidad viaja en un byte */
+#define SESSIONS_MAX 64
+
+static uint8_t *put_sockopts(uint8_t *ptr, bool present, const struct sockopt_profile *v) {
+    *ptr++ = present;
+    const int values[] = {
+        v->nodelay, v->sndbuf, v->rcvbuf, v->notsent_lowat,
+        v->keepidle, v->keepintvl, v->keepcnt, v->user_timeout,
+    };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint32_t net32 = htonl(present ? (uint32_t)values[i] : UINT32_MAX);
+        memcpy(ptr, &net32, 4);
+        ptr += 4;
+    }
+    return ptr;
+}
+
+void admin_process_list_sessions(struct admin_response *response) {
+    struct socks5_session_info *sessions = malloc(SESSIONS_MAX * sizeof(*sessions));
+    if (sessions == NULL) {
+        response->status = ADMIN_STATUS_ERROR;
+        response->length = 0;
+        return;
+    }
+    size_t count = socks5_session_list(sessions, SESSIONS_MAX);
+
+    uint8_t *ptr = response->data;
+    uint8_t *end = response->data + sizeof(response->data);
+
+    // total de sesiones abiertas y cuántas se listan
+    uint32_t net32 = htonl((uint32_t)socks5_sessions());
+    memcpy(ptr, &net32, 4);
+    ptr += 4;
+    uint8_t *listed = ptr++;
+    *listed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct socks5_session_info *s = &sessions[i];
+        size_t user_len = strlen(s->username);
+        size_t dest_len = strlen(s->destination);
+        size_t profile_len = strlen(s->profile);
+        if (user_len > 255) user_len = 255;
+        if (dest_len > 255) dest_len = 255;
+
+        size_t needed = 1 + user_len + 1 + dest_len + 2 + 1 + profile_len + 2 * 33;
+        if (ptr + needed > end) {
+            break;
+        }
+        *ptr++ = (uint8_t)user_len;
+        memcpy(ptr, s->username, user_len);
+        ptr += user_len;
+        *ptr++ = (uint8_t)dest_len;
+        memcpy(ptr, s->destination, dest_len);
+        ptr += dest_len;
+        uint16_t net16 = htons(s->port);
+        memcpy(ptr, &net16, 2);
+        ptr += 2;
+        *ptr++ = (uint8_t)profile_len;
+        memcpy(ptr, s->profile, profile_len);
+        ptr += profile_len;
+        ptr = put_sockopts(ptr, s->has_client, &s->client);
+        ptr = put_sockopts(ptr, s->has_origin, &s->origin);
+        (*listed)++;
+    }
+    free(sessions);
+
+    response->status = ADMIN_STATUS_OK;
+    response->length = ptr - response->data;
+}
+
+/* orígenes que se listan como máximo, los más recientes; la cantidad viaja en un byte */
+#define ORIGINS_MAX 128
+#define ORIGIN_ENTRY_SIZE 42
+
+static uint8_t *put_u32(uint8_t *ptr, uint32_t v) {
+    uint32_t net32 = htonl(v);
+    memcpy(ptr, &net32, 4);
+    return ptr + 4;
+}
+
+void admin_process_list_origins(struct admin_response *response) {
+    struct origin_info *origins = malloc(ORIGINS_MAX * sizeof(*origins));
+    if (origins == NULL) {
+        response->status = ADMIN_STATUS_ERROR;
+        response->length = 0;
+        return;
+    }
+    size_t count = origin_list(origins, ORIGINS_MAX);
+
+    uint8_t *ptr = response->data;
+    uint8_t *end = response->data + sizeof(response->data);
+    ptr = put_u32(ptr, (uint32_t)origin_count());
+    uint8_t *listed = ptr++;
+    *listed = 0;
+
+    for (size_t i = 0; i < count && ptr + ORIGIN_ENTRY_SIZE <= end; i++) {
+        const struct origin_info *o = &origins[i];
+        // familia (4 o 6), dirección de 16 bytes y puerto, en orden de red
+        uint16_t port;
+        memset(ptr + 1, 0, 16);
+        if (o->addr.ss_family == AF_INET) {
+            const struct sockaddr_in *sin = (const struct sockaddr_in *)&o->addr;
+            *ptr = 4;
+            memcpy(ptr + 1, &sin->sin_addr, 4);
+            port = sin->sin_port;
+        } else {
+            const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)&o->addr;
+            *ptr = 6;
+            memcpy(ptr + 1, &sin6->sin6_addr, 16);
+            port = sin6->sin6_port;
+        }
+        ptr += 17;
+        memcpy(ptr, &port, 2);
+        ptr += 2;
+        ptr = put_u32(ptr, o->srtt_us);
+        ptr = put_u32(ptr, o->last_rtt_us);
+        ptr = put_u32(ptr, o->attempts);
+        ptr = put_u32(ptr, o->successes);
+        uint16_t net16 = htons(o->success_permille);
+        memcpy(ptr, &net16, 2);
+        ptr += 2;
+        *ptr++ = o->open;
+        ptr = put_u32(ptr, o->open_remaining_ms);
+        (*listed)++;
+    }
+    free(origins);
+
+    response->status = ADMIN_STATUS_OK;
+    response->length = ptr - response->data;
+}
+
+static uint8_t *put_u64(uint8_t *ptr, uint64_t v) {
+    uint64_t net64 = htobe64(v);
+    memcpy(ptr, &net64, 8);
+    return ptr + 8;
+}
+
+void admin_process_list_egress(struct admin_response *response) {
+    struct egress_info sources[EGRESS_MAX_SOURCES];
+    size_t count = egress_list(sources, EGRESS_MAX_SOURCES);
+
+    uint8_t *ptr = response->data;
+    *ptr++ = (uint8_t)count;
+    for (size_t i = 0; i < count; i++) {
+        const struct egress_info *e = &sources[i];
+        // familia (4 o 6) y dirección de 16 bytes, conexiones abiertas,
+        // iniciadas y sin puertos, y si se está salteando
+        memset(ptr + 1, 0, 16);
+        if (e->addr.ss_family == AF_INET) {
+            *ptr = 4;
+            memcpy(ptr + 1, &((const struct sockaddr_in *)&e->addr)->sin_addr, 4);
+        } else {
+            *ptr = 6;
+            memcpy(ptr + 1, &((const struct sockaddr_in6 *)&e->addr)->sin6_addr, 16);
+        }
+        ptr += 17;
+        ptr = put_u64(ptr, e->active);
+        ptr = put_u64(ptr, e->connects);
+        ptr = put_u64(ptr, e->exhausted);
+        *ptr++ = e->dry;
+    }
+
+    response->status = ADMIN_STATUS_OK;
+    response->length = ptr - response->data;
+}
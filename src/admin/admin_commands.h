@@ -10,14 +10,39 @@ void admin_process_get_metrics(struct admin_response *response);
 
 void admin_process_list_users(struct admin_response *response);
 
+/*
+ * ADD_USER y CHANGE_PASSWORD derivan la contraseña nueva: admin_process_*
+ * lo hace en el hilo que llama; para hacerlo en el pool de verificación se
+ * validan los argumentos con admin_user_password_args (retorna la contraseña,
+ * o NULL con el error en `response') y se completa con admin_finish_*.
+ */
+const char *admin_user_password_args(struct admin_response *response, const char *data);
+
 void admin_process_add_user(struct admin_response *response, const char *data);
+void admin_finish_add_user(struct admin_response *response, const char *username, const char *encoded);
 
 void admin_process_del_user(struct admin_response *response, const char *data);
 
 void admin_process_list_connections(struct admin_response *response);
 
 void admin_process_change_password(struct admin_response *response, const char *data);
+void admin_finish_change_password(struct admin_response *response, const char *username, const char *encoded);
 
 void admin_process_change_role(struct admin_response *response, const char *data);
 
+void admin_process_list_credentials(struct admin_response *response);
+void admin_process_upgrade(struct admin_response *response);
+
+void admin_process_set_limits(struct admin_response *response, const char *data);
+
+void admin_process_get_limits(struct admin_response *response, const char *data);
+
+void admin_process_reload_acl(struct admin_response *response);
+
+void admin_process_list_sessions(struct admin_response *response);
+
+void admin_process_list_origins(struct admin_response *response);
+
+void admin_process_list_egress(struct admin_response *response);
+
 #endif
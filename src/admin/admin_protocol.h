@@ -13,6 +13,14 @@ enum admin_command {
     ADMIN_CMD_LIST_CONNECTIONS = 0x05,
     ADMIN_CMD_CHANGE_PASSWORD = 0x06,
     ADMIN_CMD_CHANGE_ROLE = 0x07,
+    ADMIN_CMD_LIST_CREDENTIALS = 0x08,
+    ADMIN_CMD_UPGRADE = 0x09,
+    ADMIN_CMD_SET_LIMITS = 0x0A,
+    ADMIN_CMD_GET_LIMITS = 0x0B,
+    ADMIN_CMD_RELOAD_ACL = 0x0C,
+    ADMIN_CMD_LIST_SESSIONS = 0x0D,
+    ADMIN_CMD_LIST_ORIGINS = 0x0E,
+    ADMIN_CMD_LIST_EGRESS = 0x0F,
 };
 
 enum admin_status {
@@ -3,6 +3,7 @@
 #include "admin_auth.h"
 #include "admin_commands.h"
 #include "../users/users.h"
+#include "../auth/verify.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,10 +18,15 @@
 #endif
 
 static int admin_server_fd = -1;
+static size_t admin_clients = 0;
 
 struct admin_client {
     int fd;
+    fd_selector s;
     bool authenticated;
+    /* esperando al pool de verificación; si se cierra antes lo libera el callback */
+    bool pending;
+    bool closed;
     char username[256];
     
     struct admin_auth_data auth_data;
@@ -96,6 +102,27 @@ int admin_server_init(fd_selector s, uint16_t port) {
     return 0;
 }
 
+int admin_server_adopt(fd_selector s, int fd) {
+    admin_server_fd = fd;
+
+    if (selector_fd_set_nio(admin_server_fd) < 0 ||
+        SELECTOR_SUCCESS != selector_register(s, admin_server_fd, &admin_accept_handler, OP_READ, NULL)) {
+        close(admin_server_fd);
+        admin_server_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int admin_server_listener(void) {
+    return admin_server_fd;
+}
+
+size_t admin_server_clients(void) {
+    return admin_clients;
+}
+
 void admin_server_destroy(fd_selector s) {
     if (admin_server_fd != -1) {
         selector_unregister_fd(s, admin_server_fd);
@@ -126,6 +153,7 @@ void admin_passive_accept(struct selector_key *key) {
     
     memset(client, 0, sizeof(*client));
     client->fd = client_fd;
+    client->s = key->s;
     client->authenticated = false;
     client->auth_state = AUTH_STATE_VERSION;
     admin_auth_init(&client->auth_data);
@@ -135,38 +163,120 @@ void admin_passive_accept(struct selector_key *key) {
         close(client_fd);
         return;
     }
+    admin_clients++;
+}
+
+static void auth_reply(struct admin_client *client, bool ok) {
+    client->authenticated = ok;
+    client->auth_response[0] = ADMIN_VERSION;
+    client->auth_response[1] = ok ? ADMIN_STATUS_OK : ADMIN_STATUS_AUTH_FAILED;
+    client->auth_response_sent = 0;
+    if (ok) {
+        strncpy(client->username, client->auth_data.username, sizeof(client->username) - 1);
+    }
+    memset(client->auth_data.password, 0, sizeof(client->auth_data.password));
+}
+
+/* la respuesta quedó lista desde un callback del pool: volver a escribir */
+static void resume_write(struct admin_client *client) {
+    if (selector_set_interest(client->s, client->fd, OP_WRITE) != SELECTOR_SUCCESS) {
+        selector_unregister_fd(client->s, client->fd);
+    }
+}
+
+static void admin_auth_done(void *arg, bool ok) {
+    struct admin_client *client = arg;
+    client->pending = false;
+    admin_auth_end(ok);
+    if (client->closed) {
+        free(client);
+        return;
+    }
+    if (ok) {
+        user_record_login(client->auth_data.username);
+    }
+    auth_reply(client, ok);
+    resume_write(client);
 }
 
-static void process_auth(struct admin_client *client, uint8_t *buffer, size_t len) {
+/* interés que le sigue: leer más, escribir la respuesta o esperar al pool */
+static fd_interest process_auth(struct admin_client *client, uint8_t *buffer, size_t len) {
     for (size_t i = 0; i < len; i++) {
         if (admin_auth_process_byte(&client->auth_data, buffer[i], &client->auth_state) < 0) {
-            client->auth_response[0] = ADMIN_VERSION;
-            client->auth_response[1] = ADMIN_STATUS_AUTH_FAILED;
-            client->auth_response_sent = 0;
-            return;
+            client->auth_data.complete = true;
+            auth_reply(client, false);
+            return OP_WRITE;
         }
         
         if (client->auth_data.complete) {
-            if (admin_auth_validate(client->auth_data.username, client->auth_data.password, client->username)) {
-                client->authenticated = true;
-                client->auth_response[0] = ADMIN_VERSION;
-                client->auth_response[1] = ADMIN_STATUS_OK;
-            } else {
-                client->auth_response[0] = ADMIN_VERSION;
-                client->auth_response[1] = ADMIN_STATUS_AUTH_FAILED;
+            const char *username = client->auth_data.username;
+            const char *password = client->auth_data.password;
+            // pasado el límite se rechaza igual exista o no el usuario
+            if (!admin_auth_begin()) {
+                auth_reply(client, false);
+                return OP_WRITE;
             }
-            client->auth_response_sent = 0;
-            return;
+            if (auth_verify_cached(username, password)) {
+                admin_auth_end(true);
+                user_record_login(username);
+                auth_reply(client, true);
+                return OP_WRITE;
+            }
+            if (auth_verify_submit(username, password, admin_auth_done, client) == 0) {
+                client->pending = true;
+                return OP_NOOP;
+            }
+            const bool ok = admin_auth_validate(username, password, NULL);
+            admin_auth_end(ok);
+            auth_reply(client, ok);
+            return OP_WRITE;
         }
     }
+    return OP_READ;
+}
+
+static void admin_hash_done(void *arg, const char *encoded) {
+    struct admin_client *client = arg;
+    client->pending = false;
+    if (client->closed) {
+        free(client);
+        return;
+    }
+    const char *username = (const char *)client->request.data;
+    if (client->request.command == ADMIN_CMD_ADD_USER) {
+        admin_finish_add_user(&client->response, username, encoded);
+    } else {
+        admin_finish_change_password(&client->response, username, encoded);
+    }
+    resume_write(client);
 }
 
-static void process_command(struct admin_client *client) {
+/* ADD_USER y CHANGE_PASSWORD: la contraseña nueva se deriva en el pool */
+static fd_interest process_password_command(struct admin_client *client) {
+    const char *data = (const char *)client->request.data;
+    const char *password = admin_user_password_args(&client->response, data);
+    if (password == NULL) {
+        return OP_WRITE;
+    }
+    if (auth_hash_submit(password, admin_hash_done, client) == 0) {
+        client->pending = true;
+        return OP_NOOP;
+    }
+    if (client->request.command == ADMIN_CMD_ADD_USER) {
+        admin_process_add_user(&client->response, data);
+    } else {
+        admin_process_change_password(&client->response, data);
+    }
+    return OP_WRITE;
+}
+
+/* OP_WRITE con la respuesta lista, u OP_NOOP si la completa el pool */
+static fd_interest process_command(struct admin_client *client) {
     if (!client->authenticated) {
         client->response.version = ADMIN_VERSION;
         client->response.status = ADMIN_STATUS_PERMISSION_DENIED;
         client->response.length = 0;
-        return;
+        return OP_WRITE;
     }
     
     if (admin_command_requires_admin(client->request.command)) {
@@ -174,7 +284,7 @@ static void process_command(struct admin_client *client) {
             client->response.version = ADMIN_VERSION;
             client->response.status = ADMIN_STATUS_PERMISSION_DENIED;
             client->response.length = 0;
-            return;
+            return OP_WRITE;
         }
     }
     
@@ -188,8 +298,7 @@ static void process_command(struct admin_client *client) {
             admin_process_list_users(&client->response);
             break;
         case ADMIN_CMD_ADD_USER:
-            admin_process_add_user(&client->response, (char *)client->request.data);
-            break;
+            return process_password_command(client);
         case ADMIN_CMD_DEL_USER:
             admin_process_del_user(&client->response, (char *)client->request.data);
             break;
@@ -197,16 +306,40 @@ static void process_command(struct admin_client *client) {
             admin_process_list_connections(&client->response);
             break;
         case ADMIN_CMD_CHANGE_PASSWORD:
-            admin_process_change_password(&client->response, (char *)client->request.data);
-            break;
+            return process_password_command(client);
         case ADMIN_CMD_CHANGE_ROLE:
             admin_process_change_role(&client->response, (char *)client->request.data);
             break;
+        case ADMIN_CMD_LIST_CREDENTIALS:
+            admin_process_list_credentials(&client->response);
+            break;
+        case ADMIN_CMD_UPGRADE:
+            admin_process_upgrade(&client->response);
+            break;
+        case ADMIN_CMD_SET_LIMITS:
+            admin_process_set_limits(&client->response, (char *)client->request.data);
+            break;
+        case ADMIN_CMD_GET_LIMITS:
+            admin_process_get_limits(&client->response, (char *)client->request.data);
+            break;
+        case ADMIN_CMD_RELOAD_ACL:
+            admin_process_reload_acl(&client->response);
+            break;
+        case ADMIN_CMD_LIST_SESSIONS:
+            admin_process_list_sessions(&client->response);
+            break;
+        case ADMIN_CMD_LIST_ORIGINS:
+            admin_process_list_origins(&client->response);
+            break;
+        case ADMIN_CMD_LIST_EGRESS:
+            admin_process_list_egress(&client->response);
+            break;
         default:
             client->response.status = ADMIN_STATUS_INVALID_CMD;
             client->response.length = 0;
             break;
     }
+    return OP_WRITE;
 }
 
 static void admin_client_read(struct selector_key *key) {
@@ -221,8 +354,7 @@ static void admin_client_read(struct selector_key *key) {
             return;
         }
         
-        process_auth(client, buffer, n);
-        selector_set_interest_key(key, OP_WRITE);
+        selector_set_interest_key(key, process_auth(client, buffer, n));
         return;
     }
     
@@ -246,8 +378,7 @@ static void admin_client_read(struct selector_key *key) {
             }
             
             if (client->request.length == 0) {
-                process_command(client);
-                selector_set_interest_key(key, OP_WRITE);
+                selector_set_interest_key(key, process_command(client));
                 return;
             }
         }
@@ -269,8 +400,7 @@ static void admin_client_read(struct selector_key *key) {
     }
     
     if (data_read == client->request.length) {
-        process_command(client);
-        selector_set_interest_key(key, OP_WRITE);
+        selector_set_interest_key(key, process_command(client));
     }
 }
 
@@ -347,6 +477,12 @@ static void admin_client_close(struct selector_key *key) {
     struct admin_client *client = (struct admin_client *)key->data;
     if (client != NULL) {
         close(client->fd);
-        free(client);
+        admin_clients--;
+        // con una verificación pendiente la libera su callback
+        if (client->pending) {
+            client->closed = true;
+        } else {
+            free(client);
+        }
     }
 }
@@ -2,10 +2,17 @@
 #define ADMIN_SERVER_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "../utils/selector.h"
 
 int admin_server_init(fd_selector s, uint16_t port);
+/* registra un socket pasivo ya creado (heredado de otro proceso) */
+int admin_server_adopt(fd_selector s, int fd);
+/* socket pasivo de administración, -1 si no hay */
+int admin_server_listener(void);
 void admin_server_destroy(fd_selector s);
+/* conexiones de administración abiertas */
+size_t admin_server_clients(void);
 
 void admin_passive_accept(struct selector_key *key);
 
@@ -27,6 +27,14 @@
 #define CMD_LIST_CONNECTIONS 0x05
 #define CMD_CHANGE_PASSWORD 0x06
 #define CMD_CHANGE_ROLE 0x07
+#define CMD_LIST_CREDENTIALS 0x08
+#define CMD_UPGRADE 0x09
+#define CMD_SET_LIMITS 0x0A
+#define CMD_GET_LIMITS 0x0B
+#define CMD_RELOAD_ACL 0x0C
+#define CMD_LIST_SESSIONS 0x0D
+#define CMD_LIST_ORIGINS 0x0E
+#define CMD_LIST_EGRESS 0x0F
 
 #define STATUS_OK 0x00
 #define STATUS_ERROR 0x01
@@ -184,6 +192,64 @@ static void cmd_metrics(int sockfd) {
     printf("Current connections: %llu\n", (unsigned long long)current_conn);
     printf("Bytes transferred: %llu\n", (unsigned long long)bytes_trans);
     printf("Server start time: %llu\n", (unsigned long long)start_time);
+
+    if (data_len >= 48) {
+        uint64_t tfo_attempts, tfo_syn_data;
+        memcpy(&tfo_attempts, data + 32, 8);
+        memcpy(&tfo_syn_data, data + 40, 8);
+        tfo_attempts = be64toh(tfo_attempts);
+        tfo_syn_data = be64toh(tfo_syn_data);
+        printf("TFO to origin: %llu attempts, %llu with data in SYN\n",
+               (unsigned long long)tfo_attempts, (unsigned long long)tfo_syn_data);
+    }
+
+    if (data_len >= 56) {
+        uint64_t pauses;
+        memcpy(&pauses, data + 48, 8);
+        printf("Listener pauses: %llu\n", (unsigned long long)be64toh(pauses));
+    }
+
+    if (data_len >= 64) {
+        uint64_t refusals;
+        memcpy(&refusals, data + 56, 8);
+        printf("Refused by user limits: %llu\n", (unsigned long long)be64toh(refusals));
+    }
+
+    if (data_len >= 72) {
+        uint64_t denials;
+        memcpy(&denials, data + 64, 8);
+        printf("Denied by access rules: %llu\n", (unsigned long long)be64toh(denials));
+    }
+
+    // buffers de túnel por tamaño, de 2 KiB en adelante
+    if (data_len >= 72 + 10 * 8) {
+        printf("Tunnel buffers by size:");
+        for (int i = 0; i < 10; i++) {
+            uint64_t count;
+            memcpy(&count, data + 72 + i * 8, 8);
+            count = be64toh(count);
+            if (count > 0) {
+                printf(" %uK=%llu", 2u << i, (unsigned long long)count);
+            }
+        }
+        printf("\n");
+    }
+
+    if (data_len >= 168) {
+        uint64_t sends, copied;
+        memcpy(&sends, data + 152, 8);
+        memcpy(&copied, data + 160, 8);
+        printf("Zero-copy sends: %llu (%llu reported as copied)\n",
+               (unsigned long long)be64toh(sends), (unsigned long long)be64toh(copied));
+    }
+
+    if (data_len >= 184) {
+        uint64_t trips, fastfails;
+        memcpy(&trips, data + 168, 8);
+        memcpy(&fastfails, data + 176, 8);
+        printf("Origin circuits opened: %llu (%llu CONNECTs failed fast)\n",
+               (unsigned long long)be64toh(trips), (unsigned long long)be64toh(fastfails));
+    }
 }
 
 static void cmd_users(int sockfd) {
@@ -376,6 +442,328 @@ static void cmd_connections(int sockfd) {
     }
 }
 
+static int read_string(const uint8_t *data, uint16_t data_len, size_t *ptr, char out[256]) {
+    if (*ptr >= data_len) return -1;
+    uint8_t len = data[(*ptr)++];
+    if (*ptr + len > data_len) return -1;
+    memcpy(out, data + *ptr, len);
+    out[len] = '\0';
+    *ptr += len;
+    return 0;
+}
+
+static void cmd_credentials(int sockfd) {
+    if (send_command(sockfd, CMD_LIST_CREDENTIALS, NULL, 0) < 0) {
+        return;
+    }
+    
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+    
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+    
+    if (status == STATUS_PERMISSION_DENIED) {
+        printf("Permission denied (admin only)\n");
+        return;
+    } else if (status != STATUS_OK) {
+        fprintf(stderr, "Command failed with status %d\n", status);
+        return;
+    }
+    
+    printf("--- CREDENTIALS ---\n");
+    
+    if (data_len == 0 || data[0] == 0) {
+        printf("No credentials captured\n");
+        return;
+    }
+    
+    uint8_t count = data[0];
+    printf("Total: %d\n", count);
+    
+    size_t ptr = 1;
+    for (int i = 0; i < count; i++) {
+        char username[256], destination[256], protocol[256], cuser[256], cpass[256];
+        
+        if (read_string(data, data_len, &ptr, username) < 0) break;
+        if (read_string(data, data_len, &ptr, destination) < 0) break;
+        
+        if (ptr + 2 > data_len) break;
+        uint16_t port_val;
+        memcpy(&port_val, data + ptr, 2);
+        port_val = be16toh(port_val);
+        ptr += 2;
+        
+        if (read_string(data, data_len, &ptr, protocol) < 0) break;
+        if (read_string(data, data_len, &ptr, cuser) < 0) break;
+        if (read_string(data, data_len, &ptr, cpass) < 0) break;
+        
+        if (ptr + 8 > data_len) break;
+        uint64_t timestamp;
+        memcpy(&timestamp, data + ptr, 8);
+        timestamp = be64toh(timestamp);
+        ptr += 8;
+        
+        time_t ts = (time_t)timestamp;
+        struct tm *tm_info = localtime(&ts);
+        char time_str[64];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+        
+        printf("  - [%s] %s -> %s:%u %s:%s at %s\n", protocol, username, destination, port_val,
+               cuser, cpass, time_str);
+    }
+}
+
+static void cmd_upgrade(int sockfd) {
+    if (send_command(sockfd, CMD_UPGRADE, NULL, 0) < 0) {
+        return;
+    }
+    
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+    
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+    
+    printf("--- UPGRADE ---\n");
+    if (status == STATUS_OK) {
+        printf("Upgrade scheduled\n");
+    } else if (status == STATUS_PERMISSION_DENIED) {
+        printf("Permission denied (admin only)\n");
+    } else {
+        printf("Error: status=%d\n", status);
+    }
+}
+
+static void cmd_reload_acl(int sockfd) {
+    if (send_command(sockfd, CMD_RELOAD_ACL, NULL, 0) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+
+    printf("--- ACL RELOAD ---\n");
+    if (status == STATUS_OK && data_len >= 4) {
+        uint32_t rules;
+        memcpy(&rules, data, 4);
+        printf("Access rules reloaded: %u rules\n", ntohl(rules));
+    } else if (status == STATUS_PERMISSION_DENIED) {
+        printf("Permission denied (admin only)\n");
+    } else if (status == STATUS_ERROR && data_len > 0) {
+        printf("Error: %.*s\n", (int)data_len, (const char *)data);
+    } else {
+        printf("Error: status=%d\n", status);
+    }
+}
+
+/* una línea con las opciones efectivas de un socket; 33 bytes */
+static void print_sockopts(const char *label, const uint8_t *p) {
+    if (p[0] == 0) {
+        printf("      %s: -\n", label);
+        return;
+    }
+    int32_t v[8];
+    for (int i = 0; i < 8; i++) {
+        uint32_t net32;
+        memcpy(&net32, p + 1 + i * 4, 4);
+        v[i] = (int32_t)ntohl(net32);
+    }
+    printf("      %s: nodelay=%d sndbuf=%d rcvbuf=%d", label, v[0], v[1], v[2]);
+    if (v[3] >= 0) {
+        printf(" lowat=%d", v[3]);
+    }
+    if (v[4] == 0) {
+        printf(" keepalive=off");
+    } else {
+        printf(" keepalive=%d/%d/%d", v[4], v[5], v[6]);
+    }
+    if (v[7] >= 0) {
+        printf(" user_timeout=%dms", v[7]);
+    }
+    printf("\n");
+}
+
+static void cmd_sessions(int sockfd) {
+    if (send_command(sockfd, CMD_LIST_SESSIONS, NULL, 0) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+
+    if (status != STATUS_OK || data_len < 5) {
+        fprintf(stderr, "Command failed with status %d\n", status);
+        return;
+    }
+
+    uint32_t total;
+    memcpy(&total, data, 4);
+    uint8_t count = data[4];
+    printf("--- SESSIONS ---\n");
+    printf("Open: %u (showing %u)\n", ntohl(total), count);
+
+    size_t ptr = 5;
+    for (int i = 0; i < count; i++) {
+        char username[256], destination[256], profile[256];
+        char *fields[] = {username, destination};
+        for (int f = 0; f < 2; f++) {
+            if (ptr >= data_len || ptr + 1 + data[ptr] > data_len) return;
+            memcpy(fields[f], data + ptr + 1, data[ptr]);
+            fields[f][data[ptr]] = '\0';
+            ptr += 1 + data[ptr];
+        }
+        if (ptr + 3 > data_len) return;
+        uint16_t port;
+        memcpy(&port, data + ptr, 2);
+        ptr += 2;
+        if (ptr + 1 + data[ptr] + 66 > data_len) return;
+        memcpy(profile, data + ptr + 1, data[ptr]);
+        profile[data[ptr]] = '\0';
+        ptr += 1 + data[ptr];
+
+        if (destination[0] != '\0') {
+            printf("  - %s -> %s:%u [%s]\n", username[0] ? username : "(unauthenticated)", destination,
+                   ntohs(port), profile);
+        } else {
+            printf("  - %s [%s]\n", username[0] ? username : "(unauthenticated)", profile);
+        }
+        print_sockopts("client", data + ptr);
+        print_sockopts("origin", data + ptr + 33);
+        ptr += 66;
+    }
+}
+
+/* microsegundos como milisegundos con un decimal, o `-' sin medición */
+static void format_rtt(char *out, size_t len, uint32_t us) {
+    if (us == 0) {
+        snprintf(out, len, "-");
+    } else {
+        snprintf(out, len, "%.1fms", us / 1000.0);
+    }
+}
+
+static void cmd_origins(int sockfd) {
+    if (send_command(sockfd, CMD_LIST_ORIGINS, NULL, 0) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+
+    if (status != STATUS_OK || data_len < 5) {
+        fprintf(stderr, "Command failed with status %d\n", status);
+        return;
+    }
+
+    uint32_t total;
+    memcpy(&total, data, 4);
+    uint8_t count = data[4];
+    printf("--- ORIGINS ---\n");
+    printf("Tracked: %u (showing %u, most recent first)\n", ntohl(total), count);
+    if (count > 0) {
+        printf("  %-46s %9s %9s %11s %5s  %s\n", "ADDRESS", "SRTT", "LAST", "OK/TRIES", "RATE", "CIRCUIT");
+    }
+
+    size_t ptr = 5;
+    for (int i = 0; i < count && ptr + 42 <= data_len; i++, ptr += 42) {
+        const uint8_t *e = data + ptr;
+        char ip[INET6_ADDRSTRLEN], address[INET6_ADDRSTRLEN + 10];
+        uint16_t port;
+        memcpy(&port, e + 17, 2);
+        if (e[0] == 4) {
+            inet_ntop(AF_INET, e + 1, ip, sizeof(ip));
+            snprintf(address, sizeof(address), "%s:%u", ip, ntohs(port));
+        } else {
+            inet_ntop(AF_INET6, e + 1, ip, sizeof(ip));
+            snprintf(address, sizeof(address), "[%s]:%u", ip, ntohs(port));
+        }
+
+        uint32_t v[4], remaining;
+        for (int f = 0; f < 4; f++) {
+            memcpy(&v[f], e + 19 + f * 4, 4);
+            v[f] = ntohl(v[f]);
+        }
+        uint16_t permille;
+        memcpy(&permille, e + 35, 2);
+        memcpy(&remaining, e + 38, 4);
+
+        char srtt[16], last[16], tries[24];
+        format_rtt(srtt, sizeof(srtt), v[0]);
+        format_rtt(last, sizeof(last), v[1]);
+        snprintf(tries, sizeof(tries), "%u/%u", v[3], v[2]);
+        printf("  %-46s %9s %9s %11s %4u%%  ", address, srtt, last, tries, ntohs(permille) / 10);
+        if (!e[37]) {
+            printf("closed\n");
+        } else if (ntohl(remaining) > 0) {
+            printf("open (%.1fs left)\n", ntohl(remaining) / 1000.0);
+        } else {
+            printf("open (probing)\n");
+        }
+    }
+}
+
+static void cmd_egress(int sockfd) {
+    if (send_command(sockfd, CMD_LIST_EGRESS, NULL, 0) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+
+    if (status != STATUS_OK || data_len < 1) {
+        fprintf(stderr, "Command failed with status %d\n", status);
+        return;
+    }
+
+    uint8_t count = data[0];
+    printf("--- EGRESS ADDRESSES ---\n");
+    if (count == 0) {
+        printf("None configured, the system picks the source address\n");
+        return;
+    }
+    printf("  %-40s %10s %12s %10s  %s\n", "ADDRESS", "ACTIVE", "CONNECTS", "NO PORTS", "STATE");
+
+    size_t ptr = 1;
+    for (int i = 0; i < count && ptr + 42 <= data_len; i++, ptr += 42) {
+        const uint8_t *e = data + ptr;
+        char ip[INET6_ADDRSTRLEN];
+        inet_ntop(e[0] == 4 ? AF_INET : AF_INET6, e + 1, ip, sizeof(ip));
+
+        uint64_t v[3];
+        for (int f = 0; f < 3; f++) {
+            memcpy(&v[f], e + 17 + f * 8, 8);
+            v[f] = be64toh(v[f]);
+        }
+        printf("  %-40s %10llu %12llu %10llu  %s\n", ip, (unsigned long long)v[0],
+               (unsigned long long)v[1], (unsigned long long)v[2], e[41] ? "out of ports" : "ok");
+    }
+}
+
 static void cmd_change_password(int sockfd, const char *username, const char *new_password) {
     uint8_t data[512];
     size_t pos = 0;
@@ -454,6 +842,125 @@ static void cmd_change_role(int sockfd, const char *username, const char *role)
     }
 }
 
+/* número con sufijo opcional K, M o G (potencias de 1024); -1 si es inválido */
+static int parse_size(const char *s, unsigned long long *out) {
+    char *end;
+    if (*s == '-') {
+        return -1;
+    }
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) {
+        return -1;
+    }
+    switch (*end) {
+        case 'G': case 'g': v <<= 10; /* fall through */
+        case 'M': case 'm': v <<= 10; /* fall through */
+        case 'K': case 'k': v <<= 10; end++; break;
+        default: break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static void cmd_set_limits(int sockfd, const char *username, char **values) {
+    char data[512];
+    size_t username_len = strlen(username);
+    if (username_len >= 256) {
+        fprintf(stderr, "Username too long\n");
+        return;
+    }
+
+    memcpy(data, username, username_len + 1);
+    size_t pos = username_len + 1;
+    for (int i = 0; i < 4; i++) {
+        unsigned long long v;
+        if (parse_size(values[i], &v) < 0) {
+            fprintf(stderr, "Invalid limit: %s\n", values[i]);
+            return;
+        }
+        pos += snprintf(data + pos, sizeof(data) - pos, "%llu", v) + 1;
+    }
+
+    if (send_command(sockfd, CMD_SET_LIMITS, (uint8_t *)data, pos) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t response[8192];
+    uint16_t response_len;
+
+    if (recv_response(sockfd, &status, response, &response_len) < 0) {
+        return;
+    }
+
+    printf("--- LIMITS: %s ---\n", username);
+    if (status == STATUS_OK) {
+        printf("Limits updated\n");
+    } else if (status == STATUS_USER_NOT_FOUND) {
+        printf("User not found\n");
+    } else if (status == STATUS_PERMISSION_DENIED) {
+        printf("Permission denied (admin role required)\n");
+    } else if (status == STATUS_INVALID_ARGS) {
+        printf("Invalid limits\n");
+    } else {
+        printf("Error: status=%d\n", status);
+    }
+}
+
+static void print_limit(const char *name, unsigned long long limit, const char *unit) {
+    if (limit == 0) {
+        printf("%-18s unlimited\n", name);
+    } else {
+        printf("%-18s %llu%s\n", name, limit, unit);
+    }
+}
+
+static void cmd_usage(int sockfd, const char *username) {
+    size_t username_len = strlen(username);
+    if (send_command(sockfd, CMD_GET_LIMITS, (const uint8_t *)username, username_len + 1) < 0) {
+        return;
+    }
+
+    uint8_t status;
+    uint8_t data[8192];
+    uint16_t data_len;
+
+    if (recv_response(sockfd, &status, data, &data_len) < 0) {
+        return;
+    }
+
+    printf("--- USAGE: %s ---\n", username);
+    if (status == STATUS_USER_NOT_FOUND) {
+        printf("User not found\n");
+        return;
+    }
+    if (status != STATUS_OK || data_len < 44) {
+        printf("Error: status=%d\n", status);
+        return;
+    }
+
+    uint32_t sessions, rate, active;
+    uint64_t daily, monthly, bytes_day, bytes_month;
+    memcpy(&sessions, data, 4);
+    memcpy(&rate, data + 4, 4);
+    memcpy(&daily, data + 8, 8);
+    memcpy(&monthly, data + 16, 8);
+    memcpy(&active, data + 24, 4);
+    memcpy(&bytes_day, data + 28, 8);
+    memcpy(&bytes_month, data + 36, 8);
+
+    print_limit("Max sessions:", ntohl(sessions), "");
+    print_limit("Max rate:", ntohl(rate), " conn/min");
+    print_limit("Daily quota:", be64toh(daily), " bytes");
+    print_limit("Monthly quota:", be64toh(monthly), " bytes");
+    printf("%-18s %u\n", "Active sessions:", ntohl(active));
+    printf("%-18s %llu bytes\n", "Today:", (unsigned long long)be64toh(bytes_day));
+    printf("%-18s %llu bytes\n", "This month:", (unsigned long long)be64toh(bytes_month));
+}
+
 static void print_usage(const char *prog) {
     printf("Usage: %s -h <host> -p <port> -u <username> -P <password> COMMAND [ARGS]\n", prog);
     printf("\nOptions:\n");
@@ -467,12 +974,22 @@ static void print_usage(const char *prog) {
     printf("  add <user> <pass>                Add a new user (admin only)\n");
     printf("  del <user>                       Delete a user (admin only)\n");
     printf("  conns                            List recent connections\n");
+    printf("  sessions                         List open sessions with their socket options\n");
+    printf("  origins                          List origin connect times, success rates and circuits\n");
+    printf("  egress                           List egress source addresses and their usage\n");
+    printf("  creds                            List sniffed credentials (admin only)\n");
+    printf("  upgrade                          Hand over to the new binary and drain (admin only)\n");
     printf("  change-password <user> <pass>    Change user password (admin only)\n");
     printf("  change-role <user> <admin|user>  Change user role (admin only)\n");
+    printf("  limits <user> <sessions> <conn/min> <daily> <monthly>\n");
+    printf("                                   Set user limits, 0 = unlimited, K/M/G suffixes (admin only)\n");
+    printf("  usage <user>                     Show user limits and current usage\n");
+    printf("  acl-reload                       Reload the access control rules file (admin only)\n");
     printf("\nExamples:\n");
     printf("  %s -u admin -P 1234 metrics\n", prog);
     printf("  %s -u admin -P 1234 add john secret123\n", prog);
     printf("  %s -u admin -P 1234 change-role john admin\n", prog);
+    printf("  %s -u admin -P 1234 limits john 10 60 1G 20G\n", prog);
 }
 
 int main(int argc, char **argv) {
@@ -548,6 +1065,18 @@ int main(int argc, char **argv) {
         cmd_del_user(sockfd, argv[optind + 1]);
     } else if (strcmp(command, "conns") == 0) {
         cmd_connections(sockfd);
+    } else if (strcmp(command, "creds") == 0) {
+        cmd_credentials(sockfd);
+    } else if (strcmp(command, "upgrade") == 0) {
+        cmd_upgrade(sockfd);
+    } else if (strcmp(command, "acl-reload") == 0) {
+        cmd_reload_acl(sockfd);
+    } else if (strcmp(command, "sessions") == 0) {
+        cmd_sessions(sockfd);
+    } else if (strcmp(command, "origins") == 0) {
+        cmd_origins(sockfd);
+    } else if (strcmp(command, "egress") == 0) {
+        cmd_egress(sockfd);
     } else if (strcmp(command, "change-password") == 0) {
         if (optind + 2 >= argc) {
             fprintf(stderr, "Error: 'change-password' requires username and new password\n");
@@ -564,6 +1093,22 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
         cmd_change_role(sockfd, argv[optind + 1], argv[optind + 2]);
+    } else if (strcmp(command, "limits") == 0) {
+        if (optind + 5 >= argc) {
+            fprintf(stderr, "Error: 'limits' requires username, sessions, rate, daily and monthly quota\n");
+            print_usage(argv[0]);
+            close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+        cmd_set_limits(sockfd, argv[optind + 1], &argv[optind + 2]);
+    } else if (strcmp(command, "usage") == 0) {
+        if (optind + 1 >= argc) {
+            fprintf(stderr, "Error: 'usage' requires username\n");
+            print_usage(argv[0]);
+            close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+        cmd_usage(sockfd, argv[optind + 1]);
     } else {
         fprintf(stderr, "Unknown command: %s\n", command);
         print_usage(argv[0]);
@@ -1,20 +1,99 @@
 #include "auth.h"
 #include "../socks5/socks5.h"
 #include "../users/users.h"
+#include "verify.h"
+#include "../utils/wire_parser.h"
 #include <string.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+static unsigned auth_check_version(void *dst) {
+    return ((struct auth_parser *)dst)->version == 0x01 ? AUTH_ULEN : AUTH_ERROR;
+}
+
+static const struct wire_step auth_steps[] = {
+    [AUTH_VERSION] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct auth_parser, version),
+        .check = auth_check_version,
+    },
+    [AUTH_ULEN] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct auth_parser, ulen),
+        .next = AUTH_UNAME,
+    },
+    [AUTH_UNAME] = {
+        .kind = WIRE_VAR,
+        .offset = offsetof(struct auth_parser, uname),
+        .len_offset = offsetof(struct auth_parser, ulen),
+        .cap = sizeof(((struct auth_parser *)0)->uname),
+        .next = AUTH_PLEN,
+    },
+    [AUTH_PLEN] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct auth_parser, plen),
+        .next = AUTH_PASSWD,
+    },
+    [AUTH_PASSWD] = {
+        .kind = WIRE_VAR,
+        .offset = offsetof(struct auth_parser, passwd),
+        .len_offset = offsetof(struct auth_parser, plen),
+        .cap = sizeof(((struct auth_parser *)0)->passwd),
+        .next = AUTH_DONE,
+    },
+};
+
+static const struct wire_definition auth_definition = {
+    .steps = auth_steps,
+    .done = AUTH_DONE,
+    .error = AUTH_ERROR,
+};
+
+void auth_parser_init(struct auth_parser *p) {
+    p->state = AUTH_VERSION;
+    p->field_read = 0;
+    p->ulen = 0;
+    p->plen = 0;
+}
+
+enum auth_state auth_parser_consume(struct auth_parser *p, buffer *b) {
+    unsigned state = p->state;
+    wire_consume(&auth_definition, &state, &p->field_read, p, b);
+    p->state = state;
+    return p->state;
+}
+
+static unsigned auth_reply(struct socks5 *data, fd_selector s, bool ok) {
+    data->auth.authenticated = ok;
+
+    buffer_write(&data->origin_buffer, 0x01);
+    buffer_write(&data->origin_buffer, ok ? 0x00 : 0x01);
+
+    if (selector_set_interest(s, data->client_fd, OP_WRITE) != SELECTOR_SUCCESS) {
+        return ERROR;
+    }
+    return AUTH_WRITE;
+}
+
 void auth_read_init(unsigned state, struct selector_key *key) {
     struct socks5 *data = ATTACHMENT(key);
-    buffer_reset(&data->client_buffer);
+    data->auth.parser = malloc(sizeof(struct auth_parser));
+    if (data->auth.parser != NULL) {
+        auth_parser_init(data->auth.parser);
+    }
 }
 
 unsigned auth_read(struct selector_key *key) {
     struct socks5 *data = ATTACHMENT(key);
+    struct auth_parser *p = data->auth.parser;
+
+    if (p == NULL) {
+        return ERROR;
+    }
     
     size_t read_limit;
     uint8_t *read_buffer = buffer_write_ptr(&data->client_buffer, &read_limit);
@@ -25,48 +104,65 @@ unsigned auth_read(struct selector_key *key) {
     }
     
     buffer_write_adv(&data->client_buffer, read_count);
-    
-    size_t nbytes;
-    uint8_t *buf = buffer_read_ptr(&data->client_buffer, &nbytes);
-    
-    if (nbytes < 2) {
-        return AUTH_READ;
-    }
+    auth_parser_consume(p, &data->client_buffer);
 
-    if (buf[0] != 0x01) {
+    if (p->state == AUTH_ERROR) {
         return ERROR;
     }
-    
-    uint8_t ulen = buf[1];
-    if (nbytes < 2 + ulen + 1) {
+
+    if (p->state != AUTH_DONE) {
         return AUTH_READ;
     }
-    
-    uint8_t plen = buf[2 + ulen];
-    if (nbytes < 2 + ulen + 1 + plen) {
-        return AUTH_READ;
+
+    memcpy(data->auth.username, p->uname, p->ulen);
+    data->auth.username[p->ulen] = '\0';
+    memcpy(data->auth.password, p->passwd, p->plen);
+    data->auth.password[p->plen] = '\0';
+
+    free(p);
+    data->auth.parser = NULL;
+
+    if (auth_verify_cached(data->auth.username, data->auth.password)) {
+        user_record_login(data->auth.username);
+        return auth_reply(data, key->s, true);
     }
 
-    memcpy(data->auth.username, buf + 2, ulen);
-    data->auth.username[ulen] = '\0';
-    memcpy(data->auth.password, buf + 2 + ulen + 1, plen);
-    data->auth.password[plen] = '\0';
-    
-    data->auth.authenticated = user_authenticate(data->auth.username, data->auth.password);
-    
-    buffer_write(&data->origin_buffer, 0x01);  
-    
-    if (data->auth.authenticated) {
-        buffer_write(&data->origin_buffer, 0x00); 
-    } else {
-        buffer_write(&data->origin_buffer, 0x01);  
+    // la derivación de la clave corre en el pool; el cliente no se escucha
+    // hasta que llegue el resultado
+    if (auth_verify_submit(data->auth.username, data->auth.password, auth_verify_handler, data) == 0) {
+        if (selector_set_interest_key(key, OP_NOOP) != SELECTOR_SUCCESS) {
+            return ERROR;
+        }
+        data->auth.verifying = true;
+        return AUTH_VERIFY;
     }
-    
-    if (selector_set_interest_key(key, OP_WRITE) != SELECTOR_SUCCESS) {
-        return ERROR;
+
+    return auth_reply(data, key->s, user_authenticate(data->auth.username, data->auth.password));
+}
+
+void auth_verify_handler(void *arg, bool ok) {
+    struct socks5 *data = arg;
+    data->auth.verifying = false;
+
+    // la sesión se cerró mientras se verificaba: se liberó todo menos esto
+    if (data->closed) {
+        free(data);
+        return;
     }
-    
-    return AUTH_WRITE;
+
+    if (ok) {
+        user_record_login(data->auth.username);
+    }
+    if (auth_reply(data, data->selector, ok) == ERROR) {
+        struct selector_key key = {
+            .s = data->selector,
+            .fd = data->client_fd,
+            .data = data,
+        };
+        close_connection(&key);
+        return;
+    }
+    data->stm.current = &data->stm.states[AUTH_WRITE];
 }
 
 unsigned auth_write(struct selector_key *key) {
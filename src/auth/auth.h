@@ -1,10 +1,39 @@
 #ifndef AUTH_H
 #define AUTH_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../utils/buffer.h"
 #include "../utils/selector.h"
 
+enum auth_state {
+    AUTH_VERSION,
+    AUTH_ULEN,
+    AUTH_UNAME,
+    AUTH_PLEN,
+    AUTH_PASSWD,
+    AUTH_DONE,
+    AUTH_ERROR,
+};
+
+struct auth_parser {
+    enum auth_state state;
+    size_t field_read;
+    uint8_t version;
+    uint8_t ulen;
+    uint8_t uname[256];
+    uint8_t plen;
+    uint8_t passwd[256];
+};
+
 void auth_read_init(unsigned state, struct selector_key *key);
 unsigned auth_read(struct selector_key *key);
 unsigned auth_write(struct selector_key *key);
+/* resultado de la verificación en el pool (ver verify.h) */
+void auth_verify_handler(void *data, bool ok);
+
+void auth_parser_init(struct auth_parser *p);
+enum auth_state auth_parser_consume(struct auth_parser *p, buffer *b);
 
 #endif
@@ -0,0 +1,125 @@
+#include "password.h"
+#include "../utils/sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PREFIX "$pbkdf2-sha256$"
+#define KEY_LENGTH SHA256_DIGEST_LENGTH
+#define MAX_ITERATIONS 10000000UL
+
+static void to_hex(const uint8_t *in, size_t n, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        *out++ = digits[in[i] >> 4];
+        *out++ = digits[in[i] & 0x0F];
+    }
+    *out = '\0';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/* lee exactamente `n' bytes en hex de `s' hasta `end' */
+static bool from_hex(const char *s, const char *end, uint8_t *out, size_t n) {
+    if ((size_t)(end - s) != 2 * n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        int hi = hex_value(s[2 * i]);
+        int lo = hex_value(s[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static bool parse(const char *encoded, uint32_t *iterations, uint8_t salt[PASSWORD_SALT_LENGTH],
+                  uint8_t key[KEY_LENGTH]) {
+    if (encoded == NULL || strncmp(encoded, PREFIX, strlen(PREFIX)) != 0) {
+        return false;
+    }
+    const char *p = encoded + strlen(PREFIX);
+    char *end;
+    unsigned long n = strtoul(p, &end, 10);
+    if (end == p || *end != '$' || n == 0 || n > MAX_ITERATIONS) {
+        return false;
+    }
+    *iterations = (uint32_t)n;
+
+    p = end + 1;
+    const char *sep = strchr(p, '$');
+    if (sep == NULL || !from_hex(p, sep, salt, PASSWORD_SALT_LENGTH)) {
+        return false;
+    }
+    p = sep + 1;
+    return from_hex(p, p + strlen(p), key, KEY_LENGTH);
+}
+
+bool password_random(uint8_t *buf, size_t n) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) {
+            close(fd);
+            return false;
+        }
+        got += r;
+    }
+    close(fd);
+    return true;
+}
+
+bool password_hash(const char *plain, char *out, size_t out_len) {
+    uint8_t salt[PASSWORD_SALT_LENGTH];
+    uint8_t key[KEY_LENGTH];
+    char salt_hex[2 * sizeof(salt) + 1];
+    char key_hex[2 * sizeof(key) + 1];
+
+    if (!password_random(salt, sizeof(salt))) {
+        return false;
+    }
+    pbkdf2_sha256(plain, strlen(plain), salt, sizeof(salt), PASSWORD_ITERATIONS, key, sizeof(key));
+    to_hex(salt, sizeof(salt), salt_hex);
+    to_hex(key, sizeof(key), key_hex);
+
+    int n = snprintf(out, out_len, PREFIX "%u$%s$%s", (unsigned)PASSWORD_ITERATIONS, salt_hex, key_hex);
+    return n > 0 && (size_t)n < out_len;
+}
+
+bool password_verify(const char *plain, const char *encoded) {
+    uint32_t iterations;
+    uint8_t salt[PASSWORD_SALT_LENGTH];
+    uint8_t expected[KEY_LENGTH];
+    uint8_t key[KEY_LENGTH];
+
+    if (plain == NULL || !parse(encoded, &iterations, salt, expected)) {
+        return false;
+    }
+    pbkdf2_sha256(plain, strlen(plain), salt, sizeof(salt), iterations, key, sizeof(key));
+
+    // comparación sin cortocircuito
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        diff |= key[i] ^ expected[i];
+    }
+    return diff == 0;
+}
+
+bool password_is_hash(const char *s) {
+    uint32_t iterations;
+    uint8_t salt[PASSWORD_SALT_LENGTH];
+    uint8_t key[KEY_LENGTH];
+    return parse(s, &iterations, salt, key);
+}
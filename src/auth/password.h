@@ -0,0 +1,32 @@
+#ifndef PASSWORD_H
+#define PASSWORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Contraseñas guardadas como PBKDF2-HMAC-SHA256 con sal aleatoria:
+ *   $pbkdf2-sha256$<iteraciones>$<sal hex>$<clave hex>
+ * Las iteraciones viajan en el texto, así que se pueden subir sin invalidar
+ * las contraseñas existentes.
+ */
+
+#define PASSWORD_ITERATIONS 10000
+#define PASSWORD_SALT_LENGTH 16
+/* largo máximo del texto codificado, incluyendo el '\0' */
+#define PASSWORD_ENCODED_MAX 160
+
+/* deriva y codifica `plain' en `out'; false si no hay fuente de aleatoriedad */
+bool password_hash(const char *plain, char *out, size_t out_len);
+
+/* true si `plain' corresponde a `encoded'. Costoso: no llamar desde el selector */
+bool password_verify(const char *plain, const char *encoded);
+
+/* true si `s' tiene el formato de una contraseña derivada */
+bool password_is_hash(const char *s);
+
+/* llena `buf' con bytes aleatorios del sistema */
+bool password_random(uint8_t *buf, size_t n);
+
+#endif
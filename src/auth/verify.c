@@ -0,0 +1,282 @@
+#include "verify.h"
+#include "password.h"
+#include "../users/users.h"
+#include "../utils/sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CACHE_SLOTS 1024
+/* resultados que se leen del pipe por cada evento */
+#define RESULTS_PER_READ 64
+
+struct verify_job {
+    struct verify_job *next;
+    /* derivar `password' en `encoded' en lugar de verificarla */
+    bool hash;
+    char username[MAX_USERNAME];
+    char password[MAX_PASSWORD];
+    char encoded[PASSWORD_ENCODED_MAX];
+    bool exists;
+    bool ok;
+    auth_verify_callback verified;
+    auth_hash_callback hashed;
+    void *data;
+};
+
+/* digest de (secreto, usuario, contraseña, hash guardado) de un login exitoso */
+struct cache_entry {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    time_t expires;
+};
+
+static int pipe_fds[2] = {-1, -1};
+static pthread_t workers[AUTH_VERIFY_WORKERS];
+static int workers_count = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct verify_job *queue_head = NULL;
+static struct verify_job *queue_tail = NULL;
+static bool shutdown_flag = false;
+
+/* contra este hash se verifican los usuarios inexistentes: tardan lo mismo */
+static char dummy_hash[PASSWORD_ENCODED_MAX];
+
+/* solo se accede desde el hilo del selector */
+static uint8_t cache_secret[SHA256_DIGEST_LENGTH];
+static struct cache_entry cache[CACHE_SLOTS];
+
+static void verify_handle_read(struct selector_key *key);
+
+static const struct fd_handler verify_handler = {
+    .handle_read = verify_handle_read,
+    .handle_write = NULL,
+    .handle_close = NULL,
+    .handle_block = NULL,
+};
+
+static uint32_t cache_slot(const char *username) {
+    uint32_t h = 2166136261u;
+    for (const char *s = username; *s; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h & (CACHE_SLOTS - 1);
+}
+
+static void cache_digest(const char *username, const char *password, const char *encoded,
+                         uint8_t digest[SHA256_DIGEST_LENGTH]) {
+    struct sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, cache_secret, sizeof(cache_secret));
+    sha256_update(&ctx, username, strlen(username) + 1);
+    sha256_update(&ctx, password, strlen(password) + 1);
+    sha256_update(&ctx, encoded, strlen(encoded));
+    sha256_final(&ctx, digest);
+}
+
+static void cache_store(const char *username, const char *password, const char *encoded) {
+    struct cache_entry *e = &cache[cache_slot(username)];
+    cache_digest(username, password, encoded, e->digest);
+    e->expires = time(NULL) + AUTH_CACHE_TTL;
+}
+
+bool auth_verify_cached(const char *username, const char *password) {
+    char encoded[PASSWORD_ENCODED_MAX];
+    if (!user_password_hash(username, encoded, sizeof(encoded))) {
+        return false;
+    }
+    const struct cache_entry *e = &cache[cache_slot(username)];
+    if (e->expires <= time(NULL)) {
+        return false;
+    }
+    // el hash guardado entra en el digest: un cambio de contraseña invalida la entrada
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    cache_digest(username, password, encoded, digest);
+    return memcmp(digest, e->digest, sizeof(digest)) == 0;
+}
+
+static void job_free(struct verify_job *job) {
+    memset(job->password, 0, sizeof(job->password));
+    free(job);
+}
+
+static void *verify_worker(void *arg) {
+    while (1) {
+        pthread_mutex_lock(&queue_mutex);
+
+        while (queue_head == NULL && !shutdown_flag) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+
+        if (queue_head == NULL) {
+            pthread_mutex_unlock(&queue_mutex);
+            break;
+        }
+
+        struct verify_job *job = queue_head;
+        queue_head = job->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (job->hash) {
+            job->ok = password_hash(job->password, job->encoded, sizeof(job->encoded));
+        } else {
+            bool ok = password_verify(job->password, job->exists ? job->encoded : dummy_hash);
+            job->ok = ok && job->exists;
+        }
+
+        if (write(pipe_fds[1], &job, sizeof(job)) != sizeof(job)) {
+            job_free(job);
+        }
+    }
+
+    return NULL;
+}
+
+static void verify_handle_read(struct selector_key *key) {
+    struct verify_job *jobs[RESULTS_PER_READ];
+    ssize_t n = read(key->fd, jobs, sizeof(jobs));
+    if (n <= 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < (size_t)n / sizeof(jobs[0]); i++) {
+        struct verify_job *job = jobs[i];
+        if (job->hash) {
+            job->hashed(job->data, job->ok ? job->encoded : NULL);
+            job_free(job);
+            continue;
+        }
+        if (job->ok) {
+            // la contraseña pudo cambiar mientras se verificaba
+            char current[PASSWORD_ENCODED_MAX];
+            job->ok = user_password_hash(job->username, current, sizeof(current)) &&
+                      strcmp(current, job->encoded) == 0;
+        }
+        if (job->ok) {
+            cache_store(job->username, job->password, job->encoded);
+        }
+        job->verified(job->data, job->ok);
+        job_free(job);
+    }
+}
+
+int auth_verify_init(fd_selector selector) {
+    if (!password_random(cache_secret, sizeof(cache_secret)) ||
+        !password_hash("", dummy_hash, sizeof(dummy_hash))) {
+        return -1;
+    }
+    memset(cache, 0, sizeof(cache));
+
+    if (pipe(pipe_fds) < 0) {
+        return -1;
+    }
+
+    if (selector_fd_set_nio(pipe_fds[0]) == -1 ||
+        selector_register(selector, pipe_fds[0], &verify_handler, OP_READ, NULL) != SELECTOR_SUCCESS) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        pipe_fds[0] = pipe_fds[1] = -1;
+        return -1;
+    }
+
+    shutdown_flag = false;
+    queue_head = queue_tail = NULL;
+
+    for (workers_count = 0; workers_count < AUTH_VERIFY_WORKERS; workers_count++) {
+        if (pthread_create(&workers[workers_count], NULL, verify_worker, NULL) != 0) {
+            break;
+        }
+    }
+    if (workers_count == 0) {
+        selector_unregister_fd(selector, pipe_fds[0]);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        pipe_fds[0] = pipe_fds[1] = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void auth_verify_destroy(void) {
+    pthread_mutex_lock(&queue_mutex);
+    shutdown_flag = true;
+    // lo que no empezó a verificarse se descarta
+    while (queue_head != NULL) {
+        struct verify_job *next = queue_head->next;
+        job_free(queue_head);
+        queue_head = next;
+    }
+    queue_tail = NULL;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    for (int i = 0; i < workers_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    workers_count = 0;
+
+    for (int i = 0; i < 2; i++) {
+        if (pipe_fds[i] >= 0) {
+            close(pipe_fds[i]);
+            pipe_fds[i] = -1;
+        }
+    }
+}
+
+static void enqueue(struct verify_job *job) {
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_tail != NULL) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+int auth_verify_submit(const char *username, const char *password, auth_verify_callback callback, void *data) {
+    if (username == NULL || password == NULL || callback == NULL || workers_count == 0) {
+        return -1;
+    }
+
+    struct verify_job *job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return -1;
+    }
+
+    strncpy(job->username, username, sizeof(job->username) - 1);
+    strncpy(job->password, password, sizeof(job->password) - 1);
+    job->exists = user_password_hash(username, job->encoded, sizeof(job->encoded));
+    job->verified = callback;
+    job->data = data;
+    enqueue(job);
+    return 0;
+}
+
+int auth_hash_submit(const char *password, auth_hash_callback callback, void *data) {
+    if (password == NULL || callback == NULL || workers_count == 0) {
+        return -1;
+    }
+
+    struct verify_job *job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return -1;
+    }
+
+    job->hash = true;
+    strncpy(job->password, password, sizeof(job->password) - 1);
+    job->hashed = callback;
+    job->data = data;
+    enqueue(job);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdbool.h>
+#include "../utils/selector.h"
+
+/*
+ * Verificación de contraseñas fuera del selector: un pool de hilos deriva la
+ * clave y el resultado vuelve al selector por un pipe, igual que el
+ * resolver DNS. Las verificaciones exitosas se recuerdan un rato para no
+ * repetir la derivación en logins seguidos del mismo usuario. El mismo pool
+ * deriva las contraseñas nuevas que llegan por administración.
+ */
+
+#define AUTH_VERIFY_WORKERS 4
+/* segundos que se recuerda una verificación exitosa */
+#define AUTH_CACHE_TTL 60
+
+typedef void (*auth_verify_callback)(void *data, bool ok);
+/* `encoded' es la contraseña derivada, o NULL si no se pudo derivar */
+typedef void (*auth_hash_callback)(void *data, const char *encoded);
+
+int auth_verify_init(fd_selector selector);
+void auth_verify_destroy(void);
+
+/* true si el usuario se verificó con esta misma contraseña hace poco */
+bool auth_verify_cached(const char *username, const char *password);
+
+/* encola la verificación; el resultado llega a `callback' con `data'. -1 si falla */
+int auth_verify_submit(const char *username, const char *password, auth_verify_callback callback, void *data);
+
+/* encola la derivación de `password' para guardarla. -1 si falla */
+int auth_hash_submit(const char *password, auth_hash_callback callback, void *data);
+
+#endif
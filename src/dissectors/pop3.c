@@ -0,0 +1,190 @@
+#include "pop3.h"
+#include "../utils/parser.h"
+#include "../utils/parser_utils.h"
+#include "../utils/linescan.h"
+#include "../users/users.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* una sesión que no envió credenciales en estas líneas ya no está en AUTHORIZATION */
+#define POP3_MAX_LINES 32
+
+static bool module_enabled = false;
+static struct parser_table *user_table = NULL;
+static struct parser_table *pass_table = NULL;
+
+int pop3_sniffer_module_init(bool enabled) {
+    module_enabled = false;
+    if (!enabled) {
+        return 0;
+    }
+
+    struct parser_definition user_def = parser_utils_strcmpi("USER ");
+    struct parser_definition pass_def = parser_utils_strcmpi("PASS ");
+
+    if (user_def.states != NULL) {
+        user_table = parser_compile(parser_no_classes(), &user_def);
+        parser_utils_strcmpi_destroy(&user_def);
+    }
+    if (pass_def.states != NULL) {
+        pass_table = parser_compile(parser_no_classes(), &pass_def);
+        parser_utils_strcmpi_destroy(&pass_def);
+    }
+
+    if (user_table == NULL || pass_table == NULL) {
+        pop3_sniffer_module_destroy();
+        return -1;
+    }
+
+    module_enabled = true;
+    return 0;
+}
+
+void pop3_sniffer_module_destroy(void) {
+    parser_table_destroy(user_table);
+    parser_table_destroy(pass_table);
+    user_table = NULL;
+    pass_table = NULL;
+    module_enabled = false;
+}
+
+bool pop3_sniffer_wants(uint16_t port) {
+    return module_enabled && port == POP3_PORT;
+}
+
+static void start_line(struct pop3_sniffer *s) {
+    parser_reset(s->user_cmd);
+    parser_reset(s->pass_cmd);
+    s->user_may_match = true;
+    s->pass_may_match = true;
+    s->arg_len = 0;
+    s->state = (++s->lines > POP3_MAX_LINES) ? POP3_DONE : POP3_COMMAND;
+}
+
+struct pop3_sniffer *pop3_sniffer_new(const char *socks_user, const char *destination, uint16_t port) {
+    struct pop3_sniffer *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->user_cmd = parser_init_table(user_table);
+    s->pass_cmd = parser_init_table(pass_table);
+    if (s->user_cmd == NULL || s->pass_cmd == NULL) {
+        pop3_sniffer_free(s);
+        return NULL;
+    }
+
+    strncpy(s->socks_user, socks_user, sizeof(s->socks_user) - 1);
+    strncpy(s->destination, destination, sizeof(s->destination) - 1);
+    s->port = port;
+    s->lines = 0;
+    start_line(s);
+    return s;
+}
+
+void pop3_sniffer_free(struct pop3_sniffer *s) {
+    if (s == NULL) {
+        return;
+    }
+    parser_destroy(s->user_cmd);
+    parser_destroy(s->pass_cmd);
+    free(s);
+}
+
+static void command_byte(struct pop3_sniffer *s, uint8_t c) {
+    if (s->user_may_match) {
+        const struct parser_event *e = parser_feed(s->user_cmd, c);
+        if (e->type == STRING_CMP_EQ) {
+            s->capturing_pass = false;
+            s->state = POP3_ARGUMENT;
+            return;
+        }
+        s->user_may_match = (e->type == STRING_CMP_MAYEQ);
+    }
+
+    if (s->pass_may_match) {
+        const struct parser_event *e = parser_feed(s->pass_cmd, c);
+        if (e->type == STRING_CMP_EQ) {
+            s->capturing_pass = true;
+            s->state = POP3_ARGUMENT;
+            return;
+        }
+        s->pass_may_match = (e->type == STRING_CMP_MAYEQ);
+    }
+
+    if (!s->user_may_match && !s->pass_may_match) {
+        // otro comando luego de enviar credenciales: la sesión ya salió de
+        // AUTHORIZATION (o al menos ya vimos lo que nos interesa)
+        s->state = s->credentials_seen ? POP3_DONE : POP3_SKIP_LINE;
+    }
+}
+
+static void argument_done(struct pop3_sniffer *s) {
+    s->arg[s->arg_len] = '\0';
+
+    if (!s->capturing_pass) {
+        memcpy(s->pop3_user, s->arg, s->arg_len + 1);
+        return;
+    }
+
+    s->credentials_seen = true;
+    printf("[POP3] %s -> %s:%u USER %s PASS %s\n",
+           s->socks_user, s->destination, s->port, s->pop3_user, s->arg);
+    user_log_credentials(s->socks_user, s->destination, s->port, "pop3", s->pop3_user, s->arg);
+}
+
+bool pop3_sniffer_feed(struct pop3_sniffer *s, const uint8_t *data, size_t n) {
+    size_t i = 0;
+
+    while (i < n && s->state != POP3_DONE) {
+        switch (s->state) {
+            case POP3_COMMAND:
+                // solo los primeros bytes de cada línea pasan por los parsers
+                if (data[i] == '\n') {
+                    start_line(s);
+                } else {
+                    command_byte(s, data[i]);
+                }
+                i++;
+                break;
+
+            case POP3_ARGUMENT: {
+                const size_t eol = i + linescan_eol(data + i, n - i);
+                size_t len = eol - i;
+                if (len > sizeof(s->arg) - 1 - s->arg_len) {
+                    len = sizeof(s->arg) - 1 - s->arg_len;
+                }
+                memcpy(s->arg + s->arg_len, data + i, len);
+                s->arg_len += len;
+                if (eol < n) {
+                    if (s->arg_len > 0 && s->arg[s->arg_len - 1] == '\r') {
+                        s->arg_len--;
+                    }
+                    argument_done(s);
+                    start_line(s);
+                    i = eol + 1;
+                } else {
+                    i = n;
+                }
+                break;
+            }
+
+            case POP3_SKIP_LINE: {
+                const size_t eol = i + linescan_eol(data + i, n - i);
+                if (eol < n) {
+                    start_line(s);
+                    i = eol + 1;
+                } else {
+                    i = n;
+                }
+                break;
+            }
+
+            case POP3_DONE:
+                break;
+        }
+    }
+
+    return s->state != POP3_DONE;
+}
@@ -0,0 +1,48 @@
+#ifndef POP3_H
+#define POP3_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define POP3_PORT 110
+#define POP3_MAX_ARG 256
+
+enum pop3_sniffer_state {
+    POP3_COMMAND,
+    POP3_ARGUMENT,
+    POP3_SKIP_LINE,
+    POP3_DONE,
+};
+
+struct parser;
+
+struct pop3_sniffer {
+    enum pop3_sniffer_state state;
+    struct parser *user_cmd;
+    struct parser *pass_cmd;
+    bool user_may_match;
+    bool pass_may_match;
+    bool capturing_pass;
+    bool credentials_seen;
+    unsigned lines;
+
+    char arg[POP3_MAX_ARG];
+    size_t arg_len;
+    char pop3_user[POP3_MAX_ARG];
+
+    char socks_user[256];
+    char destination[256];
+    uint16_t port;
+};
+
+int pop3_sniffer_module_init(bool enabled);
+void pop3_sniffer_module_destroy(void);
+
+bool pop3_sniffer_wants(uint16_t port);
+
+struct pop3_sniffer *pop3_sniffer_new(const char *socks_user, const char *destination, uint16_t port);
+bool pop3_sniffer_feed(struct pop3_sniffer *s, const uint8_t *data, size_t n);
+void pop3_sniffer_free(struct pop3_sniffer *s);
+
+#endif
@@ -5,20 +5,33 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #include "utils/selector.h"
 #include "socks5/socks5.h"
+#include "auth/auth.h"
+#include "auth/verify.h"
+#include "socks5/request.h"
 #include "users/users.h"
 #include "metrics/metrics.h"
 #include "admin/admin_server.h"
 #include "dns/dns_resolver.h"
+#include "dissectors/pop3.h"
+#include "socks5/bind.h"
+#include "socks5/upstream.h"
+#include "socks5/copy.h"
+#include "socks5/sockopt.h"
+#include "socks5/origin.h"
+#include "socks5/egress.h"
+#include "upgrade/upgrade.h"
+#include "acl/acl.h"
 #include "utils/args.h"
 
-#define MAX_PENDING 20
-
 static bool done = false;
 
 static void
@@ -27,10 +40,51 @@ sigterm_handler(const int signal) {
     done = true;
 }
 
+/*
+ * Ajustes opcionales del listener. TCP Fast Open deja que el hello SOCKS viaje
+ * en el SYN; TCP_DEFER_ACCEPT retiene la conexión en el kernel hasta que
+ * llegan datos, así el accept ya encuentra el hello para leer.
+ */
+static void
+listener_tune(int server, const struct socks5args *args) {
+    if (args->fastopen_qlen > 0) {
+#ifdef TCP_FASTOPEN
+        if (setsockopt(server, IPPROTO_TCP, TCP_FASTOPEN, &args->fastopen_qlen, sizeof(int)) < 0) {
+            perror("Warning: TCP_FASTOPEN");
+        }
+#else
+        fprintf(stderr, "Warning: TCP_FASTOPEN not supported\n");
+#endif
+    }
+    if (args->defer_accept > 0) {
+#ifdef TCP_DEFER_ACCEPT
+        if (setsockopt(server, IPPROTO_TCP, TCP_DEFER_ACCEPT, &args->defer_accept, sizeof(int)) < 0) {
+            perror("Warning: TCP_DEFER_ACCEPT");
+        }
+#else
+        fprintf(stderr, "Warning: TCP_DEFER_ACCEPT not supported\n");
+#endif
+    }
+}
+
+/*
+ * Con epoll o io_uring el selector admite tantos fds como el proceso pueda
+ * abrir: se sube el límite blando hasta el duro.
+ */
+static void
+raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
 extern void dns_callback_handler(struct dns_response *response);
 
 int main(int argc, char **argv) {
     struct socks5args args;
+    upgrade_init(argc, argv);
     parse_args(argc, argv, &args);
     
     setvbuf(stdout, NULL, _IONBF, 0);
@@ -49,9 +103,21 @@ int main(int argc, char **argv) {
     
     int ret = 0;
 
+    // en una actualización en caliente los listeners llegan del proceso anterior
+    const bool inherited = upgrade_inherited();
+    int inherited_admin = -1;
+    bool draining = false;
+    time_t drain_deadline = 0;
+
     int is_ipv6 = (strchr(args.socks_addr, ':') != NULL);
     
-    if (is_ipv6) {
+    if (inherited) {
+        addr_len = sizeof(addr);
+        if (upgrade_receive(&server, &inherited_admin) != 0 ||
+            getsockname(server, (struct sockaddr *)&addr, &addr_len) < 0) {
+            err_msg = "Receiving listeners from previous process";
+        }
+    } else if (is_ipv6) {
         struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
         addr6->sin6_family = AF_INET6;
         addr6->sin6_port = htons(args.socks_port);
@@ -81,23 +147,32 @@ int main(int argc, char **argv) {
         if (server < 0) {
             err_msg = "Unable to create socket";
         } else {
-            setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+            if (!inherited) {
+                setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+                listener_tune(server, &args);
+            }
 
-            if (bind(server, (struct sockaddr*)&addr, addr_len) < 0) {
+            if (!inherited && bind(server, (struct sockaddr*)&addr, addr_len) < 0) {
                 err_msg = "Unable to bind socket";
-            } else if (listen(server, MAX_PENDING) < 0) {
+            } else if (!inherited && listen(server, args.backlog) < 0) {
                 err_msg = "Unable to listen";
             } else if (selector_fd_set_nio(server) == -1) {
                 err_msg = "Getting server socket flags";
             } else {
                 const struct selector_init conf = {
                     .signal = SIGALRM,
+                    // los plazos que revisa el loop (traspaso, drenado,
+                    // linger) se cumplen con un segundo de precisión
                     .select_timeout = {
-                        .tv_sec = 10,
+                        .tv_sec = 1,
                         .tv_nsec = 0,
                     },
+                    .engine = args.io_engine,
                 };
 
+                if (args.io_engine != SELECTOR_ENGINE_SELECT) {
+                    raise_fd_limit();
+                }
                 if (selector_init(&conf) != 0) {
                     err_msg = "Initializing selector";
                 } else {
@@ -105,7 +180,7 @@ int main(int argc, char **argv) {
                     if (selector == NULL) {
                         err_msg = "Unable to create selector";
                     } else {
-                        const struct fd_handler socksv5 = {
+                        static const struct fd_handler socksv5 = {
                             .handle_read = socks5_passive_accept,
                         };
 
@@ -120,21 +195,89 @@ int main(int argc, char **argv) {
                             printf("Starting SOCKS5 server...\n");
                             printf("SOCKS port: %s:%d\n", args.socks_addr, args.socks_port);
                             printf("Admin port: %s:%d\n", args.mng_addr, args.mng_port);
+                            printf("I/O engine: %s (up to %zu fds)\n", selector_engine_name(selector_get_engine(selector)),
+                                   selector_max_fds(selector));
                             printf("Server ready and listening\n");
 
                             socks5_pool_init();
-                            users_init(&args);
+                            request_set_origin_fastopen(args.fastopen_ports, args.fastopen_ports_count);
+                            const size_t max_sessions = socks5_set_max_sessions(selector, (size_t)args.max_sessions);
+                            if (args.max_sessions > 0 && max_sessions < (size_t)args.max_sessions) {
+                                fprintf(stderr, "Warning: -M %d needs more than %zu fds, using %zu sessions\n",
+                                        args.max_sessions, selector_max_fds(selector), max_sessions);
+                            }
+                            copy_set_max_buffer((size_t)args.buffer_max_kb * 1024);
+                            // select() despierta por la cola de errores y por los datos sin
+                            // distinguirlos: con envíos sin confirmar el loop giraría en vacío
+                            if (args.zerocopy_kb > 0 && selector_get_engine(selector) == SELECTOR_ENGINE_SELECT) {
+                                fprintf(stderr, "Warning: MSG_ZEROCOPY needs epoll or io_uring, -Z ignored\n");
+                                copy_set_zerocopy(0);
+                            } else if (!copy_set_zerocopy((size_t)args.zerocopy_kb * 1024)) {
+                                fprintf(stderr, "Warning: MSG_ZEROCOPY not supported, -Z ignored\n");
+                            }
+                            socks5_set_eager_read(args.fastopen_qlen > 0 || args.defer_accept > 0);
+                            if (users_init(&args) != 0) {
+                                fprintf(stderr, "Unable to open user database\n");
+                                done = true;
+                            }
+                            char acl_err[256];
+                            if (acl_init(args.acl_file, acl_err, sizeof(acl_err)) != 0) {
+                                fprintf(stderr, "Unable to load access control rules: %s\n", acl_err);
+                                done = true;
+                            }
+                            char sockopt_err[256];
+                            if (sockopt_init(args.sockopt_profiles, args.sockopt_profiles_count, args.sockopt_rules,
+                                             args.sockopt_rules_count, sockopt_err, sizeof(sockopt_err)) != 0) {
+                                fprintf(stderr, "Unable to load socket option profiles: %s\n", sockopt_err);
+                                done = true;
+                            }
+                            if (origin_init(ORIGIN_TABLE_SIZE, args.breaker_failures, args.breaker_cooldown) != 0) {
+                                fprintf(stderr, "Unable to allocate origin health table\n");
+                                done = true;
+                            }
+                            char egress_err[256];
+                            if (egress_init(args.egress_addrs, args.egress_addrs_count,
+                                            args.egress_hash ? EGRESS_HASH : EGRESS_ROUND_ROBIN,
+                                            egress_err, sizeof(egress_err)) != 0) {
+                                fprintf(stderr, "Unable to load egress addresses: %s\n", egress_err);
+                                done = true;
+                            }
                             metrics_init();
+                            upgrade_restore();
+
+                            bind_pool_init((struct sockaddr *)&addr, addr_len,
+                                           args.bind_port_first, args.bind_port_last);
+
+                            if (pop3_sniffer_module_init(args.disectors_enabled) != 0) {
+                                fprintf(stderr, "Warning: Could not start POP3 dissector\n");
+                            }
 
                             dns_resolver_set_callback(dns_callback_handler);
                             if (dns_resolver_init(selector) != 0) {
                                 fprintf(stderr, "Warning: Could not start DNS resolver\n");
                             }
 
-                            if (admin_server_init(selector, args.mng_port) != 0) {
+                            if (auth_verify_init(selector) != 0) {
+                                fprintf(stderr, "Warning: Could not start password verifiers, verifying inline\n");
+                            }
+
+                            int admin_ret = inherited_admin >= 0
+                                          ? admin_server_adopt(selector, inherited_admin)
+                                          : admin_server_init(selector, args.mng_port);
+                            if (admin_ret != 0) {
                                 fprintf(stderr, "Warning: Could not start admin server\n");
                             }
 
+                            if (upstream_init(selector, args.upstream, args.upstream_rules,
+                                              args.upstream_rules_count, args.upstream_pool) != 0) {
+                                done = true;
+                            }
+
+                            // si el arranque falló el proceso anterior sigue atendiendo
+                            if (!done) {
+                                upgrade_ready();
+                            }
+
                             while (!done) {
                                 err_msg = NULL;
                                 ss = selector_select(selector);
@@ -142,6 +285,31 @@ int main(int argc, char **argv) {
                                     err_msg = "Serving";
                                     break;
                                 }
+                                upstream_pool_maintain();
+                                copy_sweep();
+                                socks5_listener_maintain();
+
+                                upgrade_maintain();
+                                if (upgrade_pending() && !draining) {
+                                    upgrade_start(selector, server, admin_server_listener());
+                                }
+                                if (upgrade_took_over()) {
+                                    // el proceso nuevo ya atiende: dejar de aceptar y drenar
+                                    selector_unregister_fd(selector, server);
+                                    close(server);
+                                    server = -1;
+                                    socks5_listener_closed();
+                                    bind_pool_handover();
+                                    admin_server_destroy(selector);
+                                    upstream_destroy();
+                                    draining = true;
+                                    drain_deadline = time(NULL) + args.drain_seconds;
+                                }
+                                // las conexiones de administración abiertas esperan su respuesta
+                                if (draining && ((socks5_sessions() == 0 && admin_server_clients() == 0)
+                                                 || time(NULL) >= drain_deadline)) {
+                                    done = true;
+                                }
                             }
 
                             if (err_msg == NULL && ss == SELECTOR_SUCCESS) {
@@ -164,7 +332,9 @@ int main(int argc, char **argv) {
     }
     
     if (selector != NULL) {
+        upgrade_abort();
         admin_server_destroy(selector);
+        upstream_destroy();
     }
 
     if (selector != NULL) {
@@ -174,7 +344,12 @@ int main(int argc, char **argv) {
 
     selector_close();
     dns_resolver_destroy();
+    auth_verify_destroy();
     users_destroy();
+    acl_destroy();
+    origin_destroy();
+    pop3_sniffer_module_destroy();
+    bind_pool_destroy();
     socks5_pool_destroy();
     
     if (server >= 0) {
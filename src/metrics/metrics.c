@@ -39,3 +39,142 @@ void metrics_add_bytes(uint64_t bytes) {
     global_metrics.bytes_transferred += bytes;
     pthread_mutex_unlock(&metrics_mutex);
 }
+
+void metrics_tfo_result(bool syn_data) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.tfo_attempts++;
+    if (syn_data) {
+        global_metrics.tfo_syn_data++;
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_listener_paused(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.listener_pauses++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_limit_refused(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.limit_refusals++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_acl_denied(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.acl_denials++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_zerocopy_sent(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.zerocopy_sends++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_zerocopy_copied(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.zerocopy_copied++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_origin_tripped(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.origin_trips++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_origin_fastfail(void) {
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.origin_fastfails++;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+static int buffer_class(size_t size) {
+    int c = 0;
+    while (c < METRICS_BUFFER_CLASSES - 1 && ((size_t)METRICS_BUFFER_MIN << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+void metrics_buffer_resized(size_t old_size, size_t new_size) {
+    pthread_mutex_lock(&metrics_mutex);
+    if (old_size > 0 && global_metrics.buffer_sizes[buffer_class(old_size)] > 0) {
+        global_metrics.buffer_sizes[buffer_class(old_size)]--;
+    }
+    if (new_size > 0) {
+        global_metrics.buffer_sizes[buffer_class(new_size)]++;
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+/* lo que manda un proceso de una versión anterior, sin los contadores nuevos */
+#define SERIALIZED_MIN 48
+
+static uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        *p++ = (uint8_t)(v >> (i * 8));
+    }
+    return p;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/* las conexiones y los buffers actuales no se traspasan: quedan en el proceso anterior */
+size_t metrics_serialize(uint8_t *buf, size_t cap) {
+    if (cap < METRICS_SERIALIZED_SIZE) {
+        return 0;
+    }
+    struct metrics m = metrics_get();
+    uint8_t *p = buf;
+    p = put_u64(p, m.total_connections);
+    p = put_u64(p, m.bytes_transferred);
+    p = put_u64(p, (uint64_t)m.server_start_time);
+    p = put_u64(p, m.tfo_attempts);
+    p = put_u64(p, m.tfo_syn_data);
+    p = put_u64(p, m.listener_pauses);
+    p = put_u64(p, m.limit_refusals);
+    p = put_u64(p, m.acl_denials);
+    p = put_u64(p, m.zerocopy_sends);
+    p = put_u64(p, m.zerocopy_copied);
+    p = put_u64(p, m.origin_trips);
+    p = put_u64(p, m.origin_fastfails);
+    return p - buf;
+}
+
+bool metrics_deserialize(const uint8_t *buf, size_t len) {
+    if (len < SERIALIZED_MIN) {
+        return false;
+    }
+    pthread_mutex_lock(&metrics_mutex);
+    global_metrics.total_connections += get_u64(buf);
+    global_metrics.bytes_transferred += get_u64(buf + 8);
+    global_metrics.server_start_time = (time_t)get_u64(buf + 16);
+    global_metrics.tfo_attempts += get_u64(buf + 24);
+    global_metrics.tfo_syn_data += get_u64(buf + 32);
+    global_metrics.listener_pauses += get_u64(buf + 40);
+    if (len >= 56) {
+        global_metrics.limit_refusals += get_u64(buf + 48);
+    }
+    if (len >= 64) {
+        global_metrics.acl_denials += get_u64(buf + 56);
+    }
+    if (len >= 80) {
+        global_metrics.zerocopy_sends += get_u64(buf + 64);
+        global_metrics.zerocopy_copied += get_u64(buf + 72);
+    }
+    if (len >= 96) {
+        global_metrics.origin_trips += get_u64(buf + 80);
+        global_metrics.origin_fastfails += get_u64(buf + 88);
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+    return true;
+}
@@ -2,13 +2,36 @@
 #define METRICS_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
+/* los buffers de túnel se cuentan por tamaño: 2 KiB, 4 KiB, ... 1 MiB */
+#define METRICS_BUFFER_MIN 2048
+#define METRICS_BUFFER_CLASSES 10
+
 struct metrics {
     uint64_t total_connections;
     uint64_t current_connections;
     uint64_t bytes_transferred;
     time_t server_start_time;
+    /* conexiones al origen con TCP Fast Open y cuántas llevaron datos en el SYN */
+    uint64_t tfo_attempts;
+    uint64_t tfo_syn_data;
+    /* veces que se pausó el listener por falta de capacidad */
+    uint64_t listener_pauses;
+    /* túneles rechazados por los límites de un usuario */
+    uint64_t limit_refusals;
+    /* destinos rechazados por las reglas de acceso */
+    uint64_t acl_denials;
+    /* envíos con MSG_ZEROCOPY y avisos del kernel de que igual copió */
+    uint64_t zerocopy_sends;
+    uint64_t zerocopy_copied;
+    /* circuitos de orígenes abiertos y CONNECT respondidos sin intentar por eso */
+    uint64_t origin_trips;
+    uint64_t origin_fastfails;
+    /* buffers de túnel vivos en cada clase de tamaño */
+    uint64_t buffer_sizes[METRICS_BUFFER_CLASSES];
 };
 
 void metrics_init(void);
@@ -21,4 +44,28 @@ void metrics_connection_closed(void);
 
 void metrics_add_bytes(uint64_t bytes);
 
+void metrics_tfo_result(bool syn_data);
+
+void metrics_listener_paused(void);
+
+void metrics_limit_refused(void);
+
+void metrics_acl_denied(void);
+
+void metrics_zerocopy_sent(void);
+
+void metrics_zerocopy_copied(void);
+
+void metrics_origin_tripped(void);
+
+void metrics_origin_fastfail(void);
+
+/* un buffer de túnel pasó de `old_size' a `new_size' bytes; 0 si no existía o dejó de existir */
+void metrics_buffer_resized(size_t old_size, size_t new_size);
+
+/* contadores acumulados para traspasarlos a otro proceso (actualización en caliente) */
+#define METRICS_SERIALIZED_SIZE 96
+size_t metrics_serialize(uint8_t *buf, size_t cap);
+bool metrics_deserialize(const uint8_t *buf, size_t len);
+
 #endif
@@ -0,0 +1,419 @@
+#include "bind.h"
+#include "socks5.h"
+#include "request.h"
+#include "../users/users.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+struct bind_listener {
+    int fd;
+    bool listening;
+    /* lo usa una sesión (acá o, si es heredado, en el proceso anterior) */
+    bool busy;
+};
+
+/*
+ * Listeners abiertos al iniciar el servidor sobre el rango de puertos
+ * configurado. Se hace el bind(2) de antemano y el listen(2) recién la
+ * primera vez que se usan; los libres se apilan para tomarlos en O(1).
+ */
+static struct bind_listener pool[BIND_POOL_MAX];
+static int pool_count = 0;
+static int free_slots[BIND_POOL_MAX];
+static int free_count = 0;
+
+static struct sockaddr_storage pool_addr;
+static socklen_t pool_addr_len = 0;
+
+/*
+ * Actualización en caliente: los listeners llegan del proceso anterior y se
+ * adoptan en lugar de volver a hacer el bind(2). Los que allá seguían en uso
+ * quedan retenidos hasta que ese proceso termina (cambia getppid()).
+ */
+static int inherited_fds[BIND_POOL_MAX];
+static bool inherited_busy[BIND_POOL_MAX];
+static int inherited_count = 0;
+static pid_t held_parent = -1;
+static int held_count = 0;
+
+/* proceso viejo tras el traspaso: los listeners ya son del proceso nuevo */
+static bool handed_over = false;
+
+static void set_port(struct sockaddr_storage *addr, uint16_t port) {
+    if (addr->ss_family == AF_INET) {
+        ((struct sockaddr_in *)addr)->sin_port = htons(port);
+    } else {
+        ((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+    }
+}
+
+static int open_listener(uint16_t port) {
+    struct sockaddr_storage addr = pool_addr;
+    set_port(&addr, port);
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+    if (addr.ss_family == AF_INET6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &(int){0}, sizeof(int));
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+    if (bind(fd, (struct sockaddr *)&addr, pool_addr_len) < 0 || selector_fd_set_nio(fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void bind_pool_inherit(const int *fds, const bool *busy, int n) {
+    inherited_count = 0;
+    for (int i = 0; i < n && i < BIND_POOL_MAX; i++) {
+        inherited_fds[inherited_count] = fds[i];
+        inherited_busy[inherited_count] = busy[i];
+        inherited_count++;
+    }
+    held_parent = getppid();
+}
+
+/* listener heredado para `port'; -1 si no vino del proceso anterior */
+static int take_inherited(uint16_t port, bool *busy) {
+    for (int i = 0; i < inherited_count; i++) {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (inherited_fds[i] < 0 || getsockname(inherited_fds[i], (struct sockaddr *)&addr, &len) < 0) {
+            continue;
+        }
+        const uint16_t p = addr.ss_family == AF_INET ? ntohs(((struct sockaddr_in *)&addr)->sin_port)
+                                                     : ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+        if (p == port) {
+            const int fd = inherited_fds[i];
+            *busy = inherited_busy[i];
+            inherited_fds[i] = -1;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+int bind_pool_init(const struct sockaddr *addr, socklen_t addr_len, uint16_t first_port, uint16_t last_port) {
+    memset(&pool_addr, 0, sizeof(pool_addr));
+    memcpy(&pool_addr, addr, addr_len);
+    pool_addr_len = addr_len;
+    pool_count = 0;
+    free_count = 0;
+    held_count = 0;
+
+    for (unsigned port = first_port; first_port != 0 && port <= last_port && pool_count < BIND_POOL_MAX; port++) {
+        bool busy = false;
+        int listening = 0;
+        int fd = take_inherited((uint16_t)port, &busy);
+        if (fd >= 0) {
+            // si ya atendió un BIND sigue escuchando y puede tener conexiones viejas
+            socklen_t len = sizeof(listening);
+            getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
+        } else {
+            fd = open_listener((uint16_t)port);
+        }
+        if (fd < 0) {
+            fprintf(stderr, "Warning: BIND port %u unavailable: %s\n", port, strerror(errno));
+            continue;
+        }
+        pool[pool_count].fd = fd;
+        pool[pool_count].listening = listening != 0;
+        pool[pool_count].busy = busy;
+        if (busy) {
+            held_count++;
+        } else {
+            free_slots[free_count++] = pool_count;
+        }
+        pool_count++;
+    }
+
+    // los de puertos que ya no están en el rango
+    for (int i = 0; i < inherited_count; i++) {
+        if (inherited_fds[i] >= 0) {
+            close(inherited_fds[i]);
+        }
+    }
+    inherited_count = 0;
+
+    return pool_count;
+}
+
+int bind_pool_export(int *fds, bool *busy, int max) {
+    int n = 0;
+    for (int i = 0; i < pool_count && n < max; i++) {
+        if (pool[i].fd >= 0) {
+            fds[n] = pool[i].fd;
+            busy[n] = pool[i].busy;
+            n++;
+        }
+    }
+    return n;
+}
+
+void bind_pool_handover(void) {
+    handed_over = true;
+    for (int i = 0; i < free_count; i++) {
+        struct bind_listener *l = &pool[free_slots[i]];
+        close(l->fd);
+        l->fd = -1;
+    }
+    free_count = 0;
+}
+
+/* el proceso anterior terminó: sus listeners retenidos pasan a estar libres */
+static void release_held(void) {
+    if (held_count == 0 || getppid() == held_parent) {
+        return;
+    }
+    for (int i = 0; i < pool_count; i++) {
+        if (pool[i].busy) {
+            pool[i].busy = false;
+            free_slots[free_count++] = i;
+        }
+    }
+    held_count = 0;
+}
+
+void bind_pool_destroy(void) {
+    for (int i = 0; i < pool_count; i++) {
+        if (pool[i].fd >= 0) {
+            close(pool[i].fd);
+            pool[i].fd = -1;
+        }
+    }
+    pool_count = 0;
+    free_count = 0;
+}
+
+/* descarta conexiones que llegaron mientras el listener estaba libre */
+static void drain_backlog(int fd) {
+    int stale;
+    while ((stale = accept(fd, NULL, NULL)) >= 0) {
+        close(stale);
+    }
+}
+
+static int listener_acquire(int *slot) {
+    *slot = -1;
+
+    if (free_count == 0) {
+        release_held();
+    }
+    if (free_count > 0) {
+        int i = free_slots[--free_count];
+        if (!pool[i].listening) {
+            if (listen(pool[i].fd, BIND_BACKLOG) < 0) {
+                free_slots[free_count++] = i;
+                return -1;
+            }
+            pool[i].listening = true;
+        } else {
+            drain_backlog(pool[i].fd);
+        }
+        pool[i].busy = true;
+        *slot = i;
+        return pool[i].fd;
+    }
+
+    // sin rango configurado (o agotado): puerto efímero
+    if (pool_addr_len == 0) {
+        return -1;
+    }
+    int fd = open_listener(0);
+    if (fd >= 0 && listen(fd, BIND_BACKLOG) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void listener_release(int fd, int slot) {
+    if (slot >= 0 && slot < pool_count && pool[slot].fd == fd) {
+        pool[slot].busy = false;
+        if (handed_over) {
+            close(fd);
+            pool[slot].fd = -1;
+        } else {
+            free_slots[free_count++] = slot;
+        }
+    } else {
+        close(fd);
+    }
+}
+
+static bool is_unspecified(const struct sockaddr_storage *addr) {
+    if (addr->ss_family == AF_INET) {
+        return ((const struct sockaddr_in *)addr)->sin_addr.s_addr == htonl(INADDR_ANY);
+    }
+    return IN6_IS_ADDR_UNSPECIFIED(&((const struct sockaddr_in6 *)addr)->sin6_addr);
+}
+
+uint8_t bind_open(struct selector_key *key, struct request_parser *parser) {
+    struct socks5 *data = ATTACHMENT(key);
+
+    int slot;
+    int fd = listener_acquire(&slot);
+    if (fd < 0) {
+        return REQUEST_REPLY_FAILURE;
+    }
+
+    if (register_bind_selector(key->s, fd, data) != SELECTOR_SUCCESS) {
+        listener_release(fd, slot);
+        return REQUEST_REPLY_FAILURE;
+    }
+    data->bind.listen_fd = fd;
+    data->bind.slot = slot;
+
+    // BND.ADDR: si el listener escucha en todas las interfaces informamos la
+    // IP por la que nos contactó el cliente
+    socklen_t len = sizeof(data->bind.bound);
+    getsockname(fd, (struct sockaddr *)&data->bind.bound, &len);
+    if (is_unspecified(&data->bind.bound)) {
+        struct sockaddr_storage local;
+        socklen_t local_len = sizeof(local);
+        if (getsockname(data->client_fd, (struct sockaddr *)&local, &local_len) == 0 &&
+            local.ss_family == data->bind.bound.ss_family) {
+            uint16_t port = data->bind.bound.ss_family == AF_INET
+                ? ntohs(((struct sockaddr_in *)&data->bind.bound)->sin_port)
+                : ntohs(((struct sockaddr_in6 *)&data->bind.bound)->sin6_port);
+            data->bind.bound = local;
+            set_port(&data->bind.bound, port);
+        }
+    }
+
+    // DST.ADDR indica de quién se espera la conexión. Un FQDN no se resuelve:
+    // en ese caso se acepta la primera conexión entrante.
+    memset(&data->bind.expected, 0, sizeof(data->bind.expected));
+    if (parser->address_type == ADDRESS_TYPE_IPV4) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&data->bind.expected;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, parser->dst_addr, IPV4_LENGTH);
+    } else if (parser->address_type == ADDRESS_TYPE_IPV6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&data->bind.expected;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, parser->dst_addr, IPV6_LENGTH);
+    }
+
+    return REQUEST_REPLY_SUCCESS;
+}
+
+void bind_close(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    if (data->bind.listen_fd >= 0) {
+        selector_unregister_fd(key->s, data->bind.listen_fd);
+        listener_release(data->bind.listen_fd, data->bind.slot);
+        data->bind.listen_fd = -1;
+    }
+}
+
+static bool peer_allowed(const struct sockaddr_storage *expected, const struct sockaddr_storage *peer) {
+    if (expected->ss_family == AF_UNSPEC || is_unspecified(expected)) {
+        return true;
+    }
+
+    const uint8_t *want;
+    size_t want_len;
+    if (expected->ss_family == AF_INET) {
+        want = (const uint8_t *)&((const struct sockaddr_in *)expected)->sin_addr;
+        want_len = IPV4_LENGTH;
+    } else {
+        want = ((const struct sockaddr_in6 *)expected)->sin6_addr.s6_addr;
+        want_len = IPV6_LENGTH;
+    }
+
+    if (peer->ss_family == AF_INET) {
+        return want_len == IPV4_LENGTH &&
+               memcmp(want, &((const struct sockaddr_in *)peer)->sin_addr, IPV4_LENGTH) == 0;
+    }
+    const struct in6_addr *p6 = &((const struct sockaddr_in6 *)peer)->sin6_addr;
+    if (want_len == IPV4_LENGTH) {
+        return IN6_IS_ADDR_V4MAPPED(p6) && memcmp(want, p6->s6_addr + 12, IPV4_LENGTH) == 0;
+    }
+    return memcmp(want, p6->s6_addr, IPV6_LENGTH) == 0;
+}
+
+void bind_accept_init(const unsigned state, struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    if (selector_set_interest(key->s, data->bind.listen_fd, OP_READ) != SELECTOR_SUCCESS ||
+        selector_set_interest(key->s, data->client_fd, OP_READ) != SELECTOR_SUCCESS) {
+        close_connection(key);
+    }
+}
+
+static unsigned client_read(struct selector_key *key, struct socks5 *data) {
+    // lo que envíe el cliente antes de la conexión se entrega luego al par
+    if (!buffer_can_write(&data->origin_buffer)) {
+        selector_set_interest(key->s, data->client_fd, OP_NOOP);
+        return BIND_ACCEPT;
+    }
+
+    size_t limit;
+    uint8_t *ptr = buffer_write_ptr(&data->origin_buffer, &limit);
+    ssize_t n = recv(key->fd, ptr, limit, 0);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? BIND_ACCEPT : ERROR;
+    }
+    if (n == 0) {
+        return DONE;
+    }
+    buffer_write_adv(&data->origin_buffer, n);
+    return BIND_ACCEPT;
+}
+
+unsigned bind_accept_read(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+
+    if (key->fd == data->client_fd) {
+        return client_read(key, data);
+    }
+
+    struct sockaddr_storage peer;
+    socklen_t peer_len = sizeof(peer);
+    int fd = accept(key->fd, (struct sockaddr *)&peer, &peer_len);
+    if (fd < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) ? BIND_ACCEPT : ERROR;
+    }
+
+    if (!peer_allowed(&data->bind.expected, &peer)) {
+        close(fd);
+        return BIND_ACCEPT;
+    }
+
+    if (selector_fd_set_nio(fd) == -1 || register_origin_selector(key, fd, data) != SELECTOR_SUCCESS) {
+        close(fd);
+        return ERROR;
+    }
+    data->origin_fd = fd;
+    sockopt_apply(fd, data->sockopt);
+
+    bind_close(key);
+
+    // segunda respuesta: dirección del par que se conectó. Viaja por el
+    // buffer hacia el cliente, así la envía el propio relay.
+    buffer_reset(&data->client_buffer);
+    if (!request_build_bound_response(&data->client_buffer, REQUEST_REPLY_SUCCESS, (struct sockaddr *)&peer)) {
+        return ERROR;
+    }
+
+    char dest[INET6_ADDRSTRLEN];
+    uint16_t port;
+    if (peer.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in *)&peer)->sin_addr, dest, sizeof(dest));
+        port = ntohs(((struct sockaddr_in *)&peer)->sin_port);
+    } else {
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&peer)->sin6_addr, dest, sizeof(dest));
+        port = ntohs(((struct sockaddr_in6 *)&peer)->sin6_port);
+    }
+    user_log_connection(data->auth.username, dest, port);
+
+    return COPY;
+}
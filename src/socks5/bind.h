@@ -0,0 +1,34 @@
+#ifndef BIND_H
+#define BIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include "../utils/selector.h"
+
+#define BIND_POOL_MAX 128
+#define BIND_BACKLOG 4
+
+struct request_parser;
+
+int bind_pool_init(const struct sockaddr *addr, socklen_t addr_len, uint16_t first_port, uint16_t last_port);
+void bind_pool_destroy(void);
+
+/*
+ * Actualización en caliente. El proceso viejo exporta los listeners del pool
+ * (`busy' si los usa una sesión) y, cuando el nuevo confirma, cierra los
+ * libres con bind_pool_handover; los ocupados se cierran al terminar su
+ * sesión. El proceso nuevo los recibe con bind_pool_inherit antes de
+ * bind_pool_init, que los adopta en lugar de abrir esos puertos.
+ */
+int bind_pool_export(int *fds, bool *busy, int max);
+void bind_pool_handover(void);
+void bind_pool_inherit(const int *fds, const bool *busy, int n);
+
+uint8_t bind_open(struct selector_key *key, struct request_parser *parser);
+void bind_close(struct selector_key *key);
+
+void bind_accept_init(const unsigned state, struct selector_key *key);
+unsigned bind_accept_read(struct selector_key *key);
+
+#endif
@@ -1,166 +1,512 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
 #include "copy.h"
 #include "socks5.h"
+#include "request.h"
 #include "../metrics/metrics.h"
 #include "../users/users.h"
+#include "../dissectors/pop3.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <string.h>
+#include <time.h>
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
-void copy_init(unsigned int state, struct selector_key *key) {
-    struct socks5 *data = ATTACHMENT(key);
-    
-    if (selector_set_interest(key->s, data->client_fd, OP_READ) != SELECTOR_SUCCESS) {
-        close_connection(key);
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAVE_ZEROCOPY 1
+#else
+#define HAVE_ZEROCOPY 0
+#undef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+
+/*
+ * Cada sentido avanza por su cuenta: el interés de un fd se arma con lo que
+ * pide cada sentido que lo usa (leer si su buffer de entrada tiene lugar,
+ * escribir si su buffer de salida tiene datos), así un sentido lleno no le
+ * quita la lectura al otro ni queda esperando una lectura que no puede hacer.
+ *
+ * El EOF de un lado no cierra el túnel: cuando el buffer de ese sentido se
+ * vacía se hace shutdown(SHUT_WR) del otro lado y el sentido contrario sigue
+ * hasta terminar también. Mientras tanto la sesión se cierra si pasan
+ * COPY_LINGER_SECONDS sin actividad.
+ *
+ * Los buffers arrancan en BUFFER_SIZE, dentro de la sesión. Si un sentido
+ * llena su buffer vacío de una sola lectura COPY_GROW_FILLS veces seguidas
+ * (el límite es el tamaño de cada syscall y no el destino) se duplica,
+ * hasta el máximo configurado; tras COPY_SHRINK_SECONDS sin tráfico y
+ * vacío vuelve al tamaño inicial. Así una descarga masiva mueve bloques
+ * grandes y las sesiones interactivas ocupan poca memoria.
+ *
+ * Las sesiones a medio cerrar o con buffers agrandados están en una lista que
+ * copy_sweep recorre una vez por segundo.
+ *
+ * Con copy_set_zerocopy, los envíos de al menos ese tamaño desde un buffer
+ * circular usan MSG_ZEROCOPY: el kernel manda directo desde las páginas del
+ * buffer, así que esos bytes quedan retenidos (zc_held) hasta que la cola de
+ * errores del destino confirme el envío. Solo los buffers circulares: sus
+ * páginas siguen vivas aunque se achique o libere el buffer mientras el
+ * kernel las usa, lo que no pasa con el almacenamiento de la sesión o del
+ * heap. Si el kernel avisa que igual tuvo que copiar (loopback, placas sin
+ * scatter-gather) el sentido vuelve a send() común.
+ */
+
+static struct socks5 *swept = NULL;
+static time_t last_sweep = 0;
+static size_t max_buffer = COPY_MAX_BUFFER;
+static size_t zerocopy_min = 0;
+
+void copy_set_max_buffer(size_t bytes) {
+    max_buffer = bytes < BUFFER_SIZE ? BUFFER_SIZE : bytes;
+}
+
+bool copy_set_zerocopy(size_t min_bytes) {
+    zerocopy_min = HAVE_ZEROCOPY ? min_bytes : 0;
+    return HAVE_ZEROCOPY || min_bytes == 0;
+}
+
+static void
+sweep_add(struct socks5 *data) {
+    if (data->swept) {
         return;
     }
-    
-    if (selector_set_interest(key->s, data->origin_fd, OP_READ) != SELECTOR_SUCCESS) {
-        close_connection(key);
+    data->swept = true;
+    data->sweep_prev = NULL;
+    data->sweep_next = swept;
+    if (swept != NULL) {
+        swept->sweep_prev = data;
+    }
+    swept = data;
+}
+
+static void
+sweep_remove(struct socks5 *data) {
+    if (!data->swept) {
         return;
     }
+    data->swept = false;
+    if (data->sweep_prev != NULL) {
+        data->sweep_prev->sweep_next = data->sweep_next;
+    } else {
+        swept = data->sweep_next;
+    }
+    if (data->sweep_next != NULL) {
+        data->sweep_next->sweep_prev = data->sweep_prev;
+    }
 }
 
-unsigned copy_read(struct selector_key *key) {
-    struct socks5 *data = ATTACHMENT(key);
-    
-    if (key->fd == data->client_fd) {
-        size_t read_limit;
-        
-        if (!buffer_can_write(&data->origin_buffer)) {
-            return COPY;
+static void
+linger_start(struct socks5 *data) {
+    data->lingering = true;
+    data->linger_deadline = time(NULL) + COPY_LINGER_SECONDS;
+    sweep_add(data);
+}
+
+/*
+ * Cambia el buffer del sentido a `size' bytes; false si no hay memoria. Los
+ * agrandados son circulares (sin compactar ni recv cortos cuando el destino
+ * dejó datos a medio enviar) y, si no se pueden mapear, lineales en el heap.
+ */
+static bool
+flow_resize(struct copy_flow *f, size_t size, uint8_t *inline_data) {
+    uint8_t *heap = NULL;
+    if (size <= BUFFER_SIZE) {
+        buffer_rebase(f->buf, size, inline_data);
+    } else if (buffer_ring_rebase(f->buf, size) != 0) {
+        heap = malloc(size);
+        if (heap == NULL) {
+            return false;
         }
-        
-        uint8_t *read_buffer = buffer_write_ptr(&data->origin_buffer, &read_limit);
-        ssize_t read_count = recv(key->fd, read_buffer, read_limit, 0);
-        
-        if (read_count < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return COPY;  
-            }
-            return ERROR;
-        } else if (read_count == 0) {
-            return DONE;
+        buffer_rebase(f->buf, size, heap);
+    }
+    free(f->heap);
+    f->heap = heap;
+    metrics_buffer_resized(f->size, size);
+    f->size = size;
+    return true;
+}
+
+static uint8_t *
+flow_inline_data(struct socks5 *data, const struct copy_flow *f) {
+    return f->buf == &data->origin_buffer ? data->origin_buffer_data : data->client_buffer_data;
+}
+
+void copy_release(struct socks5 *data) {
+    sweep_remove(data);
+    for (int i = 0; i < 2; i++) {
+        struct copy_flow *f = &data->flows[i];
+        if (f->size > 0) {
+            metrics_buffer_resized(f->size, 0);
+            f->size = 0;
+            buffer_ring_free(f->buf);
         }
-        
-        buffer_write_adv(&data->origin_buffer, read_count);
-        metrics_add_bytes(read_count);
-        user_update_metrics(data->auth.username, (uint64_t)read_count);
-        
-        size_t write_limit;
-        uint8_t *write_buffer = buffer_read_ptr(&data->origin_buffer, &write_limit);
-        ssize_t write_count = send(data->origin_fd, write_buffer, write_limit, MSG_NOSIGNAL);
-        
-        if (write_count > 0) {
-            buffer_read_adv(&data->origin_buffer, write_count);
+        free(f->heap);
+        f->heap = NULL;
+    }
+}
+
+void copy_sweep(void) {
+    const time_t now = time(NULL);
+    if (swept == NULL || now == last_sweep) {
+        return;
+    }
+    last_sweep = now;
+
+    struct socks5 *next;
+    for (struct socks5 *data = swept; data != NULL; data = next) {
+        next = data->sweep_next;
+        if (data->lingering && now >= data->linger_deadline) {
+            struct selector_key key = {
+                .s = data->selector,
+                .fd = data->client_fd,
+                .data = data,
+            };
+            close_connection(&key);
+            continue;
         }
-        
-        if (buffer_can_read(&data->origin_buffer) || (write_count < 0 && errno == EWOULDBLOCK)) {
-            if (selector_set_interest(key->s, data->origin_fd, OP_WRITE) != SELECTOR_SUCCESS) {
-                return ERROR;
+
+        bool grown = false;
+        for (int i = 0; i < 2; i++) {
+            struct copy_flow *f = &data->flows[i];
+            if (f->size > BUFFER_SIZE && !buffer_can_read(f->buf) && now - f->last_active >= COPY_SHRINK_SECONDS) {
+                flow_resize(f, BUFFER_SIZE, flow_inline_data(data, f));
+                f->fills = 0;
             }
+            grown |= f->size > BUFFER_SIZE;
         }
-        
-        return COPY;
-        
-    } else if (key->fd == data->origin_fd) {
-        size_t read_limit;
-        
-        if (!buffer_can_write(&data->client_buffer)) {
-            return COPY;
+        if (!grown && !data->lingering) {
+            sweep_remove(data);
         }
-        
-        uint8_t *read_buffer = buffer_write_ptr(&data->client_buffer, &read_limit);
-        ssize_t read_count = recv(key->fd, read_buffer, read_limit, 0);
-        
-        if (read_count < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return COPY;  
-            }
-            return ERROR;
-        } else if (read_count == 0) {
-            return DONE;
+    }
+}
+
+/* registra una lectura de `n' bytes sobre `avail' libres y agranda si corresponde */
+static void
+flow_account(struct socks5 *data, struct copy_flow *f, size_t avail, size_t n) {
+    if (f->size > BUFFER_SIZE) {
+        f->last_active = time(NULL);
+    }
+    if (avail != f->size || n < avail) {
+        f->fills = 0;
+        return;
+    }
+    if (++f->fills < COPY_GROW_FILLS || f->size >= max_buffer) {
+        return;
+    }
+    f->fills = 0;
+    if (flow_resize(f, f->size * 2, NULL)) {
+        f->last_active = time(NULL);
+        sweep_add(data);
+    }
+}
+
+/* bytes de `buf' que todavía no se enviaron */
+static size_t
+flow_unsent(const struct copy_flow *f) {
+    size_t n;
+    buffer_read_ptr(f->buf, &n);
+    return n - f->zc_held;
+}
+
+static fd_interest
+flow_interest(const struct socks5 *data, int fd) {
+    fd_interest ret = OP_NOOP;
+    for (int i = 0; i < 2; i++) {
+        const struct copy_flow *f = &data->flows[i];
+        if (f->src == fd && !f->eof && buffer_can_write(f->buf)) {
+            ret |= OP_READ;
         }
-        
-        buffer_write_adv(&data->client_buffer, read_count);
-        metrics_add_bytes(read_count);
-        user_update_metrics(data->auth.username, (uint64_t)read_count);
-        
-        size_t write_limit;
-        uint8_t *write_buffer = buffer_read_ptr(&data->client_buffer, &write_limit);
-        ssize_t write_count = send(data->client_fd, write_buffer, write_limit, MSG_NOSIGNAL);
-        
-        if (write_count > 0) {
-            buffer_read_adv(&data->client_buffer, write_count);
+        if (f->dst == fd && flow_unsent(f) > 0 && f->zc_count < COPY_ZC_SENDS) {
+            ret |= OP_WRITE;
         }
-        
-        if (buffer_can_read(&data->client_buffer) || (write_count < 0 && errno == EWOULDBLOCK)) {
-            if (selector_set_interest(key->s, data->client_fd, OP_WRITE) != SELECTOR_SUCCESS) {
-                return ERROR;
-            }
+        if (f->dst == fd && f->zc_count > 0) {
+            ret |= OP_ERROR;
         }
-        
-        return COPY;
     }
-    
-    return ERROR;
+    return ret;
 }
 
-unsigned copy_write(struct selector_key *key) {
+static unsigned
+update_interests(struct selector_key *key) {
     struct socks5 *data = ATTACHMENT(key);
-    
-    if (key->fd == data->client_fd) {
-        size_t write_limit;
-        
-        if (!buffer_can_read(&data->client_buffer)) {
-            return COPY;
-        }
-        
-        uint8_t *write_buffer = buffer_read_ptr(&data->client_buffer, &write_limit);
-        ssize_t write_count = send(key->fd, write_buffer, write_limit, MSG_NOSIGNAL);
-        
-        if (write_count <= 0) {
+    if (selector_set_interest(key->s, data->client_fd, flow_interest(data, data->client_fd)) != SELECTOR_SUCCESS
+        || selector_set_interest(key->s, data->origin_fd, flow_interest(data, data->origin_fd)) != SELECTOR_SUCCESS) {
+        return ERROR;
+    }
+    return COPY;
+}
+
+/*
+ * Si el sentido terminó y no le quedan datos se le avisa al destino. COPY
+ * sigue mientras el otro sentido no haya terminado, DONE si ya lo hizo.
+ */
+static unsigned
+flow_check_done(struct selector_key *key, struct copy_flow *f) {
+    struct socks5 *data = ATTACHMENT(key);
+    if (f->eof && !f->shut && !buffer_can_read(f->buf)) {
+        f->shut = true;
+        if (shutdown(f->dst, SHUT_WR) < 0 && errno != ENOTCONN) {
             return ERROR;
         }
-        
-        buffer_read_adv(&data->client_buffer, write_count);
-        
-        if (!buffer_can_read(&data->client_buffer)) {
-            if (selector_set_interest(key->s, data->client_fd, OP_READ) != SELECTOR_SUCCESS) {
-                return ERROR;
+    }
+    if (data->flows[0].shut && data->flows[1].shut) {
+        return DONE;
+    }
+    if (f->eof) {
+        linger_start(data);
+    }
+    return update_interests(key);
+}
+
+/* consume del principio de `buf' los envíos ya confirmados */
+static void
+zc_release(struct copy_flow *f) {
+    while (f->zc_count > 0 && f->zc[f->zc_head].done) {
+        const uint32_t len = f->zc[f->zc_head].len;
+        f->zc_held -= len;
+        buffer_read_adv(f->buf, len);
+        f->zc_head = (f->zc_head + 1) % COPY_ZC_SENDS;
+        f->zc_count--;
+    }
+}
+
+/*
+ * Anota `len' bytes recién enviados. Los copiados también esperan en la cola
+ * si hay envíos sin confirmar antes que ellos: el buffer se consume en orden.
+ */
+static void
+zc_push(struct copy_flow *f, size_t len, bool zerocopy) {
+    const unsigned i = (f->zc_head + f->zc_count) % COPY_ZC_SENDS;
+    f->zc[i].len = (uint32_t)len;
+    f->zc[i].seq = f->zc_seq;
+    f->zc[i].done = !zerocopy;
+    f->zc_count++;
+    f->zc_held += len;
+    if (zerocopy) {
+        f->zc_seq++;
+    }
+}
+
+/* -1 si el destino falló; que no haya lugar en el socket no es error */
+static int
+flow_send(struct copy_flow *f) {
+    size_t write_limit;
+    uint8_t *write_buffer = buffer_read_ptr(f->buf, &write_limit);
+    write_buffer += f->zc_held;
+    write_limit -= f->zc_held;
+    if (write_limit == 0 || f->zc_count == COPY_ZC_SENDS) {
+        return 0;
+    }
+
+    bool zerocopy = f->zerocopy && f->buf->ring != 0 && write_limit >= zerocopy_min;
+    ssize_t write_count = send(f->dst, write_buffer, write_limit, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+    if (write_count < 0 && zerocopy && errno == ENOBUFS) {
+        // no hay memoria para fijar más páginas: este envío se copia
+        zerocopy = false;
+        write_count = send(f->dst, write_buffer, write_limit, MSG_NOSIGNAL);
+    }
+
+    if (write_count < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (zerocopy) {
+        metrics_zerocopy_sent();
+    }
+    if (zerocopy || f->zc_count > 0) {
+        zc_push(f, (size_t)write_count, zerocopy);
+    } else {
+        buffer_read_adv(f->buf, write_count);
+    }
+    return 0;
+}
+
+#if HAVE_ZEROCOPY
+/* marca como confirmados los envíos [lo, hi] */
+static void
+zc_complete(struct copy_flow *f, uint32_t lo, uint32_t hi, bool copied) {
+    for (unsigned k = 0; k < f->zc_count; k++) {
+        const unsigned i = (f->zc_head + k) % COPY_ZC_SENDS;
+        if (!f->zc[i].done && (uint32_t)(f->zc[i].seq - lo) <= (uint32_t)(hi - lo)) {
+            f->zc[i].done = true;
+        }
+    }
+    if (copied) {
+        metrics_zerocopy_copied();
+        f->zerocopy = false;
+    }
+}
+
+/* lee los avisos de la cola de errores de `dst'; -1 si el socket falló */
+static int
+flow_reap(struct copy_flow *f) {
+    bool any = false;
+    for (;;) {
+        uint8_t control[128];
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        if (recvmsg(f->dst, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
             }
+            break;
         }
-        
-        return COPY;
-        
-    } else if (key->fd == data->origin_fd) {
-        size_t write_limit;
-        
-        if (!buffer_can_read(&data->origin_buffer)) {
-            return COPY;
+        any = true;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            const struct sock_extended_err *ee = (const struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                zc_complete(f, ee->ee_info, ee->ee_data, ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+            }
         }
-        
-        uint8_t *write_buffer = buffer_read_ptr(&data->origin_buffer, &write_limit);
-        ssize_t write_count = send(key->fd, write_buffer, write_limit, MSG_NOSIGNAL);
-        
-        if (write_count <= 0) {
-            return ERROR;
+    }
+    zc_release(f);
+
+    // sin avisos, POLLERR viene de un error del socket y no de la cola
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (!any && (getsockopt(f->dst, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)) {
+        if (err != 0) {
+            errno = err;
         }
-        
-        buffer_read_adv(&data->origin_buffer, write_count);
-        
-        if (!buffer_can_read(&data->origin_buffer)) {
-            if (selector_set_interest(key->s, data->origin_fd, OP_READ) != SELECTOR_SUCCESS) {
-                return ERROR;
-            }
+        return -1;
+    }
+    return 0;
+}
+#else
+static int
+flow_reap(struct copy_flow *f) {
+    (void)f;
+    return 0;
+}
+#endif
+
+/* el primer resultado de un origen conectado con Fast Open, ver request_origin_confirm */
+static void
+origin_result(struct socks5 *data, int fd, int error) {
+    if (fd == data->origin_fd) {
+        request_origin_confirm(data, error);
+    }
+}
+
+void copy_init(unsigned int state, struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+
+    data->flows[0] = (struct copy_flow){
+        .src = data->client_fd, .dst = data->origin_fd, .buf = &data->origin_buffer, .upstream = true,
+    };
+    data->flows[1] = (struct copy_flow){
+        .src = data->origin_fd, .dst = data->client_fd, .buf = &data->client_buffer, .upstream = false,
+    };
+    for (int i = 0; i < 2; i++) {
+        data->flows[i].size = BUFFER_SIZE;
+        metrics_buffer_resized(0, BUFFER_SIZE);
+#if HAVE_ZEROCOPY
+        const int one = 1;
+        data->flows[i].zerocopy = zerocopy_min > 0
+            && setsockopt(data->flows[i].dst, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+    }
+
+    // puede haber datos pendientes de una etapa previa (ej: la segunda
+    // respuesta de BIND)
+    if (update_interests(key) != COPY) {
+        close_connection(key);
+    }
+}
+
+unsigned copy_read(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    struct copy_flow *f = key->fd == data->flows[0].src ? &data->flows[0]
+                        : key->fd == data->flows[1].src ? &data->flows[1] : NULL;
+    if (f == NULL) {
+        return ERROR;
+    }
+    if (!buffer_can_write(f->buf)) {
+        return update_interests(key);
+    }
+
+    size_t read_limit;
+    uint8_t *read_buffer = buffer_write_ptr(f->buf, &read_limit);
+    ssize_t read_count = recv(key->fd, read_buffer, read_limit, 0);
+
+    if (read_count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return COPY;
         }
-        
-        return COPY;
+        origin_result(data, key->fd, errno);
+        return ERROR;
+    }
+    origin_result(data, key->fd, 0);
+    if (read_count == 0) {
+        f->eof = true;
+        return flow_check_done(key, f);
+    }
+
+    if (f->upstream && data->pop3 != NULL && !pop3_sniffer_feed(data->pop3, read_buffer, read_count)) {
+        pop3_sniffer_free(data->pop3);
+        data->pop3 = NULL;
+    }
+
+    buffer_write_adv(f->buf, read_count);
+    metrics_add_bytes(read_count);
+    user_update_metrics(data->auth.username, (uint64_t)read_count);
+    flow_account(data, f, read_limit, (size_t)read_count);
+
+    // se intenta escribir enseguida: casi siempre hay lugar y se ahorra una
+    // vuelta del selector
+    if (flow_send(f) < 0) {
+        origin_result(data, f->dst, errno);
+        return ERROR;
+    }
+    if (data->lingering) {
+        linger_start(data);
+    }
+    return update_interests(key);
+}
+
+unsigned copy_write(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    struct copy_flow *f = key->fd == data->flows[0].dst ? &data->flows[0]
+                        : key->fd == data->flows[1].dst ? &data->flows[1] : NULL;
+    if (f == NULL) {
+        return ERROR;
+    }
+
+    if (flow_unsent(f) > 0 && flow_send(f) < 0) {
+        origin_result(data, f->dst, errno);
+        return ERROR;
+    }
+    if (data->lingering) {
+        linger_start(data);
+    }
+    return flow_check_done(key, f);
+}
+
+unsigned copy_error(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    struct copy_flow *f = key->fd == data->flows[0].dst ? &data->flows[0]
+                        : key->fd == data->flows[1].dst ? &data->flows[1] : NULL;
+    if (f == NULL) {
+        return ERROR;
+    }
+
+    // lo confirmado libera lugar para leer y para más envíos
+    if (flow_reap(f) < 0 || flow_send(f) < 0) {
+        origin_result(data, f->dst, errno);
+        return ERROR;
     }
-    
-    return ERROR;
+    return flow_check_done(key, f);
 }
@@ -1,10 +1,37 @@
 #ifndef COPY_H
 #define COPY_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "../utils/selector.h"
 
+/* segundos sin actividad que se espera al otro sentido tras un half-close */
+#define COPY_LINGER_SECONDS 60
+/* tamaño máximo por defecto del buffer de un sentido */
+#define COPY_MAX_BUFFER (256 * 1024)
+/* lecturas seguidas que llenan el buffer vacío antes de duplicarlo */
+#define COPY_GROW_FILLS 2
+/* segundos sin tráfico tras los que un buffer agrandado vuelve al inicial */
+#define COPY_SHRINK_SECONDS 10
+
+struct socks5;
+
 void copy_init(unsigned int state, struct selector_key *key);
 unsigned copy_read(struct selector_key *key);
 unsigned copy_write(struct selector_key *key);
+/* confirmaciones de MSG_ZEROCOPY en la cola de errores del destino */
+unsigned copy_error(struct selector_key *key);
+
+/* tope para el crecimiento de los buffers (potencia de dos) */
+void copy_set_max_buffer(size_t bytes);
+/* envíos de al menos `min_bytes' con MSG_ZEROCOPY (0 los deshabilita);
+ * false si el sistema no lo soporta */
+bool copy_set_zerocopy(size_t min_bytes);
+/* cierra las sesiones a medio cerrar cuyo plazo venció y achica los buffers
+ * inactivos; llamar en cada vuelta */
+void copy_sweep(void);
+/* libera lo que COPY tenga asociado a la sesión antes de liberarla */
+void copy_release(struct socks5 *data);
 
 #endif
@@ -0,0 +1,157 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include "egress.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+struct egress_source {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    uint64_t active;
+    uint64_t connects;
+    uint64_t exhausted;
+    time_t dry_until;
+};
+
+static struct egress_source sources[EGRESS_MAX_SOURCES];
+static int source_count = 0;
+static enum egress_mode balance = EGRESS_ROUND_ROBIN;
+static unsigned next_source = 0;
+
+static bool
+parse_source(const char *s, struct egress_source *src) {
+    memset(src, 0, sizeof(*src));
+    struct sockaddr_in *sin = (struct sockaddr_in *)&src->addr;
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&src->addr;
+    if (inet_pton(AF_INET, s, &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        src->len = sizeof(*sin);
+        return true;
+    }
+    if (inet_pton(AF_INET6, s, &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        src->len = sizeof(*sin6);
+        return true;
+    }
+    return false;
+}
+
+int egress_init(char **addrs, int n, enum egress_mode mode, char *err, size_t err_len) {
+    source_count = 0;
+    next_source = 0;
+    balance = mode;
+    for (int i = 0; i < n; i++) {
+        if (source_count >= EGRESS_MAX_SOURCES || !parse_source(addrs[i], &sources[source_count])) {
+            snprintf(err, err_len, "invalid egress address: %s", addrs[i]);
+            return -1;
+        }
+        // se prueba el bind para avisar ahora si la dirección no es local
+        const int fd = socket(sources[source_count].addr.ss_family, SOCK_STREAM, 0);
+        if (fd < 0 || egress_bind(fd, source_count) < 0) {
+            snprintf(err, err_len, "egress address %s is not usable: %s", addrs[i], strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        close(fd);
+        source_count++;
+    }
+    return 0;
+}
+
+int egress_sources(int family) {
+    int n = 0;
+    for (int i = 0; i < source_count; i++) {
+        n += sources[i].addr.ss_family == family;
+    }
+    return n;
+}
+
+/* FNV-1a de la IP del cliente, sin el puerto */
+static uint32_t
+client_hash(const struct sockaddr *client) {
+    const uint8_t *p = NULL;
+    size_t len = 0;
+    if (client != NULL && client->sa_family == AF_INET) {
+        p = (const uint8_t *)&((const struct sockaddr_in *)client)->sin_addr;
+        len = 4;
+    } else if (client != NULL && client->sa_family == AF_INET6) {
+        p = (const uint8_t *)&((const struct sockaddr_in6 *)client)->sin6_addr;
+        len = 16;
+    }
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+int egress_pick(int family, const struct sockaddr *client) {
+    if (source_count == 0) {
+        return -1;
+    }
+    const unsigned start = balance == EGRESS_HASH ? client_hash(client) % (unsigned)source_count
+                                                  : next_source % (unsigned)source_count;
+    const time_t now = time(NULL);
+    int fallback = -1;
+    for (int k = 0; k < source_count; k++) {
+        const int i = (int)((start + (unsigned)k) % (unsigned)source_count);
+        if (sources[i].addr.ss_family != family) {
+            continue;
+        }
+        if (now >= sources[i].dry_until) {
+            // la rueda sigue desde la elegida, así no se le da doble turno a
+            // la que viene después de una de otra familia
+            next_source = (unsigned)i + 1;
+            return i;
+        }
+        if (fallback < 0) {
+            fallback = i;
+        }
+    }
+    // todas sin puertos hace poco: se intenta igual con la que tocaba
+    return fallback;
+}
+
+int egress_bind(int fd, int source) {
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &(int){1}, sizeof(int));
+#endif
+    return bind(fd, (const struct sockaddr *)&sources[source].addr, sources[source].len);
+}
+
+void egress_exhausted(int source) {
+    sources[source].exhausted++;
+    sources[source].dry_until = time(NULL) + EGRESS_DRY_SECONDS;
+}
+
+void egress_acquire(int source) {
+    sources[source].active++;
+    sources[source].connects++;
+}
+
+void egress_release(int source) {
+    if (sources[source].active > 0) {
+        sources[source].active--;
+    }
+}
+
+size_t egress_list(struct egress_info *out, size_t max) {
+    const time_t now = time(NULL);
+    size_t n = 0;
+    for (int i = 0; i < source_count && n < max; i++, n++) {
+        out[n].addr = sources[i].addr;
+        out[n].active = sources[i].active;
+        out[n].connects = sources[i].connects;
+        out[n].exhausted = sources[i].exhausted;
+        out[n].dry = now < sources[i].dry_until;
+    }
+    return n;
+}
@@ -0,0 +1,70 @@
+#ifndef EGRESS_H
+#define EGRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define EGRESS_MAX_SOURCES 16
+/* segundos que se deja de elegir una dirección que se quedó sin puertos */
+#define EGRESS_DRY_SECONDS 1
+
+/*
+ * Direcciones de origen para las conexiones a los destinos. Cada una tiene
+ * su propio rango de puertos efímeros por destino, así que con varias se
+ * supera el límite de conexiones simultáneas a un mismo IP:puerto.
+ */
+enum egress_mode {
+    /* una dirección por conexión, en rueda */
+    EGRESS_ROUND_ROBIN,
+    /* la misma dirección para cada cliente, según su IP */
+    EGRESS_HASH,
+};
+
+struct egress_info {
+    struct sockaddr_storage addr;
+    /* conexiones abiertas desde la dirección y todas las que se iniciaron */
+    uint64_t active;
+    uint64_t connects;
+    /* veces que el kernel no encontró un puerto libre (EADDRNOTAVAIL) */
+    uint64_t exhausted;
+    /* se está salteando por haberse quedado sin puertos */
+    bool dry;
+};
+
+/*
+ * Direcciones IPv4 o IPv6 literales, que tienen que ser locales. Sin
+ * ninguna las conexiones salen por la dirección que elija el sistema. -1 si
+ * alguna es inválida, con el motivo en `err'.
+ */
+int egress_init(char **addrs, int n, enum egress_mode mode, char *err, size_t err_len);
+
+/* direcciones configuradas de la familia `family' */
+int egress_sources(int family);
+
+/*
+ * Dirección para una conexión de la familia `family' desde `client',
+ * salteando las que se quedaron sin puertos mientras haya otra. -1 si no hay
+ * ninguna de esa familia.
+ */
+int egress_pick(int family, const struct sockaddr *client);
+
+/*
+ * Asigna la dirección `source' a `fd' antes del connect. Con
+ * IP_BIND_ADDRESS_NO_PORT el puerto se elige recién en el connect, por
+ * destino, en lugar de reservar uno para cualquier destino en el bind.
+ */
+int egress_bind(int fd, int source);
+
+/* el connect desde `source' falló por falta de puertos: se saltea un rato */
+void egress_exhausted(int source);
+
+/* una conexión desde `source' quedó abierta o en curso, y cuando se cierra */
+void egress_acquire(int source);
+void egress_release(int source);
+
+/* direcciones configuradas con su uso; devuelve cuántas llenó */
+size_t egress_list(struct egress_info *out, size_t max);
+
+#endif
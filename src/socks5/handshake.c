@@ -1,65 +1,66 @@
 #include "handshake.h"
 #include "socks5.h"
+#include "../utils/wire_parser.h"
 #include <string.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <stdio.h>
+#include <errno.h>
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+static unsigned hello_check_version(void *dst) {
+    return ((struct hello_parser *)dst)->version == 0x05 ? HELLO_NMETHODS : HELLO_ERROR;
+}
+
+static unsigned hello_check_nmethods(void *dst) {
+    return ((struct hello_parser *)dst)->nmethods != 0 ? HELLO_METHODS : HELLO_ERROR;
+}
+
+static const struct wire_step hello_steps[] = {
+    [HELLO_VERSION] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct hello_parser, version),
+        .check = hello_check_version,
+    },
+    [HELLO_NMETHODS] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct hello_parser, nmethods),
+        .check = hello_check_nmethods,
+    },
+    [HELLO_METHODS] = {
+        .kind = WIRE_VAR,
+        .offset = offsetof(struct hello_parser, methods),
+        .len_offset = offsetof(struct hello_parser, nmethods),
+        .cap = sizeof(((struct hello_parser *)0)->methods),
+        .next = HELLO_DONE,
+    },
+};
+
+static const struct wire_definition hello_definition = {
+    .steps = hello_steps,
+    .done = HELLO_DONE,
+    .error = HELLO_ERROR,
+};
+
 void hello_parser_init(struct hello_parser *p) {
-    memset(p, 0, sizeof(*p));
     p->state = HELLO_VERSION;
+    p->field_read = 0;
+    p->nmethods = 0;
     p->method = 0xFF;
 }
 
 enum hello_state hello_process(struct hello_parser *p, buffer *b) {
-    while (buffer_can_read(b)) {
-        uint8_t byte = buffer_read(b);
-        
-        switch (p->state) {
-            case HELLO_VERSION:
-                if (byte != 0x05) {
-                    p->state = HELLO_ERROR;
-                    return p->state;
-                }
-                p->state = HELLO_NMETHODS;
-                break;
-                
-            case HELLO_NMETHODS:
-                if (byte == 0) {
-                    p->state = HELLO_ERROR;
-                    return p->state;
-                }
-                p->nmethods = byte;
-                p->methods_read = 0;
-                p->state = HELLO_METHODS;
-                break;
-                
-                case HELLO_METHODS:
-                if (byte == 0x02) {
-                    p->method = 0x02;
-                }
-                
-                p->methods_read++;
-                
-                if (p->methods_read >= p->nmethods) {
-                    if (p->method == 0xFF) {
-                        p->method = 0xFF;
-                    }
-                    p->state = HELLO_DONE;
-                    return p->state;
-                }
-                break;
-                
-            case HELLO_DONE:
-            case HELLO_ERROR:
-                return p->state;
-        }
+    unsigned state = p->state;
+    wire_consume(&hello_definition, &state, &p->field_read, p, b);
+    p->state = state;
+
+    if (p->state == HELLO_DONE && memchr(p->methods, 0x02, p->nmethods) != NULL) {
+        p->method = 0x02;
     }
-    
+
     return p->state;
 }
 
@@ -87,6 +88,9 @@ unsigned handshake_read(struct selector_key *key) {
     uint8_t *read_buffer = buffer_write_ptr(&data->client_buffer, &read_limit);
     ssize_t read_count = recv(key->fd, read_buffer, read_limit, 0);
     
+    if (read_count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return HANDSHAKE_READ;
+    }
     if (read_count <= 0) {
         return ERROR;
     }
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "../utils/buffer.h"
 #include "../utils/selector.h"
 
@@ -16,8 +17,10 @@ enum hello_state {
 
 struct hello_parser {
     enum hello_state state;
+    size_t field_read;
+    uint8_t version;
     uint8_t nmethods;
-    uint8_t methods_read;
+    uint8_t methods[255];
     uint8_t method;
 };
 
@@ -0,0 +1,374 @@
+#include "origin.h"
+#include "../metrics/metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define NONE (-1)
+
+struct origin_key {
+    uint16_t family;
+    uint16_t port;
+    uint8_t addr[16];
+};
+
+/*
+ * Las entradas viven en un arreglo fijo: se encuentran por una tabla hash
+ * encadenada y forman una lista por último uso, de la que se descarta la cola
+ * cuando no queda lugar.
+ */
+struct origin_entry {
+    struct origin_key key;
+    int32_t hash_next;
+    int32_t lru_prev;
+    int32_t lru_next;
+    /* mediciones, ver struct origin_info */
+    uint32_t srtt_us;
+    uint32_t last_rtt_us;
+    uint32_t attempts;
+    uint32_t successes;
+    uint16_t success_permille;
+    /* fallos seguidos desde el último connect exitoso */
+    unsigned failures;
+    bool open;
+    /* el último fallo fue un rechazo (si no, un timeout o destino inalcanzable) */
+    bool refused;
+    /* múltiplo del cool-down, se duplica con cada sondeo fallido */
+    unsigned backoff;
+    uint64_t open_until;
+    /* cuándo se dejó pasar el sondeo en curso, 0 si no hay */
+    uint64_t probe_at;
+};
+
+static struct origin_entry *entries = NULL;
+static int32_t *buckets = NULL;
+static size_t capacity = 0;
+static size_t used = 0;
+static size_t mask = 0;
+static int32_t lru_head = NONE;
+static int32_t lru_tail = NONE;
+static unsigned threshold = 0;
+static uint64_t cooldown_us = 0;
+
+uint64_t origin_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static bool
+make_key(const struct sockaddr *addr, struct origin_key *key) {
+    memset(key, 0, sizeof(*key));
+    key->family = addr->sa_family;
+    if (addr->sa_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)addr;
+        key->port = sin->sin_port;
+        memcpy(key->addr, &sin->sin_addr, sizeof(sin->sin_addr));
+        return true;
+    }
+    if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)addr;
+        key->port = sin6->sin6_port;
+        memcpy(key->addr, &sin6->sin6_addr, sizeof(sin6->sin6_addr));
+        return true;
+    }
+    return false;
+}
+
+/* FNV-1a */
+static uint32_t
+key_hash(const struct origin_key *key) {
+    const uint8_t *p = (const uint8_t *)key;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*key); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void
+lru_unlink(int32_t i) {
+    struct origin_entry *e = &entries[i];
+    if (e->lru_prev != NONE) {
+        entries[e->lru_prev].lru_next = e->lru_next;
+    } else {
+        lru_head = e->lru_next;
+    }
+    if (e->lru_next != NONE) {
+        entries[e->lru_next].lru_prev = e->lru_prev;
+    } else {
+        lru_tail = e->lru_prev;
+    }
+}
+
+static void
+lru_push(int32_t i) {
+    entries[i].lru_prev = NONE;
+    entries[i].lru_next = lru_head;
+    if (lru_head != NONE) {
+        entries[lru_head].lru_prev = i;
+    }
+    lru_head = i;
+    if (lru_tail == NONE) {
+        lru_tail = i;
+    }
+}
+
+static void
+bucket_remove(int32_t i) {
+    int32_t *link = &buckets[key_hash(&entries[i].key) & mask];
+    while (*link != i) {
+        link = &entries[*link].hash_next;
+    }
+    *link = entries[i].hash_next;
+}
+
+/* entrada de `key', que pasa a ser la más reciente; con `create' se agrega si falta */
+static struct origin_entry *
+lookup(const struct origin_key *key, bool create) {
+    const size_t b = key_hash(key) & mask;
+    for (int32_t i = buckets[b]; i != NONE; i = entries[i].hash_next) {
+        if (memcmp(&entries[i].key, key, sizeof(*key)) == 0) {
+            lru_unlink(i);
+            lru_push(i);
+            return &entries[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    int32_t i;
+    if (used < capacity) {
+        i = (int32_t)used++;
+    } else {
+        i = lru_tail;
+        lru_unlink(i);
+        bucket_remove(i);
+    }
+    struct origin_entry *e = &entries[i];
+    memset(e, 0, sizeof(*e));
+    e->key = *key;
+    e->backoff = 1;
+    e->hash_next = buckets[b];
+    buckets[b] = i;
+    lru_push(i);
+    return e;
+}
+
+int origin_init(size_t table_size, unsigned failures, unsigned cooldown_seconds) {
+    origin_destroy();
+    if (table_size == 0) {
+        return 0;
+    }
+
+    size_t nbuckets = 1;
+    while (nbuckets < table_size * 2) {
+        nbuckets <<= 1;
+    }
+    entries = calloc(table_size, sizeof(*entries));
+    buckets = malloc(nbuckets * sizeof(*buckets));
+    if (entries == NULL || buckets == NULL) {
+        origin_destroy();
+        return -1;
+    }
+    for (size_t i = 0; i < nbuckets; i++) {
+        buckets[i] = NONE;
+    }
+    capacity = table_size;
+    mask = nbuckets - 1;
+    threshold = failures;
+    cooldown_us = (uint64_t)cooldown_seconds * 1000000;
+    return 0;
+}
+
+void origin_destroy(void) {
+    free(entries);
+    free(buckets);
+    entries = NULL;
+    buckets = NULL;
+    capacity = 0;
+    used = 0;
+    lru_head = NONE;
+    lru_tail = NONE;
+    threshold = 0;
+}
+
+enum origin_verdict origin_admit(const struct sockaddr *addr) {
+    struct origin_key key;
+    if (threshold == 0 || !make_key(addr, &key)) {
+        return ORIGIN_ALLOW;
+    }
+    struct origin_entry *e = lookup(&key, false);
+    if (e == NULL || !e->open) {
+        return ORIGIN_ALLOW;
+    }
+
+    const uint64_t now = origin_now();
+    // un sondeo que nunca informó (el cliente se fue a mitad del connect)
+    // deja de bloquear al siguiente después de otro cool-down
+    if (now >= e->open_until && (e->probe_at == 0 || now - e->probe_at >= cooldown_us)) {
+        e->probe_at = now;
+        return ORIGIN_PROBE;
+    }
+    return e->refused ? ORIGIN_OPEN_REFUSED : ORIGIN_OPEN_UNREACHABLE;
+}
+
+static void
+record(struct origin_entry *e, bool ok, uint64_t started) {
+    const uint16_t outcome = ok ? 1000 : 0;
+    e->success_permille = e->attempts == 0 ? outcome
+                        : (uint16_t)((int)e->success_permille + ((int)outcome - (int)e->success_permille) / 8);
+    e->attempts++;
+    if (!ok) {
+        return;
+    }
+    e->successes++;
+    if (started != 0) {
+        const uint64_t rtt = origin_now() - started;
+        e->last_rtt_us = rtt > UINT32_MAX ? UINT32_MAX : (uint32_t)rtt;
+        // como el SRTT de TCP: 1/8 de la nueva medición
+        e->srtt_us = e->srtt_us == 0 ? e->last_rtt_us
+                   : (uint32_t)((int64_t)e->srtt_us + ((int64_t)e->last_rtt_us - (int64_t)e->srtt_us) / 8);
+    }
+}
+
+void origin_report(const struct sockaddr *addr, int error, uint64_t started) {
+    struct origin_key key;
+    if (capacity == 0 || !make_key(addr, &key)) {
+        return;
+    }
+
+    if (error == 0) {
+        struct origin_entry *e = lookup(&key, true);
+        record(e, true, started);
+        e->failures = 0;
+        e->open = false;
+        e->backoff = 1;
+        e->probe_at = 0;
+        return;
+    }
+
+    // los errores locales (sin fds, sin puertos) no dicen nada del origen
+    bool refused = error == ECONNREFUSED;
+    if (!refused && error != ETIMEDOUT && error != EHOSTUNREACH && error != ENETUNREACH
+#ifdef EHOSTDOWN
+        && error != EHOSTDOWN
+#endif
+        ) {
+        return;
+    }
+
+    struct origin_entry *e = lookup(&key, true);
+    record(e, false, started);
+    e->refused = refused;
+    if (threshold == 0) {
+        return;
+    }
+    const uint64_t now = origin_now();
+    if (e->open) {
+        // los fallos de intentos anteriores a la apertura no cuentan
+        if (e->probe_at != 0) {
+            e->backoff = e->backoff * 2 > ORIGIN_MAX_BACKOFF ? ORIGIN_MAX_BACKOFF : e->backoff * 2;
+            e->open_until = now + cooldown_us * e->backoff;
+            e->probe_at = 0;
+        }
+        return;
+    }
+    if (++e->failures >= threshold) {
+        e->open = true;
+        e->backoff = 1;
+        e->open_until = now + cooldown_us;
+        e->probe_at = 0;
+        metrics_origin_tripped();
+    }
+}
+
+static uint64_t
+expected_cost(const struct addrinfo *ai) {
+    struct origin_key key;
+    if (capacity == 0 || !make_key(ai->ai_addr, &key)) {
+        return ORIGIN_UNKNOWN_RTT_US;
+    }
+    const struct origin_entry *e = lookup(&key, false);
+    if (e == NULL) {
+        return ORIGIN_UNKNOWN_RTT_US;
+    }
+    if (e->open) {
+        return UINT64_MAX;
+    }
+    const uint64_t rtt = e->srtt_us != 0 ? e->srtt_us : ORIGIN_UNKNOWN_RTT_US;
+    const uint64_t rate = e->success_permille < 10 ? 10 : e->success_permille;
+    return rtt * 1000 / rate;
+}
+
+struct candidate {
+    struct addrinfo *ai;
+    uint64_t cost;
+};
+
+void origin_sort(struct addrinfo **list) {
+    struct candidate v[ORIGIN_SORT_MAX];
+    size_t n = 0;
+    struct addrinfo *rest = *list;
+    for (; rest != NULL && n < ORIGIN_SORT_MAX; rest = rest->ai_next) {
+        v[n].ai = rest;
+        v[n].cost = expected_cost(rest);
+        n++;
+    }
+    if (n < 2) {
+        return;
+    }
+
+    // inserción: estable y sobra para unos pocos candidatos
+    for (size_t i = 1; i < n; i++) {
+        const struct candidate x = v[i];
+        size_t j = i;
+        for (; j > 0 && v[j - 1].cost > x.cost; j--) {
+            v[j] = v[j - 1];
+        }
+        v[j] = x;
+    }
+    for (size_t i = 0; i + 1 < n; i++) {
+        v[i].ai->ai_next = v[i + 1].ai;
+    }
+    v[n - 1].ai->ai_next = rest;
+    *list = v[0].ai;
+}
+
+size_t origin_count(void) {
+    return used;
+}
+
+size_t origin_list(struct origin_info *out, size_t max) {
+    const uint64_t now = origin_now();
+    size_t n = 0;
+    for (int32_t i = lru_head; i != NONE && n < max; i = entries[i].lru_next) {
+        const struct origin_entry *e = &entries[i];
+        struct origin_info *info = &out[n++];
+        memset(info, 0, sizeof(*info));
+        if (e->key.family == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in *)&info->addr;
+            sin->sin_family = AF_INET;
+            sin->sin_port = e->key.port;
+            memcpy(&sin->sin_addr, e->key.addr, sizeof(sin->sin_addr));
+        } else {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&info->addr;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = e->key.port;
+            memcpy(&sin6->sin6_addr, e->key.addr, sizeof(sin6->sin6_addr));
+        }
+        info->srtt_us = e->srtt_us;
+        info->last_rtt_us = e->last_rtt_us;
+        info->attempts = e->attempts;
+        info->successes = e->successes;
+        info->success_permille = e->success_permille;
+        info->open = e->open;
+        if (e->open && e->open_until > now) {
+            info->open_remaining_ms = (uint32_t)((e->open_until - now) / 1000);
+        }
+    }
+    return n;
+}
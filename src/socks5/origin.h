@@ -0,0 +1,82 @@
+#ifndef ORIGIN_H
+#define ORIGIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/* entradas de la tabla de salud de orígenes; al llenarse se descarta la menos usada */
+#define ORIGIN_TABLE_SIZE 4096
+/* tras cada sondeo fallido el cool-down se duplica hasta este múltiplo */
+#define ORIGIN_MAX_BACKOFF 8
+/* tiempo de connect que se supone para una dirección sin mediciones */
+#define ORIGIN_UNKNOWN_RTT_US 100000
+/* candidatos que se reordenan; los que siguen quedan en el orden del resolver */
+#define ORIGIN_SORT_MAX 32
+
+/*
+ * Salud de cada origen (IP:puerto) según los últimos connect(2): tiempo de
+ * conexión suavizado, tasa de éxito reciente y el estado de su circuito.
+ *
+ * Después de `threshold' fallos seguidos (rechazos o timeouts) el circuito se
+ * abre: los CONNECT a ese origen se responden sin intentar durante el
+ * cool-down. Al vencer se deja pasar un solo intento de prueba; si conecta el
+ * circuito se cierra y si falla vuelve a abrirse por el doble de tiempo.
+ */
+enum origin_verdict {
+    ORIGIN_ALLOW,
+    /* el intento es el sondeo del circuito medio abierto */
+    ORIGIN_PROBE,
+    /* circuito abierto: el último fallo fue un rechazo o un timeout */
+    ORIGIN_OPEN_REFUSED,
+    ORIGIN_OPEN_UNREACHABLE,
+};
+
+struct origin_info {
+    struct sockaddr_storage addr;
+    /* tiempo de connect suavizado y el último medido, en microsegundos (0 sin medir) */
+    uint32_t srtt_us;
+    uint32_t last_rtt_us;
+    uint32_t attempts;
+    uint32_t successes;
+    /* éxitos recientes en milésimos, con más peso en los últimos intentos */
+    uint16_t success_permille;
+    bool open;
+    /* milisegundos hasta que pase el próximo sondeo */
+    uint32_t open_remaining_ms;
+};
+
+/* `threshold' en 0 deshabilita el circuito. -1 si no hay memoria para la tabla. */
+int origin_init(size_t capacity, unsigned threshold, unsigned cooldown_seconds);
+
+void origin_destroy(void);
+
+/* reloj monotónico en microsegundos para medir un connect */
+uint64_t origin_now(void);
+
+/* si se puede intentar conectar a `addr' */
+enum origin_verdict origin_admit(const struct sockaddr *addr);
+
+/*
+ * Resultado de un connect(2) a `addr': 0 si conectó, si no el errno.
+ * `started' es origin_now() al llamar a connect, 0 si no se midió.
+ */
+void origin_report(const struct sockaddr *addr, int error, uint64_t started);
+
+/*
+ * Reordena los candidatos por el tiempo de conexión esperado: el suavizado
+ * dividido la tasa de éxito. Los que no tienen mediciones cuentan como
+ * ORIGIN_UNKNOWN_RTT_US y los de circuito abierto van al final; entre iguales
+ * se respeta el orden del resolver.
+ */
+void origin_sort(struct addrinfo **list);
+
+/* orígenes en la tabla */
+size_t origin_count(void);
+
+/* hasta `max' orígenes, del más al menos usado recientemente */
+size_t origin_list(struct origin_info *out, size_t max);
+
+#endif
@@ -1,7 +1,21 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+
 #include "request.h"
 #include "socks5.h"
 #include "../users/users.h"
 #include "../dns/dns_resolver.h"
+#include "../utils/wire_parser.h"
+#include "../dissectors/pop3.h"
+#include "udp.h"
+#include "bind.h"
+#include "upstream.h"
+#include "../metrics/metrics.h"
+#include "../utils/args.h"
+#include "../acl/acl.h"
+#include "origin.h"
+#include "egress.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,11 +24,20 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+#if defined(__linux__) && !defined(TCP_FASTOPEN_CONNECT)
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+
+/* puertos de origen (protocolos donde habla primero el cliente) con TFO */
+static uint16_t fastopen_ports[MAX_FASTOPEN_PORTS];
+static int fastopen_ports_count = 0;
+
 void build_destination_string(struct request_parser *parser, char *out, size_t out_len) {
     if (parser == NULL || out == NULL || out_len == 0) {
         return;
@@ -32,92 +55,111 @@ void build_destination_string(struct request_parser *parser, char *out, size_t o
     }
 }
 
+static unsigned request_check_version(void *dst) {
+    return ((struct request_parser *)dst)->version == 0x05 ? REQUEST_CMD : REQUEST_ERROR;
+}
+
+static unsigned request_check_command(void *dst) {
+    switch (((struct request_parser *)dst)->command) {
+        case REQUEST_COMMAND_CONNECT:
+        case REQUEST_COMMAND_BIND:
+        case REQUEST_COMMAND_UDP_ASSOCIATE:
+            return REQUEST_RSV;
+        default:
+            return REQUEST_ERROR;
+    }
+}
+
+static unsigned request_check_reserved(void *dst) {
+    return ((struct request_parser *)dst)->reserved == 0x00 ? REQUEST_ATYP : REQUEST_ERROR;
+}
+
+static unsigned request_check_address_type(void *dst) {
+    struct request_parser *parser = dst;
+    switch (parser->address_type) {
+        case ADDRESS_TYPE_IPV4:
+            parser->dst_addr_length = IPV4_LENGTH;
+            return REQUEST_DSTADDR_IPV4;
+        case ADDRESS_TYPE_IPV6:
+            parser->dst_addr_length = IPV6_LENGTH;
+            return REQUEST_DSTADDR_IPV6;
+        case ADDRESS_TYPE_DOMAIN:
+            return REQUEST_DSTADDR_FQDN_LEN;
+        default:
+            return REQUEST_ERROR;
+    }
+}
+
+static const struct wire_step request_steps[] = {
+    [REQUEST_VERSION] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct request_parser, version),
+        .check = request_check_version,
+    },
+    [REQUEST_CMD] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct request_parser, command),
+        .check = request_check_command,
+    },
+    [REQUEST_RSV] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct request_parser, reserved),
+        .check = request_check_reserved,
+    },
+    [REQUEST_ATYP] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct request_parser, address_type),
+        .check = request_check_address_type,
+    },
+    [REQUEST_DSTADDR_IPV4] = {
+        .kind = WIRE_FIXED,
+        .offset = offsetof(struct request_parser, dst_addr),
+        .len = IPV4_LENGTH,
+        .next = REQUEST_DSTPORT,
+    },
+    [REQUEST_DSTADDR_IPV6] = {
+        .kind = WIRE_FIXED,
+        .offset = offsetof(struct request_parser, dst_addr),
+        .len = IPV6_LENGTH,
+        .next = REQUEST_DSTPORT,
+    },
+    [REQUEST_DSTADDR_FQDN_LEN] = {
+        .kind = WIRE_U8,
+        .offset = offsetof(struct request_parser, dst_addr_length),
+        .next = REQUEST_DSTADDR_FQDN,
+    },
+    [REQUEST_DSTADDR_FQDN] = {
+        .kind = WIRE_VAR,
+        .offset = offsetof(struct request_parser, dst_addr),
+        .len_offset = offsetof(struct request_parser, dst_addr_length),
+        .cap = sizeof(((struct request_parser *)0)->dst_addr),
+        .next = REQUEST_DSTPORT,
+    },
+    [REQUEST_DSTPORT] = {
+        .kind = WIRE_U16,
+        .offset = offsetof(struct request_parser, dst_port),
+        .next = REQUEST_DONE,
+    },
+};
+
+static const struct wire_definition request_definition = {
+    .steps = request_steps,
+    .done = REQUEST_DONE,
+    .error = REQUEST_ERROR,
+};
+
 void request_parser_init(struct request_parser *parser) {
     if (parser == NULL) return;
     parser->state = REQUEST_VERSION;
+    parser->bytes_read = 0;
     parser->dst_port = 0;
     parser->dst_addr_length = 0;
-    parser->bytes_read = 0;
 }
 
 enum request_state request_parser_consume(struct request_parser *parser, buffer *b) {
-    while (buffer_can_read(b) && !request_parser_is_done(parser)) {
-        uint8_t c = buffer_read(b);
-        
-        switch (parser->state) {
-            case REQUEST_VERSION:
-                parser->state = (c == 0x05) ? REQUEST_CMD : REQUEST_ERROR;
-                break;
-                
-            case REQUEST_CMD:
-                if (c == REQUEST_COMMAND_CONNECT) {
-                    parser->command = c;
-                    parser->state = REQUEST_RSV;
-                } else {
-                    parser->state = REQUEST_ERROR;
-                }
-                break;
-                
-            case REQUEST_RSV:
-                parser->state = (c == 0x00) ? REQUEST_ATYP : REQUEST_ERROR;
-                break;
-                
-            case REQUEST_ATYP:
-                parser->address_type = c;
-                parser->bytes_read = 0;
-                switch (c) {
-                    case ADDRESS_TYPE_IPV4:
-                        parser->dst_addr_length = IPV4_LENGTH;
-                        parser->state = REQUEST_DSTADDR;
-                        break;
-                    case ADDRESS_TYPE_IPV6:
-                        parser->dst_addr_length = IPV6_LENGTH;
-                        parser->state = REQUEST_DSTADDR;
-                        break;
-                    case ADDRESS_TYPE_DOMAIN:
-                        parser->state = REQUEST_DSTADDR;
-                        break;
-                    default:
-                        parser->state = REQUEST_ERROR;
-                }
-                break;
-                
-            case REQUEST_DSTADDR:
-                if (parser->address_type == ADDRESS_TYPE_DOMAIN && parser->bytes_read == 0) {
-                    parser->dst_addr_length = c;
-                    parser->bytes_read++;
-                } else {
-                    size_t index = parser->bytes_read - (parser->address_type == ADDRESS_TYPE_DOMAIN ? 1 : 0);
-                    if (index >= sizeof(parser->dst_addr)) {
-                        parser->state = REQUEST_ERROR;
-                        break;
-                    }
-                    
-                    parser->dst_addr[index] = c;
-                    parser->bytes_read++;
-                    
-                    if ((parser->address_type == ADDRESS_TYPE_DOMAIN && parser->bytes_read == parser->dst_addr_length + 1) ||
-                        (parser->address_type != ADDRESS_TYPE_DOMAIN && parser->bytes_read == parser->dst_addr_length)) {
-                        parser->dst_addr[parser->dst_addr_length] = '\0';
-                        parser->bytes_read = 0;
-                        parser->state = REQUEST_DSTPORT;
-                    }
-                }
-                break;
-                
-            case REQUEST_DSTPORT:
-                parser->dst_port = (parser->dst_port << 8) | c;
-                if (++parser->bytes_read == 2) {
-                    parser->bytes_read = 0;
-                    parser->state = REQUEST_DONE;
-                }
-                break;
-                
-            default:
-                break;
-        }
-    }
-    
+    unsigned state = parser->state;
+    wire_consume(&request_definition, &state, &parser->bytes_read, parser, b);
+    parser->state = state;
     return parser->state;
 }
 
@@ -140,6 +182,41 @@ bool request_build_response(const struct request_parser *parser, buffer *buf, ui
     return true;
 }
 
+bool request_build_bound_response(buffer *buf, uint8_t reply_code, const struct sockaddr *bound) {
+    uint8_t answer[4 + IPV6_LENGTH + 2] = {0x05, reply_code, 0x00};
+    size_t len;
+
+    if (bound->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)bound;
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+            answer[3] = ADDRESS_TYPE_IPV4;
+            memcpy(answer + 4, sin6->sin6_addr.s6_addr + 12, IPV4_LENGTH);
+            memcpy(answer + 4 + IPV4_LENGTH, &sin6->sin6_port, 2);
+            len = 4 + IPV4_LENGTH + 2;
+        } else {
+            answer[3] = ADDRESS_TYPE_IPV6;
+            memcpy(answer + 4, &sin6->sin6_addr, IPV6_LENGTH);
+            memcpy(answer + 4 + IPV6_LENGTH, &sin6->sin6_port, 2);
+            len = 4 + IPV6_LENGTH + 2;
+        }
+    } else {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)bound;
+        answer[3] = ADDRESS_TYPE_IPV4;
+        memcpy(answer + 4, &sin->sin_addr, IPV4_LENGTH);
+        memcpy(answer + 4 + IPV4_LENGTH, &sin->sin_port, 2);
+        len = 4 + IPV4_LENGTH + 2;
+    }
+
+    size_t limit;
+    uint8_t *ptr = buffer_write_ptr(buf, &limit);
+    if (limit < len) {
+        return false;
+    }
+    memcpy(ptr, answer, len);
+    buffer_write_adv(buf, len);
+    return true;
+}
+
 static int resolve_address(struct request_parser *parser, struct addrinfo **result) {
     struct addrinfo hints;
     memset(&hints, 0, sizeof(hints));
@@ -172,7 +249,102 @@ static int resolve_address(struct request_parser *parser, struct addrinfo **resu
     return ret;
 }
 
-int try_connect(struct addrinfo *addr, int *out_fd) {
+void request_set_origin_fastopen(const unsigned short *ports, int n) {
+    fastopen_ports_count = 0;
+    for (int i = 0; i < n && i < MAX_FASTOPEN_PORTS; i++) {
+        fastopen_ports[fastopen_ports_count++] = ports[i];
+    }
+}
+
+bool request_origin_fastopen(uint16_t port) {
+    for (int i = 0; i < fastopen_ports_count; i++) {
+        if (fastopen_ports[i] == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t addrinfo_port(const struct addrinfo *addr) {
+    if (addr->ai_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)addr->ai_addr)->sin_port);
+    }
+    if (addr->ai_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)addr->ai_addr)->sin6_port);
+    }
+    return 0;
+}
+
+void request_origin_fastopen_report(int fd) {
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+        metrics_tfo_result((info.tcpi_options & TCPI_OPT_SYN_DATA) != 0);
+    }
+#endif
+}
+
+void request_origin_confirm(struct socks5 *data, int error) {
+    if (!data->request.origin_unconfirmed) {
+        return;
+    }
+    data->request.origin_unconfirmed = false;
+    if (data->current_addrinfo != NULL) {
+        origin_report(data->current_addrinfo->ai_addr, error, 0);
+    }
+}
+
+static bool acl_allows(const struct socks5 *data, const struct addrinfo *addr) {
+    return data->acl_domain_allowed || acl_check_addr(acl_current(), data->auth.username, addr->ai_addr);
+}
+
+/* false si las reglas de acceso rechazan todas las direcciones resueltas */
+static bool acl_allows_any(const struct socks5 *data, const struct addrinfo *list) {
+    for (; list != NULL; list = list->ai_next) {
+        if (acl_allows(data, list)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Reglas de acceso sobre el destino pedido. Un dominio sin regla propia se
+ * juzga por las direcciones a las que resuelve (ver try_connect), salvo que
+ * salga por el proxy padre y no se resuelva acá.
+ */
+static bool request_acl_allows(struct socks5 *data, const struct request_parser *parser) {
+    const struct acl *acl = acl_current();
+    if (acl == NULL || parser->command != REQUEST_COMMAND_CONNECT) {
+        return true;
+    }
+
+    if (parser->address_type == ADDRESS_TYPE_DOMAIN) {
+        enum acl_verdict v = acl_check_domain(acl, data->auth.username, (const char *)parser->dst_addr);
+        data->acl_domain_allowed = v == ACL_ALLOW;
+        if (v == ACL_NO_MATCH && upstream_matches(parser)) {
+            return acl_default_allows(acl, data->auth.username);
+        }
+        return v != ACL_DENY;
+    }
+
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if (parser->address_type == ADDRESS_TYPE_IPV4) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, parser->dst_addr, IPV4_LENGTH);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, parser->dst_addr, IPV6_LENGTH);
+    }
+    return acl_check_addr(acl, data->auth.username, (struct sockaddr *)&ss);
+}
+
+/* socket no bloqueante con las opciones de la sesión, todavía sin conectar */
+static int origin_socket(const struct socks5 *data, const struct addrinfo *addr) {
     int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
     if (fd < 0) {
         return -1;
@@ -182,10 +354,158 @@ int try_connect(struct addrinfo *addr, int *out_fd) {
         close(fd);
         return -1;
     }
-    
-    int ret = connect(fd, addr->ai_addr, addr->ai_addrlen);
-    *out_fd = fd;
-    return ret;
+    sockopt_apply(fd, data->sockopt);
+
+#ifdef TCP_FASTOPEN_CONNECT
+    // con una cookie en caché connect(2) retorna 0 sin enviar el SYN: sale con
+    // el primer send() del cliente y se responde al cliente sin esperar el
+    // handshake. Sin cookie el kernel hace el handshake normal pidiéndola.
+    if (fastopen_ports_count > 0 && request_origin_fastopen(addrinfo_port(addr))) {
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &(int){1}, sizeof(int));
+    }
+#endif
+    return fd;
+}
+
+/*
+ * Las direcciones que rechazan las reglas de acceso se saltean como si
+ * fallara socket(2). Con direcciones de salida (ver egress.h), si a una no le
+ * quedan puertos para este destino se reintenta desde la siguiente.
+ */
+int try_connect(struct socks5 *data, struct addrinfo *addr, int *out_fd) {
+    *out_fd = -1;
+    if (!acl_allows(data, addr)) {
+        errno = EACCES;
+        return -1;
+    }
+
+    const int sources = egress_sources(addr->ai_family);
+    for (int attempt = 0; ; attempt++) {
+        int fd = origin_socket(data, addr);
+        if (fd < 0) {
+            return -1;
+        }
+
+        const int source = egress_pick(addr->ai_family, (struct sockaddr *)&data->client_addr);
+        int ret = source >= 0 ? egress_bind(fd, source) : 0;
+        if (ret == 0) {
+            ret = connect(fd, addr->ai_addr, addr->ai_addrlen);
+        }
+        if (source >= 0 && ret < 0 && (errno == EADDRNOTAVAIL || errno == EADDRINUSE)) {
+            egress_exhausted(source);
+            if (attempt + 1 < sources) {
+                close(fd);
+                continue;
+            }
+        }
+        if (source >= 0 && (ret == 0 || errno == EINPROGRESS)) {
+            egress_acquire(source);
+            data->egress_source = source;
+        }
+        *out_fd = fd;
+        return ret;
+    }
+}
+
+/* un intento al origen que se descarta deja libre su dirección de salida */
+static void egress_done(struct socks5 *data) {
+    if (data->egress_source >= 0) {
+        egress_release(data->egress_source);
+        data->egress_source = -1;
+    }
+}
+
+static uint8_t connect_error_reply(int error) {
+    switch (error) {
+        case ECONNREFUSED:
+            return REQUEST_REPLY_CONNECTION_REFUSED;
+        case ENETUNREACH:
+            return REQUEST_REPLY_NETWORK_UNREACHABLE;
+        case EACCES:
+            return REQUEST_REPLY_CONNECTION_NOT_ALLOWED;
+        default:
+            return REQUEST_REPLY_HOST_UNREACHABLE;
+    }
+}
+
+static unsigned connect_success(fd_selector s, struct socks5 *data) {
+    data->request.reply = REQUEST_REPLY_SUCCESS;
+    user_log_connection(data->auth.username, data->request.destination, data->request.port);
+    request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
+    selector_set_interest(s, data->client_fd, OP_WRITE);
+    return REQUEST_WRITE;
+}
+
+/*
+ * Prueba los candidatos desde current_addrinfo hasta que uno conecta o queda
+ * en curso. Se saltean los que rechazan las reglas de acceso y los orígenes
+ * con el circuito abierto (ver origin.h); si no queda ninguno se responde
+ * según el último error.
+ */
+static unsigned connect_next(fd_selector s, struct socks5 *data) {
+    int last_error = EHOSTUNREACH;
+    bool attempted = false;
+    bool tripped = false;
+
+    for (; data->current_addrinfo != NULL; data->current_addrinfo = data->current_addrinfo->ai_next) {
+        const struct addrinfo *addr = data->current_addrinfo;
+        const enum origin_verdict verdict = origin_admit(addr->ai_addr);
+        if (verdict == ORIGIN_OPEN_REFUSED || verdict == ORIGIN_OPEN_UNREACHABLE) {
+            last_error = verdict == ORIGIN_OPEN_REFUSED ? ECONNREFUSED : EHOSTUNREACH;
+            tripped = true;
+            continue;
+        }
+
+        int origin_fd = -1;
+        data->request.connect_started = origin_now();
+        const int ret = try_connect(data, data->current_addrinfo, &origin_fd);
+        const int error = ret < 0 ? errno : 0;
+        attempted |= origin_fd >= 0;
+        if (origin_fd < 0) {
+            last_error = error;
+            continue;
+        }
+        if (ret < 0 && error != EINPROGRESS) {
+            origin_report(addr->ai_addr, error, data->request.connect_started);
+            close(origin_fd);
+            egress_done(data);
+            last_error = error;
+            continue;
+        }
+        if (register_origin_selector_from_key(s, origin_fd, data) != SELECTOR_SUCCESS) {
+            close(origin_fd);
+            egress_done(data);
+            last_error = EHOSTUNREACH;
+            continue;
+        }
+
+        data->origin_fd = origin_fd;
+        if (ret == 0) {
+            // con Fast Open el SYN todavía no salió: el resultado llega con
+            // el primer envío o lectura del túnel (ver request_origin_confirm)
+            if (fastopen_ports_count > 0 && request_origin_fastopen(addrinfo_port(addr))) {
+                data->request.origin_unconfirmed = true;
+            } else {
+                origin_report(addr->ai_addr, 0, data->request.connect_started);
+            }
+            return connect_success(s, data);
+        }
+        selector_set_interest(s, origin_fd, OP_WRITE);
+        selector_set_interest(s, data->client_fd, OP_NOOP);
+        return REQUEST_CONNECT;
+    }
+
+    if (tripped && !attempted) {
+        metrics_origin_fastfail();
+    }
+    if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
+        freeaddrinfo(data->origin_addrinfo);
+    }
+    data->origin_addrinfo = NULL;
+    data->request.reply = connect_error_reply(last_error);
+    request_build_response(data->request.parser, &data->origin_buffer, data->request.reply);
+    selector_set_interest(s, data->client_fd, OP_WRITE);
+    return REQUEST_WRITE;
 }
 
 void dns_callback_handler(struct dns_response *response) {
@@ -202,43 +522,23 @@ void dns_callback_handler(struct dns_response *response) {
         free(response);
         return;
     }
-    
-    int origin_fd = -1;
-    int connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-    
-    if (origin_fd < 0 || register_origin_selector_from_key(data->selector, origin_fd, data) != SELECTOR_SUCCESS) {
-        if (origin_fd >= 0) close(origin_fd);
+
+    if (!acl_allows_any(data, data->origin_addrinfo)) {
+        metrics_acl_denied();
         freeaddrinfo(data->origin_addrinfo);
         data->origin_addrinfo = NULL;
-        request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_HOST_UNREACHABLE);
+        data->request.reply = REQUEST_REPLY_CONNECTION_NOT_ALLOWED;
+        request_build_response(data->request.parser, &data->origin_buffer, data->request.reply);
         selector_set_interest(data->selector, data->client_fd, OP_WRITE);
         data->stm.current = &data->stm.states[REQUEST_WRITE];
         free(response);
         return;
     }
-    
-    data->origin_fd = origin_fd;
-    
-    if (connect_ret == 0) {
-        data->request.reply = REQUEST_REPLY_SUCCESS;
-        char dest[256];
-        build_destination_string(data->request.parser, dest, sizeof(dest));
-        user_log_connection(data->auth.username, dest, data->request.parser->dst_port);
-        request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-        selector_set_interest(data->selector, data->client_fd, OP_WRITE);
-        data->stm.current = &data->stm.states[REQUEST_WRITE];
-    } else if (errno == EINPROGRESS) {
-        selector_set_interest(data->selector, origin_fd, OP_WRITE);
-        selector_set_interest(data->selector, data->client_fd, OP_NOOP);
-        data->stm.current = &data->stm.states[REQUEST_CONNECT];
-    } else {
-        close(origin_fd);
-        data->origin_fd = -1;
-        request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_CONNECTION_REFUSED);
-        selector_set_interest(data->selector, data->client_fd, OP_WRITE);
-        data->stm.current = &data->stm.states[REQUEST_WRITE];
-    }
-    
+
+    // las direcciones más rápidas según los connect anteriores primero
+    origin_sort(&data->origin_addrinfo);
+    data->current_addrinfo = data->origin_addrinfo;
+    data->stm.current = &data->stm.states[connect_next(data->selector, data)];
     free(response);
 }
 
@@ -279,6 +579,62 @@ unsigned request_read(struct selector_key *key) {
         return REQUEST_WRITE;
     }
 
+    if (!request_acl_allows(data, parser)) {
+        metrics_acl_denied();
+        data->request.reply = REQUEST_REPLY_CONNECTION_NOT_ALLOWED;
+        request_build_response(parser, &data->origin_buffer, data->request.reply);
+        selector_set_interest_key(key, OP_WRITE);
+        return REQUEST_WRITE;
+    }
+
+    // los límites del usuario se aplican acá y no en la autenticación: la
+    // respuesta de RFC 1929 no distingue un rechazo de una contraseña mala
+    if (user_session_admit(data->auth.username) != USER_ADMIT_OK) {
+        metrics_limit_refused();
+        data->request.reply = REQUEST_REPLY_CONNECTION_NOT_ALLOWED;
+        request_build_response(parser, &data->origin_buffer, data->request.reply);
+        selector_set_interest_key(key, OP_WRITE);
+        return REQUEST_WRITE;
+    }
+    data->auth.admitted = true;
+    build_destination_string(parser, data->request.destination, sizeof(data->request.destination));
+    data->request.port = parser->dst_port;
+
+    // con el usuario y el destino ya se conoce el perfil definitivo
+    const struct sockopt_profile *profile = sockopt_select(data->auth.username, parser->dst_port);
+    if (profile != data->sockopt) {
+        data->sockopt = profile;
+        sockopt_apply(data->client_fd, profile);
+    }
+
+    if (parser->command == REQUEST_COMMAND_BIND) {
+        data->request.reply = bind_open(key, parser);
+        if (data->request.reply == REQUEST_REPLY_SUCCESS) {
+            request_build_bound_response(&data->origin_buffer, REQUEST_REPLY_SUCCESS,
+                                         (struct sockaddr *)&data->bind.bound);
+        } else {
+            request_build_response(parser, &data->origin_buffer, data->request.reply);
+        }
+        selector_set_interest_key(key, OP_WRITE);
+        return REQUEST_WRITE;
+    }
+
+    if (parser->command == REQUEST_COMMAND_UDP_ASSOCIATE) {
+        data->request.reply = udp_associate_open(key, parser);
+        if (data->request.reply == REQUEST_REPLY_SUCCESS) {
+            request_build_bound_response(&data->origin_buffer, REQUEST_REPLY_SUCCESS,
+                                         (struct sockaddr *)&data->udp.bound);
+        } else {
+            request_build_response(parser, &data->origin_buffer, data->request.reply);
+        }
+        selector_set_interest_key(key, OP_WRITE);
+        return REQUEST_WRITE;
+    }
+
+    if (upstream_matches(parser)) {
+        return upstream_session_start(key);
+    }
+
     if (parser->address_type == ADDRESS_TYPE_DOMAIN) {
         char port_str[6];
         snprintf(port_str, sizeof(port_str), "%u", parser->dst_port);
@@ -309,98 +665,7 @@ unsigned request_read(struct selector_key *key) {
     data->current_addrinfo = addrinfo_list;
     data->resolution_from_getaddrinfo = true;
 
-    int origin_fd = -1;
-    int connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-    
-    if (origin_fd < 0) {
-        data->current_addrinfo = data->current_addrinfo->ai_next;
-
-        while (data->current_addrinfo != NULL) {
-            connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-            if (origin_fd >= 0) break;
-            data->current_addrinfo = data->current_addrinfo->ai_next;
-        }
-        
-        if (origin_fd < 0) {
-            freeaddrinfo(addrinfo_list);
-            data->origin_addrinfo = NULL;
-            request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_HOST_UNREACHABLE);
-            selector_set_interest_key(key, OP_WRITE);
-            return REQUEST_WRITE;
-        }
-    }
-
-    if (register_origin_selector(key, origin_fd, data) != SELECTOR_SUCCESS) {
-        close(origin_fd);
-        freeaddrinfo(addrinfo_list);
-        data->origin_addrinfo = NULL;
-        request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_FAILURE);
-        selector_set_interest_key(key, OP_WRITE);
-        return REQUEST_WRITE;
-    }
-    
-    data->origin_fd = origin_fd;
-
-    if (connect_ret == 0) {
-        data->request.reply = REQUEST_REPLY_SUCCESS;
-        char dest[256];
-        build_destination_string(parser, dest, sizeof(dest));
-        user_log_connection(data->auth.username, dest, parser->dst_port);
-        request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-        selector_set_interest_key(key, OP_WRITE);
-        return REQUEST_WRITE;
-    }
-    
-    if (errno == EINPROGRESS) {
-        selector_set_interest(key->s, origin_fd, OP_WRITE);
-        selector_set_interest_key(key, OP_NOOP);
-        return REQUEST_CONNECT;
-    }
-    
-    selector_unregister_fd(key->s, origin_fd);
-    close(origin_fd);
-    data->origin_fd = -1;
-    
-    data->current_addrinfo = data->current_addrinfo->ai_next;
-    
-    while (data->current_addrinfo != NULL) {
-        connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-        
-        if (origin_fd >= 0) {
-            if (register_origin_selector(key, origin_fd, data) != SELECTOR_SUCCESS) {
-                close(origin_fd);
-                data->current_addrinfo = data->current_addrinfo->ai_next;
-                continue;
-            }
-            
-            data->origin_fd = origin_fd;
-            
-            if (connect_ret == 0) {
-                data->request.reply = REQUEST_REPLY_SUCCESS;
-                request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-                selector_set_interest_key(key, OP_WRITE);
-                return REQUEST_WRITE;
-            }
-            
-            if (errno == EINPROGRESS) {
-                selector_set_interest(key->s, origin_fd, OP_WRITE);
-                selector_set_interest_key(key, OP_NOOP);
-                return REQUEST_CONNECT;
-            }
-
-            selector_unregister_fd(key->s, origin_fd);
-            close(origin_fd);
-            data->origin_fd = -1;
-        }
-        
-        data->current_addrinfo = data->current_addrinfo->ai_next;
-    }
-    
-    freeaddrinfo(addrinfo_list);
-    data->origin_addrinfo = NULL;
-    request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_HOST_UNREACHABLE);
-    selector_set_interest_key(key, OP_WRITE);
-    return REQUEST_WRITE;
+    return connect_next(key->s, data);
 }
 
 unsigned request_dns(struct selector_key *key) {
@@ -425,108 +690,8 @@ unsigned request_dns(struct selector_key *key) {
     if (data->origin_addrinfo == NULL) {
         return REQUEST_DNS;
     }
-    
-    int origin_fd = -1;
-    int connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-    
-    if (origin_fd < 0) {
-        data->current_addrinfo = data->current_addrinfo->ai_next;
-        
-        while (data->current_addrinfo != NULL) {
-            connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-            if (origin_fd >= 0) break;
-            data->current_addrinfo = data->current_addrinfo->ai_next;
-        }
-        
-        if (origin_fd < 0) {
-            if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
-                freeaddrinfo(data->origin_addrinfo);
-            }
-            data->origin_addrinfo = NULL;
-            request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_HOST_UNREACHABLE);
-            selector_set_interest_key(key, OP_WRITE);
-            return REQUEST_WRITE;
-        }
-    }
-    
-    if (register_origin_selector(key, origin_fd, data) != SELECTOR_SUCCESS) {
-        close(origin_fd);
-        if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
-            freeaddrinfo(data->origin_addrinfo);
-        }
-        data->origin_addrinfo = NULL;
-        request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_FAILURE);
-        selector_set_interest_key(key, OP_WRITE);
-        return REQUEST_WRITE;
-    }
-    
-    data->origin_fd = origin_fd;
-    
-    if (connect_ret == 0) {
-        data->request.reply = REQUEST_REPLY_SUCCESS;
-        char dest[256];
-        build_destination_string(parser, dest, sizeof(dest));
-        user_log_connection(data->auth.username, dest, parser->dst_port);
-        request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-        selector_set_interest_key(key, OP_WRITE);
-        return REQUEST_WRITE;
-    }
-    
-    if (errno == EINPROGRESS) {
-        selector_set_interest(key->s, origin_fd, OP_WRITE);
-        selector_set_interest_key(key, OP_NOOP);
-        return REQUEST_CONNECT;
-    }
-    
-    selector_unregister_fd(key->s, origin_fd);
-    close(origin_fd);
-    data->origin_fd = -1;
-    
-    data->current_addrinfo = data->current_addrinfo->ai_next;
-    
-    while (data->current_addrinfo != NULL) {
-        connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-        
-        if (origin_fd >= 0) {
-            if (register_origin_selector(key, origin_fd, data) != SELECTOR_SUCCESS) {
-                close(origin_fd);
-                data->current_addrinfo = data->current_addrinfo->ai_next;
-                continue;
-            }
-            
-            data->origin_fd = origin_fd;
-            
-            if (connect_ret == 0) {
-                data->request.reply = REQUEST_REPLY_SUCCESS;
-                char dest[256];
-                build_destination_string(parser, dest, sizeof(dest));
-                user_log_connection(data->auth.username, dest, parser->dst_port);
-                request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-                selector_set_interest_key(key, OP_WRITE);
-                return REQUEST_WRITE;
-            }
-            
-            if (errno == EINPROGRESS) {
-                selector_set_interest(key->s, origin_fd, OP_WRITE);
-                selector_set_interest_key(key, OP_NOOP);
-                return REQUEST_CONNECT;
-            }
-            
-            selector_unregister_fd(key->s, origin_fd);
-            close(origin_fd);
-            data->origin_fd = -1;
-        }
-        
-        data->current_addrinfo = data->current_addrinfo->ai_next;
-    }
-    
-    if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
-        freeaddrinfo(data->origin_addrinfo);
-    }
-    data->origin_addrinfo = NULL;
-    request_build_response(parser, &data->origin_buffer, REQUEST_REPLY_HOST_UNREACHABLE);
-    selector_set_interest_key(key, OP_WRITE);
-    return REQUEST_WRITE;
+
+    return connect_next(key->s, data);
 }
 
 unsigned request_connect(struct selector_key *key) {
@@ -543,72 +708,31 @@ unsigned request_connect(struct selector_key *key) {
         error = errno;
     }
     
+    if (data->current_addrinfo != NULL) {
+        origin_report(data->current_addrinfo->ai_addr, error, data->request.connect_started);
+    }
     if (error == 0) {
-        data->request.reply = REQUEST_REPLY_SUCCESS;
-        char dest[256];
-        build_destination_string(data->request.parser, dest, sizeof(dest));
-        user_log_connection(data->auth.username, dest, data->request.parser->dst_port);
-        request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-        selector_set_interest(key->s, data->client_fd, OP_WRITE);
-        selector_set_interest(key->s, data->origin_fd, OP_READ);
-        return REQUEST_WRITE;
+        return connect_success(key->s, data);
     }
 
     selector_unregister_fd(key->s, data->origin_fd);
     close(data->origin_fd);
     data->origin_fd = -1;
+    egress_done(data);
 
     if (data->current_addrinfo != NULL) {
         data->current_addrinfo = data->current_addrinfo->ai_next;
     }
-    
-    while (data->current_addrinfo != NULL) {
-        int origin_fd = -1;
-        int connect_ret = try_connect(data->current_addrinfo, &origin_fd);
-        
-        if (origin_fd >= 0) {
-            if (register_origin_selector(key, origin_fd, data) != SELECTOR_SUCCESS) {
-                close(origin_fd);
-                data->current_addrinfo = data->current_addrinfo->ai_next;
-                continue;
-            }
-            
-            data->origin_fd = origin_fd;
-            
-            if (connect_ret == 0) {
-                data->request.reply = REQUEST_REPLY_SUCCESS;
-                char dest[256];
-                build_destination_string(data->request.parser, dest, sizeof(dest));
-                user_log_connection(data->auth.username, dest, data->request.parser->dst_port);
-                request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_SUCCESS);
-                selector_set_interest(key->s, data->client_fd, OP_WRITE);
-                selector_set_interest(key->s, data->origin_fd, OP_READ);
-                return REQUEST_WRITE;
-            }
-            
-            if (errno == EINPROGRESS) {
-                selector_set_interest(key->s, origin_fd, OP_WRITE);
-                selector_set_interest(key->s, data->client_fd, OP_NOOP);
-                return REQUEST_CONNECT;
-            }
-            
-            selector_unregister_fd(key->s, origin_fd);
-            close(origin_fd);
-            data->origin_fd = -1;
-        }
-        
-        data->current_addrinfo = data->current_addrinfo->ai_next;
-    }
-    
-    if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
-        freeaddrinfo(data->origin_addrinfo);
-        data->origin_addrinfo = NULL;
+    return connect_next(key->s, data);
+}
+
+void request_write_init(const unsigned state, struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    // el origen puede enviar datos (o cerrar) antes de que termine de salir la
+    // respuesta; recién se lo escucha en COPY
+    if (data->origin_fd >= 0) {
+        selector_set_interest(key->s, data->origin_fd, OP_NOOP);
     }
-    
-    data->request.reply = REQUEST_REPLY_CONNECTION_REFUSED;
-    request_build_response(data->request.parser, &data->origin_buffer, REQUEST_REPLY_CONNECTION_REFUSED);
-    selector_set_interest(key->s, data->client_fd, OP_WRITE);
-    return REQUEST_WRITE;
 }
 
 unsigned request_write(struct selector_key *key) {
@@ -636,6 +760,27 @@ unsigned request_write(struct selector_key *key) {
         return ERROR;
     }
     
+    if (data->request.parser->command == REQUEST_COMMAND_UDP_ASSOCIATE) {
+        free(data->request.parser);
+        data->request.parser = NULL;
+        return UDP_RELAY;
+    }
+    
+    if (data->request.parser->command == REQUEST_COMMAND_BIND) {
+        free(data->request.parser);
+        data->request.parser = NULL;
+        return BIND_ACCEPT;
+    }
+    
+    data->origin_fastopen = data->origin_addrinfo != NULL &&
+                            request_origin_fastopen(data->request.parser->dst_port);
+
+    if (pop3_sniffer_wants(data->request.parser->dst_port)) {
+        char dest[256];
+        build_destination_string(data->request.parser, dest, sizeof(dest));
+        data->pop3 = pop3_sniffer_new(data->auth.username, dest, data->request.parser->dst_port);
+    }
+    
     free(data->request.parser);
     data->request.parser = NULL;
     
@@ -6,16 +6,22 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h> 
+#include <stddef.h>
 
 #include "../utils/buffer.h"
 #include "../utils/selector.h"
 
+struct socks5;
+
 enum request_state {
     REQUEST_VERSION,
     REQUEST_CMD,
     REQUEST_RSV,
     REQUEST_ATYP,
-    REQUEST_DSTADDR,
+    REQUEST_DSTADDR_IPV4,
+    REQUEST_DSTADDR_IPV6,
+    REQUEST_DSTADDR_FQDN_LEN,
+    REQUEST_DSTADDR_FQDN,
     REQUEST_DSTPORT,
     REQUEST_DONE,
     REQUEST_ERROR,
@@ -37,21 +43,26 @@ enum request_reply {
 #define ADDRESS_TYPE_DOMAIN 0x03
 #define ADDRESS_TYPE_IPV6 0x04
 #define REQUEST_COMMAND_CONNECT 0x01
+#define REQUEST_COMMAND_BIND 0x02
+#define REQUEST_COMMAND_UDP_ASSOCIATE 0x03
 #define IPV4_LENGTH 4
 #define IPV6_LENGTH 16
 
 struct request_parser {
     enum request_state state;
+    size_t bytes_read;
+    uint8_t version;
     uint8_t command;
+    uint8_t reserved;
     uint8_t address_type;
     uint8_t dst_addr[256];
     uint8_t dst_addr_length;
     uint16_t dst_port;
-    uint8_t bytes_read;
 };
 
 void request_read_init(const unsigned state, struct selector_key *key);
 unsigned request_read(struct selector_key *key);
+void request_write_init(const unsigned state, struct selector_key *key);
 unsigned request_write(struct selector_key *key);
 unsigned request_connect(struct selector_key *key);
 unsigned request_dns(struct selector_key *key);
@@ -61,8 +72,21 @@ enum request_state request_parser_consume(struct request_parser *parser, buffer
 bool request_parser_is_done(const struct request_parser *parser);
 bool request_parser_has_error(const struct request_parser *parser);
 bool request_build_response(const struct request_parser *parser, buffer *buf, uint8_t reply_code);
+bool request_build_bound_response(buffer *buf, uint8_t reply_code, const struct sockaddr *bound);
+
+int try_connect(struct socks5 *data, struct addrinfo *addr, int *out_fd);
 
-int try_connect(struct addrinfo *addr, int *out_fd);
+/* TCP Fast Open hacia el origen, solo para los puertos configurados */
+void request_set_origin_fastopen(const unsigned short *ports, int n);
+bool request_origin_fastopen(uint16_t port);
+/* contabiliza en las métricas si el SYN al origen llevó datos */
+void request_origin_fastopen_report(int fd);
+/*
+ * Un connect con Fast Open que retornó 0 no mandó el SYN todavía: el éxito o
+ * el fallo del origen se informa acá con el primer resultado del túnel, 0 o
+ * el errno, sin tiempo de conexión medido.
+ */
+void request_origin_confirm(struct socks5 *data, int error);
 void build_destination_string(struct request_parser *parser, char *out, size_t out_len);
 
 #endif
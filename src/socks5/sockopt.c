@@ -0,0 +1,327 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include "sockopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+enum rule_kind {
+    RULE_ANY,
+    RULE_PORT,
+    RULE_USER,
+};
+
+struct sockopt_rule {
+    enum rule_kind kind;
+    uint16_t port;
+    char username[256];
+    int profile;
+};
+
+/*
+ * interactive: sin Nagle, poco dato sin enviar en el socket (lo demás espera
+ * en el buffer del túnel) y caídas detectadas en unos dos minutos.
+ * bulk: buffers del sistema y tolerancia larga a cortes; sus buffers se
+ * pueden fijar con `-o bulk:sndbuf=4M,rcvbuf=4M' si el sistema lo permite.
+ */
+static const struct sockopt_profile builtin[] = {
+    {
+        .name = "default", .nodelay = -1, .sndbuf = -1, .rcvbuf = -1, .notsent_lowat = -1,
+        .keepidle = -1, .keepintvl = -1, .keepcnt = -1, .user_timeout = -1,
+    },
+    {
+        .name = "interactive", .nodelay = 1, .sndbuf = -1, .rcvbuf = -1, .notsent_lowat = 16 * 1024,
+        .keepidle = 60, .keepintvl = 10, .keepcnt = 6, .user_timeout = 120 * 1000,
+    },
+    {
+        .name = "bulk", .nodelay = -1, .sndbuf = -1, .rcvbuf = -1, .notsent_lowat = -1,
+        .keepidle = 300, .keepintvl = 30, .keepcnt = 4, .user_timeout = 420 * 1000,
+    },
+};
+
+static struct sockopt_profile profiles[SOCKOPT_MAX_PROFILES];
+static int profile_count = 0;
+static struct sockopt_rule rules[SOCKOPT_MAX_RULES];
+static int rule_count = 0;
+
+static int
+find_profile(const char *name, size_t len) {
+    for (int i = 0; i < profile_count; i++) {
+        if (strlen(profiles[i].name) == len && strncmp(profiles[i].name, name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* entero no negativo con sufijo K o M opcional; -1 si no es válido */
+static int
+parse_size(const char *s, size_t len) {
+    char buf[32];
+    if (len == 0 || len >= sizeof(buf)) {
+        return -1;
+    }
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    errno = 0;
+    long v = strtol(buf, &end, 10);
+    if (end == buf || v < 0 || errno == ERANGE) {
+        return -1;
+    }
+    long mult = 1;
+    if (*end == 'K' || *end == 'k') {
+        mult = 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        mult = 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || v > INT_MAX / mult) {
+        return -1;
+    }
+    return (int)(v * mult);
+}
+
+/* `off' o `idle[/intervalo[/sondeos]]' */
+static bool
+parse_keepalive(const char *s, size_t len, struct sockopt_profile *p) {
+    if (len == 3 && strncmp(s, "off", 3) == 0) {
+        p->keepidle = 0;
+        return true;
+    }
+    int *fields[] = {&p->keepidle, &p->keepintvl, &p->keepcnt};
+    const char *end = s + len;
+    for (int i = 0; i < 3 && s < end; i++) {
+        const char *slash = memchr(s, '/', (size_t)(end - s));
+        const char *stop = slash != NULL ? slash : end;
+        *fields[i] = parse_size(s, (size_t)(stop - s));
+        if (*fields[i] <= 0) {
+            return false;
+        }
+        s = slash != NULL ? slash + 1 : end;
+    }
+    return s == end;
+}
+
+static bool
+parse_option(const char *s, size_t len, struct sockopt_profile *p) {
+    const char *eq = memchr(s, '=', len);
+    if (eq == NULL) {
+        return false;
+    }
+    const size_t key_len = (size_t)(eq - s);
+    const char *value = eq + 1;
+    const size_t value_len = len - key_len - 1;
+    const struct {
+        const char *key;
+        int *field;
+    } sizes[] = {
+        {"nodelay", &p->nodelay},
+        {"sndbuf", &p->sndbuf},
+        {"rcvbuf", &p->rcvbuf},
+        {"lowat", &p->notsent_lowat},
+        {"user_timeout", &p->user_timeout},
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (strlen(sizes[i].key) == key_len && strncmp(sizes[i].key, s, key_len) == 0) {
+            *sizes[i].field = parse_size(value, value_len);
+            return *sizes[i].field >= 0 && (sizes[i].field != &p->nodelay || *sizes[i].field <= 1);
+        }
+    }
+    if (key_len == 9 && strncmp(s, "keepalive", 9) == 0) {
+        return parse_keepalive(value, value_len, p);
+    }
+    return false;
+}
+
+/* `nombre:opción=valor,...'; un nombre existente parte de sus valores */
+static bool
+parse_profile(const char *spec) {
+    const char *colon = strchr(spec, ':');
+    const size_t name_len = colon != NULL ? (size_t)(colon - spec) : strlen(spec);
+    if (name_len == 0 || name_len >= SOCKOPT_NAME_MAX) {
+        return false;
+    }
+    int idx = find_profile(spec, name_len);
+    if (idx < 0) {
+        if (profile_count >= SOCKOPT_MAX_PROFILES) {
+            return false;
+        }
+        idx = profile_count++;
+        profiles[idx] = builtin[0];
+        memcpy(profiles[idx].name, spec, name_len);
+        profiles[idx].name[name_len] = '\0';
+    }
+    if (colon == NULL) {
+        return true;
+    }
+    const char *s = colon + 1;
+    while (*s != '\0') {
+        const char *comma = strchr(s, ',');
+        const size_t len = comma != NULL ? (size_t)(comma - s) : strlen(s);
+        if (!parse_option(s, len, &profiles[idx])) {
+            return false;
+        }
+        s += len + (comma != NULL);
+    }
+    return true;
+}
+
+/* `puerto=perfil', `@usuario=perfil' o `*=perfil' */
+static bool
+parse_rule(const char *spec, struct sockopt_rule *rule) {
+    const char *eq = strrchr(spec, '=');
+    if (eq == NULL || eq == spec) {
+        return false;
+    }
+    rule->profile = find_profile(eq + 1, strlen(eq + 1));
+    if (rule->profile < 0) {
+        return false;
+    }
+    const size_t len = (size_t)(eq - spec);
+    if (len == 1 && spec[0] == '*') {
+        rule->kind = RULE_ANY;
+        return true;
+    }
+    if (spec[0] == '@') {
+        if (len < 2 || len - 1 >= sizeof(rule->username)) {
+            return false;
+        }
+        rule->kind = RULE_USER;
+        memcpy(rule->username, spec + 1, len - 1);
+        rule->username[len - 1] = '\0';
+        return true;
+    }
+    const int port = parse_size(spec, len);
+    if (port <= 0 || port > UINT16_MAX || spec[len - 1] < '0' || spec[len - 1] > '9') {
+        return false;
+    }
+    rule->kind = RULE_PORT;
+    rule->port = (uint16_t)port;
+    return true;
+}
+
+int sockopt_init(char **profile_specs, int nprofiles, char **rule_specs, int nrules, char *err, size_t err_len) {
+    profile_count = (int)(sizeof(builtin) / sizeof(builtin[0]));
+    memcpy(profiles, builtin, sizeof(builtin));
+    rule_count = 0;
+
+    for (int i = 0; i < nprofiles; i++) {
+        if (!parse_profile(profile_specs[i])) {
+            snprintf(err, err_len, "invalid socket option profile: %s", profile_specs[i]);
+            return -1;
+        }
+    }
+    for (int i = 0; i < nrules; i++) {
+        if (rule_count >= SOCKOPT_MAX_RULES || !parse_rule(rule_specs[i], &rules[rule_count])) {
+            snprintf(err, err_len, "invalid socket option rule: %s", rule_specs[i]);
+            return -1;
+        }
+        rule_count++;
+    }
+    return 0;
+}
+
+const struct sockopt_profile *sockopt_select(const char *username, uint16_t port) {
+    if (profile_count == 0) {
+        return &builtin[0];
+    }
+    const struct sockopt_rule *best = NULL;
+    for (int i = 0; i < rule_count; i++) {
+        const struct sockopt_rule *r = &rules[i];
+        const bool match = r->kind == RULE_ANY
+            || (r->kind == RULE_PORT && port != 0 && r->port == port)
+            || (r->kind == RULE_USER && username != NULL && strcmp(r->username, username) == 0);
+        if (match && (best == NULL || r->kind > best->kind)) {
+            best = r;
+        }
+    }
+    return best != NULL ? &profiles[best->profile] : &profiles[0];
+}
+
+static void
+set_int(int fd, int level, int name, int value) {
+    if (value >= 0) {
+        setsockopt(fd, level, name, &value, sizeof(value));
+    }
+}
+
+void sockopt_apply(int fd, const struct sockopt_profile *p) {
+    if (p == NULL) {
+        return;
+    }
+    // los buffers antes del connect: definen la escala de ventana del SYN
+    set_int(fd, SOL_SOCKET, SO_SNDBUF, p->sndbuf);
+    set_int(fd, SOL_SOCKET, SO_RCVBUF, p->rcvbuf);
+    set_int(fd, IPPROTO_TCP, TCP_NODELAY, p->nodelay);
+#ifdef TCP_NOTSENT_LOWAT
+    set_int(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, p->notsent_lowat);
+#endif
+    if (p->keepidle >= 0) {
+        set_int(fd, SOL_SOCKET, SO_KEEPALIVE, p->keepidle > 0);
+    }
+    if (p->keepidle > 0) {
+#ifdef TCP_KEEPIDLE
+        set_int(fd, IPPROTO_TCP, TCP_KEEPIDLE, p->keepidle);
+#endif
+#ifdef TCP_KEEPINTVL
+        set_int(fd, IPPROTO_TCP, TCP_KEEPINTVL, p->keepintvl);
+#endif
+#ifdef TCP_KEEPCNT
+        set_int(fd, IPPROTO_TCP, TCP_KEEPCNT, p->keepcnt);
+#endif
+    }
+#ifdef TCP_USER_TIMEOUT
+    set_int(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, p->user_timeout);
+#endif
+}
+
+static int
+get_int(int fd, int level, int name) {
+    int value = -1;
+    socklen_t len = sizeof(value);
+    if (getsockopt(fd, level, name, &value, &len) < 0) {
+        return -1;
+    }
+    return value;
+}
+
+bool sockopt_read(int fd, struct sockopt_profile *out) {
+    memset(out, 0, sizeof(*out));
+    out->nodelay = get_int(fd, IPPROTO_TCP, TCP_NODELAY);
+    if (out->nodelay < 0) {
+        return false;
+    }
+    out->sndbuf = get_int(fd, SOL_SOCKET, SO_SNDBUF);
+    out->rcvbuf = get_int(fd, SOL_SOCKET, SO_RCVBUF);
+    out->notsent_lowat = -1;
+#ifdef TCP_NOTSENT_LOWAT
+    out->notsent_lowat = get_int(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#endif
+    out->keepidle = get_int(fd, SOL_SOCKET, SO_KEEPALIVE) > 0 ? -1 : 0;
+    out->keepintvl = -1;
+    out->keepcnt = -1;
+    if (out->keepidle != 0) {
+#ifdef TCP_KEEPIDLE
+        out->keepidle = get_int(fd, IPPROTO_TCP, TCP_KEEPIDLE);
+#endif
+#ifdef TCP_KEEPINTVL
+        out->keepintvl = get_int(fd, IPPROTO_TCP, TCP_KEEPINTVL);
+#endif
+#ifdef TCP_KEEPCNT
+        out->keepcnt = get_int(fd, IPPROTO_TCP, TCP_KEEPCNT);
+#endif
+    }
+    out->user_timeout = -1;
+#ifdef TCP_USER_TIMEOUT
+    out->user_timeout = get_int(fd, IPPROTO_TCP, TCP_USER_TIMEOUT);
+#endif
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SOCKOPT_H
+#define SOCKOPT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SOCKOPT_NAME_MAX 16
+#define SOCKOPT_MAX_PROFILES 8
+#define SOCKOPT_MAX_RULES 32
+
+/*
+ * Opciones de socket que se aplican juntas a los sockets de una sesión. Un
+ * valor en -1 deja el del sistema; fijar los buffers apaga el autoajuste del
+ * kernel y queda limitado por net.core.wmem_max / rmem_max.
+ */
+struct sockopt_profile {
+    char name[SOCKOPT_NAME_MAX];
+    int nodelay;
+    int sndbuf;
+    int rcvbuf;
+    /* TCP_NOTSENT_LOWAT en bytes */
+    int notsent_lowat;
+    /* segundos sin tráfico antes del primer sondeo (0 apaga keepalive),
+     * entre sondeos y sondeos sin respuesta antes de cortar */
+    int keepidle;
+    int keepintvl;
+    int keepcnt;
+    /* TCP_USER_TIMEOUT en milisegundos */
+    int user_timeout;
+};
+
+/*
+ * Perfiles propios o cambios a los predefinidos (default, interactive, bulk)
+ * con el formato `nombre:opción=valor,...', y reglas de selección
+ * `puerto=perfil', `@usuario=perfil' o `*=perfil'. -1 si alguno es inválido,
+ * con el motivo en `err'.
+ */
+int sockopt_init(char **profiles, int nprofiles, char **rules, int nrules, char *err, size_t err_len);
+
+/*
+ * Perfil de una sesión: la regla del usuario, si no la del puerto de destino,
+ * si no la de `*' y si no `default'. Al aceptar todavía no se conocen
+ * (NULL y 0).
+ */
+const struct sockopt_profile *sockopt_select(const char *username, uint16_t port);
+
+/* aplica las opciones fijadas del perfil; las que el socket rechaza se ignoran */
+void sockopt_apply(int fd, const struct sockopt_profile *profile);
+
+/* valores efectivos de `fd' según el kernel; false si no es un socket TCP */
+bool sockopt_read(int fd, struct sockopt_profile *out);
+
+#endif
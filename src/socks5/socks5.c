@@ -1,30 +1,59 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+
 #include "socks5.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 
 #include "../auth/auth.h"
+#include "../users/users.h"
 #include "../utils/stm.h"
 #include "../metrics/metrics.h"
 #include "handshake.h"
 #include "request.h"
 #include "copy.h"
+#include "udp.h"
+#include "bind.h"
+#include "upstream.h"
+#include "egress.h"
+#include "../dissectors/pop3.h"
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
 #define MAX_POOL_SIZE 500
+/* conexiones que se aceptan como máximo por cada evento del listener */
+#define ACCEPT_BATCH 32
+/* fds por debajo del máximo del selector que se reservan para los orígenes */
+#define FD_RESERVE 16
+/* descriptores de una sesión CONNECT: el cliente y el origen */
+#define SESSION_FDS 2
+/* el listener se reanuda al bajar de este porcentaje del máximo de sesiones */
+#define RESUME_PERCENT 90
 
 static size_t pool_size = 0;
+static size_t max_sessions = MAX_POOL_SIZE;
+static bool eager_read = false;
+
+/* listener pausado por falta de capacidad */
+static fd_selector paused_selector = NULL;
+static int paused_listener = -1;
+
+/* sesiones vivas, la más nueva primero */
+static struct socks5 *sessions = NULL;
 
 static void socks5_read(struct selector_key *key);
 static void socks5_write(struct selector_key *key);
 static void socks5_block(struct selector_key *key);
 static void socks5_close(struct selector_key *key);
+static void socks5_error(struct selector_key *key);
 
 static void handle_error(const unsigned state, struct selector_key *key);
 static void handle_done(const unsigned state, struct selector_key *key);
@@ -34,6 +63,7 @@ static const struct fd_handler socks5_handler = {
     .handle_write = socks5_write,
     .handle_block = socks5_block,
     .handle_close = socks5_close,
+    .handle_error = socks5_error,
 };
 
 static void nothing(const unsigned int s, struct selector_key *key) {
@@ -54,6 +84,9 @@ static const struct state_definition socks5_states[] = {
         .on_arrival = auth_read_init,
         .on_read_ready = auth_read,
     },
+    {
+        .state = AUTH_VERIFY,
+    },
     {
         .state = AUTH_WRITE,
         .on_write_ready = auth_write,
@@ -73,15 +106,33 @@ static const struct state_definition socks5_states[] = {
     },
     {
         .state = REQUEST_WRITE,
+        .on_arrival = request_write_init,
         .on_write_ready = request_write,
     },
+    {
+        .state = UPSTREAM_NEGOTIATE,
+        .on_arrival = upstream_session_init,
+        .on_read_ready = upstream_session_step,
+        .on_write_ready = upstream_session_step,
+    },
     {
         .state = COPY,
         .on_arrival = copy_init,
         .on_read_ready = copy_read,
         .on_write_ready = copy_write,
+        .on_error_ready = copy_error,
         .on_departure = nothing,
     },
+    {
+        .state = UDP_RELAY,
+        .on_arrival = udp_relay_init,
+        .on_read_ready = udp_relay_read,
+    },
+    {
+        .state = BIND_ACCEPT,
+        .on_arrival = bind_accept_init,
+        .on_read_ready = bind_accept_read,
+    },
     {
         .state = DONE,
         .on_arrival = handle_done,
@@ -92,20 +143,54 @@ static const struct state_definition socks5_states[] = {
     }
 };
 
-void socks5_passive_accept(struct selector_key *key) {
-    struct sockaddr_storage client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    
-    int new_client_fd = accept(key->fd, (struct sockaddr *)&client_addr, &addr_len);
-    if (new_client_fd < 0) {
-        return;
+static void listener_pause(struct selector_key *key) {
+    if (paused_listener < 0 && selector_set_interest_key(key, OP_NOOP) == SELECTOR_SUCCESS) {
+        paused_selector = key->s;
+        paused_listener = key->fd;
+        metrics_listener_paused();
     }
-    
-    if (new_client_fd > FD_SETSIZE) {
-        close(new_client_fd);
+}
+
+/*
+ * true si el próximo fd que entregue el sistema queda dentro del selector
+ * con FD_RESERVE de margen. Se averigua duplicando el listener (el sistema
+ * da el menor fd libre, igual que accept) para no tener que aceptar una
+ * conexión y cerrarla.
+ */
+static bool fd_headroom(fd_selector s, int listener) {
+    const int probe = fcntl(listener, F_DUPFD, 0);
+    if (probe < 0) {
+        return false;
+    }
+    close(probe);
+    return (size_t)probe + FD_RESERVE < selector_max_fds(s);
+}
+
+static void listener_resume(void) {
+    if (paused_listener < 0 || pool_size * 100 >= max_sessions * RESUME_PERCENT
+        || !fd_headroom(paused_selector, paused_listener)) {
         return;
     }
-    
+    selector_set_interest(paused_selector, paused_listener, OP_READ);
+    paused_listener = -1;
+    paused_selector = NULL;
+}
+
+static int accept_client(int listener, struct sockaddr_storage *addr, socklen_t *addr_len) {
+#if defined(__linux__)
+    return accept4(listener, (struct sockaddr *)addr, addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int fd = accept(listener, (struct sockaddr *)addr, addr_len);
+    if (fd >= 0 && selector_fd_set_nio(fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+static void socks5_session_new(struct selector_key *key, int new_client_fd,
+                               const struct sockaddr_storage *client_addr) {
     struct socks5 *data = calloc(1, sizeof(*data));
     if (data == NULL) {
         close(new_client_fd);
@@ -118,19 +203,23 @@ void socks5_passive_accept(struct selector_key *key) {
     data->closed = false;
     data->client_fd = new_client_fd;
     data->origin_fd = -1;
-    data->client_addr = client_addr;
+    data->egress_source = -1;
+    data->udp.client_fd = -1;
+    data->udp.remote4_fd = -1;
+    data->udp.remote6_fd = -1;
+    data->bind.listen_fd = -1;
+    data->client_addr = *client_addr;
+    data->selector = key->s;
     
     buffer_init(&data->client_buffer, BUFFER_SIZE, data->client_buffer_data);
     buffer_init(&data->origin_buffer, BUFFER_SIZE, data->origin_buffer_data);
+
+    // sin usuario ni destino todavía: el perfil de `*' o el default
+    data->sockopt = sockopt_select(NULL, 0);
+    sockopt_apply(new_client_fd, data->sockopt);
     
     stm_init(&data->stm);
     
-    if (selector_fd_set_nio(new_client_fd) == -1) {
-        free(data);
-        close(new_client_fd);
-        return;
-    }
-    
     selector_status status = selector_register(key->s, new_client_fd, &socks5_handler, OP_READ, data);
     if (status != SELECTOR_SUCCESS) {
         free(data);
@@ -140,6 +229,53 @@ void socks5_passive_accept(struct selector_key *key) {
     
     pool_size++;
     metrics_connection_opened();
+    data->session_next = sessions;
+    if (sessions != NULL) {
+        sessions->session_prev = data;
+    }
+    sessions = data;
+
+    // se lee el hello en la misma vuelta del loop en lugar de esperar al
+    // próximo select
+    if (eager_read) {
+        struct selector_key client_key = {
+            .s = key->s,
+            .fd = new_client_fd,
+            .data = data,
+        };
+        socks5_read(&client_key);
+    }
+}
+
+void socks5_passive_accept(struct selector_key *key) {
+    // el margen de fds se averigua una vez por evento; dentro de la tanda lo
+    // da el fd que entregó cada accept
+    bool headroom = fd_headroom(key->s, key->fd);
+    for (int i = 0; i < ACCEPT_BATCH; i++) {
+        // sin capacidad se deja de aceptar: las conexiones esperan en el
+        // backlog del kernel en lugar de aceptarlas y cerrarlas
+        if (pool_size >= max_sessions || !headroom) {
+            listener_pause(key);
+            return;
+        }
+
+        struct sockaddr_storage client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int new_client_fd = accept_client(key->fd, &client_addr, &addr_len);
+        if (new_client_fd < 0) {
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                listener_pause(key);
+            }
+            return;
+        }
+
+        // accept entrega el menor fd libre: con margen para los fds que abra
+        // la sesión, el próximo queda lejos del máximo y no hace falta
+        // duplicar el listener; cerca del máximo se vuelve a probar
+        headroom = (size_t)new_client_fd + SESSION_FDS + FD_RESERVE < selector_max_fds(key->s)
+                   || fd_headroom(key->s, key->fd);
+        socks5_session_new(key, new_client_fd, &client_addr);
+    }
 }
 
 void close_connection(struct selector_key *key) {
@@ -148,6 +284,15 @@ void close_connection(struct selector_key *key) {
         return;
     }
     data->closed = true;
+    copy_release(data);
+    if (data->session_prev != NULL) {
+        data->session_prev->session_next = data->session_next;
+    } else {
+        sessions = data->session_next;
+    }
+    if (data->session_next != NULL) {
+        data->session_next->session_prev = data->session_prev;
+    }
     
     if (data->client_fd >= 0) {
         selector_unregister_fd(key->s, data->client_fd);
@@ -156,16 +301,37 @@ void close_connection(struct selector_key *key) {
     }
     
     if (data->origin_fd >= 0) {
+        if (data->origin_fastopen) {
+            request_origin_fastopen_report(data->origin_fd);
+        }
         selector_unregister_fd(key->s, data->origin_fd);
         close(data->origin_fd);
         data->origin_fd = -1;
     }
+    if (data->egress_source >= 0) {
+        egress_release(data->egress_source);
+        data->egress_source = -1;
+    }
+    
+    udp_associate_close(key);
+    bind_close(key);
     
     if (data->origin_addrinfo != NULL && data->resolution_from_getaddrinfo) {
         freeaddrinfo(data->origin_addrinfo);
     }
     
-    free(data);
+    free(data->hello.parser);
+    free(data->auth.parser);
+    free(data->request.parser);
+    pop3_sniffer_free(data->pop3);
+    free(data->upstream);
+    if (data->auth.admitted) {
+        user_session_release(data->auth.username);
+    }
+    // con una verificación pendiente la libera auth_verify_handler
+    if (!data->auth.verifying) {
+        free(data);
+    }
     
     if (pool_size > 0) {
         pool_size--;
@@ -202,9 +368,22 @@ static void socks5_block(struct selector_key *key) {
     }
 }
 
-static void socks5_close(struct selector_key *key) {
+static void socks5_error(struct selector_key *key) {
     struct state_machine *sm = &ATTACHMENT(key)->stm;
-    stm_handler_close(sm, key);
+    enum socks5_state state = stm_handler_error(sm, key);
+    if (state == ERROR || state == DONE) {
+        close_connection(key);
+    }
+}
+
+static void socks5_close(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    // la sesión pertenece al fd del cliente: desregistrar un origin fallido
+    // o un listener de BIND no debe liberarla
+    if (key->fd != data->client_fd) {
+        return;
+    }
+    stm_handler_close(&data->stm, key);
     close_connection(key);
 }
 
@@ -216,13 +395,64 @@ static void handle_done(const unsigned state, struct selector_key *key) {
 
 int socks5_pool_init(void) {
     pool_size = 0;
+    paused_listener = -1;
+    paused_selector = NULL;
     return 0;
 }
 
+size_t socks5_sessions(void) {
+    return pool_size;
+}
+
+void socks5_listener_maintain(void) {
+    listener_resume();
+}
+
+void socks5_listener_closed(void) {
+    paused_listener = -1;
+    paused_selector = NULL;
+}
+
+size_t socks5_set_max_sessions(fd_selector s, size_t max) {
+    max_sessions = max > 0 ? max : MAX_POOL_SIZE;
+    // cada sesión ocupa al menos el cliente y el origen
+    const size_t fds = selector_max_fds(s);
+    const size_t reachable = fds > FD_RESERVE + SESSION_FDS ? (fds - FD_RESERVE) / SESSION_FDS : 1;
+    if (max_sessions > reachable) {
+        max_sessions = reachable;
+    }
+    return max_sessions;
+}
+
+void socks5_set_eager_read(bool eager) {
+    eager_read = eager;
+}
+
 void socks5_pool_destroy(void) {
     pool_size = 0;
+    sessions = NULL;
+}
+
+size_t socks5_session_list(struct socks5_session_info *out, size_t max) {
+    size_t n = 0;
+    for (const struct socks5 *data = sessions; data != NULL && n < max; data = data->session_next) {
+        struct socks5_session_info *info = &out[n++];
+        memset(info, 0, sizeof(*info));
+        // los campos tienen el mismo tamaño que los de la sesión
+        memcpy(info->username, data->auth.username, strlen(data->auth.username) + 1);
+        memcpy(info->destination, data->request.destination, strlen(data->request.destination) + 1);
+        info->port = data->request.port;
+        memcpy(info->profile, data->sockopt->name, strlen(data->sockopt->name) + 1);
+        info->has_client = data->client_fd >= 0 && sockopt_read(data->client_fd, &info->client);
+        info->has_origin = data->origin_fd >= 0 && sockopt_read(data->origin_fd, &info->origin);
+    }
+    return n;
 }
 
 selector_status register_origin_selector_from_key(fd_selector s, int origin_fd, struct socks5 *data) {
     return selector_register(s, origin_fd, &socks5_handler, OP_READ, data);
 }
+
+selector_status register_bind_selector(fd_selector s, int listen_fd, struct socks5 *data) {
+    return selector_register(s, listen_fd, &socks5_handler, OP_NOOP, data);
+}
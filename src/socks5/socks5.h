@@ -3,18 +3,62 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <netdb.h>
 
 #include "../utils/buffer.h"
 #include "../utils/selector.h"
 #include "../utils/stm.h"
+#include "sockopt.h"
 
-#define BUFFER_SIZE 8192
+/* tamaño inicial de los buffers; en COPY crecen según el tráfico, ver copy.c */
+#define BUFFER_SIZE 2048
 #define ATTACHMENT(key) ((struct socks5 *)((key)->data))
+/* envíos con MSG_ZEROCOPY de un sentido que pueden esperar confirmación a la vez */
+#define COPY_ZC_SENDS 8
 
 struct hello_parser;
+struct auth_parser;
+struct pop3_sniffer;
 struct request_parser;
+struct upstream_negotiation;
+
+/*
+ * Un sentido del túnel en COPY: lo que se lee de `src' se acumula en `buf'
+ * hasta poder escribirlo en `dst'.
+ */
+struct copy_flow {
+    int src;
+    int dst;
+    buffer *buf;
+    /* el sentido que va del cliente al origen (el que ve el sniffer de POP3) */
+    bool upstream;
+    /* `src' devolvió EOF: al vaciar `buf' se hace shutdown(SHUT_WR) de `dst' */
+    bool eof;
+    bool shut;
+    /* tamaño de `buf', su almacenamiento en el heap si creció y no pudo ser
+     * circular (si no, el de la sesión o el mapeo del buffer) y cuántas
+     * lecturas seguidas lo llenaron desde vacío */
+    size_t size;
+    uint8_t *heap;
+    unsigned fills;
+    time_t last_active;
+    /* MSG_ZEROCOPY habilitado en `dst'. Los primeros `zc_held' bytes de `buf'
+     * ya se enviaron pero no se consumen hasta que el kernel confirme todos
+     * los envíos de `zc' que los cubren (en orden desde `zc_head'); `zc_seq'
+     * es el número que el kernel le asigna al próximo envío */
+    bool zerocopy;
+    size_t zc_held;
+    struct {
+        uint32_t len;
+        uint32_t seq;
+        bool done;
+    } zc[COPY_ZC_SENDS];
+    unsigned zc_head;
+    unsigned zc_count;
+    uint32_t zc_seq;
+};
 
 struct socks5 {
     struct state_machine stm;
@@ -22,17 +66,32 @@ struct socks5 {
     bool closed;
     int client_fd;
     int origin_fd;
+    /* dirección de salida de la conexión al origen, -1 si no se eligió ninguna */
+    int egress_source;
     
     buffer client_buffer;
     buffer origin_buffer;
     uint8_t client_buffer_data[BUFFER_SIZE];
     uint8_t origin_buffer_data[BUFFER_SIZE];
+    /* cliente -> origen (origin_buffer) y origen -> cliente (client_buffer) */
+    struct copy_flow flows[2];
+    /* un sentido terminó: se espera al otro mientras haya actividad antes de
+     * `linger_deadline', ver copy_sweep */
+    bool lingering;
+    time_t linger_deadline;
+    /* la sesión está en la lista que recorre copy_sweep (a medio cerrar o con
+     * buffers agrandados) */
+    bool swept;
+    struct socks5 *sweep_prev;
+    struct socks5 *sweep_next;
     
     struct sockaddr_storage client_addr;
     
     struct addrinfo *origin_addrinfo;
     struct addrinfo *current_addrinfo;
     bool resolution_from_getaddrinfo;
+    /* el dominio pedido tiene una regla allow: no se revisan sus direcciones */
+    bool acl_domain_allowed;
     
     struct {
         struct hello_parser *parser;
@@ -40,30 +99,78 @@ struct socks5 {
     } hello;
     
     struct {
+        struct auth_parser *parser;
         char username[256];
         char password[256];
         bool authenticated;
+        /* hay una verificación en el pool que apunta a esta sesión */
+        bool verifying;
+        /* la sesión cuenta en los límites del usuario, ver user_session_admit */
+        bool admitted;
     } auth;
     
     struct {
         struct request_parser *parser;
         uint8_t reply;
+        /* destino pedido, para el listado de sesiones (el parser se libera antes de COPY) */
+        char destination[256];
+        uint16_t port;
+        /* origin_now() del connect en curso, para medir cuánto tarda */
+        uint64_t connect_started;
+        /* connect con Fast Open sin handshake, ver request_origin_confirm */
+        bool origin_unconfirmed;
     } request;
+
+    struct pop3_sniffer *pop3;
+    bool origin_fastopen;
+
+    struct {
+        int client_fd;
+        int remote4_fd;
+        int remote6_fd;
+        struct sockaddr_storage bound;
+        socklen_t bound_len;
+        struct sockaddr_storage client;
+        socklen_t client_len;
+        bool client_known;
+        uint16_t expected_port;
+    } udp;
+
+    struct {
+        int listen_fd;
+        int slot;
+        struct sockaddr_storage bound;
+        struct sockaddr_storage expected;
+    } bind;
+
+    struct upstream_negotiation *upstream;
+    bool upstream_pooled;
+    bool upstream_retried;
     
     fd_selector selector;
     struct selector_key *current_key;
+
+    /* perfil de opciones aplicado a los sockets, ver sockopt.h */
+    const struct sockopt_profile *sockopt;
+    /* lista de sesiones vivas, ver socks5_session_list */
+    struct socks5 *session_prev;
+    struct socks5 *session_next;
 };
 
 enum socks5_state {
     HANDSHAKE_READ,
     HANDSHAKE_WRITE,
     AUTH_READ,
+    AUTH_VERIFY,
     AUTH_WRITE,
     REQUEST_READ,
     REQUEST_DNS,
     REQUEST_CONNECT,
     REQUEST_WRITE,
+    UPSTREAM_NEGOTIATE,
     COPY,
+    UDP_RELAY,
+    BIND_ACCEPT,
     DONE,
     ERROR
 };
@@ -72,8 +179,39 @@ void socks5_passive_accept(struct selector_key *key);
 void close_connection(struct selector_key *key);
 selector_status register_origin_selector(struct selector_key *key, int origin_fd, struct socks5 *data);
 selector_status register_origin_selector_from_key(fd_selector s, int origin_fd, struct socks5 *data);
+selector_status register_bind_selector(fd_selector s, int listen_fd, struct socks5 *data);
+
+/* estado de una sesión viva tal como lo informa el comando `sessions' */
+struct socks5_session_info {
+    char username[256];
+    /* vacío hasta que llega el pedido */
+    char destination[256];
+    uint16_t port;
+    char profile[SOCKOPT_NAME_MAX];
+    /* valores efectivos de cada socket; `has_*' en false si no está abierto */
+    bool has_client;
+    bool has_origin;
+    struct sockopt_profile client;
+    struct sockopt_profile origin;
+};
 
 int socks5_pool_init(void);
+/* sesiones abiertas */
+size_t socks5_sessions(void);
+/* reanuda el listener pausado si volvió a haber sesiones y fds libres; se
+ * llama desde el loop principal */
+void socks5_listener_maintain(void);
+/* el listener SOCKS se cerró: olvidar si estaba pausado */
+void socks5_listener_closed(void);
+/*
+ * Al llegar a `max' sesiones se pausa el listener hasta que se liberen. Se
+ * limita a las que entran en los fds del selector; retorna el máximo usado.
+ */
+size_t socks5_set_max_sessions(fd_selector s, size_t max);
+/* con TFO o TCP_DEFER_ACCEPT el hello suele llegar junto con el accept */
+void socks5_set_eager_read(bool eager);
 void socks5_pool_destroy(void);
+/* completa hasta `max' entradas con las sesiones vivas, las más nuevas primero */
+size_t socks5_session_list(struct socks5_session_info *out, size_t max);
 
 #endif
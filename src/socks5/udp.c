@@ -0,0 +1,367 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+
+#include "udp.h"
+#include "socks5.h"
+#include "request.h"
+#include "../metrics/metrics.h"
+#include "../users/users.h"
+#include "../acl/acl.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef __linux__
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+/* RSV(2) | FRAG(1) | ATYP(1) | ADDR(<=16) | PORT(2) */
+#define UDP_HEADER_MAX (4 + IPV6_LENGTH + 2)
+
+static void udp_read(struct selector_key *key);
+
+static const struct fd_handler udp_handler = {
+    .handle_read = udp_read,
+};
+
+/*
+ * El selector corre en un único hilo, así que los buffers de los lotes se
+ * comparten entre todas las asociaciones.
+ */
+static uint8_t datagrams[UDP_BATCH][UDP_MAX_DATAGRAM];
+static uint8_t headers[UDP_BATCH][UDP_HEADER_MAX];
+static struct sockaddr_storage peers[UDP_BATCH];
+static struct iovec iovs[UDP_BATCH][2];
+static struct mmsghdr msgs[UDP_BATCH];
+
+static struct sockaddr_storage out_addrs[2][UDP_BATCH];
+static struct iovec out_iovs[2][UDP_BATCH];
+static struct mmsghdr out_msgs[2][UDP_BATCH];
+
+static int recv_batch(int fd, struct mmsghdr *m, unsigned n) {
+#ifdef __linux__
+    return recvmmsg(fd, m, n, 0, NULL);
+#else
+    unsigned i = 0;
+    for (; i < n; i++) {
+        ssize_t r = recvmsg(fd, &m[i].msg_hdr, 0);
+        if (r < 0) {
+            return i == 0 ? -1 : (int)i;
+        }
+        m[i].msg_len = (unsigned)r;
+    }
+    return (int)i;
+#endif
+}
+
+static void send_batch(int fd, struct mmsghdr *m, unsigned n) {
+    unsigned sent = 0;
+    while (sent < n) {
+#ifdef __linux__
+        int r = sendmmsg(fd, m + sent, n - sent, 0);
+#else
+        int r = sendmsg(fd, &m[sent].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // UDP: ante EAGAIN o un destino inválido se descarta el datagrama
+            sent++;
+            continue;
+        }
+        sent += (unsigned)r;
+    }
+}
+
+static void prepare_recv(unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        iovs[i][0].iov_base = datagrams[i];
+        iovs[i][0].iov_len = sizeof(datagrams[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &peers[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+static bool same_host(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+    if (a->ss_family != b->ss_family) {
+        return false;
+    }
+    if (a->ss_family == AF_INET) {
+        return ((const struct sockaddr_in *)a)->sin_addr.s_addr == ((const struct sockaddr_in *)b)->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr, &((const struct sockaddr_in6 *)b)->sin6_addr,
+                      sizeof(struct in6_addr)) == 0;
+    }
+    return false;
+}
+
+static uint16_t sockaddr_port(const struct sockaddr_storage *a) {
+    if (a->ss_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)a)->sin_port);
+    }
+    return ntohs(((const struct sockaddr_in6 *)a)->sin6_port);
+}
+
+static int open_udp_socket(int family, const struct sockaddr *bind_addr, socklen_t bind_len) {
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (selector_fd_set_nio(fd) == -1 || (bind_addr != NULL && bind(fd, bind_addr, bind_len) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int remote_socket(struct selector_key *key, struct socks5 *data, int family) {
+    int *fd = family == AF_INET ? &data->udp.remote4_fd : &data->udp.remote6_fd;
+    if (*fd >= 0) {
+        return *fd;
+    }
+
+    int new_fd = open_udp_socket(family, NULL, 0);
+    if (new_fd < 0) {
+        return -1;
+    }
+    if (selector_register(key->s, new_fd, &udp_handler, OP_READ, data) != SELECTOR_SUCCESS) {
+        close(new_fd);
+        return -1;
+    }
+    *fd = new_fd;
+    return new_fd;
+}
+
+uint8_t udp_associate_open(struct selector_key *key, struct request_parser *parser) {
+    struct socks5 *data = ATTACHMENT(key);
+
+    // el socket hacia el cliente escucha en la misma IP en la que nos contactó
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    if (getsockname(data->client_fd, (struct sockaddr *)&local, &local_len) < 0) {
+        return REQUEST_REPLY_FAILURE;
+    }
+    if (local.ss_family == AF_INET) {
+        ((struct sockaddr_in *)&local)->sin_port = 0;
+    } else {
+        ((struct sockaddr_in6 *)&local)->sin6_port = 0;
+    }
+
+    int fd = open_udp_socket(local.ss_family, (struct sockaddr *)&local, local_len);
+    if (fd < 0) {
+        return REQUEST_REPLY_FAILURE;
+    }
+    if (selector_register(key->s, fd, &udp_handler, OP_READ, data) != SELECTOR_SUCCESS) {
+        close(fd);
+        return REQUEST_REPLY_FAILURE;
+    }
+    data->udp.client_fd = fd;
+
+    data->udp.bound_len = sizeof(data->udp.bound);
+    getsockname(fd, (struct sockaddr *)&data->udp.bound, &data->udp.bound_len);
+
+    // DST.PORT indica desde qué puerto enviará el cliente (0 si no lo sabe)
+    data->udp.expected_port = parser->dst_port;
+    data->udp.client_known = false;
+
+    char dest[256];
+    build_destination_string(parser, dest, sizeof(dest));
+    user_log_connection(data->auth.username, dest, parser->dst_port);
+
+    return REQUEST_REPLY_SUCCESS;
+}
+
+void udp_associate_close(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    int *fds[] = {&data->udp.client_fd, &data->udp.remote4_fd, &data->udp.remote6_fd};
+
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) {
+            selector_unregister_fd(key->s, *fds[i]);
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+/* parsea y quita el header RFC 1928; retorna su largo o 0 si se descarta */
+static size_t parse_header(const uint8_t *d, size_t len, struct sockaddr_storage *to, socklen_t *to_len) {
+    if (len < 4 || d[0] != 0x00 || d[1] != 0x00) {
+        return 0;
+    }
+    // no soportamos fragmentación: se descartan los fragmentos
+    if (d[2] != 0x00) {
+        return 0;
+    }
+
+    memset(to, 0, sizeof(*to));
+    if (d[3] == ADDRESS_TYPE_IPV4 && len >= 4 + IPV4_LENGTH + 2) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)to;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, d + 4, IPV4_LENGTH);
+        memcpy(&sin->sin_port, d + 4 + IPV4_LENGTH, 2);
+        *to_len = sizeof(*sin);
+        return 4 + IPV4_LENGTH + 2;
+    }
+    if (d[3] == ADDRESS_TYPE_IPV6 && len >= 4 + IPV6_LENGTH + 2) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)to;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, d + 4, IPV6_LENGTH);
+        memcpy(&sin6->sin6_port, d + 4 + IPV6_LENGTH, 2);
+        *to_len = sizeof(*sin6);
+        return 4 + IPV6_LENGTH + 2;
+    }
+    // ADDRESS_TYPE_DOMAIN requeriría resolver en el hilo del selector por
+    // cada datagrama: se descarta
+    return 0;
+}
+
+static size_t build_header(uint8_t *h, const struct sockaddr_storage *from) {
+    h[0] = 0x00;
+    h[1] = 0x00;
+    h[2] = 0x00;
+    if (from->ss_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)from;
+        h[3] = ADDRESS_TYPE_IPV4;
+        memcpy(h + 4, &sin->sin_addr, IPV4_LENGTH);
+        memcpy(h + 4 + IPV4_LENGTH, &sin->sin_port, 2);
+        return 4 + IPV4_LENGTH + 2;
+    }
+    const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)from;
+    h[3] = ADDRESS_TYPE_IPV6;
+    memcpy(h + 4, &sin6->sin6_addr, IPV6_LENGTH);
+    memcpy(h + 4 + IPV6_LENGTH, &sin6->sin6_port, 2);
+    return 4 + IPV6_LENGTH + 2;
+}
+
+/* cliente -> destinos: se quita el header y se agrupa por familia */
+static void relay_from_client(struct selector_key *key, struct socks5 *data, int n) {
+    unsigned count[2] = {0, 0};
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (!same_host(&peers[i], &data->client_addr)) {
+            continue;
+        }
+        if (data->udp.client_known) {
+            if (sockaddr_port(&peers[i]) != sockaddr_port(&data->udp.client)) {
+                continue;
+            }
+        } else {
+            if (data->udp.expected_port != 0 && sockaddr_port(&peers[i]) != data->udp.expected_port) {
+                continue;
+            }
+            data->udp.client = peers[i];
+            data->udp.client_len = msgs[i].msg_hdr.msg_namelen;
+            data->udp.client_known = true;
+        }
+
+        struct sockaddr_storage to;
+        socklen_t to_len;
+        size_t hlen = parse_header(datagrams[i], msgs[i].msg_len, &to, &to_len);
+        if (hlen == 0) {
+            continue;
+        }
+        if (!acl_check_addr(acl_current(), data->auth.username, (struct sockaddr *)&to)) {
+            metrics_acl_denied();
+            continue;
+        }
+
+        const int f = to.ss_family == AF_INET ? 0 : 1;
+        const unsigned j = count[f]++;
+        out_addrs[f][j] = to;
+        out_iovs[f][j].iov_base = datagrams[i] + hlen;
+        out_iovs[f][j].iov_len = msgs[i].msg_len - hlen;
+        memset(&out_msgs[f][j], 0, sizeof(out_msgs[f][j]));
+        out_msgs[f][j].msg_hdr.msg_name = &out_addrs[f][j];
+        out_msgs[f][j].msg_hdr.msg_namelen = to_len;
+        out_msgs[f][j].msg_hdr.msg_iov = &out_iovs[f][j];
+        out_msgs[f][j].msg_hdr.msg_iovlen = 1;
+        bytes += msgs[i].msg_len - hlen;
+    }
+
+    for (int f = 0; f < 2; f++) {
+        if (count[f] == 0) {
+            continue;
+        }
+        int fd = remote_socket(key, data, f == 0 ? AF_INET : AF_INET6);
+        if (fd >= 0) {
+            send_batch(fd, out_msgs[f], count[f]);
+        }
+    }
+
+    if (bytes > 0) {
+        metrics_add_bytes(bytes);
+        user_update_metrics(data->auth.username, bytes);
+    }
+}
+
+/* destinos -> cliente: se antepone el header sin copiar el payload */
+static void relay_to_client(struct socks5 *data, int n) {
+    if (!data->udp.client_known) {
+        return;
+    }
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < n; i++) {
+        iovs[i][1].iov_base = datagrams[i];
+        iovs[i][1].iov_len = msgs[i].msg_len;
+        iovs[i][0].iov_base = headers[i];
+        iovs[i][0].iov_len = build_header(headers[i], &peers[i]);
+        msgs[i].msg_hdr.msg_name = &data->udp.client;
+        msgs[i].msg_hdr.msg_namelen = data->udp.client_len;
+        msgs[i].msg_hdr.msg_iovlen = 2;
+        bytes += msgs[i].msg_len;
+    }
+
+    send_batch(data->udp.client_fd, msgs, (unsigned)n);
+    metrics_add_bytes(bytes);
+    user_update_metrics(data->auth.username, bytes);
+}
+
+static void udp_read(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+
+    prepare_recv(UDP_BATCH);
+    int n = recv_batch(key->fd, msgs, UDP_BATCH);
+    if (n <= 0) {
+        return;
+    }
+
+    if (key->fd == data->udp.client_fd) {
+        relay_from_client(key, data, n);
+    } else {
+        relay_to_client(data, n);
+    }
+}
+
+void udp_relay_init(const unsigned state, struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    if (selector_set_interest(key->s, data->client_fd, OP_READ) != SELECTOR_SUCCESS) {
+        close_connection(key);
+    }
+}
+
+/* la asociación vive mientras viva la conexión TCP de control */
+unsigned udp_relay_read(struct selector_key *key) {
+    uint8_t discard[512];
+    ssize_t n = recv(key->fd, discard, sizeof(discard), 0);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? UDP_RELAY : ERROR;
+    }
+    return n == 0 ? DONE : UDP_RELAY;
+}
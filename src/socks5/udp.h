@@ -0,0 +1,18 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include <stdint.h>
+#include "../utils/selector.h"
+
+#define UDP_BATCH 32
+#define UDP_MAX_DATAGRAM 65535
+
+struct request_parser;
+
+uint8_t udp_associate_open(struct selector_key *key, struct request_parser *parser);
+void udp_associate_close(struct selector_key *key);
+
+void udp_relay_init(const unsigned state, struct selector_key *key);
+unsigned udp_relay_read(struct selector_key *key);
+
+#endif
@@ -0,0 +1,671 @@
+#include "upstream.h"
+#include "socks5.h"
+#include "request.h"
+#include "../users/users.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct upstream_rule {
+    bool any;
+    int family;
+    uint8_t addr[IPV6_LENGTH];
+    unsigned prefix;
+    char domain[256];
+};
+
+struct pool_entry {
+    int fd;
+    struct upstream_negotiation neg;
+};
+
+static bool enabled = false;
+static fd_selector selector = NULL;
+
+static struct sockaddr_storage gateway;
+static socklen_t gateway_len = 0;
+static char gateway_user[256];
+static char gateway_pass[256];
+static bool gateway_auth = false;
+
+static struct upstream_rule rules[UPSTREAM_MAX_RULES];
+static int rules_count = 0;
+
+static struct pool_entry pool[UPSTREAM_POOL_MAX];
+static int pool_target = 0;
+static time_t last_failure = 0;
+
+static void pool_read(struct selector_key *key);
+static void pool_write(struct selector_key *key);
+
+static const struct fd_handler pool_handler = {
+    .handle_read = pool_read,
+    .handle_write = pool_write,
+};
+
+static int parse_gateway(const char *spec) {
+    char buf[600];
+    if (strlen(spec) >= sizeof(buf)) {
+        fprintf(stderr, "upstream proxy should be at most %zu bytes long\n", sizeof(buf) - 1);
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    char *host = buf;
+    char *at = strrchr(buf, '@');
+    if (at != NULL) {
+        *at = '\0';
+        char *colon = strchr(buf, ':');
+        if (colon == NULL) {
+            return -1;
+        }
+        *colon = '\0';
+        // RFC 1929: usuario y contraseña de hasta 255 bytes cada uno
+        const size_t ulen = strlen(buf), plen = strlen(colon + 1);
+        if (ulen >= sizeof(gateway_user) || plen >= sizeof(gateway_pass)) {
+            fprintf(stderr, "upstream proxy username and password should be at most %zu bytes long\n",
+                    sizeof(gateway_user) - 1);
+            return -1;
+        }
+        memcpy(gateway_user, buf, ulen + 1);
+        memcpy(gateway_pass, colon + 1, plen + 1);
+        gateway_auth = true;
+        host = at + 1;
+    }
+
+    char *port = NULL;
+    if (host[0] == '[') {
+        char *end = strchr(host, ']');
+        if (end == NULL || end[1] != ':') {
+            return -1;
+        }
+        *end = '\0';
+        port = end + 2;
+        host++;
+    } else {
+        port = strrchr(host, ':');
+        if (port == NULL) {
+            return -1;
+        }
+        *port++ = '\0';
+    }
+
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0 || res == NULL) {
+        return -1;
+    }
+    memcpy(&gateway, res->ai_addr, res->ai_addrlen);
+    gateway_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static int parse_rule(const char *s, struct upstream_rule *r) {
+    memset(r, 0, sizeof(*r));
+
+    if (strcmp(s, "*") == 0) {
+        r->any = true;
+        return 0;
+    }
+
+    char buf[sizeof(r->domain)];
+    const size_t len = strlen(s);
+    if (len >= sizeof(buf)) {
+        fprintf(stderr, "upstream rule should be at most %zu bytes long\n", sizeof(buf) - 1);
+        return -1;
+    }
+    memcpy(buf, s, len + 1);
+
+    char *slash = strchr(buf, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    }
+
+    if (inet_pton(AF_INET, buf, r->addr) == 1) {
+        r->family = AF_INET;
+        r->prefix = 32;
+    } else if (inet_pton(AF_INET6, buf, r->addr) == 1) {
+        r->family = AF_INET6;
+        r->prefix = 128;
+    } else if (slash == NULL) {
+        // dominio: coincide consigo mismo y con sus subdominios
+        const char *d = buf[0] == '.' ? buf + 1 : buf;
+        if (*d == '\0') {
+            return -1;
+        }
+        memcpy(r->domain, d, strlen(d) + 1);
+        return 0;
+    } else {
+        return -1;
+    }
+
+    if (slash != NULL) {
+        char *end;
+        long prefix = strtol(slash + 1, &end, 10);
+        if (*end != '\0' || prefix < 0 || prefix > (long)r->prefix) {
+            return -1;
+        }
+        r->prefix = (unsigned)prefix;
+    }
+    return 0;
+}
+
+static bool prefix_matches(const uint8_t *a, const uint8_t *b, unsigned prefix) {
+    unsigned bytes = prefix / 8;
+    unsigned bits = prefix % 8;
+    if (memcmp(a, b, bytes) != 0) {
+        return false;
+    }
+    if (bits == 0) {
+        return true;
+    }
+    uint8_t mask = (uint8_t)(0xFF << (8 - bits));
+    return (a[bytes] & mask) == (b[bytes] & mask);
+}
+
+static bool domain_matches(const char *host, size_t host_len, const char *domain) {
+    size_t len = strlen(domain);
+    if (host_len < len || strncasecmp(host + host_len - len, domain, len) != 0) {
+        return false;
+    }
+    return host_len == len || host[host_len - len - 1] == '.';
+}
+
+bool upstream_matches(const struct request_parser *parser) {
+    if (!enabled || parser->command != REQUEST_COMMAND_CONNECT) {
+        return false;
+    }
+    if (rules_count == 0) {
+        return true;
+    }
+
+    for (int i = 0; i < rules_count; i++) {
+        const struct upstream_rule *r = rules + i;
+        if (r->any) {
+            return true;
+        }
+        switch (parser->address_type) {
+            case ADDRESS_TYPE_IPV4:
+                if (r->family == AF_INET && prefix_matches(parser->dst_addr, r->addr, r->prefix)) {
+                    return true;
+                }
+                break;
+            case ADDRESS_TYPE_IPV6:
+                if (r->family == AF_INET6 && prefix_matches(parser->dst_addr, r->addr, r->prefix)) {
+                    return true;
+                }
+                break;
+            case ADDRESS_TYPE_DOMAIN:
+                if (r->domain[0] != '\0' &&
+                    domain_matches((const char *)parser->dst_addr, parser->dst_addr_length, r->domain)) {
+                    return true;
+                }
+                break;
+        }
+    }
+    return false;
+}
+
+static void queue_hello(struct upstream_negotiation *n) {
+    n->out[0] = 0x05;
+    n->out[1] = 0x01;
+    n->out[2] = gateway_auth ? 0x02 : 0x00;
+    n->out_len = 3;
+    n->out_sent = 0;
+    n->in_len = 0;
+    n->phase = UPSTREAM_HELLO_SEND;
+}
+
+static void queue_auth(struct upstream_negotiation *n) {
+    size_t ulen = strlen(gateway_user);
+    size_t plen = strlen(gateway_pass);
+    n->out[0] = 0x01;
+    n->out[1] = (uint8_t)ulen;
+    memcpy(n->out + 2, gateway_user, ulen);
+    n->out[2 + ulen] = (uint8_t)plen;
+    memcpy(n->out + 3 + ulen, gateway_pass, plen);
+    n->out_len = 3 + ulen + plen;
+    n->out_sent = 0;
+    n->in_len = 0;
+    n->phase = UPSTREAM_AUTH_SEND;
+}
+
+void upstream_queue_request(struct upstream_negotiation *n, const struct request_parser *parser) {
+    uint8_t *p = n->out;
+    *p++ = 0x05;
+    *p++ = REQUEST_COMMAND_CONNECT;
+    *p++ = 0x00;
+    *p++ = parser->address_type;
+    switch (parser->address_type) {
+        case ADDRESS_TYPE_IPV4:
+            memcpy(p, parser->dst_addr, IPV4_LENGTH);
+            p += IPV4_LENGTH;
+            break;
+        case ADDRESS_TYPE_IPV6:
+            memcpy(p, parser->dst_addr, IPV6_LENGTH);
+            p += IPV6_LENGTH;
+            break;
+        default:
+            // el FQDN viaja tal cual: resuelve el proxy padre
+            *p++ = parser->dst_addr_length;
+            memcpy(p, parser->dst_addr, parser->dst_addr_length);
+            p += parser->dst_addr_length;
+            break;
+    }
+    *p++ = (uint8_t)(parser->dst_port >> 8);
+    *p++ = (uint8_t)(parser->dst_port & 0xFF);
+    n->out_len = p - n->out;
+    n->out_sent = 0;
+    n->in_len = 0;
+    n->phase = UPSTREAM_REQUEST_SEND;
+}
+
+/* largo total de la respuesta al pedido, 0 si aún no se sabe, -1 si es inválida */
+static int reply_length(const struct upstream_negotiation *n) {
+    if (n->in_len < 5) {
+        return 0;
+    }
+    switch (n->in[3]) {
+        case ADDRESS_TYPE_IPV4:
+            return 4 + IPV4_LENGTH + 2;
+        case ADDRESS_TYPE_IPV6:
+            return 4 + IPV6_LENGTH + 2;
+        case ADDRESS_TYPE_DOMAIN:
+            return 4 + 1 + n->in[4] + 2;
+        default:
+            return -1;
+    }
+}
+
+/* recibe hasta completar `want' bytes en `in'; retorna false si hay que esperar o falló */
+static bool receive(struct upstream_negotiation *n, int fd, size_t want) {
+    if (n->in_len >= want) {
+        return true;
+    }
+    ssize_t r = recv(fd, n->in + n->in_len, want - n->in_len, 0);
+    if (r < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            n->phase = UPSTREAM_FAILED;
+        }
+        return false;
+    }
+    if (r == 0) {
+        n->phase = UPSTREAM_FAILED;
+        return false;
+    }
+    n->in_len += r;
+    return n->in_len >= want;
+}
+
+fd_interest upstream_step(struct upstream_negotiation *n, int fd, size_t *extra_offset, size_t *extra_len) {
+    while (true) {
+        switch (n->phase) {
+            case UPSTREAM_CONNECTING: {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                    n->phase = UPSTREAM_FAILED;
+                    break;
+                }
+                queue_hello(n);
+                break;
+            }
+
+            case UPSTREAM_HELLO_SEND:
+            case UPSTREAM_AUTH_SEND:
+            case UPSTREAM_REQUEST_SEND: {
+                ssize_t r = send(fd, n->out + n->out_sent, n->out_len - n->out_sent, MSG_NOSIGNAL);
+                if (r < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return OP_WRITE;
+                    }
+                    n->phase = UPSTREAM_FAILED;
+                    break;
+                }
+                n->out_sent += r;
+                if (n->out_sent < n->out_len) {
+                    return OP_WRITE;
+                }
+                n->in_len = 0;
+                n->phase = n->phase == UPSTREAM_HELLO_SEND ? UPSTREAM_HELLO_RECV
+                         : n->phase == UPSTREAM_AUTH_SEND ? UPSTREAM_AUTH_RECV
+                         : UPSTREAM_REPLY_RECV;
+                break;
+            }
+
+            case UPSTREAM_HELLO_RECV:
+                if (!receive(n, fd, 2)) {
+                    if (n->phase == UPSTREAM_FAILED) break;
+                    return OP_READ;
+                }
+                if (n->in[0] != 0x05) {
+                    n->phase = UPSTREAM_FAILED;
+                } else if (n->in[1] == 0x02 && gateway_auth) {
+                    queue_auth(n);
+                } else if (n->in[1] == 0x00) {
+                    n->phase = UPSTREAM_READY;
+                } else {
+                    n->phase = UPSTREAM_FAILED;
+                }
+                break;
+
+            case UPSTREAM_AUTH_RECV:
+                if (!receive(n, fd, 2)) {
+                    if (n->phase == UPSTREAM_FAILED) break;
+                    return OP_READ;
+                }
+                n->phase = n->in[1] == 0x00 ? UPSTREAM_READY : UPSTREAM_FAILED;
+                break;
+
+            case UPSTREAM_REPLY_RECV: {
+                // se lee todo lo disponible: lo que siga a la respuesta ya
+                // son datos del origen
+                ssize_t r = recv(fd, n->in + n->in_len, sizeof(n->in) - n->in_len, 0);
+                if (r < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return OP_READ;
+                    }
+                    n->phase = UPSTREAM_FAILED;
+                    break;
+                }
+                if (r == 0) {
+                    n->phase = UPSTREAM_FAILED;
+                    break;
+                }
+                n->in_len += r;
+                int len = reply_length(n);
+                if (len < 0 || n->in[0] != 0x05) {
+                    n->phase = UPSTREAM_FAILED;
+                    break;
+                }
+                if (len == 0 || n->in_len < (size_t)len) {
+                    return OP_READ;
+                }
+                n->reply = n->in[1];
+                *extra_offset = len;
+                *extra_len = n->in_len - len;
+                n->phase = n->reply == REQUEST_REPLY_SUCCESS ? UPSTREAM_DONE : UPSTREAM_FAILED;
+                break;
+            }
+
+            case UPSTREAM_READY:
+            case UPSTREAM_DONE:
+            case UPSTREAM_FAILED:
+                return OP_NOOP;
+        }
+    }
+}
+
+static int connect_gateway(struct upstream_negotiation *n) {
+    int fd = socket(gateway.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+    if (selector_fd_set_nio(fd) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    memset(n, 0, sizeof(*n));
+    n->reply = REQUEST_REPLY_FAILURE;
+    if (connect(fd, (struct sockaddr *)&gateway, gateway_len) == 0) {
+        queue_hello(n);
+    } else if (errno == EINPROGRESS) {
+        n->phase = UPSTREAM_CONNECTING;
+    } else {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void pool_discard(struct pool_entry *e) {
+    selector_unregister_fd(selector, e->fd);
+    close(e->fd);
+    e->fd = -1;
+}
+
+static void pool_fill(void) {
+    if (!enabled || pool_target == 0 || time(NULL) - last_failure < UPSTREAM_RETRY_SECONDS) {
+        return;
+    }
+
+    int alive = 0;
+    for (int i = 0; i < pool_target; i++) {
+        if (pool[i].fd >= 0) {
+            alive++;
+        }
+    }
+
+    for (int i = 0; i < pool_target && alive < pool_target; i++) {
+        struct pool_entry *e = pool + i;
+        if (e->fd >= 0) {
+            continue;
+        }
+        e->fd = connect_gateway(&e->neg);
+        if (e->fd < 0) {
+            last_failure = time(NULL);
+            return;
+        }
+        if (selector_register(selector, e->fd, &pool_handler, OP_WRITE, e) != SELECTOR_SUCCESS) {
+            close(e->fd);
+            e->fd = -1;
+            last_failure = time(NULL);
+            return;
+        }
+        alive++;
+    }
+}
+
+static void pool_event(struct selector_key *key) {
+    struct pool_entry *e = key->data;
+
+    if (e->neg.phase == UPSTREAM_READY) {
+        // una conexión ociosa no debería recibir nada: el padre la cerró
+        pool_discard(e);
+        return;
+    }
+
+    size_t offset, len;
+    fd_interest interest = upstream_step(&e->neg, e->fd, &offset, &len);
+    if (e->neg.phase == UPSTREAM_FAILED) {
+        pool_discard(e);
+        last_failure = time(NULL);
+        return;
+    }
+    if (e->neg.phase == UPSTREAM_READY) {
+        interest = OP_READ;
+    }
+    selector_set_interest(selector, e->fd, interest);
+}
+
+static void pool_read(struct selector_key *key) {
+    pool_event(key);
+}
+
+static void pool_write(struct selector_key *key) {
+    pool_event(key);
+}
+
+int upstream_init(fd_selector s, const char *spec, char **rule_specs, int nrules, int pool_size) {
+    enabled = false;
+    selector = s;
+    gateway_auth = false;
+    rules_count = 0;
+    pool_target = 0;
+    for (int i = 0; i < UPSTREAM_POOL_MAX; i++) {
+        pool[i].fd = -1;
+    }
+
+    if (spec == NULL) {
+        return 0;
+    }
+    if (parse_gateway(spec) != 0) {
+        fprintf(stderr, "Invalid upstream proxy: %s\n", spec);
+        return -1;
+    }
+    for (int i = 0; i < nrules && rules_count < UPSTREAM_MAX_RULES; i++) {
+        if (parse_rule(rule_specs[i], &rules[rules_count]) != 0) {
+            fprintf(stderr, "Invalid upstream rule: %s\n", rule_specs[i]);
+            return -1;
+        }
+        rules_count++;
+    }
+
+    pool_target = pool_size < 0 ? UPSTREAM_POOL_DEFAULT : pool_size;
+    if (pool_target > UPSTREAM_POOL_MAX) {
+        pool_target = UPSTREAM_POOL_MAX;
+    }
+    enabled = true;
+    last_failure = 0;
+    pool_fill();
+    return 0;
+}
+
+void upstream_destroy(void) {
+    for (int i = 0; i < UPSTREAM_POOL_MAX; i++) {
+        if (pool[i].fd >= 0) {
+            pool_discard(pool + i);
+        }
+    }
+    enabled = false;
+}
+
+bool upstream_enabled(void) {
+    return enabled;
+}
+
+void upstream_pool_maintain(void) {
+    pool_fill();
+}
+
+int upstream_open(struct upstream_negotiation *n) {
+    for (int i = 0; i < pool_target; i++) {
+        struct pool_entry *e = pool + i;
+        if (e->fd >= 0 && e->neg.phase == UPSTREAM_READY) {
+            int fd = e->fd;
+            selector_unregister_fd(selector, fd);
+            e->fd = -1;
+            memset(n, 0, sizeof(*n));
+            n->phase = UPSTREAM_READY;
+            n->reply = REQUEST_REPLY_FAILURE;
+            pool_fill();
+            return fd;
+        }
+    }
+
+    int fd = connect_gateway(n);
+    pool_fill();
+    return fd;
+}
+
+static unsigned session_reply(struct selector_key *key, struct socks5 *data, uint8_t reply) {
+    data->request.reply = reply;
+    request_build_response(data->request.parser, &data->origin_buffer, reply);
+    selector_set_interest(key->s, data->client_fd, OP_WRITE);
+    if (data->origin_fd >= 0) {
+        selector_set_interest(key->s, data->origin_fd, OP_NOOP);
+    }
+    free(data->upstream);
+    data->upstream = NULL;
+    return REQUEST_WRITE;
+}
+
+static unsigned session_open(struct selector_key *key, struct socks5 *data) {
+    int fd = upstream_open(data->upstream);
+    if (fd < 0) {
+        return session_reply(key, data, REQUEST_REPLY_NETWORK_UNREACHABLE);
+    }
+    if (register_origin_selector_from_key(key->s, fd, data) != SELECTOR_SUCCESS) {
+        close(fd);
+        return session_reply(key, data, REQUEST_REPLY_FAILURE);
+    }
+    data->origin_fd = fd;
+    data->upstream_pooled = data->upstream->phase == UPSTREAM_READY;
+    // las del pool ya están conectadas: los buffers quedan como estaban
+    sockopt_apply(fd, data->sockopt);
+    // tanto el connect en curso como el pedido pendiente esperan escritura
+    selector_set_interest(key->s, fd, OP_WRITE);
+    return UPSTREAM_NEGOTIATE;
+}
+
+unsigned upstream_session_start(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    data->upstream = malloc(sizeof(*data->upstream));
+    if (data->upstream == NULL) {
+        return session_reply(key, data, REQUEST_REPLY_FAILURE);
+    }
+    data->upstream_retried = false;
+    return session_open(key, data);
+}
+
+void upstream_session_init(const unsigned state, struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    selector_set_interest(key->s, data->client_fd, OP_NOOP);
+}
+
+unsigned upstream_session_step(struct selector_key *key) {
+    struct socks5 *data = ATTACHMENT(key);
+    struct upstream_negotiation *n = data->upstream;
+
+    if (n == NULL || key->fd != data->origin_fd) {
+        return UPSTREAM_NEGOTIATE;
+    }
+
+    size_t offset = 0, len = 0;
+    fd_interest interest = upstream_step(n, data->origin_fd, &offset, &len);
+
+    if (n->phase == UPSTREAM_READY) {
+        upstream_queue_request(n, data->request.parser);
+        interest = upstream_step(n, data->origin_fd, &offset, &len);
+    }
+
+    if (n->phase == UPSTREAM_DONE) {
+        // lo que el origen envió junto con la respuesta va al cliente
+        size_t limit;
+        uint8_t *ptr = buffer_write_ptr(&data->client_buffer, &limit);
+        if (len > limit) {
+            return session_reply(key, data, REQUEST_REPLY_FAILURE);
+        }
+        memcpy(ptr, n->in + offset, len);
+        buffer_write_adv(&data->client_buffer, len);
+
+        char dest[256];
+        build_destination_string(data->request.parser, dest, sizeof(dest));
+        user_log_connection(data->auth.username, dest, data->request.parser->dst_port);
+        return session_reply(key, data, REQUEST_REPLY_SUCCESS);
+    }
+
+    if (n->phase == UPSTREAM_FAILED) {
+        // una conexión del pool pudo haber expirado del lado del padre: se
+        // reintenta una vez con otra
+        if (data->upstream_pooled && !data->upstream_retried && n->in_len == 0) {
+            data->upstream_retried = true;
+            selector_unregister_fd(key->s, data->origin_fd);
+            close(data->origin_fd);
+            data->origin_fd = -1;
+            return session_open(key, data);
+        }
+        uint8_t reply = n->reply != REQUEST_REPLY_SUCCESS ? n->reply : REQUEST_REPLY_FAILURE;
+        return session_reply(key, data, reply);
+    }
+
+    selector_set_interest(key->s, data->origin_fd, interest);
+    return UPSTREAM_NEGOTIATE;
+}
@@ -0,0 +1,77 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../utils/selector.h"
+
+#define UPSTREAM_MAX_RULES 32
+#define UPSTREAM_POOL_MAX 64
+#define UPSTREAM_POOL_DEFAULT 4
+#define UPSTREAM_RETRY_SECONDS 2
+
+struct request_parser;
+
+enum upstream_phase {
+    UPSTREAM_CONNECTING,
+    UPSTREAM_HELLO_SEND,
+    UPSTREAM_HELLO_RECV,
+    UPSTREAM_AUTH_SEND,
+    UPSTREAM_AUTH_RECV,
+    /* autenticada, lista para recibir un pedido (pool) */
+    UPSTREAM_READY,
+    UPSTREAM_REQUEST_SEND,
+    UPSTREAM_REPLY_RECV,
+    UPSTREAM_DONE,
+    UPSTREAM_FAILED,
+};
+
+/* negociación SOCKS5 no bloqueante contra el proxy padre */
+struct upstream_negotiation {
+    enum upstream_phase phase;
+    uint8_t out[600];
+    size_t out_len;
+    size_t out_sent;
+    uint8_t in[600];
+    size_t in_len;
+    /* REP de la respuesta al pedido */
+    uint8_t reply;
+};
+
+int upstream_init(fd_selector s, const char *spec, char **rules, int nrules, int pool_size);
+void upstream_destroy(void);
+bool upstream_enabled(void);
+
+/* true si el destino del pedido debe salir por el proxy padre */
+bool upstream_matches(const struct request_parser *parser);
+
+/* refresca el pool si le faltan conexiones; se llama desde el loop principal */
+void upstream_pool_maintain(void);
+
+/*
+ * Obtiene una conexión hacia el proxy padre. Si hay una autenticada en el pool
+ * se entrega en UPSTREAM_READY; si no se inicia una nueva. Retorna el fd
+ * (no registrado en el selector) o -1.
+ */
+int upstream_open(struct upstream_negotiation *n);
+
+/* encola el pedido CONNECT del cliente; la negociación debe estar READY */
+void upstream_queue_request(struct upstream_negotiation *n, const struct request_parser *parser);
+
+/*
+ * Avanza la negociación todo lo posible sin bloquear. Retorna el interés
+ * que necesita sobre el fd. Los bytes recibidos luego de la respuesta al
+ * pedido quedan en `in' a partir de `*extra_offset' (`*extra_len' bytes).
+ */
+fd_interest upstream_step(struct upstream_negotiation *n, int fd, size_t *extra_offset, size_t *extra_len);
+
+/*
+ * Estado UPSTREAM_NEGOTIATE de la sesión: el CONNECT se reenvía al proxy
+ * padre sin resolver el destino localmente.
+ */
+unsigned upstream_session_start(struct selector_key *key);
+void upstream_session_init(const unsigned state, struct selector_key *key);
+unsigned upstream_session_step(struct selector_key *key);
+
+#endif
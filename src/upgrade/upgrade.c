@@ -0,0 +1,474 @@
+#include "upgrade.h"
+#include "../users/users.h"
+#include "../metrics/metrics.h"
+#include "../socks5/bind.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define UPGRADE_MAGIC "S5UP"
+#define UPGRADE_VERSION 3
+/* fds que acompañan al listener SOCKS, en este orden */
+#define UPGRADE_FD_ADMIN 0x01
+#define UPGRADE_FD_USERDB 0x02
+/* `nbind' listeners del pool de BIND, al final */
+#define UPGRADE_FD_BIND 0x04
+#define UPGRADE_MAX_FDS (3 + BIND_POOL_MAX)
+/* usuarios serializados: a lo sumo MAX_USERS_DB registros de ~540 bytes */
+#define UPGRADE_STATE_MAX (MAX_USERS_DB * 540 + 2)
+
+struct upgrade_header {
+    char magic[4];
+    uint8_t version;
+    uint8_t nfds;
+    /* UPGRADE_FD_* */
+    uint8_t flags;
+    uint8_t nbind;
+    /* bit i: el listener de BIND i lo usa una sesión del proceso viejo */
+    uint8_t bind_busy[BIND_POOL_MAX / 8];
+    uint8_t users_len[4];
+    uint8_t metrics_len[4];
+};
+
+static volatile sig_atomic_t pending = 0;
+static char exe_path[4096];
+static char **exe_argv = NULL;
+
+/* proceso viejo: traspaso en curso, atendido desde el selector */
+static struct {
+    fd_selector s;
+    int fd;
+    pid_t pid;
+    /* usuarios y métricas que siguen al encabezado */
+    uint8_t *buf;
+    size_t len;
+    size_t sent;
+    time_t deadline;
+    /* el proceso nuevo confirmó y todavía no se informó */
+    bool took_over;
+} handoff = {.fd = -1, .pid = -1};
+
+/* proceso nuevo que no confirmó: se lo termina y se lo recoge sin bloquear */
+static pid_t reap_pid = -1;
+static time_t reap_deadline = 0;
+
+/* proceso nuevo */
+static int channel_fd = -1;
+static uint8_t *users_state = NULL;
+static size_t users_state_len = 0;
+static uint8_t metrics_state[METRICS_SERIALIZED_SIZE];
+static size_t metrics_state_len = 0;
+
+static void
+upgrade_signal(const int signal) {
+    pending = 1;
+}
+
+void
+upgrade_init(int argc, char **argv) {
+    // parse_args modifica los argumentos (ej: -u name:pass): se copian antes
+    exe_argv = calloc(argc + 1, sizeof(char *));
+    for (int i = 0; exe_argv != NULL && i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        exe_argv[i] = malloc(len);
+        if (exe_argv[i] != NULL) {
+            memcpy(exe_argv[i], argv[i], len);
+        }
+    }
+    ssize_t n = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    if (n > 0) {
+        exe_path[n] = '\0';
+    } else {
+        // sin /proc (macOS) se usa la ruta con la que se lanzó
+        strncpy(exe_path, argv[0], sizeof(exe_path) - 1);
+    }
+    // con signal() el handler se restablece tras la primera señal y la
+    // siguiente terminaría el proceso
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = upgrade_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+void
+upgrade_request(void) {
+    pending = 1;
+}
+
+bool
+upgrade_pending(void) {
+    return pending != 0;
+}
+
+static void
+put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int
+read_full(int fd, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+send_listeners(int channel, int socks_fd, int admin_fd, int userdb_fd, size_t users_len, size_t metrics_len) {
+    struct upgrade_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, UPGRADE_MAGIC, 4);
+    h.version = UPGRADE_VERSION;
+    put_u32(h.users_len, users_len);
+    put_u32(h.metrics_len, metrics_len);
+
+    // con la base en archivo viaja su fd y, con él, el flock
+    int fds[UPGRADE_MAX_FDS] = {socks_fd};
+    h.nfds = 1;
+    if (admin_fd >= 0) {
+        fds[h.nfds++] = admin_fd;
+        h.flags |= UPGRADE_FD_ADMIN;
+    }
+    if (userdb_fd >= 0) {
+        fds[h.nfds++] = userdb_fd;
+        h.flags |= UPGRADE_FD_USERDB;
+    }
+    // los puertos de BIND siguen ocupados hasta que este proceso termina:
+    // el nuevo adopta los mismos sockets en lugar de abrirlos
+    bool busy[BIND_POOL_MAX];
+    const int nbind = bind_pool_export(fds + h.nfds, busy, BIND_POOL_MAX);
+    if (nbind > 0) {
+        for (int i = 0; i < nbind; i++) {
+            if (busy[i]) {
+                h.bind_busy[i / 8] |= 1 << (i % 8);
+            }
+        }
+        h.nbind = (uint8_t)nbind;
+        h.nfds += nbind;
+        h.flags |= UPGRADE_FD_BIND;
+    }
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = {.iov_base = &h, .iov_len = sizeof(h)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(h.nfds * sizeof(int));
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(h.nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, h.nfds * sizeof(int));
+
+    return sendmsg(channel, &msg, 0) == (ssize_t)sizeof(h) ? 0 : -1;
+}
+
+static pid_t
+spawn(int child_end) {
+    char env[32];
+    snprintf(env, sizeof(env), "%d", child_end);
+    setenv(UPGRADE_ENV, env, 1);
+
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0 || max_fd > 65536) {
+        max_fd = 65536;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // las sesiones no deben quedar abiertas en el proceso nuevo: solo
+        // sobrevive el canal, los listeners viajan por SCM_RIGHTS
+        for (int fd = 3; fd < max_fd; fd++) {
+            if (fd != child_end) {
+                close(fd);
+            }
+        }
+        if (exe_argv != NULL) {
+            execv(exe_path, exe_argv);
+        }
+        _exit(127);
+    }
+    unsetenv(UPGRADE_ENV);
+    return pid;
+}
+
+static void
+reap(pid_t pid) {
+    kill(pid, SIGTERM);
+    reap_pid = pid;
+    reap_deadline = time(NULL) + UPGRADE_ACK_TIMEOUT;
+}
+
+static void
+handoff_finish(bool ok) {
+    selector_unregister_fd(handoff.s, handoff.fd);
+    close(handoff.fd);
+    free(handoff.buf);
+    handoff.buf = NULL;
+    handoff.fd = -1;
+
+    if (ok) {
+        printf("Upgrade: process %d took over the listeners\n", (int)handoff.pid);
+        handoff.took_over = true;
+        users_detach();
+    } else {
+        fprintf(stderr, "Upgrade failed: new process did not take over\n");
+        users_freeze(false);
+        reap(handoff.pid);
+    }
+    handoff.pid = -1;
+}
+
+/* envía el estado a medida que el canal lo acepta y después espera la confirmación */
+static void
+handoff_write(struct selector_key *key) {
+    while (handoff.sent < handoff.len) {
+        ssize_t n = write(key->fd, handoff.buf + handoff.sent, handoff.len - handoff.sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                handoff_finish(false);
+            }
+            return;
+        }
+        handoff.sent += n;
+    }
+    if (selector_set_interest_key(key, OP_READ) != SELECTOR_SUCCESS) {
+        handoff_finish(false);
+    }
+}
+
+static void
+handoff_read(struct selector_key *key) {
+    uint8_t ack;
+    ssize_t n = read(key->fd, &ack, 1);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    // un cierre del canal es que el proceso nuevo no arrancó
+    handoff_finish(n == 1 && ack == 'K');
+}
+
+static const struct fd_handler handoff_handler = {
+    .handle_read = handoff_read,
+    .handle_write = handoff_write,
+};
+
+int
+upgrade_start(fd_selector s, int socks_fd, int admin_fd) {
+    // uno en curso o uno fallido sin recoger: se reintenta en otra vuelta
+    if (handoff.fd >= 0 || reap_pid > 0) {
+        return -1;
+    }
+    pending = 0;
+
+    // con base en archivo el proceso nuevo la abre: no hace falta copiarla
+    size_t users_len = users_persistent() ? 0 : users_serialize_bound();
+    uint8_t *buf = malloc(users_len + METRICS_SERIALIZED_SIZE);
+    if (buf == NULL) {
+        return -1;
+    }
+    if (users_len > 0) {
+        users_len = users_serialize(buf, users_len);
+    }
+    size_t metrics_len = metrics_serialize(buf + users_len, METRICS_SERIALIZED_SIZE);
+
+    int sp[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) < 0) {
+        free(buf);
+        return -1;
+    }
+
+    // el proceso nuevo abre la base mientras este sigue atendiendo
+    users_freeze(true);
+    pid_t pid = spawn(sp[1]);
+    close(sp[1]);
+    if (pid < 0) {
+        users_freeze(false);
+        close(sp[0]);
+        free(buf);
+        return -1;
+    }
+
+    // el encabezado entra en el buffer vacío del canal; el resto se envía
+    // desde el selector
+    const fd_interest interest = users_len + metrics_len > 0 ? OP_WRITE : OP_READ;
+    if (selector_fd_set_nio(sp[0]) == -1 ||
+        send_listeners(sp[0], socks_fd, admin_fd, users_db_fd(), users_len, metrics_len) != 0 ||
+        selector_register(s, sp[0], &handoff_handler, interest, NULL) != SELECTOR_SUCCESS) {
+        fprintf(stderr, "Upgrade failed: could not hand over the listeners\n");
+        users_freeze(false);
+        close(sp[0]);
+        free(buf);
+        reap(pid);
+        return -1;
+    }
+
+    handoff.s = s;
+    handoff.fd = sp[0];
+    handoff.pid = pid;
+    handoff.buf = buf;
+    handoff.len = users_len + metrics_len;
+    handoff.sent = 0;
+    handoff.deadline = time(NULL) + UPGRADE_ACK_TIMEOUT;
+    return 0;
+}
+
+bool
+upgrade_took_over(void) {
+    const bool ret = handoff.took_over;
+    handoff.took_over = false;
+    return ret;
+}
+
+void
+upgrade_maintain(void) {
+    const time_t now = time(NULL);
+    if (handoff.fd >= 0 && now >= handoff.deadline) {
+        handoff_finish(false);
+    }
+    if (reap_pid > 0) {
+        if (waitpid(reap_pid, NULL, WNOHANG) != 0) {
+            reap_pid = -1;
+        } else if (now >= reap_deadline) {
+            // no atendió SIGTERM
+            kill(reap_pid, SIGKILL);
+        }
+    }
+}
+
+void
+upgrade_abort(void) {
+    if (handoff.fd >= 0) {
+        handoff_finish(false);
+    }
+    if (reap_pid > 0) {
+        kill(reap_pid, SIGKILL);
+        waitpid(reap_pid, NULL, 0);
+        reap_pid = -1;
+    }
+}
+
+bool
+upgrade_inherited(void) {
+    return getenv(UPGRADE_ENV) != NULL;
+}
+
+int
+upgrade_receive(int *socks_fd, int *admin_fd) {
+    const char *env = getenv(UPGRADE_ENV);
+    *socks_fd = *admin_fd = -1;
+    if (env == NULL) {
+        return -1;
+    }
+    channel_fd = atoi(env);
+    unsetenv(UPGRADE_ENV);
+
+    struct upgrade_header h;
+    int fds[UPGRADE_MAX_FDS];
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+
+    struct iovec iov = {.iov_base = &h, .iov_len = sizeof(h)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(channel_fd, &msg, 0) != (ssize_t)sizeof(h) ||
+        memcmp(h.magic, UPGRADE_MAGIC, 4) != 0 || h.version != UPGRADE_VERSION) {
+        return -1;
+    }
+
+    const int nbind = h.flags & UPGRADE_FD_BIND ? h.nbind : 0;
+    const int expected = 1 + ((h.flags & UPGRADE_FD_ADMIN) != 0) + ((h.flags & UPGRADE_FD_USERDB) != 0) + nbind;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        nbind > BIND_POOL_MAX || h.nfds != expected || cmsg->cmsg_len != CMSG_LEN(h.nfds * sizeof(int))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), h.nfds * sizeof(int));
+    int i = 0;
+    *socks_fd = fds[i++];
+    *admin_fd = h.flags & UPGRADE_FD_ADMIN ? fds[i++] : -1;
+    if (h.flags & UPGRADE_FD_USERDB) {
+        users_inherit_db(fds[i++]);
+    }
+    if (nbind > 0) {
+        bool busy[BIND_POOL_MAX];
+        for (int b = 0; b < nbind; b++) {
+            busy[b] = (h.bind_busy[b / 8] >> (b % 8)) & 1;
+        }
+        bind_pool_inherit(fds + i, busy, nbind);
+    }
+
+    users_state_len = get_u32(h.users_len);
+    metrics_state_len = get_u32(h.metrics_len);
+    if (users_state_len > UPGRADE_STATE_MAX || metrics_state_len > sizeof(metrics_state)) {
+        return -1;
+    }
+    users_state = malloc(users_state_len > 0 ? users_state_len : 1);
+    if (users_state == NULL ||
+        read_full(channel_fd, users_state, users_state_len) < 0 ||
+        read_full(channel_fd, metrics_state, metrics_state_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void
+upgrade_restore(void) {
+    if (users_state != NULL && users_state_len > 0 && !users_deserialize(users_state, users_state_len)) {
+        fprintf(stderr, "Warning: could not restore users from previous process\n");
+    }
+    if (metrics_state_len > 0 && !metrics_deserialize(metrics_state, metrics_state_len)) {
+        fprintf(stderr, "Warning: could not restore metrics from previous process\n");
+    }
+    free(users_state);
+    users_state = NULL;
+}
+
+void
+upgrade_ready(void) {
+    if (channel_fd < 0) {
+        return;
+    }
+    const uint8_t ack = 'K';
+    if (write(channel_fd, &ack, 1) != 1) {
+        fprintf(stderr, "Warning: could not notify previous process\n");
+    }
+    close(channel_fd);
+    channel_fd = -1;
+}
@@ -0,0 +1,74 @@
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <stdbool.h>
+#include <time.h>
+#include "../utils/selector.h"
+
+/*
+ * Actualización en caliente del binario.
+ *
+ * Ante SIGUSR2 o el comando de administración UPGRADE el proceso ejecuta de
+ * nuevo su binario (ya reemplazado en disco) y le pasa por un socket Unix los
+ * sockets pasivos SOCKS, de administración y del pool de BIND (SCM_RIGHTS)
+ * junto con el estado de usuarios y métricas; con base en archivo, el fd de
+ * la base en lugar de los usuarios. Cuando el proceso nuevo confirma que está
+ * atendiendo, el viejo deja de aceptar conexiones y drena las sesiones
+ * existentes hasta que terminen o venza el plazo.
+ */
+
+/* variable de entorno con la que el proceso nuevo recibe el socket Unix */
+#define UPGRADE_ENV "SOCKS5D_UPGRADE_FD"
+/* segundos que se espera la confirmación del proceso nuevo */
+#define UPGRADE_ACK_TIMEOUT 5
+
+/*
+ * recuerda cómo volver a ejecutar el binario e instala el handler de SIGUSR2.
+ * Llamar antes de interpretar los argumentos.
+ */
+void upgrade_init(int argc, char **argv);
+
+/* pide una actualización; se atiende desde el loop principal */
+void upgrade_request(void);
+bool upgrade_pending(void);
+
+/*
+ * Proceso viejo: lanza el binario nuevo, le entrega los listeners y registra
+ * en `s' el canal por el que se envía el estado y llega la confirmación, sin
+ * bloquear el loop. Retorna 0 si el traspaso quedó en curso; -1 si falló o si
+ * todavía hay uno anterior, y en ese caso el pedido sigue pendiente.
+ */
+int upgrade_start(fd_selector s, int socks_fd, int admin_fd);
+
+/*
+ * true una vez, cuando el proceso nuevo confirmó que atiende: el llamador
+ * debe dejar de aceptar y drenar. Ante cualquier error el proceso viejo
+ * sigue atendiendo como antes.
+ */
+bool upgrade_took_over(void);
+
+/*
+ * vence el traspaso que no confirmó en UPGRADE_ACK_TIMEOUT y recoge al
+ * proceso nuevo fallido; se llama desde el loop principal
+ */
+void upgrade_maintain(void);
+
+/* corta un traspaso en curso al terminar; llamar antes de destruir el selector */
+void upgrade_abort(void);
+
+/* Proceso nuevo: true si fue lanzado por una actualización */
+bool upgrade_inherited(void);
+
+/*
+ * Proceso nuevo: recibe los listeners (admin_fd queda en -1 si el proceso
+ * viejo no tenía) y guarda el estado para `upgrade_restore'.
+ */
+int upgrade_receive(int *socks_fd, int *admin_fd);
+
+/* aplica el estado recibido; llamar luego de inicializar usuarios y métricas */
+void upgrade_restore(void);
+
+/* confirma al proceso viejo que ya se está atendiendo */
+void upgrade_ready(void);
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include "userdb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#define USERDB_MAGIC "S5DB"
+#define USERDB_VERSION 1
+#define USERDB_INITIAL_CAPACITY 64
+
+/* valores de una entrada del índice; el resto es (número de registro + 1) */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED UINT32_MAX
+
+struct userdb_header {
+    char magic[4];
+    uint32_t version;
+    /* sizeof(struct user) del binario que creó el archivo */
+    uint32_t record_size;
+    uint32_t capacity;
+    /* registros escritos, vivos y muertos */
+    uint32_t used;
+    uint32_t live;
+    /* potencia de 2, al menos el doble de la capacidad */
+    uint32_t index_slots;
+    uint32_t reserved;
+};
+
+static struct {
+    char *path;
+    int fd;
+    uint8_t *base;
+    size_t size;
+    struct userdb_header *header;
+    uint32_t *index;
+    struct user *records;
+    /* otro proceso está abriendo el archivo: no cambiar su estructura */
+    bool frozen;
+} db = {.fd = -1};
+
+/* fd del archivo recibido del proceso anterior, ya bloqueado */
+static int inherited_fd = -1;
+
+static uint32_t hash(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t slots_for(size_t capacity) {
+    size_t n = 8;
+    while (n < 2 * capacity) {
+        n <<= 1;
+    }
+    return n;
+}
+
+static size_t map_size(size_t capacity, size_t slots, size_t record_size) {
+    return sizeof(struct userdb_header) + slots * sizeof(uint32_t) + capacity * record_size;
+}
+
+static void attach(uint8_t *base, size_t size) {
+    db.base = base;
+    db.size = size;
+    db.header = (struct userdb_header *)base;
+    db.index = (uint32_t *)(base + sizeof(struct userdb_header));
+    db.records = (struct user *)(db.index + db.header->index_slots);
+}
+
+/*
+ * Busca `username' en el índice. Si no está y `insert' es true retorna la
+ * primera entrada libre (vacía o borrada) del recorrido; si no, NULL.
+ */
+static uint32_t *probe(uint32_t *index, size_t slots, const struct user *records,
+                       const char *username, bool insert) {
+    size_t mask = slots - 1;
+    uint32_t *free_slot = NULL;
+    for (size_t i = hash(username) & mask; ; i = (i + 1) & mask) {
+        uint32_t v = index[i];
+        if (v == SLOT_EMPTY) {
+            if (!insert) {
+                return NULL;
+            }
+            return free_slot != NULL ? free_slot : &index[i];
+        }
+        if (v == SLOT_DELETED) {
+            if (free_slot == NULL) {
+                free_slot = &index[i];
+            }
+        } else if (strcmp(records[v - 1].username, username) == 0) {
+            return &index[i];
+        }
+    }
+}
+
+/*
+ * Un solo proceso escribe el archivo: el que tiene el flock. El lock es de la
+ * descripción abierta, así que viaja con el fd en una actualización en
+ * caliente.
+ */
+static int lock_file(int fd, const char *path) {
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+        return 0;
+    }
+    if (errno == EWOULDBLOCK) {
+        fprintf(stderr, "User database in use by another process: %s\n", path);
+    } else {
+        perror(path);
+    }
+    return -1;
+}
+
+static uint8_t *map_create(const char *path, size_t size, int *fd) {
+    *fd = -1;
+    if (path == NULL) {
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+
+    int f = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (f < 0) {
+        return NULL;
+    }
+    // el que reemplaza al original con rename conserva la exclusividad
+    if (lock_file(f, path) < 0 || ftruncate(f, (off_t)size) < 0) {
+        close(f);
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    if (p == MAP_FAILED) {
+        close(f);
+        return NULL;
+    }
+    *fd = f;
+    return p;
+}
+
+static void release(void) {
+    if (db.base != NULL) {
+        munmap(db.base, db.size);
+    }
+    if (db.fd >= 0) {
+        close(db.fd);
+    }
+    db.base = NULL;
+    db.size = 0;
+    db.fd = -1;
+    db.header = NULL;
+    db.index = NULL;
+    db.records = NULL;
+}
+
+/*
+ * Reescribe los registros vivos de `src' (`used' registros de `stride' bytes)
+ * en un mapeo nuevo de `capacity' registros. Los registros más cortos que
+ * `struct user' (bases de versiones anteriores) se completan con ceros.
+ * Con archivo, el nuevo se arma en `path.tmp' y reemplaza al original.
+ */
+static int rebuild_from(const uint8_t *src, size_t stride, size_t used, size_t capacity) {
+    size_t slots = slots_for(capacity);
+    size_t size = map_size(capacity, slots, sizeof(struct user));
+
+    char *tmp = NULL;
+    if (db.path != NULL) {
+        size_t len = strlen(db.path) + sizeof(".tmp");
+        tmp = malloc(len);
+        if (tmp == NULL) {
+            return -1;
+        }
+        snprintf(tmp, len, "%s.tmp", db.path);
+    }
+
+    int fd;
+    uint8_t *base = map_create(tmp, size, &fd);
+    if (base == NULL) {
+        free(tmp);
+        return -1;
+    }
+
+    struct userdb_header *h = (struct userdb_header *)base;
+    memcpy(h->magic, USERDB_MAGIC, sizeof(h->magic));
+    h->version = USERDB_VERSION;
+    h->record_size = sizeof(struct user);
+    h->capacity = (uint32_t)capacity;
+    h->index_slots = (uint32_t)slots;
+    uint32_t *index = (uint32_t *)(base + sizeof(*h));
+    struct user *records = (struct user *)(index + slots);
+
+    for (size_t i = 0; i < used; i++) {
+        struct user *r = &records[h->used];
+        memcpy(r, src + i * stride, stride);
+        if (!r->active) {
+            memset(r, 0, stride);
+            continue;
+        }
+        *probe(index, slots, records, r->username, true) = h->used + 1;
+        h->used++;
+    }
+    h->live = h->used;
+
+    if (tmp != NULL) {
+        if (msync(base, size, MS_SYNC) < 0 || rename(tmp, db.path) < 0) {
+            munmap(base, size);
+            close(fd);
+            unlink(tmp);
+            free(tmp);
+            return -1;
+        }
+        free(tmp);
+    }
+
+    release();
+    db.fd = fd;
+    attach(base, size);
+    return 0;
+}
+
+static int rebuild(size_t capacity) {
+    size_t used = db.base != NULL ? db.header->used : 0;
+    return rebuild_from((const uint8_t *)db.records, sizeof(struct user), used, capacity);
+}
+
+static void sync_changes(void) {
+    if (db.path != NULL) {
+        msync(db.base, db.size, MS_ASYNC);
+    }
+}
+
+/*
+ * El índice y los registros se usan tal cual quedaron en el archivo: cada
+ * entrada tiene que apuntar a un registro escrito, tiene que quedar alguna
+ * vacía para que termine probe() y los strings de cada registro tienen que
+ * estar terminados.
+ */
+static bool consistent(const uint32_t *index, size_t slots, const uint8_t *records,
+                       size_t record_size, size_t used) {
+    bool empty = false;
+    for (size_t i = 0; i < slots; i++) {
+        const uint32_t v = index[i];
+        if (v == SLOT_EMPTY) {
+            empty = true;
+        } else if (v != SLOT_DELETED && v > used) {
+            return false;
+        }
+    }
+    if (!empty) {
+        return false;
+    }
+
+    for (size_t i = 0; i < used; i++) {
+        const uint8_t *r = records + i * record_size;
+        if (r[offsetof(struct user, username) + MAX_USERNAME - 1] != '\0' ||
+            r[offsetof(struct user, password) + MAX_PASSWORD - 1] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int load(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct userdb_header)) {
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+
+    // los campos de `struct user' se agregan al final: un registro más corto
+    // es de una versión anterior y se migra
+    const struct userdb_header *h = p;
+    size_t slots = h->index_slots;
+    size_t record_size = h->record_size;
+    if (memcmp(h->magic, USERDB_MAGIC, sizeof(h->magic)) != 0 || h->version != USERDB_VERSION ||
+        record_size < offsetof(struct user, limits) || record_size > sizeof(struct user) ||
+        h->capacity == 0 || h->capacity > MAX_USERS_DB ||
+        slots != slots_for(h->capacity) || h->used > h->capacity || h->live > h->used ||
+        map_size(h->capacity, slots, record_size) != size) {
+        munmap(p, size);
+        return -1;
+    }
+    const uint32_t *index = (const uint32_t *)((const uint8_t *)p + sizeof(*h));
+    const uint8_t *records = (const uint8_t *)(index + slots);
+    if (!consistent(index, slots, records, record_size, h->used)) {
+        munmap(p, size);
+        return -1;
+    }
+
+    if (record_size == sizeof(struct user)) {
+        db.fd = fd;
+        attach(p, size);
+        return 0;
+    }
+
+    int ret = rebuild_from(records, record_size, h->used, h->capacity);
+    munmap(p, size);
+    if (ret == 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+int userdb_open(const char *path) {
+    userdb_close();
+
+    if (path != NULL) {
+        db.path = strdup(path);
+        if (db.path == NULL) {
+            return -1;
+        }
+        int fd = inherited_fd >= 0 ? inherited_fd : open(path, O_RDWR | O_CLOEXEC);
+        inherited_fd = -1;
+        if (fd >= 0) {
+            if (lock_file(fd, path) < 0) {
+                close(fd);
+                userdb_close();
+                return -1;
+            }
+            if (load(fd) == 0) {
+                return 0;
+            }
+            close(fd);
+            fprintf(stderr, "Invalid user database: %s\n", path);
+            userdb_close();
+            return -1;
+        }
+        if (errno != ENOENT) {
+            perror(path);
+            userdb_close();
+            return -1;
+        }
+    }
+
+    if (rebuild(USERDB_INITIAL_CAPACITY) < 0) {
+        userdb_close();
+        return -1;
+    }
+    return 0;
+}
+
+void userdb_close(void) {
+    if (db.base != NULL && db.path != NULL) {
+        msync(db.base, db.size, MS_SYNC);
+    }
+    release();
+    free(db.path);
+    db.path = NULL;
+    db.frozen = false;
+}
+
+bool userdb_persistent(void) {
+    return db.path != NULL;
+}
+
+void userdb_inherit(int fd) {
+    inherited_fd = fd;
+}
+
+int userdb_fd(void) {
+    return db.path != NULL ? db.fd : -1;
+}
+
+void userdb_freeze(bool frozen) {
+    db.frozen = frozen;
+}
+
+void userdb_detach(void) {
+    if (db.base == NULL || db.path == NULL) {
+        return;
+    }
+    msync(db.base, db.size, MS_SYNC);
+    // en la misma dirección: los registros que se estén usando no se mueven
+    void *p = mmap(db.base, db.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, db.fd, 0);
+    if (p == MAP_FAILED) {
+        perror("Detaching user database");
+        return;
+    }
+    close(db.fd);
+    db.fd = -1;
+    free(db.path);
+    db.path = NULL;
+    db.frozen = false;
+}
+
+struct user *userdb_find(const char *username) {
+    if (db.base == NULL) {
+        return NULL;
+    }
+    uint32_t *slot = probe(db.index, db.header->index_slots, db.records, username, false);
+    return slot == NULL ? NULL : &db.records[*slot - 1];
+}
+
+struct user *userdb_put(const struct user *u) {
+    if (db.base == NULL || db.frozen || u->username[0] == '\0') {
+        return NULL;
+    }
+    // `u' puede apuntar a un registro que la compactación va a mover
+    struct user copy = *u;
+
+    if (db.header->used == db.header->capacity) {
+        size_t capacity = db.header->capacity;
+        if ((size_t)db.header->live + 1 > capacity / 2) {
+            capacity = capacity * 2 > MAX_USERS_DB ? MAX_USERS_DB : capacity * 2;
+        }
+        if (capacity <= db.header->live || rebuild(capacity) < 0) {
+            return NULL;
+        }
+    }
+
+    uint32_t *slot = probe(db.index, db.header->index_slots, db.records, copy.username, true);
+    uint32_t i = db.header->used;
+    copy.active = true;
+    db.records[i] = copy;
+    db.header->used++;
+
+    if (*slot != SLOT_EMPTY && *slot != SLOT_DELETED) {
+        db.records[*slot - 1].active = false;
+    } else {
+        db.header->live++;
+    }
+    *slot = i + 1;
+
+    sync_changes();
+    return &db.records[i];
+}
+
+bool userdb_remove(const char *username) {
+    if (db.base == NULL || db.frozen) {
+        return false;
+    }
+    uint32_t *slot = probe(db.index, db.header->index_slots, db.records, username, false);
+    if (slot == NULL) {
+        return false;
+    }
+    db.records[*slot - 1].active = false;
+    *slot = SLOT_DELETED;
+    db.header->live--;
+    sync_changes();
+    return true;
+}
+
+void userdb_clear(void) {
+    if (db.base == NULL || db.frozen) {
+        return;
+    }
+    memset(db.index, 0, db.header->index_slots * sizeof(uint32_t));
+    db.header->used = 0;
+    db.header->live = 0;
+    sync_changes();
+}
+
+size_t userdb_count(void) {
+    return db.base == NULL ? 0 : db.header->live;
+}
+
+size_t userdb_records(void) {
+    return db.base == NULL ? 0 : db.header->used;
+}
+
+struct user *userdb_record(size_t i) {
+    return i < userdb_records() ? &db.records[i] : NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef USERDB_H
+#define USERDB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "users.h"
+
+/*
+ * Almacenamiento de usuarios en un archivo mapeado en memoria.
+ *
+ * El archivo contiene un encabezado, un índice hash (direccionamiento abierto)
+ * y registros de tamaño fijo (`struct user'). Abrirlo no requiere parsear
+ * nada: se mapea y se valida el encabezado.
+ *
+ * Las altas y los cambios de contraseña o rol agregan un registro nuevo al
+ * final y mueven la entrada del índice; el registro anterior queda muerto.
+ * Cuando se llena la capacidad se reescribe el archivo (compactación) en uno
+ * temporal que reemplaza al original con rename(2), duplicando la capacidad
+ * si la mayoría de los registros siguen vivos.
+ *
+ * Las estadísticas (bytes, conexiones) se actualizan sobre el registro vivo.
+ *
+ * Los campos nuevos de `struct user' van al final: al abrir una base con
+ * registros más cortos se reescribe completando cada uno con ceros.
+ *
+ * Sin ruta, la misma estructura vive en memoria anónima y se pierde al salir.
+ *
+ * Un solo proceso usa el archivo: se toma un flock exclusivo al abrirlo. En
+ * una actualización en caliente el proceso viejo le pasa el fd (y con él el
+ * lock) al nuevo, no cambia la estructura mientras tanto y, cuando el nuevo
+ * confirma, sigue sobre una copia privada.
+ *
+ * Los punteros que retorna el módulo son válidos hasta la próxima
+ * modificación (`userdb_put', `userdb_remove', `userdb_clear').
+ */
+
+/** abre (o crea) la base en `path'; NULL para memoria. -1 si falla */
+int userdb_open(const char *path);
+
+/** sincroniza y libera el mapeo */
+void userdb_close(void);
+
+/** true si la base está respaldada por un archivo */
+bool userdb_persistent(void);
+
+/** el próximo `userdb_open' usa `fd' (recibido del proceso anterior) en lugar de abrir la ruta */
+void userdb_inherit(int fd);
+
+/** fd del archivo para traspasarlo, o -1 si la base está en memoria */
+int userdb_fd(void);
+
+/** con `frozen' las altas, bajas y cambios fallan; las estadísticas siguen */
+void userdb_freeze(bool frozen);
+
+/**
+ * deja de escribir el archivo: el mapeo pasa a ser una copia privada en la
+ * misma dirección y se cierra el fd (el lock queda en el proceso nuevo)
+ */
+void userdb_detach(void);
+
+/** registro vivo de `username', o NULL */
+struct user *userdb_find(const char *username);
+
+/**
+ * agrega `u' como registro vivo, reemplazando al de igual nombre si existe.
+ * Retorna el registro escrito o NULL si no hay lugar.
+ */
+struct user *userdb_put(const struct user *u);
+
+/** marca como muerto el registro de `username' */
+bool userdb_remove(const char *username);
+
+/** elimina todos los registros */
+void userdb_clear(void);
+
+/** cantidad de usuarios vivos */
+size_t userdb_count(void);
+
+/** cantidad de registros escritos (vivos y muertos), para recorrerlos */
+size_t userdb_records(void);
+
+/** i-ésimo registro; hay que chequear `active' */
+struct user *userdb_record(size_t i);
+
+#endif
@@ -1,66 +1,244 @@
 #include "users.h"
+#include "userdb.h"
+#include "../auth/password.h"
 #include "../utils/args.h"
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
 
-static struct user users_db[MAX_USERS_DB];
-static int users_count = 0;
-
 static struct user_connection connections_db[MAX_CONNECTION_LOG];
 static int connections_count = 0;
 static int connections_next_index = 0;
 
+static struct user_credential credentials_db[MAX_CREDENTIALS_LOG];
+static int credentials_count = 0;
+static int credentials_next_index = 0;
+
 static pthread_mutex_t users_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void users_init(struct socks5args *args) {
+/*
+ * Túneles abiertos y ventana de tasa de cada usuario. Son del proceso: no van
+ * en `struct user', que en una actualización en caliente está en un archivo
+ * que ven los dos procesos. Índice hash por nombre (direccionamiento abierto);
+ * las entradas sin sesiones ni ventana vigente se descartan al agrandarlo.
+ */
+struct user_state {
+    char username[MAX_USERNAME];
+    uint32_t active_sessions;
+    uint32_t rate_count;
+    time_t rate_window;
+};
+
+#define STATES_MIN_SLOTS 64
+#define RATE_WINDOW_SECONDS 60
+
+static struct user_state *states = NULL;
+/* potencia de 2 */
+static size_t states_slots = 0;
+static size_t states_used = 0;
+
+/* contra este hash se verifican los usuarios inexistentes: tardan lo mismo */
+static char dummy_hash[PASSWORD_ENCODED_MAX];
+
+static bool put_encoded(const char *username, const char *encoded, user_role_t role) {
+    struct user u;
+    memset(&u, 0, sizeof(u));
+    strncpy(u.username, username, MAX_USERNAME - 1);
+    strncpy(u.password, encoded, MAX_PASSWORD - 1);
+    u.role = role;
+    return userdb_put(&u) != NULL;
+}
+
+static bool seed_user(const char *username, const char *password, user_role_t role) {
+    char encoded[PASSWORD_ENCODED_MAX];
+    return password_hash(password, encoded, sizeof(encoded)) && put_encoded(username, encoded, role);
+}
+
+/* una contraseña derivada que entra en el registro */
+static bool valid_encoded(const char *encoded) {
+    return encoded != NULL && strlen(encoded) < MAX_PASSWORD && password_is_hash(encoded);
+}
+
+/* las contraseñas en texto plano (bases o procesos anteriores) se derivan */
+static void hash_plaintext(void) {
+    size_t n = userdb_records();
+    for (size_t i = 0; i < n; i++) {
+        struct user *u = userdb_record(i);
+        char encoded[PASSWORD_ENCODED_MAX];
+        if (u->active && !password_is_hash(u->password) &&
+            password_hash(u->password, encoded, sizeof(encoded))) {
+            strcpy(u->password, encoded);
+        }
+    }
+}
+
+/* reinicia los contadores de cuota al cambiar de día o de mes (UTC) */
+static void roll_period(struct user *u, time_t now) {
+    uint32_t day = (uint32_t)(now / 86400);
+    if (day == u->day) {
+        return;
+    }
+    u->day = day;
+    u->bytes_day = 0;
+
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    uint32_t month = (uint32_t)(tm.tm_year + 1900) * 12 + (uint32_t)tm.tm_mon;
+    if (month != u->month) {
+        u->month = month;
+        u->bytes_month = 0;
+    }
+}
+
+static uint32_t state_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool state_idle(const struct user_state *st, time_t now) {
+    return st->active_sessions == 0 && now - st->rate_window >= RATE_WINDOW_SECONDS;
+}
+
+/* entrada de `username' en `table' o la vacía donde iría */
+static struct user_state *state_slot(struct user_state *table, size_t slots, const char *username) {
+    size_t mask = slots - 1;
+    for (size_t i = state_hash(username) & mask; ; i = (i + 1) & mask) {
+        if (table[i].username[0] == '\0' || strcmp(table[i].username, username) == 0) {
+            return &table[i];
+        }
+    }
+}
+
+static bool states_rehash(time_t now) {
+    size_t live = 0;
+    for (size_t i = 0; i < states_slots; i++) {
+        if (states[i].username[0] != '\0' && !state_idle(&states[i], now)) {
+            live++;
+        }
+    }
+    size_t slots = STATES_MIN_SLOTS;
+    while (slots < 2 * (live + 1)) {
+        slots <<= 1;
+    }
+    struct user_state *table = calloc(slots, sizeof(*table));
+    if (table == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < states_slots; i++) {
+        if (states[i].username[0] != '\0' && !state_idle(&states[i], now)) {
+            *state_slot(table, slots, states[i].username) = states[i];
+        }
+    }
+    free(states);
+    states = table;
+    states_slots = slots;
+    states_used = live;
+    return true;
+}
+
+/* estado de `username'; con `create' lo agrega si no está. NULL si no hay */
+static struct user_state *user_state(const char *username, bool create, time_t now) {
+    if (create && (states_used + 1) * 4 > states_slots * 3 && !states_rehash(now)) {
+        return NULL;
+    }
+    if (states_slots == 0) {
+        return NULL;
+    }
+    struct user_state *st = state_slot(states, states_slots, username);
+    if (st->username[0] == '\0') {
+        if (!create) {
+            return NULL;
+        }
+        strncpy(st->username, username, MAX_USERNAME - 1);
+        states_used++;
+    }
+    return st;
+}
+
+static void states_reset(void) {
+    free(states);
+    states = NULL;
+    states_slots = 0;
+    states_used = 0;
+}
+
+int users_init(struct socks5args *args) {
     pthread_mutex_lock(&users_mutex);
-    
-    memset(users_db, 0, sizeof(users_db));
-    users_count = 0;
 
     memset(connections_db, 0, sizeof(connections_db));
     connections_count = 0;
     connections_next_index = 0;
 
+    if (userdb_open(args != NULL ? args->users_db : NULL) < 0) {
+        pthread_mutex_unlock(&users_mutex);
+        return -1;
+    }
+
+    hash_plaintext();
+
+    // las sesiones abiertas son del proceso que las registró
+    states_reset();
+
+    // los usuarios de la línea de comandos se agregan si la base no los tiene
     if (args != NULL) {
-        for (int i = 0; i < 10 && args->users[i].name != NULL; i++) {
-            if (users_count >= MAX_USERS_DB) break;
-            
-            strncpy(users_db[users_count].username, args->users[i].name, MAX_USERNAME - 1);
-            users_db[users_count].username[MAX_USERNAME - 1] = '\0';
-            
-            strncpy(users_db[users_count].password, args->users[i].pass, MAX_PASSWORD - 1);
-            users_db[users_count].password[MAX_PASSWORD - 1] = '\0';
-            
-            users_db[users_count].active = true;
-            users_db[users_count].role = ROLE_ADMIN;
-            users_db[users_count].bytes_transferred = 0;
-            users_db[users_count].total_connections = 0;
-            users_count++;
+        for (int i = 0; i < MAX_USERS && args->users[i].name != NULL; i++) {
+            if (userdb_find(args->users[i].name) == NULL) {
+                seed_user(args->users[i].name, args->users[i].pass, ROLE_ADMIN);
+            }
         }
     }
-    
-    if (users_count == 0) {
-        strcpy(users_db[0].username, "admin");
-        strcpy(users_db[0].password, "1234");
-        users_db[0].active = true;
-        users_db[0].role = ROLE_ADMIN;
-        users_db[0].bytes_transferred = 0;
-        users_db[0].total_connections = 0;
-        users_count = 1;
+
+    if (userdb_count() == 0) {
+        seed_user("admin", "1234", ROLE_ADMIN);
     }
-    
+
     pthread_mutex_unlock(&users_mutex);
+    return 0;
 }
 
 void users_destroy(void) {
     pthread_mutex_lock(&users_mutex);
-    memset(users_db, 0, sizeof(users_db));
-    users_count = 0;
+    userdb_close();
+    states_reset();
     memset(connections_db, 0, sizeof(connections_db));
     connections_count = 0;
     connections_next_index = 0;
+    memset(credentials_db, 0, sizeof(credentials_db));
+    credentials_count = 0;
+    credentials_next_index = 0;
+    pthread_mutex_unlock(&users_mutex);
+}
+
+bool users_persistent(void) {
+    return userdb_persistent();
+}
+
+void users_inherit_db(int fd) {
+    pthread_mutex_lock(&users_mutex);
+    userdb_inherit(fd);
+    pthread_mutex_unlock(&users_mutex);
+}
+
+int users_db_fd(void) {
+    pthread_mutex_lock(&users_mutex);
+    int fd = userdb_fd();
+    pthread_mutex_unlock(&users_mutex);
+    return fd;
+}
+
+void users_freeze(bool frozen) {
+    pthread_mutex_lock(&users_mutex);
+    userdb_freeze(frozen);
+    pthread_mutex_unlock(&users_mutex);
+}
+
+void users_detach(void) {
+    pthread_mutex_lock(&users_mutex);
+    userdb_detach();
     pthread_mutex_unlock(&users_mutex);
 }
 
@@ -69,23 +247,45 @@ bool user_authenticate(const char *username, const char *password) {
         return false;
     }
     
-    pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && 
-            strcmp(users_db[i].username, username) == 0 &&
-            strcmp(users_db[i].password, password) == 0) {
-
-            users_db[i].last_connection = time(NULL);
-            users_db[i].total_connections++;
-            
-            pthread_mutex_unlock(&users_mutex);
-            return true;
+    char encoded[PASSWORD_ENCODED_MAX];
+    const bool exists = user_password_hash(username, encoded, sizeof(encoded));
+    if (!exists) {
+        // sin esto un usuario inexistente se distingue por lo rápido que falla
+        if (dummy_hash[0] == '\0') {
+            password_hash("", dummy_hash, sizeof(dummy_hash));
         }
+        strcpy(encoded, dummy_hash);
+    }
+    if (!password_verify(password, encoded) || !exists) {
+        return false;
+    }
+    user_record_login(username);
+    return true;
+}
+
+bool user_password_hash(const char *username, char *out, size_t out_len) {
+    if (username == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+    struct user *u = userdb_find(username);
+    bool ok = u != NULL && strlen(u->password) < out_len;
+    if (ok) {
+        strcpy(out, u->password);
+    }
+    pthread_mutex_unlock(&users_mutex);
+    return ok;
+}
+
+void user_record_login(const char *username) {
+    pthread_mutex_lock(&users_mutex);
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        u->last_connection = time(NULL);
+        u->total_connections++;
     }
-    
     pthread_mutex_unlock(&users_mutex);
-    return false;
 }
 
 bool user_add(const char *username, const char *password, user_role_t role) {
@@ -100,29 +300,22 @@ bool user_add(const char *username, const char *password, user_role_t role) {
     
     pthread_mutex_lock(&users_mutex);
 
-    for (int i = 0; i < users_count; i++) {
-        if (strcmp(users_db[i].username, username) == 0) {
-            pthread_mutex_unlock(&users_mutex);
-            return false; 
-        }
-    }
+    bool ok = userdb_find(username) == NULL && seed_user(username, password, role);
 
-    if (users_count >= MAX_USERS_DB) {
-        pthread_mutex_unlock(&users_mutex);
+    pthread_mutex_unlock(&users_mutex);
+    return ok;
+}
+
+bool user_add_encoded(const char *username, const char *encoded, user_role_t role) {
+    if (username == NULL || strlen(username) == 0 || strlen(username) >= MAX_USERNAME ||
+        !valid_encoded(encoded)) {
         return false;
     }
 
-    strcpy(users_db[users_count].username, username);
-    strcpy(users_db[users_count].password, password);
-    users_db[users_count].active = true;
-    users_db[users_count].role = role;
-    users_db[users_count].bytes_transferred = 0;
-    users_db[users_count].total_connections = 0;
-    users_db[users_count].last_connection = 0;
-    users_count++;
-    
+    pthread_mutex_lock(&users_mutex);
+    bool ok = userdb_find(username) == NULL && put_encoded(username, encoded, role);
     pthread_mutex_unlock(&users_mutex);
-    return true;
+    return ok;
 }
 
 bool user_delete(const char *username) {
@@ -131,17 +324,9 @@ bool user_delete(const char *username) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (strcmp(users_db[i].username, username) == 0) {
-            users_db[i].active = false;
-            pthread_mutex_unlock(&users_mutex);
-            return true;
-        }
-    }
-    
+    bool ok = userdb_remove(username);
     pthread_mutex_unlock(&users_mutex);
-    return false;
+    return ok;
 }
 
 bool user_change_password(const char *username, const char *new_password) {
@@ -154,17 +339,34 @@ bool user_change_password(const char *username, const char *new_password) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && strcmp(users_db[i].username, username) == 0) {
-            strcpy(users_db[i].password, new_password);
-            pthread_mutex_unlock(&users_mutex);
-            return true;
-        }
+
+    bool ok = false;
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        struct user changed = *u;
+        ok = password_hash(new_password, changed.password, sizeof(changed.password)) &&
+             userdb_put(&changed) != NULL;
     }
-    
+
     pthread_mutex_unlock(&users_mutex);
-    return false;
+    return ok;
+}
+
+bool user_change_password_encoded(const char *username, const char *encoded) {
+    if (username == NULL || !valid_encoded(encoded)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+    bool ok = false;
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        struct user changed = *u;
+        strcpy(changed.password, encoded);
+        ok = userdb_put(&changed) != NULL;
+    }
+    pthread_mutex_unlock(&users_mutex);
+    return ok;
 }
 
 bool user_change_role(const char *username, user_role_t new_role) {
@@ -173,17 +375,17 @@ bool user_change_role(const char *username, user_role_t new_role) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && strcmp(users_db[i].username, username) == 0) {
-            users_db[i].role = new_role;
-            pthread_mutex_unlock(&users_mutex);
-            return true;
-        }
+
+    bool ok = false;
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        struct user changed = *u;
+        changed.role = new_role;
+        ok = userdb_put(&changed) != NULL;
     }
-    
+
     pthread_mutex_unlock(&users_mutex);
-    return false;
+    return ok;
 }
 
 bool user_is_admin(const char *username) {
@@ -192,17 +394,10 @@ bool user_is_admin(const char *username) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && strcmp(users_db[i].username, username) == 0) {
-            bool is_admin = (users_db[i].role == ROLE_ADMIN);
-            pthread_mutex_unlock(&users_mutex);
-            return is_admin;
-        }
-    }
-    
+    struct user *u = userdb_find(username);
+    bool is_admin = u != NULL && u->role == ROLE_ADMIN;
     pthread_mutex_unlock(&users_mutex);
-    return false;
+    return is_admin;
 }
 
 struct user* user_find(const char *username) {
@@ -211,25 +406,20 @@ struct user* user_find(const char *username) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && strcmp(users_db[i].username, username) == 0) {
-            pthread_mutex_unlock(&users_mutex);
-            return &users_db[i];
-        }
-    }
-    
+    struct user *u = userdb_find(username);
     pthread_mutex_unlock(&users_mutex);
-    return NULL;
+    return u;
 }
 
 int user_list(struct user **users, int max_users) {
     pthread_mutex_lock(&users_mutex);
     
     int count = 0;
-    for (int i = 0; i < users_count && count < max_users; i++) {
-        if (users_db[i].active) {
-            users[count++] = &users_db[i];
+    size_t n = userdb_records();
+    for (size_t i = 0; i < n && count < max_users; i++) {
+        struct user *u = userdb_record(i);
+        if (u->active) {
+            users[count++] = u;
         }
     }
     
@@ -243,28 +433,120 @@ void user_update_metrics(const char *username, uint64_t bytes) {
     }
     
     pthread_mutex_lock(&users_mutex);
-    
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active && strcmp(users_db[i].username, username) == 0) {
-            users_db[i].bytes_transferred += bytes;
-            pthread_mutex_unlock(&users_mutex);
-            return;
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        roll_period(u, time(NULL));
+        u->bytes_transferred += bytes;
+        u->bytes_day += bytes;
+        u->bytes_month += bytes;
+    }
+    pthread_mutex_unlock(&users_mutex);
+}
+
+bool user_set_limits(const char *username, const struct user_limits *limits) {
+    if (username == NULL || limits == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        u->limits = *limits;
+    }
+    pthread_mutex_unlock(&users_mutex);
+    return u != NULL;
+}
+
+bool user_get_limits(const char *username, struct user_limits *limits, struct user_usage *usage) {
+    if (username == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+    struct user *u = userdb_find(username);
+    if (u != NULL) {
+        roll_period(u, time(NULL));
+        if (limits != NULL) {
+            *limits = u->limits;
+        }
+        if (usage != NULL) {
+            const struct user_state *st = user_state(username, false, 0);
+            usage->active_sessions = st != NULL ? st->active_sessions : 0;
+            usage->bytes_day = u->bytes_day;
+            usage->bytes_month = u->bytes_month;
         }
     }
-    
     pthread_mutex_unlock(&users_mutex);
+    return u != NULL;
 }
 
-int user_count(void) {
+user_admit_t user_session_admit(const char *username) {
+    if (username == NULL) {
+        return USER_ADMIT_OK;
+    }
+
     pthread_mutex_lock(&users_mutex);
-    
-    int count = 0;
-    for (int i = 0; i < users_count; i++) {
-        if (users_db[i].active) {
-            count++;
+    struct user *u = userdb_find(username);
+    // sin usuario (método sin autenticación) no hay límites
+    if (u == NULL) {
+        pthread_mutex_unlock(&users_mutex);
+        return USER_ADMIT_OK;
+    }
+
+    time_t now = time(NULL);
+    const struct user_limits *l = &u->limits;
+    user_admit_t ret = USER_ADMIT_OK;
+    roll_period(u, now);
+
+    // sin memoria para el estado se admite sin contar, como antes de los límites
+    struct user_state *st = user_state(username, true, now);
+    if (st == NULL) {
+        pthread_mutex_unlock(&users_mutex);
+        return USER_ADMIT_OK;
+    }
+
+    if (l->max_sessions != 0 && st->active_sessions >= l->max_sessions) {
+        ret = USER_ADMIT_SESSIONS;
+    } else if ((l->quota_daily != 0 && u->bytes_day >= l->quota_daily) ||
+               (l->quota_monthly != 0 && u->bytes_month >= l->quota_monthly)) {
+        ret = USER_ADMIT_QUOTA;
+    } else if (l->max_rate != 0) {
+        // ventana fija de un minuto
+        if (now - st->rate_window >= RATE_WINDOW_SECONDS) {
+            st->rate_window = now;
+            st->rate_count = 0;
+        }
+        if (st->rate_count >= l->max_rate) {
+            ret = USER_ADMIT_RATE;
+        } else {
+            st->rate_count++;
         }
     }
-    
+
+    if (ret == USER_ADMIT_OK) {
+        st->active_sessions++;
+    }
+    pthread_mutex_unlock(&users_mutex);
+    return ret;
+}
+
+void user_session_release(const char *username) {
+    if (username == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+    // la base pudo reiniciarse con la sesión abierta
+    struct user_state *st = user_state(username, false, 0);
+    if (st != NULL && st->active_sessions > 0) {
+        st->active_sessions--;
+    }
+    pthread_mutex_unlock(&users_mutex);
+}
+
+int user_count(void) {
+    pthread_mutex_lock(&users_mutex);
+    int count = (int)userdb_count();
     pthread_mutex_unlock(&users_mutex);
     return count;
 }
@@ -312,3 +594,225 @@ int user_get_connections(struct user_connection *entries, int max_entries) {
     pthread_mutex_unlock(&users_mutex);
     return to_copy;
 }
+
+int user_log_credentials(const char *username, const char *destination, uint16_t port,
+                         const char *protocol, const char *captured_user, const char *captured_pass) {
+    if (username == NULL || destination == NULL || protocol == NULL ||
+        captured_user == NULL || captured_pass == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+
+    int index = credentials_next_index;
+    credentials_next_index = (credentials_next_index + 1) % MAX_CREDENTIALS_LOG;
+
+    if (credentials_count < MAX_CREDENTIALS_LOG) {
+        credentials_count++;
+    }
+
+    struct user_credential *entry = &credentials_db[index];
+    strncpy(entry->username, username, MAX_USERNAME - 1);
+    entry->username[MAX_USERNAME - 1] = '\0';
+    strncpy(entry->destination, destination, sizeof(entry->destination) - 1);
+    entry->destination[sizeof(entry->destination) - 1] = '\0';
+    entry->port = port;
+    strncpy(entry->protocol, protocol, sizeof(entry->protocol) - 1);
+    entry->protocol[sizeof(entry->protocol) - 1] = '\0';
+    strncpy(entry->captured_user, captured_user, sizeof(entry->captured_user) - 1);
+    entry->captured_user[sizeof(entry->captured_user) - 1] = '\0';
+    strncpy(entry->captured_pass, captured_pass, sizeof(entry->captured_pass) - 1);
+    entry->captured_pass[sizeof(entry->captured_pass) - 1] = '\0';
+    entry->timestamp = time(NULL);
+
+    pthread_mutex_unlock(&users_mutex);
+    return 0;
+}
+
+int user_get_credentials(struct user_credential *entries, int max_entries) {
+    if (entries == NULL || max_entries <= 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&users_mutex);
+
+    int to_copy = credentials_count < max_entries ? credentials_count : max_entries;
+
+    for (int i = 0; i < to_copy; i++) {
+        int src_index = (credentials_next_index - credentials_count + i + MAX_CREDENTIALS_LOG) % MAX_CREDENTIALS_LOG;
+        entries[i] = credentials_db[src_index];
+    }
+
+    pthread_mutex_unlock(&users_mutex);
+    return to_copy;
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        *p++ = (uint8_t)(v >> (i * 8));
+    }
+    return p;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) {
+        *p++ = (uint8_t)(v >> (i * 8));
+    }
+    return p;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/*
+ * Formato: cantidad (2 bytes) y por usuario
+ *   ULEN | USER | PLEN | PASS | ROLE | BYTES(8) | CONNS(8) | LAST(8)
+ * seguido, en el mismo orden, de los límites y el consumo de cada uno
+ *   SESSIONS(4) | RATE(4) | DAILY(8) | MONTHLY(8) | DAY(4) | MONTH(4) |
+ *   BYTES_DAY(8) | BYTES_MONTH(8)
+ * Un proceso anterior no manda la segunda parte y se acepta igual.
+ * Solo se serializan los usuarios activos.
+ */
+#define SERIALIZED_USER_MAX (1 + 255 + 1 + 255 + 1 + 24)
+#define SERIALIZED_LIMITS 48
+
+size_t users_serialize_bound(void) {
+    return 2 + (size_t)user_count() * (SERIALIZED_USER_MAX + SERIALIZED_LIMITS);
+}
+
+static uint8_t *put_limits(uint8_t *p, const struct user *u) {
+    p = put_u32(p, u->limits.max_sessions);
+    p = put_u32(p, u->limits.max_rate);
+    p = put_u64(p, u->limits.quota_daily);
+    p = put_u64(p, u->limits.quota_monthly);
+    p = put_u32(p, u->day);
+    p = put_u32(p, u->month);
+    p = put_u64(p, u->bytes_day);
+    return put_u64(p, u->bytes_month);
+}
+
+static void parse_limits(const uint8_t *p, struct user *u) {
+    u->limits.max_sessions = get_u32(p);
+    u->limits.max_rate = get_u32(p + 4);
+    u->limits.quota_daily = get_u64(p + 8);
+    u->limits.quota_monthly = get_u64(p + 16);
+    u->day = get_u32(p + 24);
+    u->month = get_u32(p + 28);
+    u->bytes_day = get_u64(p + 32);
+    u->bytes_month = get_u64(p + 40);
+}
+
+size_t users_serialize(uint8_t *buf, size_t cap) {
+    pthread_mutex_lock(&users_mutex);
+
+    if (cap < 2) {
+        pthread_mutex_unlock(&users_mutex);
+        return 0;
+    }
+
+    uint8_t *p = buf + 2;
+    uint16_t count = 0;
+    size_t n = userdb_records();
+    for (size_t i = 0; i < n; i++) {
+        const struct user *u = userdb_record(i);
+        if (!u->active) {
+            continue;
+        }
+        size_t ulen = strlen(u->username);
+        size_t plen = strlen(u->password);
+        if ((size_t)(p - buf) + 2 + ulen + plen + 1 + 24 > cap) {
+            pthread_mutex_unlock(&users_mutex);
+            return 0;
+        }
+        *p++ = (uint8_t)ulen;
+        memcpy(p, u->username, ulen);
+        p += ulen;
+        *p++ = (uint8_t)plen;
+        memcpy(p, u->password, plen);
+        p += plen;
+        *p++ = (uint8_t)u->role;
+        p = put_u64(p, u->bytes_transferred);
+        p = put_u64(p, u->total_connections);
+        p = put_u64(p, (uint64_t)u->last_connection);
+        count++;
+    }
+    if ((size_t)(p - buf) + (size_t)count * SERIALIZED_LIMITS > cap) {
+        pthread_mutex_unlock(&users_mutex);
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const struct user *u = userdb_record(i);
+        if (u->active) {
+            p = put_limits(p, u);
+        }
+    }
+    buf[0] = (uint8_t)(count >> 8);
+    buf[1] = (uint8_t)(count & 0xFF);
+
+    pthread_mutex_unlock(&users_mutex);
+    return p - buf;
+}
+
+/* lee un usuario serializado en `u'; retorna el resto o NULL si está truncado */
+static const uint8_t *parse_user(const uint8_t *p, const uint8_t *end, struct user *u) {
+    memset(u, 0, sizeof(*u));
+    if (p >= end || p + 1 + *p > end) return NULL;
+    size_t ulen = *p++;
+    memcpy(u->username, p, ulen);
+    p += ulen;
+    if (p >= end || p + 1 + *p > end) return NULL;
+    size_t plen = *p++;
+    memcpy(u->password, p, plen);
+    p += plen;
+    if (p + 1 + 24 > end) return NULL;
+    u->role = *p++ == ROLE_ADMIN ? ROLE_ADMIN : ROLE_USER;
+    u->bytes_transferred = get_u64(p);
+    u->total_connections = get_u64(p + 8);
+    u->last_connection = (time_t)get_u64(p + 16);
+    u->active = true;
+    return p + 24;
+}
+
+bool users_deserialize(const uint8_t *buf, size_t len) {
+    if (len < 2) {
+        return false;
+    }
+    uint16_t count = (uint16_t)((buf[0] << 8) | buf[1]);
+    if (count == 0) {
+        return false;
+    }
+
+    // se valida todo antes de tocar la base
+    struct user u;
+    const uint8_t *p = buf + 2;
+    const uint8_t *end = buf + len;
+    for (int i = 0; i < count; i++) {
+        if ((p = parse_user(p, end, &u)) == NULL) {
+            return false;
+        }
+    }
+    const uint8_t *limits = (size_t)(end - p) == (size_t)count * SERIALIZED_LIMITS ? p : NULL;
+
+    pthread_mutex_lock(&users_mutex);
+    userdb_clear();
+    p = buf + 2;
+    for (int i = 0; i < count; i++) {
+        p = parse_user(p, end, &u);
+        if (limits != NULL) {
+            parse_limits(limits + (size_t)i * SERIALIZED_LIMITS, &u);
+        }
+        userdb_put(&u);
+    }
+    hash_plaintext();
+    pthread_mutex_unlock(&users_mutex);
+    return true;
+}
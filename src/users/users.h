@@ -3,20 +3,48 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
 struct socks5args;
 
 #define MAX_USERNAME 256
 #define MAX_PASSWORD 256
-#define MAX_USERS_DB 100
+/* tope de la base de usuarios; la cantidad se serializa en 16 bits */
+#define MAX_USERS_DB 65535
 #define MAX_CONNECTION_LOG 1000
+#define MAX_CREDENTIALS_LOG 100
 
 typedef enum {
     ROLE_USER = 0,
     ROLE_ADMIN = 1
 } user_role_t;
 
+/* por qué se rechaza una sesión nueva de un usuario */
+typedef enum {
+    USER_ADMIT_OK = 0,
+    USER_ADMIT_SESSIONS,
+    USER_ADMIT_RATE,
+    USER_ADMIT_QUOTA
+} user_admit_t;
+
+/* 0 es sin límite */
+struct user_limits {
+    /* túneles abiertos a la vez */
+    uint32_t max_sessions;
+    /* túneles nuevos por minuto */
+    uint32_t max_rate;
+    /* bytes por día y por mes calendario (UTC) */
+    uint64_t quota_daily;
+    uint64_t quota_monthly;
+};
+
+struct user_usage {
+    uint32_t active_sessions;
+    uint64_t bytes_day;
+    uint64_t bytes_month;
+};
+
 struct user_connection {
     char username[MAX_USERNAME];
     char destination[256];
@@ -24,29 +52,83 @@ struct user_connection {
     time_t timestamp;
 };
 
+struct user_credential {
+    char username[MAX_USERNAME];
+    char destination[256];
+    uint16_t port;
+    char protocol[8];
+    char captured_user[256];
+    char captured_pass[256];
+    time_t timestamp;
+};
+
 struct user {
     char username[MAX_USERNAME];
+    /* derivada con PBKDF2, ver auth/password.h */
     char password[MAX_PASSWORD];
     bool active;
     user_role_t role;
     uint64_t bytes_transferred;
     uint64_t total_connections;
     time_t last_connection;
+    /* los campos siguientes se agregaron después: ver userdb_open */
+    struct user_limits limits;
+    uint64_t bytes_day;
+    uint64_t bytes_month;
+    /* día (desde la época) y mes (año * 12 + mes) de los contadores anteriores */
+    uint32_t day;
+    uint32_t month;
 };
 
-void users_init(struct socks5args *args);
+/* abre la base de usuarios (args->users_db, o en memoria) y agrega los de -u. -1 si falla */
+int users_init(struct socks5args *args);
 void users_destroy(void);
+/* true si los usuarios se guardan en un archivo */
+bool users_persistent(void);
+/*
+ * actualización en caliente con base en archivo (ver users/userdb.h): el
+ * proceso nuevo usa el fd recibido, el viejo no modifica la base durante el
+ * traspaso y, si el nuevo confirma, deja de escribir el archivo
+ */
+void users_inherit_db(int fd);
+int users_db_fd(void);
+void users_freeze(bool frozen);
+void users_detach(void);
+/* verifica la contraseña en el hilo que llama (costoso, ver auth/verify.h) */
 bool user_authenticate(const char *username, const char *password);
+/* copia la contraseña derivada de `username'; false si no existe */
+bool user_password_hash(const char *username, char *out, size_t out_len);
+/* registra un login exitoso en las estadísticas del usuario */
+void user_record_login(const char *username);
 bool user_add(const char *username, const char *password, user_role_t role);
 bool user_delete(const char *username);
 bool user_change_password(const char *username, const char *new_password);
+/* como user_add y user_change_password con la contraseña ya derivada (ver auth/verify.h) */
+bool user_add_encoded(const char *username, const char *encoded, user_role_t role);
+bool user_change_password_encoded(const char *username, const char *encoded);
 bool user_change_role(const char *username, user_role_t new_role);
 struct user* user_find(const char *username);
 int user_list(struct user **users, int max_users);
 void user_update_metrics(const char *username, uint64_t bytes);
+bool user_set_limits(const char *username, const struct user_limits *limits);
+bool user_get_limits(const char *username, struct user_limits *limits, struct user_usage *usage);
+/*
+ * cuenta un túnel nuevo de `username' si no supera sus límites; si retorna
+ * USER_ADMIT_OK hay que llamar a user_session_release al cerrarlo
+ */
+user_admit_t user_session_admit(const char *username);
+void user_session_release(const char *username);
 int user_count(void);
 int user_log_connection(const char *username, const char *destination, uint16_t port);
 int user_get_connections(struct user_connection *entries, int max_entries);
+int user_log_credentials(const char *username, const char *destination, uint16_t port,
+                         const char *protocol, const char *captured_user, const char *captured_pass);
+int user_get_credentials(struct user_credential *entries, int max_entries);
 bool user_is_admin(const char *username);
 
+/* estado de los usuarios para traspasarlo a otro proceso (actualización en caliente) */
+size_t users_serialize_bound(void);
+size_t users_serialize(uint8_t *buf, size_t cap);
+bool users_deserialize(const uint8_t *buf, size_t len);
+
 #endif
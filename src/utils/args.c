@@ -6,6 +6,7 @@
 #include <getopt.h>
 
 #include "args.h"
+#include "../socks5/upstream.h"
 
 static unsigned short
 port(const char* s)
@@ -24,6 +25,101 @@ port(const char* s)
     return (unsigned short)sl;
 }
 
+/* entero decimal entre `min' y `max'; si no, termina nombrando la opción */
+static long
+number(const char* s, long min, long max, const char* what)
+{
+    char* end = 0;
+    errno = 0;
+    const long sl = strtol(s, &end, 10);
+
+    if (end == s || '\0' != *end || ERANGE == errno || sl < min || sl > max)
+    {
+        fprintf(stderr, "%s should be in the range of %ld-%ld: %s\n", what, min, max, s);
+        exit(1);
+    }
+    return sl;
+}
+
+static void
+port_range(char* s, unsigned short* first, unsigned short* last)
+{
+    char* p = strchr(s, '-');
+    if (p == NULL)
+    {
+        *first = *last = port(s);
+        return;
+    }
+    *p = 0;
+    *first = port(s);
+    *last = port(p + 1);
+    if (*first == 0 || *last < *first)
+    {
+        fprintf(stderr, "invalid port range: %s-%s\n", s, p + 1);
+        exit(1);
+    }
+}
+
+static void
+port_list(char* s, struct socks5args* args)
+{
+    for (char* tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ","))
+    {
+        if (args->fastopen_ports_count >= MAX_FASTOPEN_PORTS)
+        {
+            fprintf(stderr, "too many fast open ports\n");
+            exit(1);
+        }
+        args->fastopen_ports[args->fastopen_ports_count++] = port(tok);
+    }
+}
+
+static enum selector_engine
+io_engine(const char* s)
+{
+    const enum selector_engine engines[] = {
+        SELECTOR_ENGINE_SELECT, SELECTOR_ENGINE_EPOLL, SELECTOR_ENGINE_IO_URING,
+    };
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+    {
+        if (strcmp(s, selector_engine_name(engines[i])) == 0)
+            return engines[i];
+    }
+    fprintf(stderr, "unknown I/O engine: %s (select, epoll or io_uring)\n", s);
+    exit(1);
+}
+
+static int
+buffer_kb(const char* s)
+{
+    const int kb = (int)number(s, 2, 1024, "buffer size (KiB)");
+    // potencia de dos entre el tamaño inicial (2 KiB) y 1 MiB
+    if ((kb & (kb - 1)) != 0)
+    {
+        fprintf(stderr, "buffer size should be a power of two between 2 and 1024 KiB: %s\n", s);
+        exit(1);
+    }
+    return kb;
+}
+
+static int
+zerocopy_kb(const char* s)
+{
+    return (int)number(s, 0, 1024, "zero-copy threshold (KiB)");
+}
+
+static void
+breaker(char* s, struct socks5args* args)
+{
+    char* p = strchr(s, '/');
+    if (p != NULL)
+    {
+        *p = 0;
+        args->breaker_cooldown = (int)number(p + 1, 1, 86400, "circuit breaker cool-down (seconds)");
+    }
+    args->breaker_failures = (int)number(s, 0, 65535, "circuit breaker failures");
+}
+
 static void
 user(char* s, struct users* user)
 {
@@ -57,12 +153,32 @@ usage(const char* progname)
             "Usage: %s [OPTION]...\n"
             "\n"
             "   -h               Imprime la ayuda y termina.\n"
+            "   -A <archivo>     Reglas de acceso a destinos (CIDR y dominios, por usuario).\n"
+            "   -b <desde>-<hasta> Rango de puertos para los listeners de BIND.\n"
+            "   -B <backlog>     Backlog del socket SOCKS (por defecto 20).\n"
+            "   -c <n>[/<seg>]   Tras n fallos seguidos a un origen responde sin intentar por seg segundos (por defecto 5/10, 0 no).\n"
+            "   -d <archivo>     Base de usuarios persistente (se crea si no existe).\n"
+            "   -D <segundos>    Habilita TCP_DEFER_ACCEPT en el socket SOCKS.\n"
+            "   -e <mecanismo>   Espera de E/S: select, epoll o io_uring (por defecto epoll).\n"
+            "   -F <cola>        Habilita TCP Fast Open en el socket SOCKS con esa cola.\n"
+            "   -g <segundos>    Plazo para drenar sesiones tras una actualización en caliente (por defecto 60).\n"
+            "   -M <sesiones>    Sesiones concurrentes máximas antes de pausar el accept (por defecto 500).\n"
+            "   -o <perfil>      Define o modifica un perfil de opciones de socket: nombre:opción=valor,...\n"
+            "   -O <regla>       Perfil por puerto de destino o usuario: 443=bulk, @ana=interactive, *=bulk.\n"
             "   -l <SOCKS addr>  Dirección donde servirá el proxy SOCKS.\n"
             "   -L <conf  addr>  Dirección donde servirá el servicio de management.\n"
             "   -p <SOCKS port>  Puerto entrante conexiones SOCKS.\n"
             "   -P <conf port>   Puerto entrante conexiones configuracion\n"
+            "   -R <regla>       Destino que sale por el proxy padre: CIDR, dominio o '*'. Repetible.\n"
+            "   -s <IP>          Dirección local desde la que se conecta a los orígenes. Repetible, hasta 16.\n"
+            "   -S <KiB>         Tamaño máximo del buffer de cada sentido de un túnel (por defecto 256).\n"
+            "   -T <p1,p2,...>   Puertos de origen a los que se conecta con TCP Fast Open.\n"
             "   -u <name>:<pass> Usuario y contraseña de usuario que puede usar el proxy. Hasta 10.\n"
+            "   -U [u:p@]host:port Proxy SOCKS5 padre por el que se encadenan los CONNECT.\n"
             "   -v               Imprime información sobre la versión versión y termina.\n"
+            "   -W <n>           Conexiones pre-establecidas contra el proxy padre.\n"
+            "   -x <modo>        Reparto entre las direcciones de -s: rr (en rueda, por defecto) o hash (por cliente).\n"
+            "   -Z <KiB>         Envía con MSG_ZEROCOPY los bloques de al menos ese tamaño (0, por defecto, no).\n"
 
             "\n",
             progname);
@@ -82,6 +198,16 @@ parse_args(const int argc, char** argv, struct socks5args* args)
 
     args->disectors_enabled = true;
 
+    args->upstream_pool = -1;
+
+    args->backlog = 20;
+    args->drain_seconds = 60;
+    args->io_engine = SELECTOR_ENGINE_EPOLL;
+    args->buffer_max_kb = 256;
+    args->zerocopy_kb = 0;
+    args->breaker_failures = 5;
+    args->breaker_cooldown = 10;
+
     int c;
     int nusers = 0;
 
@@ -92,12 +218,39 @@ parse_args(const int argc, char** argv, struct socks5args* args)
             {0, 0, 0, 0}
         };
 
-        c = getopt_long(argc, argv, "hl:L:Np:P:u:v", long_options, &option_index);
+        c = getopt_long(argc, argv, "A:b:B:c:d:D:e:F:g:hl:L:M:No:O:p:P:R:s:S:T:u:U:vW:x:Z:", long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c)
         {
+        case 'A':
+            args->acl_file = optarg;
+            break;
+        case 'b':
+            port_range(optarg, &args->bind_port_first, &args->bind_port_last);
+            break;
+        case 'B':
+            args->backlog = (int)number(optarg, 1, 65535, "backlog");
+            break;
+        case 'c':
+            breaker(optarg, args);
+            break;
+        case 'd':
+            args->users_db = optarg;
+            break;
+        case 'D':
+            args->defer_accept = (int)number(optarg, 0, 3600, "defer accept (seconds)");
+            break;
+        case 'e':
+            args->io_engine = io_engine(optarg);
+            break;
+        case 'F':
+            args->fastopen_qlen = (int)number(optarg, 0, 65535, "fast open queue length");
+            break;
+        case 'g':
+            args->drain_seconds = (int)number(optarg, 0, 86400, "drain time (seconds)");
+            break;
         case 'h':
             usage(argv[0]);
             break;
@@ -107,15 +260,53 @@ parse_args(const int argc, char** argv, struct socks5args* args)
         case 'L':
             args->mng_addr = optarg;
             break;
+        case 'M':
+            args->max_sessions = (int)number(optarg, 1, 1000000, "max sessions");
+            break;
         case 'N':
             args->disectors_enabled = false;
             break;
         case 'p':
             args->socks_port = port(optarg);
             break;
+        case 'o':
+            if (args->sockopt_profiles_count >= MAX_SOCKOPT_PROFILES)
+            {
+                fprintf(stderr, "maximun number of socket option profiles reached: %d.\n", MAX_SOCKOPT_PROFILES);
+                exit(1);
+            }
+            args->sockopt_profiles[args->sockopt_profiles_count++] = optarg;
+            break;
+        case 'O':
+            if (args->sockopt_rules_count >= MAX_SOCKOPT_RULES)
+            {
+                fprintf(stderr, "maximun number of socket option rules reached: %d.\n", MAX_SOCKOPT_RULES);
+                exit(1);
+            }
+            args->sockopt_rules[args->sockopt_rules_count++] = optarg;
+            break;
         case 'P':
             args->mng_port = port(optarg);
             break;
+        case 'R':
+            if (args->upstream_rules_count >= MAX_UPSTREAM_RULES)
+            {
+                fprintf(stderr, "maximun number of upstream rules reached: %d.\n", MAX_UPSTREAM_RULES);
+                exit(1);
+            }
+            args->upstream_rules[args->upstream_rules_count++] = optarg;
+            break;
+        case 's':
+            if (args->egress_addrs_count >= MAX_EGRESS_ADDRS)
+            {
+                fprintf(stderr, "maximun number of egress addresses reached: %d.\n", MAX_EGRESS_ADDRS);
+                exit(1);
+            }
+            args->egress_addrs[args->egress_addrs_count++] = optarg;
+            break;
+        case 'S':
+            args->buffer_max_kb = buffer_kb(optarg);
+            break;
         case 'u':
             if (nusers >= MAX_USERS)
             {
@@ -128,9 +319,32 @@ parse_args(const int argc, char** argv, struct socks5args* args)
                 nusers++;
             }
             break;
+        case 'T':
+            port_list(optarg, args);
+            break;
+        case 'U':
+            args->upstream = optarg;
+            break;
         case 'v':
             version();
             exit(0);
+        case 'W':
+            args->upstream_pool = (int)number(optarg, 0, UPSTREAM_POOL_MAX, "upstream pool size");
+            break;
+        case 'x':
+            if (strcmp(optarg, "hash") == 0)
+            {
+                args->egress_hash = true;
+            }
+            else if (strcmp(optarg, "rr") != 0)
+            {
+                fprintf(stderr, "unknown egress balancing mode: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'Z':
+            args->zerocopy_kb = zerocopy_kb(optarg);
+            break;
         default:
             fprintf(stderr, "unknown argument %d.\n", c);
             exit(1);
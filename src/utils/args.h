@@ -3,7 +3,14 @@
 
 #include <stdbool.h>
 
+#include "selector.h"
+
 #define MAX_USERS 10
+#define MAX_UPSTREAM_RULES 32
+#define MAX_FASTOPEN_PORTS 16
+#define MAX_SOCKOPT_PROFILES 8
+#define MAX_SOCKOPT_RULES 32
+#define MAX_EGRESS_ADDRS 16
 
 struct users
 {
@@ -21,6 +28,65 @@ struct socks5args
 
     bool disectors_enabled;
 
+    /** sesiones concurrentes antes de pausar el listener; 0 usa el default */
+    int max_sessions;
+    /** segundos para drenar las sesiones luego de una actualización en caliente */
+    int drain_seconds;
+    /** backlog de listen(2) del socket SOCKS */
+    int backlog;
+    /** largo de la cola de TCP Fast Open del listener; 0 lo deshabilita */
+    int fastopen_qlen;
+    /** segundos de TCP_DEFER_ACCEPT: accept solo con datos; 0 lo deshabilita */
+    int defer_accept;
+
+    /** puertos de origen a los que se conecta con TCP Fast Open */
+    unsigned short fastopen_ports[MAX_FASTOPEN_PORTS];
+    int fastopen_ports_count;
+
+    /** rango de puertos para los listeners de BIND; 0 si no se configuró */
+    unsigned short bind_port_first;
+    unsigned short bind_port_last;
+
+    /** proxy SOCKS5 padre ([user:pass@]host:port); NULL si no se encadena */
+    char* upstream;
+    /** destinos que salen por el padre (CIDR, dominio o `*'); sin reglas, todos */
+    char* upstream_rules[MAX_UPSTREAM_RULES];
+    int upstream_rules_count;
+    /** conexiones autenticadas que se mantienen abiertas contra el padre */
+    int upstream_pool;
+
+    /** perfiles de opciones de socket (`nombre:opción=valor,...') */
+    char* sockopt_profiles[MAX_SOCKOPT_PROFILES];
+    int sockopt_profiles_count;
+    /** qué perfil usa cada puerto de destino o usuario (`80=bulk', `@ana=interactive') */
+    char* sockopt_rules[MAX_SOCKOPT_RULES];
+    int sockopt_rules_count;
+
+    /** direcciones locales desde las que se conecta a los orígenes; sin ninguna elige el sistema */
+    char* egress_addrs[MAX_EGRESS_ADDRS];
+    int egress_addrs_count;
+    /** la dirección de salida se elige por la IP del cliente en lugar de en rueda */
+    bool egress_hash;
+
+    /** archivo de la base de usuarios; NULL la mantiene en memoria */
+    char* users_db;
+
+    /** reglas de acceso a destinos (ver acl/acl.h); NULL permite todo */
+    char* acl_file;
+
+    /** tamaño máximo en KiB de los buffers de cada sentido de un túnel */
+    int buffer_max_kb;
+
+    /** tamaño mínimo en KiB de un envío con MSG_ZEROCOPY; 0 no lo usa */
+    int zerocopy_kb;
+
+    /** fallos seguidos que abren el circuito de un origen (0 no lo usa) y segundos que queda abierto */
+    int breaker_failures;
+    int breaker_cooldown;
+
+    /** mecanismo de espera del selector; si no está disponible se usa uno más simple */
+    enum selector_engine io_engine;
+
     struct users users[MAX_USERS];
 };
 
@@ -2,9 +2,14 @@
  * buffer.c - buffer con acceso directo (útil para I/O) que mantiene
  *            mantiene puntero de lectura y de escritura.
  */
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "buffer.h"
 
@@ -12,11 +17,15 @@ inline void
 buffer_reset(buffer *b) {
     b->read  = b->data;
     b->write = b->data;
+    if(b->ring) {
+        b->limit = b->data + b->ring;
+    }
 }
 
 void
 buffer_init(buffer *b, const size_t n, uint8_t *data) {
     b->data = data;
+    b->ring = 0;
     buffer_reset(b);
     b->limit = b->data + n;
 }
@@ -62,7 +71,14 @@ buffer_read_adv(buffer *b, const ssize_t bytes) {
 
         if(b->read == b->write) {
             // compactacion poco costosa
-            buffer_compact(b);
+            buffer_reset(b);
+        } else if(b->ring) {
+            if(b->read >= b->data + b->ring) {
+                // R pasó a la segunda copia: se vuelve a la primera
+                b->read  -= b->ring;
+                b->write -= b->ring;
+            }
+            b->limit = b->read + b->ring;
         }
     }
 }
@@ -89,7 +105,9 @@ buffer_write(buffer *b, uint8_t c) {
 
 void
 buffer_compact(buffer *b) {
-    if(b->data == b->read) {
+    if(b->ring) {
+        // en el circular el espacio libre ya es contiguo
+    } else if(b->data == b->read) {
         // nada por hacer
     } else if(b->read == b->write) {
         b->read  = b->data;
@@ -101,3 +119,75 @@ buffer_compact(buffer *b) {
         b->write = b->data + n;
     }
 }
+
+void
+buffer_rebase(buffer *b, const size_t n, uint8_t *data) {
+    const size_t pending = b->write - b->read;
+    assert(pending <= n);
+    memmove(data, b->read, pending);
+    buffer_ring_free(b);
+    b->data  = data;
+    b->read  = data;
+    b->write = data + pending;
+    b->limit = data + n;
+}
+
+/* reserva 2n bytes de direcciones y mapea el mismo archivo en cada mitad */
+static uint8_t *
+ring_map(const size_t n) {
+#if defined(__linux__)
+    const long page = sysconf(_SC_PAGESIZE);
+    if(page <= 0 || n == 0 || n % (size_t) page != 0) {
+        return NULL;
+    }
+    const int fd = memfd_create("buffer", MFD_CLOEXEC);
+    if(fd < 0) {
+        return NULL;
+    }
+    uint8_t *base = NULL;
+    if(ftruncate(fd, (off_t) n) == 0) {
+        base = mmap(NULL, 2 * n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) {
+            base = NULL;
+        } else if(mmap(base, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+               || mmap(base + n, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, 2 * n);
+            base = NULL;
+        }
+    }
+    // los mapeos mantienen vivo al archivo
+    close(fd);
+    return base;
+#else
+    (void) n;
+    return NULL;
+#endif
+}
+
+int
+buffer_ring_rebase(buffer *b, const size_t n) {
+    const size_t pending = b->write - b->read;
+    if(pending > n) {
+        return -1;
+    }
+    uint8_t *data = ring_map(n);
+    if(data == NULL) {
+        return -1;
+    }
+    memcpy(data, b->read, pending);
+    buffer_ring_free(b);
+    b->data  = data;
+    b->read  = data;
+    b->write = data + pending;
+    b->limit = data + n;
+    b->ring  = n;
+    return 0;
+}
+
+void
+buffer_ring_free(buffer *b) {
+    if(b->ring) {
+        munmap(b->data, 2 * b->ring);
+        b->ring = 0;
+    }
+}
@@ -80,12 +80,18 @@
  * +---+---+---+---+---+---+
  * ↑                       ↑
  * W=0                     limit=6
+ *
+ * Buffer circular (buffer_ring_rebase): las mismas páginas se mapean dos veces
+ * seguidas, así que `data[i]' y `data[i + n]' son el mismo byte. El espacio
+ * libre y los datos pendientes siempre son contiguos aunque den la vuelta:
+ * `limit' acompaña a R (limit = R + n) y no hace falta compactar. Cuando R
+ * pasa a la segunda copia, R, W y limit se corren n bytes hacia atrás.
  */
 typedef struct buffer buffer;
 struct buffer {
     uint8_t *data;
 
-    /** límite superior del buffer. inmutable */
+    /** límite superior del buffer. inmutable salvo en los circulares */
     uint8_t *limit;
 
     /** puntero de lectura */
@@ -93,6 +99,9 @@ struct buffer {
 
     /** puntero de escritura */
     uint8_t *write;
+
+    /** tamaño si es circular; 0 si es lineal */
+    size_t ring;
 };
 
 /**
@@ -137,6 +146,28 @@ buffer_compact(buffer *b);
 void
 buffer_reset(buffer *b);
 
+/**
+ * Pasa el buffer a usar `data' (de `n' bytes) como almacenamiento, copiando
+ * los bytes pendientes de lectura al comienzo. `n' debe alcanzar para ellos.
+ * El almacenamiento anterior queda libre para quien lo haya provisto (o se
+ * libera, si era circular).
+ */
+void
+buffer_rebase(buffer *b, const size_t n, uint8_t *data);
+
+/**
+ * Pasa el buffer a uno circular de `n' bytes (múltiplo del tamaño de página),
+ * con los bytes pendientes. El almacenamiento anterior queda libre para quien
+ * lo haya provisto (o se libera, si era circular). -1 si no se pudo mapear;
+ * el buffer queda como estaba.
+ */
+int
+buffer_ring_rebase(buffer *b, const size_t n);
+
+/** libera el mapeo de un buffer circular; no hace nada con los lineales */
+void
+buffer_ring_free(buffer *b);
+
 /** retorna true si hay bytes para leer del buffer */
 bool
 buffer_can_read(buffer *b);
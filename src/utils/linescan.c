@@ -0,0 +1,162 @@
+/**
+ * linescan.c -- búsqueda vectorizada de fin de línea.
+ */
+#include "linescan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__)
+#define LINESCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static size_t
+eol_scalar(const uint8_t *s, const size_t n) {
+    size_t i = 0;
+    for(; i < n; i++) {
+        if(s[i] == '\n') {
+            break;
+        }
+    }
+    return i;
+}
+
+#ifdef LINESCAN_X86
+
+static size_t
+eol_sse2(const uint8_t *s, const size_t n) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+
+    for(; i + 16 <= n; i += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        const unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + eol_scalar(s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+eol_avx2(const uint8_t *s, const size_t n) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    size_t ret = n;
+    bool found = false;
+
+    // dos vectores por vuelta: el OR de ambas comparaciones decide si hay que
+    // mirar el detalle, así el caso común (sin '\n') es un único salto.
+    for(; !found && i + 64 <= n; i += 64) {
+        const __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)), nl);
+        const __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i + 32)), nl);
+        const uint64_t mask = (uint32_t)_mm256_movemask_epi8(a)
+                            | (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32;
+        if(mask != 0) {
+            ret   = i + __builtin_ctzll(mask);
+            found = true;
+        }
+    }
+    // sin vzeroupper el código SSE que sigue paga la transición de estado
+    _mm256_zeroupper();
+
+    return found ? ret : i + eol_sse2(s + i, n - i);
+}
+
+#endif
+
+const char *
+linescan_impl_name(const enum linescan_impl impl) {
+    const char *ret;
+    switch(impl) {
+        case LINESCAN_SSE2:
+            ret = "sse2";
+            break;
+        case LINESCAN_AVX2:
+            ret = "avx2";
+            break;
+        default:
+            ret = "escalar";
+    }
+    return ret;
+}
+
+bool
+linescan_supported(const enum linescan_impl impl) {
+    bool ret = false;
+    switch(impl) {
+        case LINESCAN_SCALAR:
+            ret = true;
+            break;
+#ifdef LINESCAN_X86
+        case LINESCAN_SSE2:
+            ret = true;
+            break;
+        case LINESCAN_AVX2:
+            __builtin_cpu_init();
+            ret = __builtin_cpu_supports("avx2");
+            break;
+#endif
+        default:
+            ret = false;
+    }
+    return ret;
+}
+
+enum linescan_impl
+linescan_best(void) {
+    if(linescan_supported(LINESCAN_AVX2)) {
+        return LINESCAN_AVX2;
+    }
+    if(linescan_supported(LINESCAN_SSE2)) {
+        return LINESCAN_SSE2;
+    }
+    return LINESCAN_SCALAR;
+}
+
+size_t
+linescan_eol_with(const enum linescan_impl impl, const uint8_t *s, const size_t n) {
+    size_t ret;
+    switch(impl) {
+#ifdef LINESCAN_X86
+        case LINESCAN_SSE2:
+            ret = eol_sse2(s, n);
+            break;
+        case LINESCAN_AVX2:
+            ret = eol_avx2(s, n);
+            break;
+#endif
+        default:
+            ret = eol_scalar(s, n);
+    }
+    return ret;
+}
+
+static size_t eol_resolve(const uint8_t *s, const size_t n);
+
+/**
+ * la primera llamada resuelve la implementación; si dos hilos la resuelven a
+ * la vez ambos escriben el mismo valor.
+ */
+static size_t (*eol_impl)(const uint8_t *, const size_t) = eol_resolve;
+
+static size_t
+eol_resolve(const uint8_t *s, const size_t n) {
+    switch(linescan_best()) {
+#ifdef LINESCAN_X86
+        case LINESCAN_AVX2:
+            eol_impl = eol_avx2;
+            break;
+        case LINESCAN_SSE2:
+            eol_impl = eol_sse2;
+            break;
+#endif
+        default:
+            eol_impl = eol_scalar;
+    }
+    return eol_impl(s, n);
+}
+
+size_t
+linescan_eol(const uint8_t *s, const size_t n) {
+    return eol_impl(s, n);
+}
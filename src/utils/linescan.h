@@ -0,0 +1,49 @@
+#ifndef LINESCAN_H_7c2d9e1f4a6b8c0d2e4f6a8b0c1d3e5f7a9b1c2d
+#define LINESCAN_H_7c2d9e1f4a6b8c0d2e4f6a8b0c1d3e5f7a9b1c2d
+
+/**
+ * linescan.c -- búsqueda vectorizada de fin de línea.
+ *
+ * Los disectores de protocolos de texto (POP3, ...) solo necesitan mirar el
+ * comienzo de cada línea: el resto se saltea hasta el próximo '\n'. Pasar
+ * esos bytes uno a uno por `parser_feed' limita el throughput del relay, así
+ * que la búsqueda se hace de a 16 (SSE2) o 32 (AVX2) bytes por comparación y
+ * solo las posiciones de interés (inicio de línea) llegan a los parsers.
+ *
+ * La implementación se elige en la primera llamada según lo que soporte la
+ * CPU. En plataformas que no son x86 se usa la versión escalar.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** implementaciones disponibles */
+enum linescan_impl {
+    LINESCAN_SCALAR,
+    LINESCAN_SSE2,
+    LINESCAN_AVX2,
+};
+
+/** nombre humano de la implementación */
+const char *
+linescan_impl_name(const enum linescan_impl impl);
+
+/** true si la CPU donde corremos soporta `impl' */
+bool
+linescan_supported(const enum linescan_impl impl);
+
+/** la mejor implementación soportada por la CPU */
+enum linescan_impl
+linescan_best(void);
+
+/**
+ * retorna el índice del primer '\n' en `s[0..n)', o `n' si no hay ninguno.
+ */
+size_t
+linescan_eol(const uint8_t *s, const size_t n);
+
+/** igual que `linescan_eol' pero forzando una implementación (benchmarks) */
+size_t
+linescan_eol_with(const enum linescan_impl impl, const uint8_t *s, const size_t n);
+
+#endif
@@ -5,12 +5,37 @@
 
 #include "parser.h"
 
+/** par de acciones de una transición */
+struct parser_action {
+    void    (*act1)(struct parser_event *ret, const uint8_t c);
+    void    (*act2)(struct parser_event *ret, const uint8_t c);
+};
+
+/** marca para las celdas de la tabla sin transición */
+#define NO_ACTION   0xFFFF
+/** máxima cantidad de estados y de acciones representables */
+#define TABLE_MAX   0xFFFF
+
+/**
+ * tabla densa: cada celda codifica el estado destino en los 16 bits bajos y
+ * el índice de la acción en los 16 altos.
+ */
+struct parser_table {
+    unsigned              states_count;
+    unsigned              start_state;
+    uint32_t             *cells;     // [states_count][256]
+    struct parser_action *actions;
+    unsigned              actions_n;
+};
+
 /* CDT del parser */
 struct parser {
     /** tipificación para cada caracter */
     const unsigned     *classes;
     /** definición de estados */
     const struct parser_definition *def;
+    /** tabla precompilada (opcional) */
+    const struct parser_table *table;
 
     /* estado actual */
     unsigned            state;
@@ -41,13 +66,180 @@ parser_init(const unsigned *classes,
     return ret;
 }
 
+struct parser *
+parser_init_table(const struct parser_table *t) {
+    struct parser *ret = malloc(sizeof(*ret));
+    if(ret != NULL) {
+        memset(ret, 0, sizeof(*ret));
+        ret->table = t;
+        ret->state = t->start_state;
+    }
+    return ret;
+}
+
 void
 parser_reset(struct parser *p) {
-    p->state   = p->def->start_state;
+    p->state   = p->table != NULL ? p->table->start_state
+                                  : p->def->start_state;
 }
 
-const struct parser_event *
-parser_feed(struct parser *p, const uint8_t c) {
+/** busca (o agrega) el par de acciones y retorna su índice */
+static unsigned
+action_id(struct parser_table *t, const struct parser_state_transition *tr) {
+    for(unsigned i = 0; i < t->actions_n; i++) {
+        if(t->actions[i].act1 == tr->act1 && t->actions[i].act2 == tr->act2) {
+            return i;
+        }
+    }
+    t->actions[t->actions_n].act1 = tr->act1;
+    t->actions[t->actions_n].act2 = tr->act2;
+    return t->actions_n++;
+}
+
+/** evalúa la condición `when' tal como lo hace `parser_feed' */
+static inline bool
+transition_matches(const struct parser_state_transition *tr,
+                   const uint8_t c, const unsigned type) {
+    bool matched;
+    if (tr->when <= 0xFF) {
+        matched = (c == tr->when);
+    } else if(tr->when == ANY) {
+        matched = true;
+    } else {
+        matched = (type & tr->when);
+    }
+    return matched;
+}
+
+struct parser_table *
+parser_compile(const unsigned *classes, const struct parser_definition *def) {
+    size_t transitions = 0;
+    for(unsigned st = 0; st < def->states_count; st++) {
+        transitions += def->states_n[st];
+    }
+    if(def->states_count == 0 || def->states_count >= TABLE_MAX
+       || transitions >= TABLE_MAX) {
+        return NULL;
+    }
+
+    struct parser_table *t = calloc(1, sizeof(*t));
+    if(t == NULL) {
+        return NULL;
+    }
+    t->states_count = def->states_count;
+    t->start_state  = def->start_state;
+    t->cells        = malloc(def->states_count * 256 * sizeof(*t->cells));
+    t->actions      = calloc(transitions, sizeof(*t->actions));
+    if(t->cells == NULL || (transitions > 0 && t->actions == NULL)) {
+        parser_table_destroy(t);
+        return NULL;
+    }
+
+    for(unsigned st = 0; st < def->states_count; st++) {
+        const struct parser_state_transition *state = def->states[st];
+        const size_t n = def->states_n[st];
+        uint32_t *row  = t->cells + st * 256;
+
+        for(unsigned c = 0; c < 256; c++) {
+            // por defecto: sin transición, el estado no cambia
+            row[c] = ((uint32_t)NO_ACTION << 16) | st;
+            for(size_t i = 0; i < n; i++) {
+                if(transition_matches(state + i, c, classes[c])) {
+                    row[c] = ((uint32_t)action_id(t, state + i) << 16)
+                           | state[i].dest;
+                    break;
+                }
+            }
+        }
+    }
+    return t;
+}
+
+void
+parser_table_destroy(struct parser_table *t) {
+    if(t != NULL) {
+        free(t->cells);
+        free(t->actions);
+        free(t);
+    }
+}
+
+/** resuelve un byte usando la tabla precompilada */
+static inline const struct parser_event *
+table_feed(struct parser *p, const uint8_t c,
+           struct parser_event *e1, struct parser_event *e2) {
+    const struct parser_table *t = p->table;
+    const uint32_t cell          = t->cells[p->state * 256 + c];
+    const unsigned action        = cell >> 16;
+
+    if(action != NO_ACTION) {
+        const struct parser_action *a = t->actions + action;
+        e1->next = NULL;
+        a->act1(e1, c);
+        if(a->act2 != NULL) {
+            e1->next = e2;
+            e2->next = NULL;
+            a->act2(e2, c);
+        }
+    }
+    p->state = cell & 0xFFFF;
+    return action != NO_ACTION ? e1 : NULL;
+}
+
+static bool linear_feed(struct parser *p, const uint8_t c);
+
+size_t
+parser_feed_span(struct parser *p, const uint8_t *s, const size_t n,
+                 struct parser_event *events, size_t *nevents) {
+    const size_t cap = *nevents;
+    size_t used      = 0;
+    size_t i         = 0;
+
+    if(p->table != NULL) {
+        // camino rápido: estado y tabla en registros durante todo el span
+        const uint32_t *cells               = p->table->cells;
+        const struct parser_action *actions = p->table->actions;
+        unsigned state                      = p->state;
+
+        for(; i < n && used + 2 <= cap; i++) {
+            const uint8_t  c      = s[i];
+            const uint32_t cell   = cells[state * 256 + c];
+            const unsigned action = cell >> 16;
+            state = cell & 0xFFFF;
+            if(action != NO_ACTION) {
+                const struct parser_action *a = actions + action;
+                struct parser_event *e        = events + used++;
+                e->next = NULL;
+                a->act1(e, c);
+                if(a->act2 != NULL) {
+                    e->next           = events + used;
+                    events[used].next = NULL;
+                    a->act2(events + used++, c);
+                }
+            }
+        }
+        p->state = state;
+    } else {
+        for(; i < n && used + 2 <= cap; i++) {
+            if(linear_feed(p, s[i])) {
+                events[used] = p->e1;
+                if(p->e1.next != NULL) {
+                    events[used + 1]   = p->e2;
+                    events[used].next  = events + used + 1;
+                    used += 2;
+                } else {
+                    used += 1;
+                }
+            }
+        }
+    }
+    *nevents = used;
+    return i;
+}
+
+/** recorre las transiciones del estado actual. retorna si hubo match */
+static bool
+linear_feed(struct parser *p, const uint8_t c) {
     const unsigned type = p->classes[c];
 
     p->e1.next = p->e2.next = 0;
@@ -78,11 +270,22 @@ parser_feed(struct parser *p, const uint8_t c) {
             break;
         }
     }
+    return matched;
+}
+
+const struct parser_event *
+parser_feed(struct parser *p, const uint8_t c) {
+    if(p->table != NULL) {
+        p->e1.next = p->e2.next = 0;
+        table_feed(p, c, &p->e1, &p->e2);
+    } else {
+        linear_feed(p, c);
+    }
     return &p->e1;
 }
 
 
-static const unsigned classes[0xFF] = {0x00};
+static const unsigned classes[0x100] = {0x00};
 
 const unsigned *
 parser_no_classes(void) {
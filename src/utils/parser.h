@@ -9,6 +9,12 @@
  *
  * El usuario provee al parser con bytes y éste retona eventos que pueden
  * servir para delimitar tokens o accionar directamente.
+ *
+ * Una definición se puede precompilar con `parser_compile' en una tabla densa
+ * [estado][byte] -> (destino, acción). Los parsers creados a partir de la
+ * tabla resuelven cada byte con un único acceso, sin recorrer las
+ * transiciones ni evaluar las condiciones `when', y pueden consumir un span
+ * completo de bytes por llamada con `parser_feed_span'.
  */
 #include <stdint.h>
 #include <stddef.h>
@@ -66,6 +72,27 @@ struct parser *
 parser_init    (const unsigned *classes,
                 const struct parser_definition *def);
 
+/** tabla de transiciones precompilada. Inmutable: se puede compartir. */
+struct parser_table;
+
+/**
+ * compila la definición en una tabla densa. La definición y `classes' pueden
+ * liberarse luego de la compilación.
+ *
+ * retorna NULL si no hay memoria o la definición tiene demasiados estados.
+ */
+struct parser_table *
+parser_compile (const unsigned *classes,
+                const struct parser_definition *def);
+
+/** libera una tabla creada con `parser_compile' */
+void
+parser_table_destroy(struct parser_table *t);
+
+/** inicializa un parser que utiliza la tabla precompilada `t' */
+struct parser *
+parser_init_table(const struct parser_table *t);
+
 /** destruye el parser */
 void
 parser_destroy  (struct parser *p);
@@ -82,6 +109,22 @@ parser_reset    (struct parser *p);
 const struct parser_event *
 parser_feed     (struct parser *p, const uint8_t c);
 
+/**
+ * alimenta el parser con hasta `n' bytes de `s' de una sola vez.
+ *
+ * Los eventos generados se escriben en `events' (capacidad indicada en
+ * `*nevents'); cuando una transición genera dos eventos el primero apunta
+ * al segundo mediante `next', igual que en `parser_feed'. Al retornar
+ * `*nevents' contiene la cantidad de eventos escritos. Los bytes que no
+ * disparan ninguna transición no generan eventos.
+ *
+ * Retorna la cantidad de bytes consumidos, que puede ser menor a `n' si no
+ * hubo lugar para más eventos.
+ */
+size_t
+parser_feed_span(struct parser *p, const uint8_t *s, const size_t n,
+                 struct parser_event *events, size_t *nevents);
+
 /**
  * En caso de la aplicacion no necesite clases caracteres, se
  * provee dicho arreglo para ser usando en `parser_init'
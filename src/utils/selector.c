@@ -1,6 +1,9 @@
 /**
  * selector.c - un muliplexor de entrada salida
  */
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>  // perror
 #include <stdlib.h> // malloc
 #include <string.h> // memset
@@ -9,13 +12,22 @@
 #include <pthread.h>
 
 #include <stdint.h> // SIZE_MAX
+#include <limits.h> // INT_MAX
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/resource.h>
 #include <sys/signal.h>
 #include <signal.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 #include "selector.h"
 
 #define N(x) (sizeof(x)/sizeof((x)[0]))
@@ -107,7 +119,44 @@ struct item {
    fd_interest         interest;
    const fd_handler   *handler;
    void *              data;
+
+   // solo para epoll / io_uring
+   /** descarta eventos de un registro o un armado anterior del mismo fd */
+   uint32_t            gen;
+   /** interés que conoce el kernel */
+   fd_interest         armed;
+   /** está en el epoll / tiene un POLL_ADD pendiente */
+   bool                in_kernel;
+   /** está en la lista de cambios a informar antes de esperar */
+   bool                dirty;
+   /**
+    * el kernel informó un cierre o un error que ningún handler atendió: no
+    * se vuelve a armar hasta que cambie el interés
+    */
+   bool                hung;
+};
+
+#ifdef __linux__
+/** anillos de io_uring mapeados del kernel */
+struct uring {
+    int                  fd;
+    void                *ring;
+    size_t               ring_size;
+    struct io_uring_sqe *sqes;
+    size_t               sqes_size;
+
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned             sq_entries;
+
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
 };
+#endif
 
 /* tarea bloqueante */
 struct blocking_job {
@@ -135,6 +184,8 @@ struct fdselector {
     // esto podría mejorarse utilizando otra estructura de datos
     struct item    *fds;
     size_t          fd_size;  // cantidad de elementos posibles de fds
+    /** fds que admite el mecanismo de espera en uso, ver engine_max_items */
+    size_t          max_items;
 
     /** fd maximo para usar en select() */
     int max_fd;  // max(.fds[].fd)
@@ -158,19 +209,45 @@ struct fdselector {
      * notificados.
      */
     struct blocking_job    *resolution_jobs;
+
+    /** mecanismo de espera en uso */
+    enum selector_engine    engine;
+    /** syscalls hechas para esperar y armar intereses */
+    uint64_t                syscalls;
+    /** fds con cambios de interés que todavía no se informaron al kernel */
+    int                    *dirty;
+    size_t                  dirty_count;
+    size_t                  dirty_cap;
+#ifdef __linux__
+    int                     epoll_fd;
+    struct epoll_event     *events;
+    struct uring            uring;
+#endif
 };
 
-/** cantidad máxima de file descriptors que la plataforma puede manejar */
+/** cantidad máxima de file descriptors que select(2) puede manejar */
 #define ITEMS_MAX_SIZE      FD_SETSIZE
 
-// en esta implementación el máximo está dado por el límite natural de select(2).
+/**
+ * select(2) no admite fds desde FD_SETSIZE; epoll e io_uring, cualquiera que
+ * el proceso pueda abrir.
+ */
+static size_t
+engine_max_items(enum selector_engine engine) {
+    struct rlimit rl;
+    if(engine == SELECTOR_ENGINE_SELECT || getrlimit(RLIMIT_NOFILE, &rl) != 0
+       || rl.rlim_cur < ITEMS_MAX_SIZE) {
+        return ITEMS_MAX_SIZE;
+    }
+    return rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > INT_MAX ? INT_MAX : (size_t)rl.rlim_cur;
+}
 
 /**
  * determina el tamaño a crecer, generando algo de slack para no tener
- * que realocar constantemente.
+ * que realocar constantemente. `max' es el máximo del selector.
  */
 static
-size_t next_capacity(const size_t n) {
+size_t next_capacity(const size_t n, const size_t max) {
     unsigned bits = 0;
     size_t tmp = n;
     while(tmp != 0) {
@@ -180,8 +257,8 @@ size_t next_capacity(const size_t n) {
     tmp = 1UL << bits;
 
     assert(tmp >= n);
-    if(tmp > ITEMS_MAX_SIZE) {
-        tmp = ITEMS_MAX_SIZE;
+    if(tmp > max) {
+        tmp = max;
     }
 
     return tmp + 1;
@@ -189,6 +266,8 @@ size_t next_capacity(const size_t n) {
 
 static inline void
 item_init(struct item *item) {
+    // realloc no limpia la memoria nueva
+    memset(item, 0x00, sizeof(*item));
     item->fd = FD_UNUSED;
 }
 
@@ -227,7 +306,10 @@ items_update_fdset_for_fd(fd_selector s, const struct item * item) {
     FD_CLR(item->fd, &s->master_w);
 
     if(ITEM_USED(item)) {
-        if(item->interest & OP_READ) {
+        // select() informa la cola de errores como lectura, sin distinguirla
+        // de los datos sin leer: un fd con OP_ERROR y datos pendientes
+        // despierta en cada vuelta. Por eso -Z no se usa con este mecanismo.
+        if(item->interest & (OP_READ | OP_ERROR)) {
             FD_SET(item->fd, &(s->master_r));
         }
 
@@ -250,12 +332,12 @@ ensure_capacity(fd_selector s, const size_t n) {
     if(n < s->fd_size) {
         // nada para hacer, entra...
         ret = SELECTOR_SUCCESS;
-    } else if(n > ITEMS_MAX_SIZE) {
+    } else if(n > s->max_items) {
         // me estás pidiendo más de lo que se puede.
         ret = SELECTOR_MAXFD;
     } else if(NULL == s->fds) {
         // primera vez.. alocamos
-        const size_t new_size = next_capacity(n);
+        const size_t new_size = next_capacity(n, s->max_items);
 
         s->fds = calloc(new_size, element_size);
         if(NULL == s->fds) {
@@ -266,7 +348,7 @@ ensure_capacity(fd_selector s, const size_t n) {
         }
     } else {
         // hay que agrandar...
-        const size_t new_size = next_capacity(n);
+        const size_t new_size = next_capacity(n, s->max_items);
         if (new_size > SIZE_MAX/element_size) { // ver MEM07-C
             ret = SELECTOR_ENOMEM;
         } else {
@@ -286,6 +368,464 @@ ensure_capacity(fd_selector s, const size_t n) {
     return ret;
 }
 
+const char *
+selector_engine_name(enum selector_engine engine) {
+    switch(engine) {
+        case SELECTOR_ENGINE_SELECT:
+            return "select";
+        case SELECTOR_ENGINE_EPOLL:
+            return "epoll";
+        case SELECTOR_ENGINE_IO_URING:
+            return "io_uring";
+    }
+    return "unknown";
+}
+
+/** eventos de poll(2) correspondientes a un interés */
+static unsigned
+interest_events(fd_interest interest) {
+    unsigned events = 0;
+    if(interest & OP_READ) {
+        events |= POLLIN;
+    }
+    if(interest & OP_WRITE) {
+        events |= POLLOUT;
+    }
+    if(interest & OP_ERROR) {
+        events |= POLLERR;
+    }
+    return events;
+}
+
+static inline uint64_t
+item_tag(const struct item *item) {
+    return ((uint64_t)item->gen << 32) | (uint32_t)item->fd;
+}
+
+/** item al que corresponde un evento, o NULL si el evento es viejo */
+static struct item *
+item_for_tag(fd_selector s, uint64_t tag) {
+    const size_t fd = (uint32_t)tag;
+    if(fd >= s->fd_size) {
+        return NULL;
+    }
+    struct item *item = s->fds + fd;
+    if(!ITEM_USED(item) || item->gen != (uint32_t)(tag >> 32)) {
+        return NULL;
+    }
+    return item;
+}
+
+/**
+ * despacha un evento con la misma semántica que el recorrido de select():
+ * el interés se revisa al momento de llamar a cada handler. Devuelve si se
+ * llamó a alguno.
+ */
+static bool
+item_dispatch(fd_selector s, struct item *item, unsigned revents) {
+    struct selector_key key = {
+        .s    = s,
+        .fd   = item->fd,
+        .data = item->data,
+    };
+    // un handler puede registrar fds y agrandar (mover) `s->fds': el item se
+    // vuelve a buscar después de cada uno
+    const int      fd  = item->fd;
+    const uint32_t gen = item->gen;
+    bool handled = false;
+    if((revents & POLLERR) && (OP_ERROR & item->interest) && item->handler->handle_error != 0) {
+        handled = true;
+        item->handler->handle_error(&key);
+        item = s->fds + fd;
+        if(!ITEM_USED(item) || item->gen != gen) {
+            return handled;
+        }
+    }
+    // un error o un cierre se informa como listo para que el handler lo lea
+    const unsigned failed = revents & (POLLERR | POLLHUP);
+    if((revents & POLLIN || failed) && (OP_READ & item->interest)) {
+        handled = true;
+        if(0 == item->handler->handle_read) {
+            assert(("OP_READ arrived but no handler. bug!" == 0));
+        } else {
+            item->handler->handle_read(&key);
+            item = s->fds + fd;
+        }
+    }
+    if((revents & POLLOUT || failed) && ITEM_USED(item) && item->gen == gen
+       && (OP_WRITE & item->interest)) {
+        handled = true;
+        if(0 == item->handler->handle_write) {
+            assert(("OP_WRITE arrived but no handler. bug!" == 0));
+        } else {
+            item->handler->handle_write(&key);
+        }
+    }
+    return handled;
+}
+
+/** anota que el interés de `item' cambió y hay que informarlo antes de esperar */
+static selector_status
+item_changed(fd_selector s, struct item *item) {
+    if(s->engine == SELECTOR_ENGINE_SELECT) {
+        items_update_fdset_for_fd(s, item);
+        return SELECTOR_SUCCESS;
+    }
+    if(item->dirty) {
+        return SELECTOR_SUCCESS;
+    }
+    if(s->dirty_count == s->dirty_cap) {
+        const size_t cap = s->dirty_cap == 0 ? 64 : s->dirty_cap * 2;
+        int *tmp = realloc(s->dirty, cap * sizeof(*tmp));
+        if(tmp == NULL) {
+            return SELECTOR_ENOMEM;
+        }
+        s->dirty     = tmp;
+        s->dirty_cap = cap;
+    }
+    s->dirty[s->dirty_count++] = item->fd;
+    item->dirty = true;
+    return SELECTOR_SUCCESS;
+}
+
+#ifdef __linux__
+
+/**
+ * epoll e io_uring informan POLLHUP y POLLERR aunque no se los pida y, por
+ * nivel, en cada espera. Si nadie los atendió el fd se deja de vigilar hasta
+ * que cambie su interés; si no, el loop no vuelve a bloquearse.
+ */
+static void
+item_hung(fd_selector s, struct item *item) {
+    if(ITEM_USED(item) && !item->hung) {
+        item->hung = true;
+        item_changed(s, item);
+    }
+}
+
+/** interés que hay que armar en el kernel */
+static inline fd_interest
+item_wanted(const struct item *item) {
+    return item->hung ? OP_NOOP : item->interest;
+}
+
+/* ----- epoll ---------------------------------------------------------- */
+
+#define EPOLL_BATCH 256
+
+static bool
+epoll_open(fd_selector s) {
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(s->epoll_fd < 0) {
+        return false;
+    }
+    s->events = malloc(EPOLL_BATCH * sizeof(*s->events));
+    if(s->events == NULL) {
+        close(s->epoll_fd);
+        return false;
+    }
+    return true;
+}
+
+static void
+epoll_forget(fd_selector s, struct item *item) {
+    if(item->in_kernel) {
+        s->syscalls++;
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, item->fd, NULL);
+    }
+    item->in_kernel = false;
+    item->armed     = OP_NOOP;
+}
+
+/**
+ * informa los cambios acumulados. Un túnel que alterna entre leer y escribir
+ * paga un solo EPOLL_CTL_MOD por cambio; sin interés el fd se saca, porque
+ * con `events' vacío el kernel igual informa los cierres (ver item_hung).
+ */
+static void
+epoll_flush(fd_selector s) {
+    for(size_t i = 0; i < s->dirty_count; i++) {
+        struct item *item = s->fds + s->dirty[i];
+        item->dirty = false;
+        if(!ITEM_USED(item)) {
+            continue;
+        }
+        const fd_interest want = item_wanted(item);
+        if(want == OP_NOOP) {
+            epoll_forget(s, item);
+            continue;
+        }
+        if(item->in_kernel && item->armed == want) {
+            continue;
+        }
+        struct epoll_event ev = {
+            .events   = interest_events(want),
+            .data.u64 = item_tag(item),
+        };
+        const int op = item->in_kernel ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        s->syscalls++;
+        if(epoll_ctl(s->epoll_fd, op, item->fd, &ev) == 0) {
+            item->in_kernel = true;
+            item->armed     = want;
+        }
+    }
+    s->dirty_count = 0;
+}
+
+static selector_status
+epoll_iteration(fd_selector s) {
+    epoll_flush(s);
+
+    const int timeout = (int)(s->master_t.tv_sec * 1000 + s->master_t.tv_nsec / 1000000);
+    s->syscalls++;
+    const int n = epoll_pwait(s->epoll_fd, s->events, EPOLL_BATCH, timeout, &emptyset);
+    if(n == -1) {
+        return (errno == EINTR || errno == EAGAIN) ? SELECTOR_SUCCESS : SELECTOR_IO;
+    }
+    for(int i = 0; i < n; i++) {
+        struct item *item = item_for_tag(s, s->events[i].data.u64);
+        if(item != NULL && !item_dispatch(s, item, s->events[i].events)) {
+            item_hung(s, item);
+        }
+    }
+    return SELECTOR_SUCCESS;
+}
+
+/* ----- io_uring --------------------------------------------------------- */
+
+#define URING_ENTRIES 256
+/** user_data de los POLL_REMOVE, cuya respuesta no interesa */
+#define URING_TAG_REMOVE UINT64_MAX
+
+static int
+uring_enter(fd_selector s, unsigned to_submit, unsigned min_complete, unsigned flags,
+            const void *arg, size_t arg_size) {
+    s->syscalls++;
+    return (int)syscall(__NR_io_uring_enter, s->uring.fd, to_submit, min_complete, flags,
+                        arg, arg_size);
+}
+
+static bool
+uring_open(fd_selector s) {
+    struct uring *r = &s->uring;
+    struct io_uring_params p;
+    memset(&p, 0x00, sizeof(p));
+
+    r->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if(r->fd < 0) {
+        return false;
+    }
+    // hace falta esperar con máscara de señales y timeout (5.11) sin perder
+    // completions si se llena la cola
+    const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((p.features & needed) != needed) {
+        close(r->fd);
+        return false;
+    }
+
+    const size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    const size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    r->ring = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQ_RING);
+    if(r->ring == MAP_FAILED) {
+        close(r->fd);
+        return false;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQES);
+    if(r->sqes == MAP_FAILED) {
+        munmap(r->ring, r->ring_size);
+        close(r->fd);
+        return false;
+    }
+
+    uint8_t *base  = r->ring;
+    r->sq_head     = (unsigned *)(base + p.sq_off.head);
+    r->sq_tail     = (unsigned *)(base + p.sq_off.tail);
+    r->sq_mask     = (unsigned *)(base + p.sq_off.ring_mask);
+    r->sq_array    = (unsigned *)(base + p.sq_off.array);
+    r->sq_entries  = p.sq_entries;
+    r->cq_head     = (unsigned *)(base + p.cq_off.head);
+    r->cq_tail     = (unsigned *)(base + p.cq_off.tail);
+    r->cq_mask     = (unsigned *)(base + p.cq_off.ring_mask);
+    r->cqes        = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+    return true;
+}
+
+static void
+uring_close(fd_selector s) {
+    munmap(s->uring.sqes, s->uring.sqes_size);
+    munmap(s->uring.ring, s->uring.ring_size);
+    close(s->uring.fd);
+}
+
+/** entradas publicadas que el kernel todavía no consumió */
+static unsigned
+uring_pending(const struct uring *r) {
+    return *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/** encola una operación; si la cola está llena la envía primero */
+static bool
+uring_push(fd_selector s, uint8_t opcode, int fd, uint64_t addr, unsigned events, uint64_t tag) {
+    struct uring *r = &s->uring;
+    if(uring_pending(r) == r->sq_entries
+       && (uring_enter(s, r->sq_entries, 0, 0, NULL, 0) < 0 || uring_pending(r) == r->sq_entries)) {
+        return false;
+    }
+    const unsigned tail = *r->sq_tail;
+    const unsigned idx  = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = r->sqes + idx;
+    memset(sqe, 0x00, sizeof(*sqe));
+    sqe->opcode        = opcode;
+    sqe->fd            = fd;
+    sqe->addr          = addr;
+    sqe->poll32_events = events;
+    sqe->user_data     = tag;
+    r->sq_array[idx]   = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool
+uring_remove(fd_selector s, struct item *item) {
+    item->in_kernel = false;
+    return uring_push(s, IORING_OP_POLL_REMOVE, -1, item_tag(item), 0, URING_TAG_REMOVE);
+}
+
+/**
+ * los POLL_ADD son de un disparo: cada completion deja el fd desarmado y se
+ * vuelve a armar acá si sigue el interés. Al armar, el kernel revisa el
+ * estado actual del fd, lo que da la misma semántica de nivel que select().
+ */
+static bool
+uring_flush(fd_selector s) {
+    bool ok = true;
+    for(size_t i = 0; i < s->dirty_count; i++) {
+        struct item *item = s->fds + s->dirty[i];
+        item->dirty = false;
+        const fd_interest want = item_wanted(item);
+        if(!ITEM_USED(item) || (item->in_kernel && item->armed == want)) {
+            continue;
+        }
+        if(item->in_kernel) {
+            ok &= uring_remove(s, item);
+        }
+        if(want != OP_NOOP) {
+            item->gen++;
+            item->armed     = want;
+            item->in_kernel = uring_push(s, IORING_OP_POLL_ADD, item->fd, 0,
+                                         interest_events(want), item_tag(item));
+            ok &= item->in_kernel;
+        }
+    }
+    s->dirty_count = 0;
+    return ok;
+}
+
+static void
+uring_reap(fd_selector s) {
+    struct uring *r = &s->uring;
+    unsigned head = *r->cq_head;
+    const unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        const struct io_uring_cqe *cqe = r->cqes + (head & *r->cq_mask);
+        const uint64_t tag = cqe->user_data;
+        const int res = cqe->res;
+        head++;
+        // se libera la entrada antes de despachar: el handler puede encolar
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        struct item *item = tag == URING_TAG_REMOVE ? NULL : item_for_tag(s, tag);
+        if(item == NULL) {
+            continue;
+        }
+        item->in_kernel = false;
+        item->armed     = OP_NOOP;
+        if(item_changed(s, item) != SELECTOR_SUCCESS) {
+            continue;
+        }
+        if(!item_dispatch(s, item, res < 0 ? POLLERR : (unsigned)res)) {
+            item_hung(s, item);
+        }
+    }
+}
+
+static selector_status
+uring_iteration(fd_selector s) {
+    if(!uring_flush(s)) {
+        return SELECTOR_IO;
+    }
+
+    struct __kernel_timespec ts = {
+        .tv_sec  = s->master_t.tv_sec,
+        .tv_nsec = s->master_t.tv_nsec,
+    };
+    struct io_uring_getevents_arg arg = {
+        .sigmask    = (uint64_t)(uintptr_t)&emptyset,
+        // el sigset_t del kernel es de 64 bits
+        .sigmask_sz = sizeof(uint64_t),
+        .ts         = (uint64_t)(uintptr_t)&ts,
+    };
+    // los cambios de interés, los re-armados y la espera en una sola syscall
+    const int n = uring_enter(s, uring_pending(&s->uring), 1,
+                              IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if(n < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+        return SELECTOR_IO;
+    }
+    uring_reap(s);
+    return SELECTOR_SUCCESS;
+}
+
+#endif
+
+/** abre el mecanismo pedido o, si el kernel no lo soporta, uno más simple */
+static void
+engine_open(fd_selector s, enum selector_engine engine) {
+#ifdef __linux__
+    if(engine == SELECTOR_ENGINE_IO_URING) {
+        if(uring_open(s)) {
+            s->engine = SELECTOR_ENGINE_IO_URING;
+            return;
+        }
+        engine = SELECTOR_ENGINE_EPOLL;
+    }
+    if(engine == SELECTOR_ENGINE_EPOLL && epoll_open(s)) {
+        s->engine = SELECTOR_ENGINE_EPOLL;
+        return;
+    }
+#endif
+    s->engine = SELECTOR_ENGINE_SELECT;
+}
+
+static void
+engine_close(fd_selector s) {
+#ifdef __linux__
+    if(s->engine == SELECTOR_ENGINE_EPOLL) {
+        free(s->events);
+        close(s->epoll_fd);
+    } else if(s->engine == SELECTOR_ENGINE_IO_URING) {
+        uring_close(s);
+    }
+#endif
+    free(s->dirty);
+    s->dirty = NULL;
+}
+
+/** el fd deja de estar registrado: el kernel tiene que olvidarlo ya */
+static void
+engine_forget(fd_selector s, struct item *item) {
+#ifdef __linux__
+    if(s->engine == SELECTOR_ENGINE_EPOLL) {
+        epoll_forget(s, item);
+    } else if(s->engine == SELECTOR_ENGINE_IO_URING && item->in_kernel) {
+        uring_remove(s, item);
+    }
+#endif
+    item->in_kernel = false;
+    item->armed     = OP_NOOP;
+}
+
 fd_selector
 selector_new(const size_t initial_elements) {
     size_t size = sizeof(struct fdselector);
@@ -297,7 +837,11 @@ selector_new(const size_t initial_elements) {
         assert(ret->max_fd == 0);
         ret->resolution_jobs  = 0;
         pthread_mutex_init(&ret->resolution_mutex, 0);
+        // el mecanismo define cuántos fds se admiten
+        engine_open(ret, conf.engine);
+        ret->max_items = engine_max_items(ret->engine);
         if(0 != ensure_capacity(ret, initial_elements)) {
+            engine_close(ret);
             selector_destroy(ret);
             ret = NULL;
         }
@@ -305,6 +849,21 @@ selector_new(const size_t initial_elements) {
     return ret;
 }
 
+enum selector_engine
+selector_get_engine(fd_selector s) {
+    return s->engine;
+}
+
+uint64_t
+selector_syscalls(fd_selector s) {
+    return s->syscalls;
+}
+
+size_t
+selector_max_fds(fd_selector s) {
+    return s->max_items;
+}
+
 void
 selector_destroy(fd_selector s) {
     // lean ya que se llama desde los casos fallidos de _new.
@@ -325,12 +884,13 @@ selector_destroy(fd_selector s) {
             free(s->fds);
             s->fds     = NULL;
             s->fd_size = 0;
+            engine_close(s);
         }
         free(s);
     }
 }
 
-#define INVALID_FD(fd)  ((fd) < 0 || (fd) >= ITEMS_MAX_SIZE)
+#define INVALID_FD(s, fd)  ((fd) < 0 || (size_t)(fd) >= (s)->max_items)
 
 selector_status
 selector_register(fd_selector        s,
@@ -340,13 +900,13 @@ selector_register(fd_selector        s,
                      void *data) {
     selector_status ret = SELECTOR_SUCCESS;
     // 0. validación de argumentos
-    if(s == NULL || INVALID_FD(fd) || handler == NULL) {
+    if(s == NULL || INVALID_FD(s, fd) || handler == NULL) {
         ret = SELECTOR_IARGS;
         goto finally;
     }
     // 1. tenemos espacio?
     size_t ufd = (size_t)fd;
-    if(ufd > s->fd_size) {
+    if(ufd >= s->fd_size) {
         ret = ensure_capacity(s, ufd);
         if(SELECTOR_SUCCESS != ret) {
             goto finally;
@@ -368,7 +928,7 @@ selector_register(fd_selector        s,
         if(fd > s->max_fd) {
             s->max_fd = fd;
         }
-        items_update_fdset_for_fd(s, item);
+        ret = item_changed(s, item);
     }
 
 finally:
@@ -380,7 +940,7 @@ selector_unregister_fd(fd_selector       s,
                        const int         fd) {
     selector_status ret = SELECTOR_SUCCESS;
 
-    if(NULL == s || INVALID_FD(fd)) {
+    if(NULL == s || INVALID_FD(s, fd)) {
         ret = SELECTOR_IARGS;
         goto finally;
     }
@@ -391,6 +951,9 @@ selector_unregister_fd(fd_selector       s,
         goto finally;
     }
 
+    // antes de handle_close, que suele cerrar el fd
+    engine_forget(s, item);
+
     if(item->handler->handle_close != NULL) {
         struct selector_key key = {
             .s    = s,
@@ -401,10 +964,17 @@ selector_unregister_fd(fd_selector       s,
     }
 
     item->interest = OP_NOOP;
-    items_update_fdset_for_fd(s, item);
+    // los fd_set sólo los usa select() y no llegan a los fds más altos
+    if(s->engine == SELECTOR_ENGINE_SELECT) {
+        items_update_fdset_for_fd(s, item);
+    }
 
-    memset(item, 0x00, sizeof(*item));
+    // la generación y la marca de pendiente sobreviven al próximo registro
+    const uint32_t gen   = item->gen;
+    const bool     dirty = item->dirty;
     item_init(item);
+    item->gen   = gen + 1;
+    item->dirty = dirty;
     s->max_fd = items_max_fd(s);
 
 finally:
@@ -415,7 +985,7 @@ selector_status
 selector_set_interest(fd_selector s, int fd, fd_interest i) {
     selector_status ret = SELECTOR_SUCCESS;
 
-    if(NULL == s || INVALID_FD(fd)) {
+    if(NULL == s || INVALID_FD(s, fd)) {
         ret = SELECTOR_IARGS;
         goto finally;
     }
@@ -424,8 +994,11 @@ selector_set_interest(fd_selector s, int fd, fd_interest i) {
         ret = SELECTOR_IARGS;
         goto finally;
     }
+    if(item->interest != i) {
+        item->hung = false;
+    }
     item->interest = i;
-    items_update_fdset_for_fd(s, item);
+    ret = item_changed(s, item);
 finally:
     return ret;
 }
@@ -434,7 +1007,7 @@ selector_status
 selector_set_interest_key(struct selector_key *key, fd_interest i) {
     selector_status ret;
 
-    if(NULL == key || NULL == key->s || INVALID_FD(key->fd)) {
+    if(NULL == key || NULL == key->s || INVALID_FD(key->s, key->fd)) {
         ret = SELECTOR_IARGS;
     } else {
         ret = selector_set_interest(key->s, key->fd, i);
@@ -460,11 +1033,16 @@ handle_iteration(fd_selector s) {
             key.fd   = item->fd;
             key.data = item->data;
             if(FD_ISSET(item->fd, &s->slave_r)) {
-                if(OP_READ & item->interest) {
+                if((OP_ERROR & item->interest) && item->handler->handle_error != 0) {
+                    item->handler->handle_error(&key);
+                    item = s->fds + i;
+                }
+                if(ITEM_USED(item) && (OP_READ & item->interest)) {
                     if(0 == item->handler->handle_read) {
                         assert(("OP_READ arrived but no handler. bug!" == 0));
                     } else {
                         item->handler->handle_read(&key);
+                        item = s->fds + i;
                     }
                 }
             }
@@ -533,16 +1111,15 @@ finally:
     return ret;
 }
 
-selector_status
-selector_select(fd_selector s) {
+static selector_status
+select_iteration(fd_selector s) {
     selector_status ret = SELECTOR_SUCCESS;
 
     memcpy(&s->slave_r, &s->master_r, sizeof(s->slave_r));
     memcpy(&s->slave_w, &s->master_w, sizeof(s->slave_w));
     memcpy(&s->slave_t, &s->master_t, sizeof(s->slave_t));
 
-    s->selector_thread = pthread_self();
-
+    s->syscalls++;
     int fds = pselect(s->max_fd + 1, &s->slave_r, &s->slave_w, 0, &s->slave_t,
                       &emptyset);
     if(-1 == fds) {
@@ -571,17 +1148,39 @@ selector_select(fd_selector s) {
     } else {
         handle_iteration(s);
     }
+finally:
+    return ret;
+}
+
+selector_status
+selector_select(fd_selector s) {
+    selector_status ret;
+
+    s->selector_thread = pthread_self();
+
+    switch(s->engine) {
+#ifdef __linux__
+        case SELECTOR_ENGINE_EPOLL:
+            ret = epoll_iteration(s);
+            break;
+        case SELECTOR_ENGINE_IO_URING:
+            ret = uring_iteration(s);
+            break;
+#endif
+        default:
+            ret = select_iteration(s);
+            break;
+    }
     if(ret == SELECTOR_SUCCESS) {
         handle_block_notifications(s);
     }
-finally:
     return ret;
 }
 
 int
 selector_fd_set_nio(const int fd) {
     int ret = 0;
-    int flags = fcntl(fd, F_GETFD, 0);
+    int flags = fcntl(fd, F_GETFL, 0);
     if(flags == -1) {
         ret = -1;
     } else {
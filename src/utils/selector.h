@@ -4,6 +4,7 @@
 #include <sys/time.h>
 #include <stdbool.h>
 #include <stddef.h> 
+#include <stdint.h>
 
 /**
  * selector.c - un muliplexor de entrada salida
@@ -13,6 +14,11 @@
  *
  * Esconde la implementación final (select(2) / poll(2) / epoll(2) / ..)
  *
+ * El mecanismo de espera se elige al crear el selector (ver
+ * `enum selector_engine'); si el kernel no soporta el pedido se usa el
+ * siguiente más simple. Todos entregan la misma semántica de nivel: un fd
+ * listo se vuelve a informar en cada iteración mientras siga el interés.
+ *
  * El usuario registra para un file descriptor especificando:
  *  1. un handler: provee funciones callback que manejarán los eventos de
  *     entrada/salida
@@ -65,6 +71,25 @@ typedef enum {
 const char *
 selector_error(const selector_status status);
 
+/**
+ * Mecanismos de espera, del más simple al más elaborado.
+ *
+ * - select: pselect(2) sobre los fd_set completos en cada iteración.
+ * - epoll: los cambios de interés se acumulan durante la iteración y se
+ *   informan con un epoll_ctl(2) por fd antes de esperar.
+ * - io_uring: cada interés es un POLL_ADD de un disparo; los cambios, los
+ *   re-armados y la espera viajan juntos en un único io_uring_enter(2).
+ */
+enum selector_engine {
+    SELECTOR_ENGINE_SELECT = 0,
+    SELECTOR_ENGINE_EPOLL,
+    SELECTOR_ENGINE_IO_URING,
+};
+
+/** nombre del mecanismo (`select', `epoll', `io_uring') */
+const char *
+selector_engine_name(enum selector_engine engine);
+
 /** opciones de inicialización del selector */
 struct selector_init {
     /** señal a utilizar para notificaciones internas */
@@ -72,6 +97,9 @@ struct selector_init {
 
     /** tiempo máximo de bloqueo durante `selector_iteratate' */
     struct timespec select_timeout;
+
+    /** mecanismo de espera preferido para los selectores nuevos */
+    enum selector_engine engine;
 };
 
 /** inicializa la librería */
@@ -102,6 +130,8 @@ typedef enum {
     OP_NOOP    = 0,
     OP_READ    = 1 << 0,
     OP_WRITE   = 1 << 2,
+    /** hay algo en la cola de errores del socket (ej: avisos de MSG_ZEROCOPY) */
+    OP_ERROR   = 1 << 3,
 } fd_interest ;
 
 /**
@@ -135,6 +165,12 @@ typedef struct fd_handler {
    */
   void (*handle_close)     (struct selector_key *key);
 
+  /**
+   * llamado con OP_ERROR cuando el fd tiene la cola de errores con datos
+   * (recvmsg con MSG_ERRQUEUE). Se invoca antes que handle_read/handle_write.
+   */
+  void (*handle_error)     (struct selector_key *key);
+
 } fd_handler;
 
 /**
@@ -178,6 +214,21 @@ selector_set_interest_key(struct selector_key *key, fd_interest i);
 selector_status
 selector_select(fd_selector s);
 
+/** mecanismo que usa efectivamente `s' (puede ser más simple que el pedido) */
+enum selector_engine
+selector_get_engine(fd_selector s);
+
+/** cantidad de syscalls hechas por el selector para esperar y armar intereses */
+uint64_t
+selector_syscalls(fd_selector s);
+
+/**
+ * fds que admite `s': FD_SETSIZE con select(2) y el límite de fds abiertos
+ * del proceso con epoll o io_uring. Los fds desde ahí no se pueden registrar.
+ */
+size_t
+selector_max_fds(fd_selector s);
+
 /**
  * Método de utilidad que activa O_NONBLOCK en un fd.
  *
@@ -0,0 +1,51 @@
+#ifndef SHA256_H_b3c6a1f0e2d94c7a8e5f1b2d3c4a5968
+#define SHA256_H_b3c6a1f0e2d94c7a8e5f1b2d3c4a5968
+
+/**
+ * sha256.c -- SHA-256 (FIPS 180-4), HMAC-SHA256 (RFC 2104) y
+ * PBKDF2-HMAC-SHA256 (RFC 8018).
+ *
+ * Implementación portable y sin dependencias externas, pensada para derivar
+ * claves de contraseñas; no es de tiempo constante respecto de la longitud
+ * de los datos.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_LENGTH 32
+#define SHA256_BLOCK_LENGTH  64
+
+struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t  block[SHA256_BLOCK_LENGTH];
+    size_t   used;
+};
+
+void
+sha256_init(struct sha256_ctx *ctx);
+
+void
+sha256_update(struct sha256_ctx *ctx, const void *data, size_t n);
+
+void
+sha256_final(struct sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_LENGTH]);
+
+/** digest de `n' bytes de `data' en una sola llamada */
+void
+sha256(const void *data, size_t n, uint8_t digest[SHA256_DIGEST_LENGTH]);
+
+void
+hmac_sha256(const void *key, size_t key_len, const void *data, size_t n,
+            uint8_t mac[SHA256_DIGEST_LENGTH]);
+
+/**
+ * deriva `out_len' bytes en `out' a partir de la contraseña y la sal con
+ * `iterations' rondas.
+ */
+void
+pbkdf2_sha256(const void *password, size_t password_len,
+              const void *salt, size_t salt_len,
+              uint32_t iterations, uint8_t *out, size_t out_len);
+
+#endif
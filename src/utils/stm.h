@@ -56,6 +56,8 @@ struct state_definition {
     unsigned (*on_write_ready)(struct selector_key *key);
     /** ejecutado cuando hay una resolución de nombres lista */
     unsigned (*on_block_ready)(struct selector_key *key);
+    /** ejecutado cuando la cola de errores del socket tiene datos (opcional) */
+    unsigned (*on_error_ready)(struct selector_key *key);
 };
 
 
@@ -79,6 +81,13 @@ stm_handler_write(struct state_machine *stm, struct selector_key *key);
 unsigned
 stm_handler_block(struct state_machine *stm, struct selector_key *key);
 
+/**
+ * indica que ocurrió el evento error (OP_ERROR). retorna nuevo id de nuevo
+ * estado; si el estado actual no lo maneja se queda en el mismo.
+ */
+unsigned
+stm_handler_error(struct state_machine *stm, struct selector_key *key);
+
 /** indica que ocurrió el evento close. retorna nuevo id de nuevo estado. */
 void
 stm_handler_close(struct state_machine *stm, struct selector_key *key);
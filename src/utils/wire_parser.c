@@ -0,0 +1,88 @@
+/**
+ * wire_parser.c -- extractor declarativo de campos binarios.
+ */
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "wire_parser.h"
+
+/** largo total del campo descripto por `s' */
+static inline size_t
+field_size(const struct wire_step *s, const uint8_t *dst) {
+    size_t ret;
+    switch(s->kind) {
+        case WIRE_U8:
+            ret = 1;
+            break;
+        case WIRE_U16:
+            ret = 2;
+            break;
+        case WIRE_FIXED:
+            ret = s->len;
+            break;
+        case WIRE_VAR:
+            ret = dst[s->len_offset];
+            break;
+        default:
+            ret = 0;
+    }
+    return ret;
+}
+
+/** se ejecuta cuando el campo está completo; retorna el siguiente paso */
+static inline unsigned
+field_done(const struct wire_step *s, uint8_t *dst, const size_t size) {
+    if(s->kind == WIRE_U16) {
+        uint16_t v;
+        memcpy(&v, dst + s->offset, sizeof(v));
+        v = ntohs(v);
+        memcpy(dst + s->offset, &v, sizeof(v));
+    } else if(s->kind == WIRE_VAR && size < s->cap) {
+        dst[s->offset + size] = '\0';
+    }
+    return s->check != NULL ? s->check(dst) : s->next;
+}
+
+unsigned
+wire_consume(const struct wire_definition *def, unsigned *state,
+             size_t *field_read, void *dst, buffer *b) {
+    uint8_t *base = dst;
+    size_t avail;
+    const uint8_t *ptr = buffer_read_ptr(b, &avail);
+    const uint8_t *cur = ptr;
+    const uint8_t *end = ptr + avail;
+
+    while(*state != def->done && *state != def->error) {
+        const struct wire_step *s = def->steps + *state;
+        const size_t size         = field_size(s, base);
+
+        if(s->kind == WIRE_VAR && size > s->cap) {
+            *state = def->error;
+            break;
+        }
+
+        if(*field_read < size) {
+            if(cur == end) {
+                break;
+            }
+            // un único bounds check por campo: si el campo está completo en
+            // el buffer se copia de una sola vez.
+            size_t take = size - *field_read;
+            if(take > (size_t)(end - cur)) {
+                take = end - cur;
+            }
+            memcpy(base + s->offset + *field_read, cur, take);
+            cur         += take;
+            *field_read += take;
+            if(*field_read < size) {
+                break;
+            }
+        }
+
+        *field_read = 0;
+        *state      = field_done(s, base, size);
+    }
+
+    buffer_read_adv(b, cur - ptr);
+    return *state;
+}
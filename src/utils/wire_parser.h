@@ -0,0 +1,90 @@
+#ifndef WIRE_PARSER_H_3b1f0c9e8d7a4b5c6f2e1d0a9b8c7d6e5f4a3b2c
+#define WIRE_PARSER_H_3b1f0c9e8d7a4b5c6f2e1d0a9b8c7d6e5f4a3b2c
+
+/**
+ * wire_parser.c -- extractor declarativo de campos binarios.
+ *
+ * Los protocolos binarios (SOCKS5, RFC 1929, ...) se describen como una tabla
+ * de pasos. Cada paso es un campo del mensaje: un byte, un entero de 16 bits
+ * en network order, un bloque de largo fijo o un bloque cuyo largo lo indica
+ * un campo leído previamente.
+ *
+ * El motor copia cada campo directamente en la estructura destino (usando el
+ * offset declarado) con un único memcpy cuando el campo está completo en el
+ * buffer, en lugar de consumir byte a byte. Si el campo llega partido entre
+ * varias lecturas se acumula y se retoma en la siguiente llamada.
+ *
+ * Cada paso indica el siguiente paso, o bien provee una función `check' que
+ * valida el campo recién leído y decide a qué paso saltar (tabla de saltos).
+ *
+ *  static const struct wire_step steps[] = {
+ *      [S_VER]  = { .kind = WIRE_U8,  .offset = offsetof(struct m, ver), .check = check_ver },
+ *      [S_LEN]  = { .kind = WIRE_U8,  .offset = offsetof(struct m, len), .next  = S_DATA    },
+ *      [S_DATA] = { .kind = WIRE_VAR, .offset = offsetof(struct m, data),
+ *                   .len_offset = offsetof(struct m, len), .cap = 255,   .next  = S_DONE    },
+ *  };
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "buffer.h"
+
+/** tipos de campo */
+enum wire_kind {
+    /** un byte */
+    WIRE_U8,
+    /** entero de 16 bits en network order; se guarda en host order */
+    WIRE_U16,
+    /** `len' bytes */
+    WIRE_FIXED,
+    /** tantos bytes como indica el uint8_t ubicado en `len_offset' */
+    WIRE_VAR,
+};
+
+/** descripción de un campo del mensaje */
+struct wire_step {
+    enum wire_kind kind;
+    /** dónde se guarda el campo dentro de la estructura destino */
+    size_t         offset;
+    /** WIRE_FIXED: largo del campo */
+    size_t         len;
+    /** WIRE_VAR: offset del uint8_t que contiene el largo */
+    size_t         len_offset;
+    /**
+     * WIRE_VAR: capacidad del destino. Si sobra lugar se termina el campo
+     * con '\0'.
+     */
+    size_t         cap;
+    /** siguiente paso si no hay `check' */
+    unsigned       next;
+    /**
+     * opcional: valida el campo (ya guardado en `dst') y retorna el siguiente
+     * paso, o el estado de error de la definición.
+     */
+    unsigned     (*check)(void *dst);
+};
+
+/** declaración completa de un mensaje */
+struct wire_definition {
+    /** pasos indexados por estado */
+    const struct wire_step *steps;
+    /** estado final exitoso */
+    unsigned                done;
+    /** estado sumidero de error */
+    unsigned                error;
+};
+
+/**
+ * Consume del buffer los bytes necesarios para avanzar el mensaje descripto
+ * por `def', guardando los campos en `dst'.
+ *
+ * `state' y `field_read' mantienen el progreso entre llamadas y deben
+ * iniciar en el primer paso y en cero respectivamente.
+ *
+ * No consume bytes más allá del fin del mensaje. Retorna el nuevo estado.
+ */
+unsigned
+wire_consume(const struct wire_definition *def, unsigned *state,
+             size_t *field_read, void *dst, buffer *b);
+
+#endif
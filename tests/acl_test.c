@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <arpa/inet.h>
+
+#include "acl/acl.h"
+
+static struct acl *
+compile(const char *text) {
+    char err[128];
+    struct acl *acl = acl_compile(text, strlen(text), err, sizeof(err));
+    ck_assert_msg(acl != NULL, "%s", err);
+    return acl;
+}
+
+static bool
+allows(const struct acl *acl, const char *user, const char *ip) {
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if (strchr(ip, ':') != NULL) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        ck_assert_int_eq(1, inet_pton(AF_INET6, ip, &sin6->sin6_addr));
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        ck_assert_int_eq(1, inet_pton(AF_INET, ip, &sin->sin_addr));
+    }
+    return acl_check_addr(acl, user, (struct sockaddr *)&ss);
+}
+
+START_TEST (test_longest_prefix) {
+    struct acl *acl = compile(
+        "# rangos internos\n"
+        "deny 10.0.0.0/8\n"
+        "allow 10.1.0.0/16\n"
+        "deny 10.1.2.3\n"
+        "deny 192.168.0.0/16   # comentario\n"
+        "deny fc00::/7\n"
+        "allow fd00::1\n");
+    ck_assert_uint_eq(6, acl_rules(acl));
+
+    ck_assert(!allows(acl, NULL, "10.200.0.1"));
+    ck_assert(allows(acl, NULL, "10.1.9.9"));
+    ck_assert(!allows(acl, NULL, "10.1.2.3"));
+    ck_assert(allows(acl, NULL, "10.1.2.4"));
+    ck_assert(!allows(acl, NULL, "192.168.1.1"));
+    ck_assert(allows(acl, NULL, "8.8.8.8"));
+    ck_assert(!allows(acl, NULL, "fd12::1"));
+    ck_assert(allows(acl, NULL, "fd00::1"));
+    ck_assert(allows(acl, NULL, "2001:db8::1"));
+    // IPv4 mapeada en IPv6
+    ck_assert(!allows(acl, NULL, "::ffff:10.0.0.1"));
+    acl_free(acl);
+}
+END_TEST
+
+START_TEST (test_insert_order) {
+    // los prefijos cortos después de los largos parten los nodos existentes
+    struct acl *acl = compile(
+        "deny 10.1.2.0/24\n"
+        "deny 10.1.3.0/24\n"
+        "allow 10.0.0.0/8\n"
+        "deny 10.1.0.0/16\n"
+        "allow 10.1.2.128/25\n"
+        "default deny\n");
+    ck_assert(allows(acl, NULL, "10.2.0.1"));
+    ck_assert(!allows(acl, NULL, "10.1.9.1"));
+    ck_assert(!allows(acl, NULL, "10.1.2.1"));
+    ck_assert(allows(acl, NULL, "10.1.2.200"));
+    ck_assert(!allows(acl, NULL, "10.1.3.200"));
+    ck_assert(!allows(acl, NULL, "11.0.0.1"));
+    acl_free(acl);
+}
+END_TEST
+
+START_TEST (test_domains) {
+    struct acl *acl = compile(
+        "deny example.com\n"
+        "allow public.example.com\n"
+        "deny *.corp\n"
+        "allow .ok.corp\n");
+    ck_assert_int_eq(ACL_DENY, acl_check_domain(acl, NULL, "example.com"));
+    ck_assert_int_eq(ACL_DENY, acl_check_domain(acl, NULL, "WWW.Example.COM."));
+    ck_assert_int_eq(ACL_ALLOW, acl_check_domain(acl, NULL, "public.example.com"));
+    ck_assert_int_eq(ACL_ALLOW, acl_check_domain(acl, NULL, "a.public.example.com"));
+    ck_assert_int_eq(ACL_NO_MATCH, acl_check_domain(acl, NULL, "notexample.com"));
+    ck_assert_int_eq(ACL_NO_MATCH, acl_check_domain(acl, NULL, "com"));
+    ck_assert_int_eq(ACL_DENY, acl_check_domain(acl, NULL, "git.corp"));
+    ck_assert_int_eq(ACL_ALLOW, acl_check_domain(acl, NULL, "x.ok.corp"));
+    ck_assert_int_eq(ACL_NO_MATCH, acl_check_domain(acl, NULL, "bad..name"));
+    acl_free(acl);
+}
+END_TEST
+
+START_TEST (test_users) {
+    struct acl *acl = compile(
+        "deny 10.0.0.0/8\n"
+        "deny intranet.local\n"
+        "@ops allow 10.5.0.0/16\n"
+        "@ops allow intranet.local\n"
+        "@guest default deny\n"
+        "@guest allow 93.184.216.34\n");
+    ck_assert(!allows(acl, "alice", "10.5.0.1"));
+    ck_assert(allows(acl, "ops", "10.5.0.1"));
+    ck_assert(!allows(acl, "ops", "10.6.0.1"));
+    ck_assert(allows(acl, "ops", "1.1.1.1"));
+    ck_assert_int_eq(ACL_DENY, acl_check_domain(acl, "alice", "intranet.local"));
+    ck_assert_int_eq(ACL_ALLOW, acl_check_domain(acl, "ops", "intranet.local"));
+
+    ck_assert(!allows(acl, "guest", "1.1.1.1"));
+    ck_assert(allows(acl, "guest", "93.184.216.34"));
+    ck_assert(!acl_default_allows(acl, "guest"));
+    ck_assert(acl_default_allows(acl, "alice"));
+    ck_assert(acl_default_allows(acl, NULL));
+    acl_free(acl);
+}
+END_TEST
+
+START_TEST (test_many_users) {
+    char *text = malloc(64 * 1000);
+    size_t len = 0;
+    for (int i = 0; i < 1000; i++) {
+        len += sprintf(text + len, "@user%d deny 10.0.%d.0/24\n", i, i % 256);
+    }
+    char err[128];
+    struct acl *acl = acl_compile(text, len, err, sizeof(err));
+    ck_assert_ptr_ne(NULL, acl);
+    char user[16], ip[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(user, sizeof(user), "user%d", i);
+        snprintf(ip, sizeof(ip), "10.0.%d.1", i % 256);
+        ck_assert(!allows(acl, user, ip));
+        snprintf(ip, sizeof(ip), "10.0.%d.1", (i + 1) % 256);
+        ck_assert(allows(acl, user, ip));
+    }
+    acl_free(acl);
+    free(text);
+}
+END_TEST
+
+START_TEST (test_errors) {
+    const char *bad[] = {
+        "deny 10.0.0.0/33\n",
+        "block 10.0.0.0/8\n",
+        "deny\n",
+        "default maybe\n",
+        "deny bad_domain!\n",
+        "@ deny 1.2.3.4\n",
+        "deny 1.2.3.4 extra words\n",
+    };
+    char err[128];
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        char text[128];
+        snprintf(text, sizeof(text), "allow 1.1.1.1\n%s", bad[i]);
+        err[0] = '\0';
+        ck_assert_ptr_eq(NULL, acl_compile(text, strlen(text), err, sizeof(err)));
+        ck_assert_msg(strncmp(err, "line 2:", 7) == 0, "%s", err);
+    }
+    // sin reglas todo se permite
+    struct acl *acl = compile("# vacío\n\n");
+    ck_assert(allows(acl, NULL, "10.0.0.1"));
+    ck_assert(allows(NULL, NULL, "10.0.0.1"));
+    acl_free(acl);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("acl");
+
+    /* Core test case */
+    tc = tcase_create("acl");
+
+    tcase_add_test(tc, test_longest_prefix);
+    tcase_add_test(tc, test_insert_order);
+    tcase_add_test(tc, test_domains);
+    tcase_add_test(tc, test_users);
+    tcase_add_test(tc, test_many_users);
+    tcase_add_test(tc, test_errors);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,3 +1,6 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
 #include <stdlib.h>
 #include <check.h>
 
@@ -93,12 +96,110 @@ START_TEST (test_buffer_misc) {
 }
 END_TEST
 
+START_TEST (test_buffer_rebase) {
+    struct buffer buf;
+    buffer *b = &buf;
+    uint8_t small[4], big[8];
+    buffer_init(b, N(small), small);
+
+    size_t wbytes = 0, rbytes = 0;
+    memcpy(buffer_write_ptr(b, &wbytes), "HOLA", 4);
+    buffer_write_adv(b, 4);
+    ck_assert_uint_eq('H', buffer_read(b));
+    ck_assert_int_eq(false, buffer_can_write(b));
+
+    // lo pendiente pasa al comienzo del almacenamiento nuevo
+    buffer_rebase(b, N(big), big);
+    uint8_t *ptr = buffer_read_ptr(b, &rbytes);
+    ck_assert_ptr_eq(big, ptr);
+    ck_assert_uint_eq(3, rbytes);
+    ck_assert_int_eq(0, memcmp(ptr, "OLA", 3));
+    buffer_write_ptr(b, &wbytes);
+    ck_assert_uint_eq(5, wbytes);
+
+    // y se puede volver a uno más chico si entra
+    buffer_read_adv(b, 2);
+    buffer_rebase(b, N(small), small);
+    ck_assert_uint_eq('A', buffer_read(b));
+    buffer_write_ptr(b, &wbytes);
+    ck_assert_uint_eq(N(small), wbytes);
+}
+END_TEST
+
+START_TEST (test_buffer_ring) {
+    struct buffer buf;
+    buffer *b = &buf;
+    uint8_t direct_buff[6];
+    buffer_init(b, N(direct_buff), direct_buff);
+
+    const size_t n = (size_t) sysconf(_SC_PAGESIZE);
+    size_t wbytes = 0, rbytes = 0;
+    memcpy(buffer_write_ptr(b, &wbytes), "HOLA", 4);
+    buffer_write_adv(b, 4);
+    buffer_read_adv(b, 1);
+
+    // tamaños que no son múltiplo de página no se pueden mapear
+    ck_assert_int_eq(-1, buffer_ring_rebase(b, n + 1));
+    ck_assert_ptr_eq(direct_buff, b->data);
+
+    ck_assert_int_eq(0, buffer_ring_rebase(b, n));
+    ck_assert_uint_eq(n, b->ring);
+    uint8_t *ptr = buffer_read_ptr(b, &rbytes);
+    ck_assert_uint_eq(3, rbytes);
+    ck_assert_int_eq(0, memcmp(ptr, "OLA", 3));
+
+    // se llena casi todo y se lee casi todo: R queda cerca del final
+    buffer_write_ptr(b, &wbytes);
+    ck_assert_uint_eq(n - 3, wbytes);
+    buffer_write_adv(b, n - 13);
+    buffer_read_adv(b, n - 15);
+    ck_assert_uint_eq(n - 15, (size_t) (b->read - b->data));
+
+    // el espacio libre da la vuelta y sigue siendo contiguo, sin compactar
+    ptr = buffer_write_ptr(b, &wbytes);
+    ck_assert_uint_eq(n - 5, wbytes);
+    for (size_t i = 0; i < wbytes; i++) {
+        ptr[i] = (uint8_t) i;
+    }
+    buffer_write_adv(b, wbytes);
+    ck_assert_int_eq(false, buffer_can_write(b));
+    // lo escrito después del final aparece al comienzo del mapeo
+    ck_assert_uint_eq(ptr[15], b->data[(ptr + 15 - b->data) % n]);
+
+    ptr = buffer_read_ptr(b, &rbytes);
+    ck_assert_uint_eq(n, rbytes);
+    buffer_read_adv(b, 20);
+    // R pasó a la segunda copia y se corrió a la primera
+    ck_assert(b->read < b->data + n);
+    ck_assert_uint_eq(b->read + n, b->limit);
+    ptr = buffer_read_ptr(b, &rbytes);
+    ck_assert_uint_eq(n - 20, rbytes);
+    ck_assert_uint_eq(15, ptr[0]);
+    ck_assert_uint_eq((uint8_t) (n - 6), ptr[rbytes - 1]);
+
+    buffer_read_adv(b, rbytes);
+    ck_assert_ptr_eq(b->data, b->read);
+    buffer_write_ptr(b, &wbytes);
+    ck_assert_uint_eq(n, wbytes);
+
+    // volver a uno lineal libera el mapeo
+    memcpy(buffer_write_ptr(b, &wbytes), "UN", 2);
+    buffer_write_adv(b, 2);
+    buffer_rebase(b, N(direct_buff), direct_buff);
+    ck_assert_uint_eq(0, b->ring);
+    ck_assert_uint_eq('U', buffer_read(b));
+    ck_assert_uint_eq('N', buffer_read(b));
+}
+END_TEST
+
 Suite *
 suite(void) {
     Suite *s   = suite_create("buffer");
     TCase *tc  = tcase_create("buffer");
 
     tcase_add_test(tc, test_buffer_misc);
+    tcase_add_test(tc, test_buffer_rebase);
+    tcase_add_test(tc, test_buffer_ring);
     suite_add_tcase(s, tc);
 
     return s;
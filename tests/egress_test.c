@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "socks5/egress.h"
+
+#define N(x) (sizeof(x)/sizeof(x[0]))
+
+static void
+init(char **addrs, int n, enum egress_mode mode) {
+    char err[128];
+    ck_assert_msg(egress_init(addrs, n, mode, err, sizeof(err)) == 0, "%s", err);
+}
+
+static struct sockaddr_in
+client(const char *ip) {
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    inet_pton(AF_INET, ip, &sin.sin_addr);
+    return sin;
+}
+
+START_TEST (test_none) {
+    init(NULL, 0, EGRESS_ROUND_ROBIN);
+    ck_assert_int_eq(0, egress_sources(AF_INET));
+    ck_assert_int_eq(-1, egress_pick(AF_INET, NULL));
+    struct egress_info info[EGRESS_MAX_SOURCES];
+    ck_assert_uint_eq(0, egress_list(info, N(info)));
+}
+END_TEST
+
+START_TEST (test_round_robin) {
+    char *addrs[] = {"127.0.0.2", "::1", "127.0.0.3"};
+    init(addrs, N(addrs), EGRESS_ROUND_ROBIN);
+    ck_assert_int_eq(2, egress_sources(AF_INET));
+    ck_assert_int_eq(1, egress_sources(AF_INET6));
+
+    // las de otra familia se saltean
+    int seen[3] = {0};
+    for (int i = 0; i < 6; i++) {
+        seen[egress_pick(AF_INET, NULL)]++;
+    }
+    ck_assert_int_eq(3, seen[0]);
+    ck_assert_int_eq(0, seen[1]);
+    ck_assert_int_eq(3, seen[2]);
+    ck_assert_int_eq(1, egress_pick(AF_INET6, NULL));
+}
+END_TEST
+
+START_TEST (test_hash) {
+    char *addrs[] = {"127.0.0.2", "127.0.0.3", "127.0.0.4"};
+    init(addrs, N(addrs), EGRESS_HASH);
+
+    // un cliente sale siempre por la misma, sin importar el puerto
+    struct sockaddr_in a = client("10.0.0.7");
+    const int first = egress_pick(AF_INET, (struct sockaddr *)&a);
+    for (int i = 0; i < 10; i++) {
+        a.sin_port = htons(1000 + i);
+        ck_assert_int_eq(first, egress_pick(AF_INET, (struct sockaddr *)&a));
+    }
+
+    // y entre muchos clientes se usan todas
+    int seen[3] = {0};
+    char ip[INET_ADDRSTRLEN];
+    for (int i = 0; i < 64; i++) {
+        snprintf(ip, sizeof(ip), "10.0.1.%d", i);
+        struct sockaddr_in c = client(ip);
+        seen[egress_pick(AF_INET, (struct sockaddr *)&c)]++;
+    }
+    ck_assert(seen[0] > 0 && seen[1] > 0 && seen[2] > 0);
+}
+END_TEST
+
+START_TEST (test_exhausted) {
+    char *addrs[] = {"127.0.0.2", "127.0.0.3"};
+    init(addrs, N(addrs), EGRESS_HASH);
+    struct sockaddr_in c = client("10.0.0.7");
+    const int first = egress_pick(AF_INET, (struct sockaddr *)&c);
+
+    // sin puertos se pasa a la otra mientras dure
+    egress_exhausted(first);
+    ck_assert_int_eq(1 - first, egress_pick(AF_INET, (struct sockaddr *)&c));
+
+    // si todas están secas se intenta con la que tocaba
+    egress_exhausted(1 - first);
+    ck_assert_int_eq(first, egress_pick(AF_INET, (struct sockaddr *)&c));
+
+    egress_acquire(first);
+    egress_acquire(first);
+    egress_release(first);
+    struct egress_info info[EGRESS_MAX_SOURCES];
+    ck_assert_uint_eq(2, egress_list(info, N(info)));
+    ck_assert_uint_eq(1, info[first].active);
+    ck_assert_uint_eq(2, info[first].connects);
+    ck_assert_uint_eq(1, info[first].exhausted);
+    ck_assert(info[first].dry);
+}
+END_TEST
+
+START_TEST (test_bind) {
+    char *addrs[] = {"127.0.0.2"};
+    init(addrs, N(addrs), EGRESS_ROUND_ROBIN);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(0, egress_bind(fd, egress_pick(AF_INET, NULL)));
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    ck_assert_int_eq(0, getsockname(fd, (struct sockaddr *)&local, &len));
+    ck_assert_uint_eq(htonl(0x7F000002), local.sin_addr.s_addr);
+    close(fd);
+}
+END_TEST
+
+START_TEST (test_errors) {
+    char err[128];
+    char *bad[][1] = {
+        {"nope"},
+        {"127.0.0.2:80"},
+        {"10.0.0"},
+        // no es una dirección local
+        {"192.0.2.1"},
+    };
+    for (unsigned i = 0; i < N(bad); i++) {
+        ck_assert_msg(egress_init(bad[i], 1, EGRESS_ROUND_ROBIN, err, sizeof(err)) < 0, "%s", bad[i][0]);
+    }
+
+    char *many[EGRESS_MAX_SOURCES + 1];
+    for (unsigned i = 0; i < N(many); i++) {
+        many[i] = "127.0.0.2";
+    }
+    ck_assert(egress_init(many, N(many), EGRESS_ROUND_ROBIN, err, sizeof(err)) < 0);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("egress");
+
+    /* Core test case */
+    tc = tcase_create("egress");
+
+    tcase_add_test(tc, test_none);
+    tcase_add_test(tc, test_round_robin);
+    tcase_add_test(tc, test_hash);
+    tcase_add_test(tc, test_exhausted);
+    tcase_add_test(tc, test_bind);
+    tcase_add_test(tc, test_errors);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <check.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "socks5/origin.h"
+
+static struct sockaddr *
+addr(const char *ip, uint16_t port) {
+    static struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if (strchr(ip, ':') != NULL) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        ck_assert_int_eq(1, inet_pton(AF_INET6, ip, &sin6->sin6_addr));
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        ck_assert_int_eq(1, inet_pton(AF_INET, ip, &sin->sin_addr));
+    }
+    return (struct sockaddr *)&ss;
+}
+
+static void
+fail(const char *ip, uint16_t port, int error, unsigned times) {
+    for (unsigned i = 0; i < times; i++) {
+        origin_report(addr(ip, port), error, 0);
+    }
+}
+
+START_TEST (test_threshold) {
+    ck_assert_int_eq(0, origin_init(16, 3, 60));
+
+    fail("10.0.0.1", 80, ECONNREFUSED, 2);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    // un éxito reinicia la cuenta
+    origin_report(addr("10.0.0.1", 80), 0, 0);
+    fail("10.0.0.1", 80, ECONNREFUSED, 2);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    fail("10.0.0.1", 80, ECONNREFUSED, 1);
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.1", 80)));
+
+    // otro puerto u otra dirección son otro origen
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 443)));
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.2", 80)));
+
+    fail("2001:db8::1", 443, ETIMEDOUT, 3);
+    ck_assert_int_eq(ORIGIN_OPEN_UNREACHABLE, origin_admit(addr("2001:db8::1", 443)));
+    origin_destroy();
+}
+END_TEST
+
+START_TEST (test_local_errors) {
+    ck_assert_int_eq(0, origin_init(16, 2, 60));
+    // sin fds o sin puertos locales no es culpa del origen
+    fail("10.0.0.1", 80, EMFILE, 5);
+    fail("10.0.0.1", 80, EADDRNOTAVAIL, 5);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    origin_destroy();
+}
+END_TEST
+
+START_TEST (test_disabled) {
+    ck_assert_int_eq(0, origin_init(16, 0, 60));
+    fail("10.0.0.1", 80, ECONNREFUSED, 100);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    origin_destroy();
+}
+END_TEST
+
+START_TEST (test_probe) {
+    ck_assert_int_eq(0, origin_init(16, 1, 1));
+    fail("10.0.0.1", 80, EHOSTUNREACH, 1);
+    ck_assert_int_eq(ORIGIN_OPEN_UNREACHABLE, origin_admit(addr("10.0.0.1", 80)));
+    usleep(1100 * 1000);
+
+    // vencido el cool-down pasa un solo sondeo
+    ck_assert_int_eq(ORIGIN_PROBE, origin_admit(addr("10.0.0.1", 80)));
+    ck_assert_int_eq(ORIGIN_OPEN_UNREACHABLE, origin_admit(addr("10.0.0.1", 80)));
+
+    // el sondeo falla: el circuito se abre por el doble
+    fail("10.0.0.1", 80, ECONNREFUSED, 1);
+    usleep(1100 * 1000);
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.1", 80)));
+    usleep(1000 * 1000);
+    ck_assert_int_eq(ORIGIN_PROBE, origin_admit(addr("10.0.0.1", 80)));
+
+    // el sondeo conecta: se cierra
+    origin_report(addr("10.0.0.1", 80), 0, 0);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    origin_destroy();
+}
+END_TEST
+
+START_TEST (test_lru) {
+    ck_assert_int_eq(0, origin_init(4, 1, 60));
+    fail("10.0.0.1", 80, ECONNREFUSED, 1);
+    fail("10.0.0.2", 80, ECONNREFUSED, 1);
+    fail("10.0.0.3", 80, ECONNREFUSED, 1);
+    fail("10.0.0.4", 80, ECONNREFUSED, 1);
+    // consultar el primero lo vuelve el más reciente
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.1", 80)));
+
+    // la tabla está llena: se descarta el menos usado (10.0.0.2)
+    fail("10.0.0.5", 80, ECONNREFUSED, 1);
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.2", 80)));
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.1", 80)));
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.3", 80)));
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.0.0.5", 80)));
+
+    // muchos más orígenes que entradas
+    for (int i = 0; i < 1000; i++) {
+        char ip[32];
+        snprintf(ip, sizeof(ip), "10.1.%d.%d", i / 256, i % 256);
+        fail(ip, 80, ECONNREFUSED, 1);
+    }
+    ck_assert_int_eq(ORIGIN_OPEN_REFUSED, origin_admit(addr("10.1.3.231", 80)));
+    ck_assert_int_eq(ORIGIN_ALLOW, origin_admit(addr("10.0.0.1", 80)));
+    origin_destroy();
+}
+END_TEST
+
+/* éxito medido como si el connect hubiera tardado `us' microsegundos */
+static void
+succeed(const char *ip, uint16_t port, uint64_t us) {
+    origin_report(addr(ip, port), 0, origin_now() - us);
+}
+
+START_TEST (test_rtt) {
+    ck_assert_int_eq(0, origin_init(16, 0, 60));
+    succeed("10.0.0.1", 80, 8000);
+    struct origin_info info;
+    ck_assert_uint_eq(1, origin_list(&info, 1));
+    ck_assert_uint_ge(info.srtt_us, 8000);
+    ck_assert_uint_lt(info.srtt_us, 9000);
+    ck_assert_uint_eq(1000, info.success_permille);
+
+    // el suavizado sigue de a un octavo
+    succeed("10.0.0.1", 80, 16000);
+    ck_assert_uint_eq(1, origin_list(&info, 1));
+    ck_assert_uint_ge(info.srtt_us, 9000);
+    ck_assert_uint_lt(info.srtt_us, 10000);
+    ck_assert_uint_ge(info.last_rtt_us, 16000);
+
+    fail("10.0.0.1", 80, ETIMEDOUT, 1);
+    ck_assert_uint_eq(1, origin_list(&info, 1));
+    ck_assert_uint_eq(3, info.attempts);
+    ck_assert_uint_eq(2, info.successes);
+    ck_assert_uint_eq(875, info.success_permille);
+    ck_assert(!info.open);
+    origin_destroy();
+}
+END_TEST
+
+static struct addrinfo *
+candidates(const char **ips, size_t n, uint16_t port) {
+    static struct addrinfo ai[8];
+    static struct sockaddr_storage ss[8];
+    struct addrinfo *next = NULL;
+    for (size_t i = n; i-- > 0; ) {
+        memcpy(&ss[i], addr(ips[i], port), sizeof(ss[i]));
+        memset(&ai[i], 0, sizeof(ai[i]));
+        ai[i].ai_family = ss[i].ss_family;
+        ai[i].ai_addr = (struct sockaddr *)&ss[i];
+        ai[i].ai_next = next;
+        next = &ai[i];
+    }
+    return next;
+}
+
+static void
+assert_order(const struct addrinfo *list, const char **expected, size_t n) {
+    for (size_t i = 0; i < n; i++, list = list->ai_next) {
+        ck_assert_ptr_nonnull(list);
+        char ip[64];
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)list->ai_addr;
+        inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof(ip));
+        ck_assert_str_eq(expected[i], ip);
+    }
+    ck_assert_ptr_null(list);
+}
+
+START_TEST (test_sort) {
+    ck_assert_int_eq(0, origin_init(16, 2, 60));
+    const char *ips[] = {"10.0.0.1", "10.0.0.2", "10.0.0.3", "10.0.0.4", "10.0.0.5"};
+    struct addrinfo *list = candidates(ips, 5, 443);
+
+    // sin mediciones queda el orden del resolver
+    origin_sort(&list);
+    assert_order(list, ips, 5);
+
+    succeed("10.0.0.1", 443, 250000);
+    succeed("10.0.0.3", 443, 2000);
+    succeed("10.0.0.4", 443, 40000);
+    fail("10.0.0.4", 443, ECONNREFUSED, 1);
+    fail("10.0.0.2", 443, ETIMEDOUT, 2);
+    // .3 rápido; .5 sin datos (100 ms); .4 a 40 ms con un fallo reciente
+    // (40 / 0.875); .1 lento; .2 con el circuito abierto al final
+    list = candidates(ips, 5, 443);
+    origin_sort(&list);
+    const char *expected[] = {"10.0.0.3", "10.0.0.4", "10.0.0.5", "10.0.0.1", "10.0.0.2"};
+    assert_order(list, expected, 5);
+
+    // un solo candidato o ninguno
+    list = candidates(ips, 1, 443);
+    origin_sort(&list);
+    assert_order(list, ips, 1);
+    list = NULL;
+    origin_sort(&list);
+    ck_assert_ptr_null(list);
+    origin_destroy();
+}
+END_TEST
+
+START_TEST (test_list) {
+    ck_assert_int_eq(0, origin_init(4, 1, 60));
+    succeed("10.0.0.1", 80, 1000);
+    fail("2001:db8::1", 443, ECONNREFUSED, 1);
+    ck_assert_uint_eq(2, origin_count());
+
+    struct origin_info info[4];
+    ck_assert_uint_eq(2, origin_list(info, 4));
+    // el más reciente primero
+    ck_assert_int_eq(AF_INET6, info[0].addr.ss_family);
+    ck_assert_uint_eq(443, ntohs(((struct sockaddr_in6 *)&info[0].addr)->sin6_port));
+    ck_assert(info[0].open);
+    ck_assert_uint_gt(info[0].open_remaining_ms, 59000);
+    ck_assert_int_eq(AF_INET, info[1].addr.ss_family);
+    ck_assert_uint_eq(80, ntohs(((struct sockaddr_in *)&info[1].addr)->sin_port));
+    ck_assert_uint_eq(1, origin_list(info, 1));
+    origin_destroy();
+    ck_assert_uint_eq(0, origin_count());
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("origin");
+
+    /* Core test case */
+    tc = tcase_create("origin");
+    tcase_set_timeout(tc, 10);
+
+    tcase_add_test(tc, test_threshold);
+    tcase_add_test(tc, test_local_errors);
+    tcase_add_test(tc, test_disabled);
+    tcase_add_test(tc, test_probe);
+    tcase_add_test(tc, test_lru);
+    tcase_add_test(tc, test_rtt);
+    tcase_add_test(tc, test_sort);
+    tcase_add_test(tc, test_list);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
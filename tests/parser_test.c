@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <check.h>
 
 #include "parser.h"
+#include "parser_utils.h"
 
 // definición de maquina
 
@@ -82,6 +85,136 @@ START_TEST (test_basic) {
 }
 END_TEST
 
+START_TEST (test_compiled) {
+    struct parser_table *table = parser_compile(parser_no_classes(), &definition);
+    ck_assert_ptr_ne(NULL, table);
+
+    struct parser *parser = parser_init_table(table);
+    assert_eq(FOO,  'f', parser_feed(parser, 'f'));
+    assert_eq(FOO,  'F', parser_feed(parser, 'F'));
+    assert_eq(BAR,  'B', parser_feed(parser, 'B'));
+    assert_eq(BAR,  'b', parser_feed(parser, 'b'));
+
+    parser_destroy(parser);
+    parser_table_destroy(table);
+}
+END_TEST
+
+START_TEST (test_compiled_matches_linear) {
+    const struct parser_definition d = parser_utils_strcmpi("user");
+    struct parser_table *table = parser_compile(parser_no_classes(), &d);
+    ck_assert_ptr_ne(NULL, table);
+
+    struct parser *linear   = parser_init(parser_no_classes(), &d);
+    struct parser *compiled = parser_init_table(table);
+
+    const char *inputs[] = {"user", "USER", "uSeR", "usex", "users", "x", ""};
+    for(unsigned i = 0; i < N(inputs); i++) {
+        parser_reset(linear);
+        parser_reset(compiled);
+        for(const char *c = inputs[i]; *c != '\0'; c++) {
+            const struct parser_event *a = parser_feed(linear,   (uint8_t)*c);
+            const struct parser_event *b = parser_feed(compiled, (uint8_t)*c);
+            ck_assert_uint_eq(a->type,    b->type);
+            ck_assert_uint_eq(a->n,       b->n);
+            ck_assert_uint_eq(a->data[0], b->data[0]);
+        }
+    }
+
+    parser_destroy(linear);
+    parser_destroy(compiled);
+    parser_table_destroy(table);
+    parser_utils_strcmpi_destroy(&d);
+}
+END_TEST
+
+START_TEST (test_feed_span) {
+    struct parser_table *table = parser_compile(parser_no_classes(), &definition);
+    struct parser *parser = parser_init_table(table);
+
+    const uint8_t input[] = {'f', 'F', 'B', 'b'};
+    struct parser_event events[8];
+    size_t nevents = N(events);
+
+    ck_assert_uint_eq(N(input), parser_feed_span(parser, input, N(input), events, &nevents));
+    ck_assert_uint_eq(4, nevents);
+    assert_eq(FOO, 'f', events + 0);
+    assert_eq(FOO, 'F', events + 1);
+    assert_eq(BAR, 'B', events + 2);
+    assert_eq(BAR, 'b', events + 3);
+
+    // sin lugar para todos los eventos se detiene antes
+    parser_reset(parser);
+    nevents = 2;
+    ck_assert_uint_eq(1, parser_feed_span(parser, input, N(input), events, &nevents));
+    ck_assert_uint_eq(1, nevents);
+
+    parser_destroy(parser);
+    parser_table_destroy(table);
+}
+END_TEST
+
+static double
+now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * No es un test de correctitud: reporta el throughput de cada forma de
+ * alimentar al parser sobre el mismo input.
+ */
+START_TEST (test_throughput) {
+    const size_t size = 16 * 1024 * 1024;
+    uint8_t *input = malloc(size);
+    ck_assert_ptr_ne(NULL, input);
+    for(size_t i = 0; i < size; i++) {
+        input[i] = "USER pass\r\n"[i % 11];
+    }
+
+    const struct parser_definition d = parser_utils_strcmpi("user pass");
+    struct parser_table *table = parser_compile(parser_no_classes(), &d);
+    struct parser *linear   = parser_init(parser_no_classes(), &d);
+    struct parser *compiled = parser_init_table(table);
+    volatile unsigned sink  = 0;
+
+    double start = now_s();
+    for(size_t i = 0; i < size; i++) {
+        sink += parser_feed(linear, input[i])->type;
+    }
+    const double t_linear = now_s() - start;
+
+    start = now_s();
+    for(size_t i = 0; i < size; i++) {
+        sink += parser_feed(compiled, input[i])->type;
+    }
+    const double t_compiled = now_s() - start;
+
+    struct parser_event events[512];
+    start = now_s();
+    for(size_t i = 0; i < size; ) {
+        size_t nevents = N(events);
+        i += parser_feed_span(compiled, input + i, size - i, events, &nevents);
+        if (nevents > 0) {
+            sink += events[nevents - 1].type;
+        }
+    }
+    const double t_span = now_s() - start;
+
+    const double mb = size / 1e6;
+    printf("parser_feed (lineal):       %8.1f MB/s\n", mb / t_linear);
+    printf("parser_feed (precompilado): %8.1f MB/s\n", mb / t_compiled);
+    printf("parser_feed_span:           %8.1f MB/s\n", mb / t_span);
+
+    parser_destroy(linear);
+    parser_destroy(compiled);
+    parser_table_destroy(table);
+    parser_utils_strcmpi_destroy(&d);
+    free(input);
+}
+END_TEST
+
 Suite *
 suite(void) {
     Suite *s;
@@ -93,6 +226,11 @@ suite(void) {
     tc = tcase_create("parser_utils");
 
     tcase_add_test(tc, test_basic);
+    tcase_add_test(tc, test_compiled);
+    tcase_add_test(tc, test_compiled_matches_linear);
+    tcase_add_test(tc, test_feed_span);
+    tcase_add_test(tc, test_throughput);
+    tcase_set_timeout(tc, 60);
     suite_add_tcase(s, tc);
 
     return s;
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "utils/sha256.h"
+#include "auth/password.h"
+
+static void
+to_hex(const uint8_t *in, size_t n, char *out) {
+    for (size_t i = 0; i < n; i++) {
+        sprintf(out + 2 * i, "%02x", in[i]);
+    }
+}
+
+START_TEST (test_sha256) {
+    uint8_t d[SHA256_DIGEST_LENGTH];
+    char hex[2 * SHA256_DIGEST_LENGTH + 1];
+
+    sha256("abc", 3, d);
+    to_hex(d, sizeof(d), hex);
+    ck_assert_str_eq("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex);
+
+    // dos bloques y actualizaciones que cruzan el borde de bloque
+    const char *msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    struct sha256_ctx ctx;
+    sha256_init(&ctx);
+    for (const char *p = msg; *p; p += 7) {
+        sha256_update(&ctx, p, strlen(p) < 7 ? strlen(p) : 7);
+    }
+    sha256_final(&ctx, d);
+    to_hex(d, sizeof(d), hex);
+    ck_assert_str_eq("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", hex);
+}
+END_TEST
+
+START_TEST (test_hmac) {
+    // RFC 4231, caso 2
+    uint8_t mac[SHA256_DIGEST_LENGTH];
+    char hex[2 * SHA256_DIGEST_LENGTH + 1];
+    const char *data = "what do ya want for nothing?";
+    hmac_sha256("Jefe", 4, data, strlen(data), mac);
+    to_hex(mac, sizeof(mac), hex);
+    ck_assert_str_eq("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", hex);
+}
+END_TEST
+
+START_TEST (test_pbkdf2) {
+    // RFC 7914, sección 11
+    uint8_t key[64];
+    char hex[2 * sizeof(key) + 1];
+    pbkdf2_sha256("passwd", 6, "salt", 4, 1, key, sizeof(key));
+    to_hex(key, sizeof(key), hex);
+    ck_assert_str_eq("55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+                     "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783", hex);
+}
+END_TEST
+
+START_TEST (test_hash_verify) {
+    char a[PASSWORD_ENCODED_MAX];
+    char b[PASSWORD_ENCODED_MAX];
+
+    ck_assert(password_hash("secreto", a, sizeof(a)));
+    ck_assert(password_hash("secreto", b, sizeof(b)));
+    ck_assert(password_is_hash(a));
+    // sal distinta en cada derivación
+    ck_assert_str_ne(a, b);
+
+    ck_assert(password_verify("secreto", a));
+    ck_assert(password_verify("secreto", b));
+    ck_assert(!password_verify("Secreto", a));
+    ck_assert(!password_verify("", a));
+
+    ck_assert(!password_is_hash("secreto"));
+    ck_assert(!password_is_hash("$pbkdf2-sha256$0$00$00"));
+    ck_assert(!password_verify("secreto", "secreto"));
+
+    char small[16];
+    ck_assert(!password_hash("secreto", small, sizeof(small)));
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("password");
+
+    /* Core test case */
+    tc = tcase_create("password");
+
+    tcase_add_test(tc, test_sha256);
+    tcase_add_test(tc, test_hmac);
+    tcase_add_test(tc, test_pbkdf2);
+    tcase_add_test(tc, test_hash_verify);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
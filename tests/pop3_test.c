@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "dissectors/pop3.h"
+#include "users/users.h"
+
+static int
+feed_chunks(struct pop3_sniffer *s, const char *text, size_t chunk) {
+    const size_t n = strlen(text);
+    for(size_t off = 0; off < n; off += chunk) {
+        const size_t len = n - off < chunk ? n - off : chunk;
+        if(!pop3_sniffer_feed(s, (const uint8_t *)text + off, len)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int
+captured(struct user_credential *out) {
+    struct user_credential entries[MAX_CREDENTIALS_LOG];
+    int n = user_get_credentials(entries, MAX_CREDENTIALS_LOG);
+    if(n > 0) {
+        *out = entries[n - 1];
+    }
+    return n;
+}
+
+START_TEST (test_user_pass) {
+    users_destroy();
+    ck_assert(pop3_sniffer_module_init(true) == 0);
+    ck_assert(pop3_sniffer_wants(110));
+    ck_assert(!pop3_sniffer_wants(25));
+
+    struct pop3_sniffer *s = pop3_sniffer_new("juan", "mail.example.com", 110);
+    ck_assert_ptr_ne(NULL, s);
+    feed_chunks(s, "CAPA\r\nuser alice\r\nPass s3cret\r\n", 1024);
+
+    struct user_credential c;
+    ck_assert_int_eq(1, captured(&c));
+    ck_assert_str_eq("juan",             c.username);
+    ck_assert_str_eq("mail.example.com", c.destination);
+    ck_assert_str_eq("pop3",             c.protocol);
+    ck_assert_str_eq("alice",            c.captured_user);
+    ck_assert_str_eq("s3cret",           c.captured_pass);
+
+    // luego de las credenciales cualquier otro comando termina la disección
+    ck_assert_int_eq(0, feed_chunks(s, "STAT\r\n", 1024));
+
+    pop3_sniffer_free(s);
+    pop3_sniffer_module_destroy();
+}
+END_TEST
+
+START_TEST (test_split_segments) {
+    users_destroy();
+    ck_assert(pop3_sniffer_module_init(true) == 0);
+
+    struct pop3_sniffer *s = pop3_sniffer_new("juan", "10.0.0.1", 110);
+    ck_assert_int_eq(1, feed_chunks(s, "USER bob\r\nPASS hunter2\r\n", 1));
+    pop3_sniffer_free(s);
+
+    struct user_credential c;
+    ck_assert_int_eq(1, captured(&c));
+    ck_assert_str_eq("bob",     c.captured_user);
+    ck_assert_str_eq("hunter2", c.captured_pass);
+    pop3_sniffer_module_destroy();
+}
+END_TEST
+
+START_TEST (test_not_pop3) {
+    users_destroy();
+    ck_assert(pop3_sniffer_module_init(true) == 0);
+
+    struct pop3_sniffer *s = pop3_sniffer_new("juan", "10.0.0.1", 110);
+    char line[64];
+    int alive = 1;
+    for(int i = 0; i < 100 && alive; i++) {
+        snprintf(line, sizeof(line), "GET /%d HTTP/1.1\r\n", i);
+        alive = feed_chunks(s, line, 7);
+    }
+    ck_assert_int_eq(0, alive);
+    pop3_sniffer_free(s);
+
+    struct user_credential c;
+    ck_assert_int_eq(0, captured(&c));
+    pop3_sniffer_module_destroy();
+}
+END_TEST
+
+START_TEST (test_disabled) {
+    ck_assert(pop3_sniffer_module_init(false) == 0);
+    ck_assert(!pop3_sniffer_wants(110));
+    pop3_sniffer_module_destroy();
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("pop3");
+
+    /* Core test case */
+    tc = tcase_create("pop3");
+
+    tcase_add_test(tc, test_user_pass);
+    tcase_add_test(tc, test_split_segments);
+    tcase_add_test(tc, test_not_pop3);
+    tcase_add_test(tc, test_disabled);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
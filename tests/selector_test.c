@@ -1,5 +1,9 @@
 #include <stdlib.h>
 #include <check.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
 
 #define INITIAL_SIZE ((size_t) 1024)
 
@@ -37,7 +41,7 @@ START_TEST (test_next_capacity) {
         ITEMS_MAX_SIZE + 1, ITEMS_MAX_SIZE,
     };
     for(unsigned i = 0; i < N(data) / 2; i++ ) {
-        ck_assert_uint_eq(data[i * 2 + 1] + 1, next_capacity(data[i*2]));
+        ck_assert_uint_eq(data[i * 2 + 1] + 1, next_capacity(data[i*2], ITEMS_MAX_SIZE));
     }
 }
 END_TEST
@@ -151,6 +155,248 @@ START_TEST (test_selector_register_unregister_register) {
 }
 END_TEST
 
+static unsigned read_count = 0;
+static void
+read_callback(struct selector_key *key) {
+    char c;
+    ck_assert_int_eq(1, read(key->fd, &c, 1));
+    read_count++;
+}
+
+START_TEST (test_selector_engines) {
+    const enum selector_engine engines[] = {
+        SELECTOR_ENGINE_SELECT, SELECTOR_ENGINE_EPOLL, SELECTOR_ENGINE_IO_URING,
+    };
+    const struct fd_handler h = {
+        .handle_read   = read_callback,
+    };
+    for(unsigned i = 0; i < N(engines); i++) {
+        // sin espera: select_timeout en cero
+        memset(&conf, 0x00, sizeof(conf));
+        conf.engine = engines[i];
+        fd_selector s = selector_new(INITIAL_SIZE);
+        ck_assert_ptr_nonnull(s);
+        // si el kernel no lo soporta se usa uno más simple
+        ck_assert_uint_le(selector_get_engine(s), engines[i]);
+
+        int p[2];
+        ck_assert_int_eq(0, pipe(p));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_register(s, p[0], &h, OP_READ, data_mark));
+
+        read_count = 0;
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(0, read_count);
+
+        // semántica de nivel: dos bytes, un read por iteración
+        ck_assert_int_eq(2, write(p[1], "ab", 2));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(1, read_count);
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(2, read_count);
+
+        // sin interés no se despacha aunque haya datos
+        ck_assert_int_eq(1, write(p[1], "c", 1));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_set_interest(s, p[0], OP_NOOP));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(2, read_count);
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_set_interest(s, p[0], OP_READ));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(3, read_count);
+        ck_assert_uint_gt(selector_syscalls(s), 0);
+
+        selector_destroy(s);
+        close(p[0]);
+        close(p[1]);
+    }
+    memset(&conf, 0x00, sizeof(conf));
+}
+END_TEST
+
+START_TEST (test_selector_max_fds) {
+    // select(2) no pasa de FD_SETSIZE
+    memset(&conf, 0x00, sizeof(conf));
+    fd_selector s = selector_new(INITIAL_SIZE);
+    ck_assert_ptr_nonnull(s);
+    ck_assert_uint_eq(ITEMS_MAX_SIZE, selector_max_fds(s));
+    selector_destroy(s);
+
+    // epoll llega hasta el límite de fds del proceso
+    struct rlimit rl;
+    ck_assert_int_eq(0, getrlimit(RLIMIT_NOFILE, &rl));
+    rl.rlim_cur = rl.rlim_max;
+    const int high = ITEMS_MAX_SIZE + 100;
+    if(setrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur <= (rlim_t)high) {
+        return;
+    }
+    conf.engine = SELECTOR_ENGINE_EPOLL;
+    s = selector_new(INITIAL_SIZE);
+    ck_assert_ptr_nonnull(s);
+    if(selector_get_engine(s) == SELECTOR_ENGINE_EPOLL) {
+        ck_assert_uint_ge(selector_max_fds(s), (size_t)high + 1);
+
+        const struct fd_handler h = {
+            .handle_read   = read_callback,
+        };
+        int p[2];
+        ck_assert_int_eq(0, pipe(p));
+        ck_assert_int_eq(high, dup2(p[0], high));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_register(s, high, &h, OP_READ, data_mark));
+        read_count = 0;
+        ck_assert_int_eq(1, write(p[1], "a", 1));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(1, read_count);
+        selector_unregister_fd(s, high);
+        close(high);
+        close(p[0]);
+        close(p[1]);
+    }
+    selector_destroy(s);
+    memset(&conf, 0x00, sizeof(conf));
+}
+END_TEST
+
+static unsigned hup_count = 0;
+static void
+hup_callback(struct selector_key *key) {
+    char c;
+    ck_assert_int_eq(0, read(key->fd, &c, 1));
+    hup_count++;
+}
+
+static double
+elapsed_since(const struct timespec *t0) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+START_TEST (test_selector_hangup_noop) {
+    const enum selector_engine engines[] = {
+        SELECTOR_ENGINE_SELECT, SELECTOR_ENGINE_EPOLL, SELECTOR_ENGINE_IO_URING,
+    };
+    const struct fd_handler h = {
+        .handle_read   = hup_callback,
+        .handle_write  = hup_callback,
+    };
+    for(unsigned i = 0; i < N(engines); i++) {
+        memset(&conf, 0x00, sizeof(conf));
+        conf.engine = engines[i];
+        conf.select_timeout.tv_nsec = 20 * 1000 * 1000;
+        fd_selector s = selector_new(INITIAL_SIZE);
+        ck_assert_ptr_nonnull(s);
+
+        // cerrado en los dos sentidos: POLLHUP por nivel
+        int p[2];
+        ck_assert_int_eq(0, socketpair(AF_UNIX, SOCK_STREAM, 0, p));
+        ck_assert_int_eq(0, shutdown(p[0], SHUT_RDWR));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_register(s, p[0], &h, OP_READ, data_mark));
+        hup_count = 0;
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(1, hup_count);
+
+        // sin interés cada espera dura el timeout en lugar de volver enseguida
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_set_interest(s, p[0], OP_NOOP));
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(int k = 0; k < 5; k++) {
+            ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        }
+        ck_assert_uint_eq(1, hup_count);
+        ck_assert(elapsed_since(&t0) >= 0.08);
+
+        // ni con un interés que el cierre no despierta (solo la cola de errores)
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_set_interest(s, p[0], OP_ERROR));
+        if(engines[i] != SELECTOR_ENGINE_SELECT) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for(int k = 0; k < 5; k++) {
+                ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+            }
+            ck_assert(elapsed_since(&t0) >= 0.08);
+        }
+
+        // con otro interés el cierre se vuelve a informar
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_set_interest(s, p[0], OP_WRITE));
+        ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+        ck_assert_uint_eq(2, hup_count);
+
+        selector_destroy(s);
+        close(p[0]);
+        close(p[1]);
+    }
+    memset(&conf, 0x00, sizeof(conf));
+}
+END_TEST
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+static unsigned error_count = 0;
+static void
+error_callback(struct selector_key *key) {
+    uint8_t control[128];
+    struct msghdr msg = {
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    while(recvmsg(key->fd, &msg, MSG_ERRQUEUE) >= 0) {
+        error_count++;
+        msg.msg_controllen = sizeof(control);
+    }
+}
+
+START_TEST (test_selector_error_queue) {
+    const enum selector_engine engines[] = {
+        SELECTOR_ENGINE_SELECT, SELECTOR_ENGINE_EPOLL, SELECTOR_ENGINE_IO_URING,
+    };
+    const struct fd_handler h = {
+        .handle_error  = error_callback,
+    };
+    for(unsigned i = 0; i < N(engines); i++) {
+        memset(&conf, 0x00, sizeof(conf));
+        conf.engine = engines[i];
+        fd_selector s = selector_new(INITIAL_SIZE);
+        ck_assert_ptr_nonnull(s);
+
+        // par TCP por loopback: la confirmación de MSG_ZEROCOPY llega por la
+        // cola de errores del que envía
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        socklen_t len = sizeof(addr);
+        const int one = 1;
+        int l = socket(AF_INET, SOCK_STREAM, 0);
+        int c = socket(AF_INET, SOCK_STREAM, 0);
+        ck_assert_int_eq(0, bind(l, (struct sockaddr *)&addr, sizeof(addr)));
+        ck_assert_int_eq(0, listen(l, 1));
+        ck_assert_int_eq(0, getsockname(l, (struct sockaddr *)&addr, &len));
+        ck_assert_int_eq(0, connect(c, (struct sockaddr *)&addr, sizeof(addr)));
+        int a = accept(l, NULL, NULL);
+        ck_assert_int_ge(a, 0);
+        if(setsockopt(c, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+            ck_assert_uint_eq(SELECTOR_SUCCESS, selector_register(s, c, &h, OP_ERROR, data_mark));
+            error_count = 0;
+            ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+            ck_assert_uint_eq(0, error_count);
+
+            ck_assert_int_eq(4, send(c, "abcd", 4, MSG_ZEROCOPY));
+            for(int tries = 0; tries < 100 && error_count == 0; tries++) {
+                ck_assert_uint_eq(SELECTOR_SUCCESS, selector_select(s));
+                if(error_count == 0) {
+                    usleep(1000);
+                }
+            }
+            ck_assert_uint_eq(1, error_count);
+        }
+
+        selector_destroy(s);
+        close(a);
+        close(c);
+        close(l);
+    }
+    memset(&conf, 0x00, sizeof(conf));
+}
+END_TEST
+#endif
+
 Suite * 
 suite(void) {
     Suite *s  = suite_create("nio");
@@ -161,6 +407,12 @@ suite(void) {
     tcase_add_test(tc, test_ensure_capacity);
     tcase_add_test(tc, test_selector_register_fd);
     tcase_add_test(tc, test_selector_register_unregister_register);
+    tcase_add_test(tc, test_selector_engines);
+    tcase_add_test(tc, test_selector_hangup_noop);
+    tcase_add_test(tc, test_selector_max_fds);
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+    tcase_add_test(tc, test_selector_error_queue);
+#endif
     suite_add_tcase(s, tc);
 
     return s;
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "socks5/sockopt.h"
+
+#define N(x) (sizeof(x)/sizeof(x[0]))
+
+static void
+init(char **profiles, int nprofiles, char **rules, int nrules) {
+    char err[128];
+    ck_assert_msg(sockopt_init(profiles, nprofiles, rules, nrules, err, sizeof(err)) == 0, "%s", err);
+}
+
+START_TEST (test_builtin_profiles) {
+    init(NULL, 0, NULL, 0);
+    const struct sockopt_profile *p = sockopt_select("user", 443);
+    ck_assert_str_eq("default", p->name);
+    ck_assert_int_eq(-1, p->nodelay);
+    ck_assert_int_eq(-1, p->keepidle);
+
+    char *rules[] = {"*=interactive"};
+    init(NULL, 0, rules, N(rules));
+    p = sockopt_select(NULL, 0);
+    ck_assert_str_eq("interactive", p->name);
+    ck_assert_int_eq(1, p->nodelay);
+    ck_assert_int_eq(16 * 1024, p->notsent_lowat);
+    ck_assert_int_eq(60, p->keepidle);
+}
+END_TEST
+
+START_TEST (test_profile_specs) {
+    char *profiles[] = {
+        "bulk:sndbuf=4M,rcvbuf=512K",
+        "ssh:nodelay=1,keepalive=30/5/3,user_timeout=20000",
+        "quiet:keepalive=off",
+    };
+    char *rules[] = {"*=bulk", "22=ssh", "@bob=quiet"};
+    init(profiles, N(profiles), rules, N(rules));
+
+    // un perfil predefinido conserva lo que no se cambió
+    const struct sockopt_profile *p = sockopt_select(NULL, 0);
+    ck_assert_str_eq("bulk", p->name);
+    ck_assert_int_eq(4 * 1024 * 1024, p->sndbuf);
+    ck_assert_int_eq(512 * 1024, p->rcvbuf);
+    ck_assert_int_eq(300, p->keepidle);
+
+    p = sockopt_select("alice", 22);
+    ck_assert_str_eq("ssh", p->name);
+    ck_assert_int_eq(1, p->nodelay);
+    ck_assert_int_eq(-1, p->sndbuf);
+    ck_assert_int_eq(30, p->keepidle);
+    ck_assert_int_eq(5, p->keepintvl);
+    ck_assert_int_eq(3, p->keepcnt);
+    ck_assert_int_eq(20000, p->user_timeout);
+
+    p = sockopt_select("bob", 22);
+    ck_assert_str_eq("quiet", p->name);
+    ck_assert_int_eq(0, p->keepidle);
+}
+END_TEST
+
+START_TEST (test_precedence) {
+    char *rules[] = {"@carol=bulk", "8080=interactive", "*=bulk", "443=default"};
+    init(NULL, 0, rules, N(rules));
+
+    ck_assert_str_eq("bulk", sockopt_select("carol", 8080)->name);
+    ck_assert_str_eq("interactive", sockopt_select("dave", 8080)->name);
+    ck_assert_str_eq("default", sockopt_select("dave", 443)->name);
+    ck_assert_str_eq("bulk", sockopt_select("dave", 80)->name);
+    // antes del pedido solo aplica `*'
+    ck_assert_str_eq("bulk", sockopt_select(NULL, 0)->name);
+}
+END_TEST
+
+START_TEST (test_errors) {
+    char err[128];
+    char *bad_profiles[][1] = {
+        {"x:nodelay=2"},
+        {"x:sndbuf=12Q"},
+        {"x:keepalive=10/0"},
+        {"x:keepalive=1/2/3/4"},
+        {"x:color=blue"},
+        {":nodelay=1"},
+        {"averyveryverylongname:nodelay=1"},
+    };
+    for (unsigned i = 0; i < N(bad_profiles); i++) {
+        ck_assert_msg(sockopt_init(bad_profiles[i], 1, NULL, 0, err, sizeof(err)) < 0, "%s", bad_profiles[i][0]);
+    }
+    char *bad_rules[][1] = {
+        {"443=nope"},
+        {"0=bulk"},
+        {"70000=bulk"},
+        {"@=bulk"},
+        {"=bulk"},
+        {"bulk"},
+    };
+    for (unsigned i = 0; i < N(bad_rules); i++) {
+        ck_assert_msg(sockopt_init(NULL, 0, bad_rules[i], 1, err, sizeof(err)) < 0, "%s", bad_rules[i][0]);
+    }
+}
+END_TEST
+
+START_TEST (test_apply_read) {
+    char *profiles[] = {"t:nodelay=1,rcvbuf=64K,keepalive=45/7/2,user_timeout=9000,lowat=8K"};
+    char *rules[] = {"*=t"};
+    init(profiles, N(profiles), rules, N(rules));
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ck_assert_int_ge(fd, 0);
+    sockopt_apply(fd, sockopt_select(NULL, 0));
+
+    struct sockopt_profile got;
+    ck_assert(sockopt_read(fd, &got));
+    ck_assert_int_eq(1, got.nodelay);
+    // Linux informa el doble de lo pedido
+    ck_assert_int_ge(got.rcvbuf, 64 * 1024);
+    ck_assert_int_eq(45, got.keepidle);
+    ck_assert_int_eq(7, got.keepintvl);
+    ck_assert_int_eq(2, got.keepcnt);
+#ifdef TCP_USER_TIMEOUT
+    ck_assert_int_eq(9000, got.user_timeout);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    ck_assert_int_eq(8 * 1024, got.notsent_lowat);
+#endif
+    close(fd);
+
+    // un socket que no es TCP
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ck_assert(!sockopt_read(fd, &got));
+    close(fd);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("sockopt");
+
+    /* Core test case */
+    tc = tcase_create("sockopt");
+
+    tcase_add_test(tc, test_builtin_profiles);
+    tcase_add_test(tc, test_profile_specs);
+    tcase_add_test(tc, test_precedence);
+    tcase_add_test(tc, test_errors);
+    tcase_add_test(tc, test_apply_read);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
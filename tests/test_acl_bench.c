@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../src/acl/acl.h"
+
+#define DEFAULT_RULES 100000
+#define DEFAULT_LOOKUPS 200000
+
+/* regla tal como la evaluaría una lista recorrida de punta a punta */
+struct linear_rule {
+    int family;             /* AF_INET, AF_INET6 o 0 para dominios */
+    uint8_t addr[16];
+    int prefix;
+    char domain[64];
+    size_t domain_len;
+    bool allow;
+};
+
+static double get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool prefix_matches(const uint8_t *a, const uint8_t *b, int bits) {
+    int bytes = bits / 8;
+    if (memcmp(a, b, (size_t)bytes) != 0) {
+        return false;
+    }
+    int rest = bits % 8;
+    if (rest == 0) {
+        return true;
+    }
+    uint8_t mask = (uint8_t)(0xFF << (8 - rest));
+    return (a[bytes] & mask) == (b[bytes] & mask);
+}
+
+static bool linear_addr(const struct linear_rule *rules, size_t n, int family, const uint8_t *addr) {
+    int best = -1;
+    bool allow = true;
+    for (size_t i = 0; i < n; i++) {
+        if (rules[i].family == family && rules[i].prefix >= best
+            && prefix_matches(rules[i].addr, addr, rules[i].prefix)) {
+            best = rules[i].prefix;
+            allow = rules[i].allow;
+        }
+    }
+    return allow;
+}
+
+static bool linear_domain(const struct linear_rule *rules, size_t n, const char *name) {
+    size_t len = strlen(name);
+    size_t best = 0;
+    bool allow = true;
+    for (size_t i = 0; i < n; i++) {
+        const struct linear_rule *r = &rules[i];
+        if (r->family != 0 || r->domain_len > len || r->domain_len < best) {
+            continue;
+        }
+        const char *tail = name + len - r->domain_len;
+        if (strcmp(tail, r->domain) == 0 && (tail == name || tail[-1] == '.')) {
+            best = r->domain_len;
+            allow = r->allow;
+        }
+    }
+    return allow;
+}
+
+struct query {
+    int family;             /* 0 para dominios */
+    struct sockaddr_storage addr;
+    const uint8_t *raw;
+    char name[96];
+};
+
+/* una consulta que cae dentro de la regla `r' o, si no, cerca de ella */
+static void build_query(struct query *q, const struct linear_rule *r, bool inside) {
+    memset(q, 0, sizeof(*q));
+    q->family = r->family;
+    if (r->family == AF_INET) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&q->addr;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, r->addr, 4);
+        if (!inside) {
+            sin->sin_addr.s_addr ^= htonl((uint32_t)rand());
+        }
+        q->raw = (const uint8_t *)&sin->sin_addr;
+    } else if (r->family == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&q->addr;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, r->addr, 16);
+        sin6->sin6_addr.s6_addr[15] = (uint8_t)rand();
+        if (!inside) {
+            sin6->sin6_addr.s6_addr[3] ^= (uint8_t)rand();
+        }
+        q->raw = sin6->sin6_addr.s6_addr;
+    } else {
+        snprintf(q->name, sizeof(q->name), inside ? "www.%s" : "www.%sx", r->domain);
+    }
+}
+
+/* 50% CIDR IPv4, 20% CIDR IPv6 y 30% dominios */
+static char *build_rules(size_t n, struct linear_rule *rules, size_t *text_len) {
+    char *text = malloc(n * 96);
+    if (text == NULL) {
+        return NULL;
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct linear_rule *r = &rules[i];
+        memset(r, 0, sizeof(*r));
+        r->allow = rand() % 4 == 0;
+        const char *verb = r->allow ? "allow" : "deny";
+        int kind = rand() % 10;
+        if (kind < 5) {
+            r->family = AF_INET;
+            r->prefix = 8 + rand() % 25;
+            uint32_t a = (uint32_t)rand() << 1 ^ (uint32_t)rand();
+            a &= r->prefix == 0 ? 0 : 0xFFFFFFFFu << (32 - r->prefix);
+            uint32_t be = htonl(a);
+            memcpy(r->addr, &be, 4);
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, r->addr, ip, sizeof(ip));
+            len += (size_t)sprintf(text + len, "%s %s/%d\n", verb, ip, r->prefix);
+        } else if (kind < 7) {
+            r->family = AF_INET6;
+            r->prefix = 16 + rand() % 49;
+            r->addr[0] = 0x20;
+            r->addr[1] = 0x01;
+            for (int b = 2; b < 8; b++) {
+                r->addr[b] = (uint8_t)rand();
+            }
+            for (int b = r->prefix; b < 64; b++) {
+                r->addr[b / 8] &= (uint8_t)~(0x80 >> (b % 8));
+            }
+            char ip[INET6_ADDRSTRLEN];
+            inet_ntop(AF_INET6, r->addr, ip, sizeof(ip));
+            len += (size_t)sprintf(text + len, "%s %s/%d\n", verb, ip, r->prefix);
+        } else {
+            r->domain_len = (size_t)snprintf(r->domain, sizeof(r->domain), "h%d.site%zu.%s",
+                                             rand() % 100, i, (const char *[]){"com", "net", "org"}[rand() % 3]);
+            if (rand() % 2 == 0) {
+                // solo el sitio: cubre a todos sus hosts
+                memmove(r->domain, strchr(r->domain, '.') + 1, strlen(strchr(r->domain, '.')));
+                r->domain_len = strlen(r->domain);
+            }
+            len += (size_t)sprintf(text + len, "%s %s\n", verb, r->domain);
+        }
+    }
+    *text_len = len;
+    return text;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_RULES;
+    size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_LOOKUPS;
+    if (n == 0 || lookups == 0) {
+        fprintf(stderr, "Uso: %s [reglas] [consultas]\n", argv[0]);
+        return 1;
+    }
+    srand(42);
+
+    struct linear_rule *rules = malloc(n * sizeof(*rules));
+    size_t text_len;
+    char *text = rules == NULL ? NULL : build_rules(n, rules, &text_len);
+    if (text == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("\n#### Benchmark de reglas de acceso ####\n");
+    printf("Reglas: %zu (%.1f KB de texto)\n", n, text_len / 1024.0);
+
+    char err[128];
+    double start = get_time_ns();
+    struct acl *acl = acl_compile(text, text_len, err, sizeof(err));
+    double compile_ns = get_time_ns() - start;
+    if (acl == NULL) {
+        fprintf(stderr, "acl_compile: %s\n", err);
+        return 1;
+    }
+    printf("Compilación: %.1f ms\n\n", compile_ns / 1e6);
+
+    // la mitad de las consultas cae dentro de alguna regla
+    struct query *queries = malloc(lookups * sizeof(*queries));
+    if (queries == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    size_t n_addr = 0, n_dom = 0;
+    for (size_t q = 0; q < lookups; q++) {
+        build_query(&queries[q], &rules[(size_t)rand() % n], rand() % 2 == 0);
+        if (queries[q].family == 0) {
+            n_dom++;
+        } else {
+            n_addr++;
+        }
+    }
+
+    // cada método en su propia pasada para que uno no le vacíe la caché al otro
+    bool *verdicts = malloc(lookups * sizeof(*verdicts));
+    double trie_addr = 0, trie_dom = 0;
+    for (int kind = 0; kind < 2; kind++) {
+        start = get_time_ns();
+        for (size_t q = 0; q < lookups; q++) {
+            const struct query *qr = &queries[q];
+            if (kind == 0 && qr->family != 0) {
+                verdicts[q] = acl_check_addr(acl, NULL, (const struct sockaddr *)&qr->addr);
+            } else if (kind == 1 && qr->family == 0) {
+                verdicts[q] = acl_check_domain(acl, NULL, qr->name) != ACL_DENY;
+            }
+        }
+        *(kind == 0 ? &trie_addr : &trie_dom) = get_time_ns() - start;
+    }
+
+    // la lista lineal es demasiado lenta para todas las consultas: se muestrea
+    size_t linear_every = n > 1000 ? 100 : 1;
+    double linear_addr_ns = 0, linear_dom_ns = 0;
+    size_t n_linear_addr = 0, n_linear_dom = 0, mismatches = 0;
+    for (size_t q = 0; q < lookups; q += linear_every) {
+        const struct query *qr = &queries[q];
+        bool expected;
+        start = get_time_ns();
+        if (qr->family != 0) {
+            expected = linear_addr(rules, n, qr->family, qr->raw);
+            linear_addr_ns += get_time_ns() - start;
+            n_linear_addr++;
+        } else {
+            expected = linear_domain(rules, n, qr->name);
+            linear_dom_ns += get_time_ns() - start;
+            n_linear_dom++;
+        }
+        if (verdicts[q] != expected) {
+            mismatches++;
+        }
+    }
+
+    printf("%-22s %14s %14s\n", "", "trie", "lineal");
+    printf("%-22s %11.1f ns %11.1f ns\n", "Dirección (ns/consulta)",
+           n_addr ? trie_addr / (double)n_addr : 0, n_linear_addr ? linear_addr_ns / (double)n_linear_addr : 0);
+    printf("%-22s %11.1f ns %11.1f ns\n", "Dominio (ns/consulta)",
+           n_dom ? trie_dom / (double)n_dom : 0, n_linear_dom ? linear_dom_ns / (double)n_linear_dom : 0);
+
+    free(verdicts);
+    free(queries);
+    acl_free(acl);
+    free(text);
+    free(rules);
+
+    if (mismatches > 0) {
+        printf("\nERROR: %zu consultas con veredicto distinto al de la búsqueda lineal\n", mismatches);
+        return 1;
+    }
+    printf("\nVeredictos verificados contra la búsqueda lineal: OK\n");
+    return 0;
+}
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * Throughput de autenticación RFC 1929 contra el proxy. Varios hilos abren
+ * conexiones, negocian usuario/contraseña y cierran, en dos fases:
+ *
+ *   - credenciales correctas: después del primer login salen del cache de
+ *     verificaciones del servidor;
+ *   - contraseña incorrecta: cada intento deriva la clave en el pool.
+ *
+ * Durante la segunda fase otro hilo mide el RTT del hello (sin autenticar)
+ * para comprobar que el selector sigue atendiendo mientras se verifica.
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define DEFAULT_SECONDS 5
+#define DEFAULT_THREADS 16
+#define MAX_SAMPLES 1000000
+#define PROBE_INTERVAL_US 10000
+
+static struct sockaddr_in proxy;
+static const char *user = "user";
+static const char *pass = "pass";
+static volatile int running = 0;
+
+struct phase {
+    const char *password;
+    int expect_ok;
+    pthread_mutex_t mutex;
+    double *lat;
+    int samples;
+    int failed;
+};
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+static int open_hello(void) {
+    unsigned char buf[2];
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+    if (connect(fd, (const struct sockaddr *)&proxy, sizeof(proxy)) < 0 ||
+        write(fd, hello, sizeof(hello)) != sizeof(hello) ||
+        read_full(fd, buf, 2) < 0 || buf[0] != 0x05 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* 1 si el servidor aceptó las credenciales, 0 si las rechazó, -1 si falló */
+static int auth_once(const char *password, double *latency_us) {
+    unsigned char buf[600];
+    double start = now_us();
+    int fd = open_hello();
+    if (fd < 0) return -1;
+
+    size_t ulen = strlen(user), plen = strlen(password);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, password, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) || read_full(fd, buf, 2) < 0) {
+        close(fd);
+        return -1;
+    }
+    *latency_us = now_us() - start;
+    close(fd);
+    return buf[1] == 0x00;
+}
+
+static void *auth_loop(void *arg) {
+    struct phase *ph = arg;
+    while (running) {
+        double lat;
+        int r = auth_once(ph->password, &lat);
+        pthread_mutex_lock(&ph->mutex);
+        if (r == ph->expect_ok && ph->samples < MAX_SAMPLES) {
+            ph->lat[ph->samples++] = lat;
+        } else if (r != ph->expect_ok) {
+            ph->failed++;
+        }
+        pthread_mutex_unlock(&ph->mutex);
+    }
+    return NULL;
+}
+
+struct probe {
+    double *lat;
+    int samples;
+};
+
+static void *probe_loop(void *arg) {
+    struct probe *pr = arg;
+    while (running) {
+        double start = now_us();
+        int fd = open_hello();
+        if (fd >= 0) {
+            if (pr->samples < MAX_SAMPLES) {
+                pr->lat[pr->samples++] = now_us() - start;
+            }
+            close(fd);
+        }
+        usleep(PROBE_INTERVAL_US);
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double diff = *(const double *)a - *(const double *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+static void report(const char *name, double *lat, int n, int failed, int seconds) {
+    if (n == 0) {
+        printf("%-24s sin muestras (fallidas: %d)\n", name, failed);
+        return;
+    }
+    qsort(lat, n, sizeof(double), compare_double);
+    printf("%-24s %9.1f/s  p50 %8.1f us  p99 %8.1f us  fallidas %d\n", name,
+           (double)n / seconds, lat[n / 2], lat[(int)(n * 0.99)], failed);
+}
+
+static int run_phase(struct phase *ph, int threads, int seconds, struct probe *pr) {
+    pthread_t *t = malloc(threads * sizeof(pthread_t));
+    pthread_t probe_thread;
+    running = 1;
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&t[i], NULL, auth_loop, ph);
+    }
+    if (pr != NULL) {
+        pthread_create(&probe_thread, NULL, probe_loop, pr);
+    }
+    sleep(seconds);
+    running = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(t[i], NULL);
+    }
+    if (pr != NULL) {
+        pthread_join(probe_thread, NULL);
+    }
+    free(t);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int port = DEFAULT_PROXY_PORT;
+    int seconds = DEFAULT_SECONDS;
+    int threads = DEFAULT_THREADS;
+
+    if (argc > 1) user = argv[1];
+    if (argc > 2) pass = argv[2];
+    if (argc > 3) port = atoi(argv[3]);
+    if (argc > 4) seconds = atoi(argv[4]);
+    if (argc > 5) threads = atoi(argv[5]);
+    if (seconds <= 0) seconds = DEFAULT_SECONDS;
+    if (threads <= 0) threads = DEFAULT_THREADS;
+
+    memset(&proxy, 0, sizeof(proxy));
+    proxy.sin_family = AF_INET;
+    proxy.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &proxy.sin_addr);
+
+    printf("#### Test de Throughput de Autenticación ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d\n", user, pass, PROXY_HOST, port);
+    printf("Hilos: %d  Duración por fase: %d s\n\n", threads, seconds);
+
+    double warm;
+    if (auth_once(pass, &warm) != 1) {
+        printf("Las credenciales fueron rechazadas\n");
+        return 1;
+    }
+
+    struct phase cached = {.password = pass, .expect_ok = 1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+    cached.lat = malloc(MAX_SAMPLES * sizeof(double));
+    run_phase(&cached, threads, seconds, NULL);
+    report("Login (cache)", cached.lat, cached.samples, cached.failed, seconds);
+
+    char wrong[300];
+    snprintf(wrong, sizeof(wrong), "%s-wrong", pass);
+    struct phase kdf = {.password = wrong, .expect_ok = 0, .mutex = PTHREAD_MUTEX_INITIALIZER};
+    kdf.lat = malloc(MAX_SAMPLES * sizeof(double));
+    struct probe pr = {.lat = malloc(MAX_SAMPLES * sizeof(double))};
+    run_phase(&kdf, threads, seconds, &pr);
+    report("Rechazo (derivación)", kdf.lat, kdf.samples, kdf.failed, seconds);
+    report("Hello durante rechazos", pr.lat, pr.samples, 0, seconds);
+
+    free(cached.lat);
+    free(kdf.lat);
+    free(pr.lat);
+    return 0;
+}
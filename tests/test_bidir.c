@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Throughput bidireccional a través del proxy: el cliente y un destino local
+ * se mandan N bytes cada uno al mismo tiempo por el mismo túnel. Se mide
+ * primero cada sentido por separado y después los dos juntos; con un relay
+ * full-duplex la suma de los dos sentidos simultáneos debería acercarse al
+ * doble de uno solo, en lugar de repartirse el mismo ancho de banda.
+ *
+ * Al final se prueba el half-close: el cliente sube sus datos y hace
+ * shutdown(SHUT_WR), y el destino responde recién al ver el EOF (como un
+ * upload HTTP/1.0). El proxy tiene que propagar el EOF sin cortar la
+ * respuesta.
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define DEFAULT_MB 256
+#define DEFAULT_STREAMS 4
+#define CHUNK (64 * 1024)
+
+/* qué manda cada extremo en una corrida */
+enum mode {
+    UPLOAD,
+    DOWNLOAD,
+    BOTH,
+    HALF_CLOSE,
+};
+
+static int target_fd = -1;
+static uint16_t target_port = 0;
+static enum mode current_mode;
+static uint64_t bytes_per_stream;
+
+struct pipe_end {
+    int fd;
+    uint64_t to_send;
+    uint64_t to_recv;
+    uint64_t received;
+    /* al terminar de mandar se hace shutdown(SHUT_WR) */
+    int shut;
+    int ok;
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *sender(void *arg) {
+    struct pipe_end *e = arg;
+    uint8_t *chunk = malloc(CHUNK);
+    for (size_t i = 0; i < CHUNK; i++) {
+        chunk[i] = (uint8_t)i;
+    }
+    uint64_t left = e->to_send;
+    while (left > 0) {
+        ssize_t w = send(e->fd, chunk, left < CHUNK ? left : CHUNK, MSG_NOSIGNAL);
+        if (w <= 0) {
+            if (w < 0 && errno == EINTR) continue;
+            break;
+        }
+        left -= (uint64_t)w;
+    }
+    free(chunk);
+    if (e->shut) {
+        shutdown(e->fd, SHUT_WR);
+    }
+    return NULL;
+}
+
+/* lee lo esperado y deja el resultado en `e'; manda en paralelo si hace falta */
+static void run_end(struct pipe_end *e) {
+    pthread_t t;
+    int sending = e->to_send > 0 && pthread_create(&t, NULL, sender, e) == 0;
+
+    uint8_t *chunk = malloc(CHUNK);
+    e->received = 0;
+    while (e->received < e->to_recv) {
+        ssize_t r = recv(e->fd, chunk, CHUNK, 0);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) continue;
+            break;
+        }
+        e->received += (uint64_t)r;
+    }
+    free(chunk);
+    if (sending) {
+        pthread_join(t, NULL);
+    }
+    e->ok = e->received == e->to_recv;
+}
+
+static void *target_conn(void *arg) {
+    struct pipe_end e = {
+        .fd = (int)(intptr_t)arg,
+        .to_send = current_mode != UPLOAD ? bytes_per_stream : 0,
+        .to_recv = current_mode != DOWNLOAD ? bytes_per_stream : 0,
+    };
+    if (current_mode == HALF_CLOSE) {
+        // primero todo el pedido hasta el EOF, después la respuesta
+        e.to_send = 0;
+        run_end(&e);
+        char c;
+        if (e.ok && recv(e.fd, &c, 1, 0) == 0) {
+            e.to_send = bytes_per_stream;
+            sender(&e);
+        }
+        close(e.fd);
+        return NULL;
+    }
+    run_end(&e);
+    // se espera el cierre del cliente para no depender del half-close
+    char c;
+    while (recv(e.fd, &c, 1, 0) > 0) {
+    }
+    close(e.fd);
+    return NULL;
+}
+
+static void *target_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(target_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        pthread_t t;
+        if (pthread_create(&t, NULL, target_conn, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(t);
+    }
+    return NULL;
+}
+
+static int start_target(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    target_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (target_fd < 0 || bind(target_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(target_fd, 512) < 0 || getsockname(target_fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("target");
+        return -1;
+    }
+    target_port = ntohs(addr.sin_port);
+
+    pthread_t t;
+    return pthread_create(&t, NULL, target_loop, NULL) == 0 ? 0 : -1;
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+static int socks5_open(const struct sockaddr_in *proxy, const char *user, const char *pass) {
+    unsigned char buf[600];
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    if (connect(fd, (const struct sockaddr *)proxy, sizeof(*proxy)) < 0 ||
+        write(fd, hello, sizeof(hello)) != sizeof(hello) ||
+        read_full(fd, buf, 2) < 0 || buf[0] != 0x05 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    size_t ulen = strlen(user), plen = strlen(pass);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, pass, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    unsigned char req[10] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1,
+                             (unsigned char)(target_port >> 8), (unsigned char)(target_port & 0xFF)};
+    if (write(fd, req, sizeof(req)) != sizeof(req) || read_full(fd, buf, 10) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *client_stream(void *arg) {
+    run_end(arg);
+    return NULL;
+}
+
+/* MB/s totales de la corrida (suma de ambos sentidos), o < 0 si falló */
+static double run(enum mode mode, const struct sockaddr_in *proxy, const char *user, const char *pass,
+                  int streams) {
+    current_mode = mode;
+    struct pipe_end *ends = calloc((size_t)streams, sizeof(*ends));
+    pthread_t *threads = calloc((size_t)streams, sizeof(*threads));
+
+    for (int i = 0; i < streams; i++) {
+        ends[i].fd = socks5_open(proxy, user, pass);
+        if (ends[i].fd < 0) {
+            fprintf(stderr, "No se pudo abrir el túnel %d a través del proxy\n", i);
+            return -1;
+        }
+        ends[i].to_send = mode != DOWNLOAD ? bytes_per_stream : 0;
+        ends[i].to_recv = mode != UPLOAD ? bytes_per_stream : 0;
+        ends[i].shut = mode == HALF_CLOSE;
+    }
+
+    const double t0 = now_s();
+    for (int i = 0; i < streams; i++) {
+        pthread_create(&threads[i], NULL, client_stream, &ends[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < streams; i++) {
+        pthread_join(threads[i], NULL);
+        failed += !ends[i].ok;
+    }
+    const double elapsed = now_s() - t0;
+
+    for (int i = 0; i < streams; i++) {
+        close(ends[i].fd);
+    }
+    free(ends);
+    free(threads);
+    if (failed) {
+        fprintf(stderr, "%d túneles no recibieron todos los datos\n", failed);
+        return -1;
+    }
+    const double directions = mode == BOTH || mode == HALF_CLOSE ? 2 : 1;
+    return directions * (double)bytes_per_stream * streams / (1024.0 * 1024.0) / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *user = argc > 1 ? argv[1] : "user";
+    const char *pass = argc > 2 ? argv[2] : "pass";
+    int port = argc > 3 ? atoi(argv[3]) : DEFAULT_PROXY_PORT;
+    long mb = argc > 4 ? atol(argv[4]) : DEFAULT_MB;
+    int streams = argc > 5 ? atoi(argv[5]) : DEFAULT_STREAMS;
+    if (port <= 0 || mb <= 0 || streams <= 0) {
+        fprintf(stderr, "Uso: %s [username] [password] [puerto] [MB por sentido] [túneles]\n", argv[0]);
+        return 1;
+    }
+    bytes_per_stream = (uint64_t)mb * 1024 * 1024 / (uint64_t)streams;
+
+    if (start_target() < 0) {
+        return 1;
+    }
+
+    struct sockaddr_in proxy;
+    memset(&proxy, 0, sizeof(proxy));
+    proxy.sin_family = AF_INET;
+    proxy.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &proxy.sin_addr);
+
+    printf("#### Test de Throughput Bidireccional ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d\n", user, pass, PROXY_HOST, port);
+    printf("Túneles: %d, %ld MB por sentido\n\n", streams, mb);
+
+    const double up = run(UPLOAD, &proxy, user, pass, streams);
+    const double down = up < 0 ? -1 : run(DOWNLOAD, &proxy, user, pass, streams);
+    const double both = down < 0 ? -1 : run(BOTH, &proxy, user, pass, streams);
+    if (both < 0) {
+        return 1;
+    }
+    const double half = run(HALF_CLOSE, &proxy, user, pass, streams);
+
+    printf("Solo subida:        %10.1f MB/s\n", up);
+    printf("Solo bajada:        %10.1f MB/s\n", down);
+    printf("Ambos sentidos:     %10.1f MB/s (%.2fx del promedio de un sentido)\n", both, both / ((up + down) / 2));
+    if (half < 0) {
+        printf("Half-close:         ERROR, se perdió la respuesta posterior al EOF\n");
+        return 1;
+    }
+    printf("Half-close:         %10.1f MB/s (respuesta completa tras el EOF)\n", half);
+    return 0;
+}
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Comando BIND de punta a punta. En cada vuelta se pide un BIND esperando al
+ * par 127.0.0.2 y se verifica:
+ *   - la primera respuesta trae el puerto donde escucha el proxy;
+ *   - una conexión desde otra IP (127.0.0.3) se descarta sin segunda respuesta;
+ *   - la conexión desde 127.0.0.2 genera la segunda respuesta con su dirección;
+ *   - lo que el cliente mandó antes de la conexión le llega al par y el
+ *     túnel funciona en los dos sentidos.
+ *
+ * La segunda vuelta deja antes una conexión vieja en el backlog del listener
+ * que se liberó. Con un solo puerto en el rango el proxy tiene que reusar ese
+ * listener y descartarla:
+ *   ./socks5d -u user:pass -b 19000-19000
+ *   ./tests/test_bind user pass 1080 19000
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define EXPECTED_PEER "127.0.0.2"
+#define OTHER_PEER "127.0.0.3"
+#define ROUNDS 2
+/* milisegundos que se espera algo que no debería llegar */
+#define QUIET_MS 300
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("  [%s] %s\n", ok ? "ok" : "FALLA", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 2000) <= 0) return -1;
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+/* true si en QUIET_MS no llega nada por `fd' */
+static int quiet(int fd) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    return poll(&pfd, 1, QUIET_MS) == 0;
+}
+
+/* true si el otro extremo cerró (EOF o RST) */
+static int closed_by_peer(int fd) {
+    unsigned char c;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    return poll(&pfd, 1, 2000) > 0 && read(fd, &c, 1) <= 0;
+}
+
+/* conexión TCP a `port' en loopback saliendo desde la IP `from' */
+static int connect_from(const char *from, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    inet_pton(AF_INET, from, &local.sin_addr);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &addr.sin_addr);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* pide BIND esperando a EXPECTED_PEER; retorna el fd y en `bound_port' BND.PORT */
+static int socks5_bind(uint16_t proxy_port, const char *user, const char *pass, uint16_t *bound_port) {
+    unsigned char buf[600];
+    int fd = connect_from(PROXY_HOST, proxy_port);
+    if (fd < 0) return -1;
+
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    if (write(fd, hello, sizeof(hello)) != sizeof(hello) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    size_t ulen = strlen(user), plen = strlen(pass);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, pass, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    unsigned char req[10] = {0x05, 0x02, 0x00, 0x01};
+    inet_pton(AF_INET, EXPECTED_PEER, req + 4);
+    if (write(fd, req, sizeof(req)) != sizeof(req) || read_full(fd, buf, 10) < 0 ||
+        buf[1] != 0x00 || buf[3] != 0x01) {
+        close(fd);
+        return -1;
+    }
+    *bound_port = (uint16_t)(buf[8] << 8 | buf[9]);
+    return fd;
+}
+
+static void round_trip(uint16_t proxy_port, const char *user, const char *pass,
+                       uint16_t want_port, uint16_t *got_port) {
+    uint16_t port = 0;
+    int client = socks5_bind(proxy_port, user, pass, &port);
+    check(client >= 0, "primera respuesta");
+    if (client < 0) {
+        return;
+    }
+    *got_port = port;
+    printf("  BND.PORT %u\n", port);
+    if (want_port != 0) {
+        check(port == want_port, "listener del rango -b");
+    }
+
+    // antes del par: lo tiene que retener el proxy
+    const char early[] = "antes";
+    check(write(client, early, sizeof(early) - 1) == sizeof(early) - 1, "datos previos a la conexión");
+
+    int other = connect_from(OTHER_PEER, port);
+    check(other >= 0 && closed_by_peer(other), "par distinto de DST.ADDR descartado");
+    check(quiet(client), "sin segunda respuesta por ese par");
+    if (other >= 0) close(other);
+
+    int peer = connect_from(EXPECTED_PEER, port);
+    check(peer >= 0, "conexión desde DST.ADDR");
+    if (peer < 0) {
+        close(client);
+        return;
+    }
+    struct sockaddr_in peer_addr;
+    socklen_t len = sizeof(peer_addr);
+    getsockname(peer, (struct sockaddr *)&peer_addr, &len);
+
+    unsigned char reply[10];
+    const int got = read_full(client, reply, sizeof(reply)) == 0;
+    check(got && reply[1] == 0x00 && reply[3] == 0x01 &&
+          memcmp(reply + 4, &peer_addr.sin_addr, 4) == 0 &&
+          memcmp(reply + 8, &peer_addr.sin_port, 2) == 0, "segunda respuesta con la dirección del par");
+
+    unsigned char buf[64];
+    check(read_full(peer, buf, sizeof(early) - 1) == 0 && memcmp(buf, early, sizeof(early) - 1) == 0,
+          "el par recibe los datos previos");
+
+    const char up[] = "cliente->par", down[] = "par->cliente";
+    check(write(client, up, sizeof(up)) == sizeof(up) &&
+          read_full(peer, buf, sizeof(up)) == 0 && memcmp(buf, up, sizeof(up)) == 0, "relay cliente -> par");
+    check(write(peer, down, sizeof(down)) == sizeof(down) &&
+          read_full(client, buf, sizeof(down)) == 0 && memcmp(buf, down, sizeof(down)) == 0, "relay par -> cliente");
+
+    close(peer);
+    check(closed_by_peer(client), "cierre del par llega al cliente");
+    close(client);
+}
+
+int main(int argc, char *argv[]) {
+    const char *user = argc > 1 ? argv[1] : "user";
+    const char *pass = argc > 2 ? argv[2] : "pass";
+    const int port = argc > 3 ? atoi(argv[3]) : DEFAULT_PROXY_PORT;
+    const int bind_port = argc > 4 ? atoi(argv[4]) : 0;
+    if (port <= 0 || port > 65535 || bind_port < 0 || bind_port > 65535) {
+        fprintf(stderr, "Uso: %s [username] [password] [puerto] [puerto de -b]\n", argv[0]);
+        return 1;
+    }
+
+    printf("#### Test de BIND ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d, par esperado %s\n", user, pass, PROXY_HOST, port, EXPECTED_PEER);
+
+    uint16_t ports[ROUNDS] = {0};
+    for (int i = 0; i < ROUNDS; i++) {
+        printf("\nVuelta %d\n", i + 1);
+        if (i > 0 && bind_port != 0) {
+            // una conexión que queda en el backlog del listener ya liberado
+            int stale = connect_from(EXPECTED_PEER, (uint16_t)bind_port);
+            check(stale >= 0, "conexión vieja en el listener libre");
+            round_trip((uint16_t)port, user, pass, (uint16_t)bind_port, &ports[i]);
+            if (stale >= 0) {
+                check(closed_by_peer(stale), "la conexión vieja se descartó");
+                close(stale);
+            }
+        } else {
+            round_trip((uint16_t)port, user, pass, (uint16_t)bind_port, &ports[i]);
+        }
+    }
+    if (bind_port != 0) {
+        printf("\n");
+        check(ports[0] == ports[ROUNDS - 1], "listener reutilizado entre vueltas");
+    }
+
+    printf("\n%s (%d fallas)\n", failures == 0 ? "OK" : "FALLA", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * Latencia de establecimiento de un CONNECT a través del proxy: desde el
+ * connect(2) del cliente hasta recibir la respuesta al pedido. Con --tfo el
+ * hello viaja en el SYN (MSG_FASTOPEN); combinar con `socks5d -F <cola>' y/o
+ * `-D <segundos>' para comparar contra el listener por defecto.
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define DEFAULT_SAMPLES 2000
+
+static int target_fd = -1;
+static uint16_t target_port = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* destino local: acepta y cierra, solo interesa el establecimiento */
+static void *target_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(target_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static int start_target(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    target_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (target_fd < 0 || bind(target_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(target_fd, 512) < 0 || getsockname(target_fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("target");
+        return -1;
+    }
+    target_port = ntohs(addr.sin_port);
+
+    pthread_t t;
+    return pthread_create(&t, NULL, target_loop, NULL) == 0 ? 0 : -1;
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+static int connect_once(const struct sockaddr_in *proxy, const char *user, const char *pass,
+                        int tfo, double *latency_us) {
+    unsigned char buf[600];
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    double start = now_us();
+
+    if (tfo) {
+#ifdef MSG_FASTOPEN
+        if (sendto(fd, hello, sizeof(hello), MSG_FASTOPEN, (const struct sockaddr *)proxy,
+                   sizeof(*proxy)) != sizeof(hello)) {
+            close(fd);
+            return -1;
+        }
+#else
+        close(fd);
+        return -1;
+#endif
+    } else {
+        if (connect(fd, (const struct sockaddr *)proxy, sizeof(*proxy)) < 0 ||
+            write(fd, hello, sizeof(hello)) != sizeof(hello)) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (read_full(fd, buf, 2) < 0 || buf[0] != 0x05 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    size_t ulen = strlen(user), plen = strlen(pass);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, pass, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    unsigned char req[10] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1,
+                             (unsigned char)(target_port >> 8), (unsigned char)(target_port & 0xFF)};
+    if (write(fd, req, sizeof(req)) != sizeof(req) || read_full(fd, buf, 10) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    *latency_us = now_us() - start;
+    close(fd);
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double diff = *(const double *)a - *(const double *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *user = "user";
+    const char *pass = "pass";
+    int port = DEFAULT_PROXY_PORT;
+    int samples = DEFAULT_SAMPLES;
+    int tfo = 0;
+
+    int pos = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tfo") == 0) {
+            tfo = 1;
+            continue;
+        }
+        switch (pos++) {
+            case 0: user = argv[i]; break;
+            case 1: pass = argv[i]; break;
+            case 2: port = atoi(argv[i]); break;
+            case 3: samples = atoi(argv[i]); break;
+        }
+    }
+    if (samples <= 0) samples = DEFAULT_SAMPLES;
+
+    if (start_target() < 0) {
+        return 1;
+    }
+
+    struct sockaddr_in proxy;
+    memset(&proxy, 0, sizeof(proxy));
+    proxy.sin_family = AF_INET;
+    proxy.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &proxy.sin_addr);
+
+    printf("#### Test de Latencia de CONNECT ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d%s\n", user, pass, PROXY_HOST, port, tfo ? " (TFO)" : "");
+    printf("Muestras: %d\n\n", samples);
+
+    double *lat = malloc(samples * sizeof(double));
+    int ok = 0, failed = 0;
+    double sum = 0;
+
+    for (int i = 0; i < samples; i++) {
+        if (connect_once(&proxy, user, pass, tfo, &lat[ok]) == 0) {
+            sum += lat[ok];
+            ok++;
+        } else {
+            failed++;
+        }
+    }
+
+    if (ok == 0) {
+        printf("Todas las conexiones fallaron\n");
+        free(lat);
+        return 1;
+    }
+
+    qsort(lat, ok, sizeof(double), compare_double);
+    printf("Exitosas: %d  Fallidas: %d\n", ok, failed);
+    printf("Promedio: %.1f us\n", sum / ok);
+    printf("p50:      %.1f us\n", lat[ok / 2]);
+    printf("p90:      %.1f us\n", lat[(int)(ok * 0.90)]);
+    printf("p99:      %.1f us\n", lat[(int)(ok * 0.99)]);
+
+    free(lat);
+    return 0;
+}
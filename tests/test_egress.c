@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Conexiones simultáneas a un mismo destino a través del proxy. Se abren N
+ * túneles contra un destino local y se mantienen abiertos; el destino anota
+ * desde qué IP le llegó cada uno. Con varias direcciones de salida el
+ * proxy debería repartirlos entre ellas y superar el límite de puertos
+ * efímeros de una sola dirección por destino.
+ *
+ * Los túneles hacia el proxy también van todos a un mismo destino, así que
+ * el cliente los reparte entre CLIENT_SOURCES direcciones de loopback para
+ * no ser él quien se quede sin puertos.
+ *
+ * Para ver el límite sin abrir decenas de miles de conexiones se puede
+ * achicar el rango de puertos (como root) y comparar con y sin -s:
+ *   sysctl -w net.ipv4.ip_local_port_range="40000 40099"
+ *   ./socks5d -u user:pass -s 127.0.0.2 -s 127.0.0.3
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define DEFAULT_TUNNELS 1000
+#define MAX_SOURCES 64
+/* direcciones 127.0.1.x desde las que el cliente se conecta al proxy */
+#define CLIENT_SOURCES 8
+
+static int target_fd = -1;
+static uint16_t target_port = 0;
+
+static pthread_mutex_t sources_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct in_addr sources[MAX_SOURCES];
+static int source_conns[MAX_SOURCES];
+static int source_count = 0;
+static int accepted = 0;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void count_source(struct in_addr ip) {
+    pthread_mutex_lock(&sources_lock);
+    accepted++;
+    int i = 0;
+    while (i < source_count && sources[i].s_addr != ip.s_addr) {
+        i++;
+    }
+    if (i == source_count && source_count < MAX_SOURCES) {
+        sources[source_count++] = ip;
+    }
+    if (i < source_count) {
+        source_conns[i]++;
+    }
+    pthread_mutex_unlock(&sources_lock);
+}
+
+/* acepta y deja abiertas las conexiones: cada una ocupa un puerto hasta el final */
+static void *target_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        struct sockaddr_in peer;
+        socklen_t len = sizeof(peer);
+        int fd = accept(target_fd, (struct sockaddr *)&peer, &len);
+        if (fd < 0) {
+            if (errno == EINTR || errno == EMFILE || errno == ENFILE) continue;
+            break;
+        }
+        count_source(peer.sin_addr);
+    }
+    return NULL;
+}
+
+static int start_target(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    target_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (target_fd < 0 || bind(target_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(target_fd, 4096) < 0 || getsockname(target_fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("target");
+        return -1;
+    }
+    target_port = ntohs(addr.sin_port);
+
+    pthread_t t;
+    return pthread_create(&t, NULL, target_loop, NULL) == 0 ? 0 : -1;
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+/* túnel autenticado al destino; -1 y en `reply' la respuesta del proxy si falló */
+static int socks5_open(const struct sockaddr_in *proxy, const char *user, const char *pass, int n, int *reply) {
+    unsigned char buf[600];
+    *reply = -1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    // si el sistema no tiene todo 127/8 en loopback se sale desde cualquiera
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(0x7F000101 + (uint32_t)(n % CLIENT_SOURCES));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &(int){1}, sizeof(int));
+#endif
+    bind(fd, (const struct sockaddr *)&local, sizeof(local));
+
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    if (connect(fd, (const struct sockaddr *)proxy, sizeof(*proxy)) < 0 ||
+        write(fd, hello, sizeof(hello)) != sizeof(hello) ||
+        read_full(fd, buf, 2) < 0 || buf[0] != 0x05 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    size_t ulen = strlen(user), plen = strlen(pass);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, pass, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    unsigned char req[10] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1,
+                             (unsigned char)(target_port >> 8), (unsigned char)(target_port & 0xFF)};
+    if (write(fd, req, sizeof(req)) != sizeof(req) || read_full(fd, buf, 10) < 0 || buf[1] != 0x00) {
+        *reply = buf[1];
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *user = argc > 1 ? argv[1] : "user";
+    const char *pass = argc > 2 ? argv[2] : "pass";
+    int port = argc > 3 ? atoi(argv[3]) : DEFAULT_PROXY_PORT;
+    int tunnels = argc > 4 ? atoi(argv[4]) : DEFAULT_TUNNELS;
+    if (port <= 0 || tunnels <= 0) {
+        fprintf(stderr, "Uso: %s [username] [password] [puerto] [túneles]\n", argv[0]);
+        return 1;
+    }
+
+    // dos fds por túnel (cliente y destino) en este proceso
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    if (start_target() < 0) {
+        return 1;
+    }
+
+    struct sockaddr_in proxy;
+    memset(&proxy, 0, sizeof(proxy));
+    proxy.sin_family = AF_INET;
+    proxy.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &proxy.sin_addr);
+
+    printf("#### Test de Direcciones de Salida ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d\n", user, pass, PROXY_HOST, port);
+    printf("Destino: 127.0.0.1:%u, %d túneles simultáneos\n\n", target_port, tunnels);
+
+    int *fds = malloc((size_t)tunnels * sizeof(*fds));
+    int opened = 0, reply = -1;
+    const double t0 = now_s();
+    while (opened < tunnels) {
+        fds[opened] = socks5_open(&proxy, user, pass, opened, &reply);
+        if (fds[opened] < 0) {
+            break;
+        }
+        opened++;
+    }
+    const double elapsed = now_s() - t0;
+
+    // el último accept puede llegar un poco después de la respuesta del proxy
+    for (int i = 0; i < 100; i++) {
+        pthread_mutex_lock(&sources_lock);
+        const int seen = accepted;
+        pthread_mutex_unlock(&sources_lock);
+        if (seen >= opened) {
+            break;
+        }
+        usleep(10000);
+    }
+
+    printf("Túneles abiertos:   %d de %d en %.2f s\n", opened, tunnels, elapsed);
+    if (opened < tunnels) {
+        if (reply >= 0) {
+            printf("Se cortó con la respuesta SOCKS 0x%02x del proxy\n", reply);
+        } else {
+            printf("Se cortó sin respuesta del proxy (¿límite de fds?)\n");
+        }
+    }
+    printf("\nConexiones por dirección de origen en el destino:\n");
+    pthread_mutex_lock(&sources_lock);
+    for (int i = 0; i < source_count; i++) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &sources[i], ip, sizeof(ip));
+        printf("  %-16s %8d (%.1f%%)\n", ip, source_conns[i], 100.0 * source_conns[i] / accepted);
+    }
+    pthread_mutex_unlock(&sources_lock);
+
+    for (int i = 0; i < opened; i++) {
+        close(fds[i]);
+    }
+    free(fds);
+    return opened == tunnels ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Rechazo de un CONNECT por los límites del usuario. Con un máximo de una
+ * sesión, se abre un túnel a un destino local y se lo mantiene; el segundo
+ * CONNECT tiene que recibir la respuesta 0x02 (no permitido) y el proxy tiene
+ * que cerrar enseguida, sin pasar a copiar: lo que el cliente manda detrás
+ * del pedido no llega a ningún lado y el destino no ve otra conexión.
+ *
+ *   ./socks5d -u user:pass
+ *   ./admin-client -u user -P pass limits user 1 0 0 0
+ *   ./tests/test_limits user pass 1080
+ */
+
+#define PROXY_HOST "127.0.0.1"
+#define DEFAULT_PROXY_PORT 1080
+#define REFUSALS 5
+/* milisegundos que se espera algo que no debería llegar */
+#define QUIET_MS 300
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("  [%s] %s\n", ok ? "ok" : "FALLA", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static int read_full(int fd, unsigned char *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 2000) <= 0) return -1;
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r <= 0) return -1;
+        got += r;
+    }
+    return 0;
+}
+
+/* true si el otro extremo cerró (EOF o RST) sin mandar nada más */
+static int closed_by_peer(int fd) {
+    unsigned char c;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    return poll(&pfd, 1, 2000) > 0 && read(fd, &c, 1) <= 0;
+}
+
+static int listen_local(uint16_t *port) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("destino");
+        exit(1);
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+/*
+ * CONNECT autenticado a 127.0.0.1:`target' con `extra' pegado detrás del
+ * pedido; retorna el fd y en `reply' el código de la respuesta (-1 sin ella).
+ */
+static int socks5_connect(int proxy_port, const char *user, const char *pass, uint16_t target,
+                          const char *extra, int *reply) {
+    unsigned char buf[600];
+    *reply = -1;
+    struct sockaddr_in proxy;
+    memset(&proxy, 0, sizeof(proxy));
+    proxy.sin_family = AF_INET;
+    proxy.sin_port = htons(proxy_port);
+    inet_pton(AF_INET, PROXY_HOST, &proxy.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    const unsigned char hello[] = {0x05, 0x01, 0x02};
+    if (connect(fd, (struct sockaddr *)&proxy, sizeof(proxy)) < 0 ||
+        write(fd, hello, sizeof(hello)) != sizeof(hello) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    size_t ulen = strlen(user), plen = strlen(pass);
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)ulen;
+    memcpy(buf + 2, user, ulen);
+    buf[2 + ulen] = (unsigned char)plen;
+    memcpy(buf + 3 + ulen, pass, plen);
+    if (write(fd, buf, 3 + ulen + plen) != (ssize_t)(3 + ulen + plen) ||
+        read_full(fd, buf, 2) < 0 || buf[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    const unsigned char req[10] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1,
+                                   (unsigned char)(target >> 8), (unsigned char)(target & 0xFF)};
+    memcpy(buf, req, sizeof(req));
+    size_t n = sizeof(req);
+    memcpy(buf + n, extra, strlen(extra));
+    n += strlen(extra);
+    if (write(fd, buf, n) != (ssize_t)n || read_full(fd, buf, 10) < 0) {
+        close(fd);
+        return -1;
+    }
+    *reply = buf[1];
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *user = argc > 1 ? argv[1] : "user";
+    const char *pass = argc > 2 ? argv[2] : "pass";
+    const int port = argc > 3 ? atoi(argv[3]) : DEFAULT_PROXY_PORT;
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "Uso: %s [username] [password] [puerto]\n", argv[0]);
+        return 1;
+    }
+
+    uint16_t target_port;
+    int target = listen_local(&target_port);
+
+    printf("#### Test de rechazo por límites ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d (con límite de 1 sesión)\n\n", user, pass, PROXY_HOST, port);
+
+    int reply;
+    int first = socks5_connect(port, user, pass, target_port, "", &reply);
+    check(first >= 0 && reply == 0x00, "primer túnel");
+    int accepted = accept(target, NULL, NULL);
+    check(accepted >= 0, "el destino recibe el primer túnel");
+
+    for (int i = 0; i < REFUSALS; i++) {
+        int fd = socks5_connect(port, user, pass, target_port, "datos detrás del pedido", &reply);
+        check(fd >= 0 && reply == 0x02, "respuesta 0x02 al CONNECT de más");
+        if (fd >= 0) {
+            check(closed_by_peer(fd), "el proxy cierra después de la respuesta");
+            close(fd);
+        }
+    }
+
+    // ni conexiones nuevas ni los datos de los rechazados
+    struct pollfd pfd[2] = {{.fd = target, .events = POLLIN}, {.fd = accepted, .events = POLLIN}};
+    check(poll(pfd, 2, QUIET_MS) == 0, "nada llega al destino por los rechazados");
+
+    // el túnel admitido sigue andando
+    unsigned char buf[8];
+    check(first >= 0 && accepted >= 0 && write(first, "hola", 4) == 4 &&
+          read_full(accepted, buf, 4) == 0 && memcmp(buf, "hola", 4) == 0, "el primer túnel sigue abierto");
+
+    if (first >= 0) close(first);
+    if (accepted >= 0) close(accepted);
+    close(target);
+
+    printf("\n%s (%d fallas)\n", failures == 0 ? "OK" : "FALLA", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/utils/linescan.h"
+
+#define CAPTURE_SIZE (16 * 1024 * 1024)
+#define ROUNDS 20
+
+static double get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* captura sintética: líneas de texto de largo aleatorio en [min_len, max_len] */
+static uint8_t *build_capture(size_t size, size_t min_len, size_t max_len, size_t *lines) {
+    uint8_t *buf = malloc(size);
+    if (buf == NULL) {
+        return NULL;
+    }
+    size_t pos = 0;
+    *lines = 0;
+    while (pos < size) {
+        size_t len = min_len + (size_t)rand() % (max_len - min_len + 1);
+        for (size_t i = 0; i < len && pos < size; i++) {
+            buf[pos++] = (uint8_t)(' ' + rand() % 94);
+        }
+        if (pos + 2 <= size) {
+            buf[pos++] = '\r';
+            buf[pos++] = '\n';
+            (*lines)++;
+        } else {
+            while (pos < size) {
+                buf[pos++] = 'x';
+            }
+        }
+    }
+    return buf;
+}
+
+/* recorre la captura en trozos como los que entrega recv(2) */
+static size_t count_lines(int impl, const uint8_t *buf, size_t size, size_t chunk) {
+    size_t lines = 0;
+    for (size_t off = 0; off < size; off += chunk) {
+        const uint8_t *p = buf + off;
+        size_t n = size - off < chunk ? size - off : chunk;
+        size_t i = 0;
+        while (i < n) {
+            size_t eol;
+            if (impl < 0) {
+                const uint8_t *m = memchr(p + i, '\n', n - i);
+                eol = m == NULL ? n : (size_t)(m - p);
+            } else {
+                eol = i + linescan_eol_with((enum linescan_impl)impl, p + i, n - i);
+            }
+            if (eol == n) {
+                break;
+            }
+            lines++;
+            i = eol + 1;
+        }
+    }
+    return lines;
+}
+
+static void bench(const char *name, int impl, const uint8_t *buf, size_t size, size_t expected) {
+    const size_t chunk = 4096;
+    if (count_lines(impl, buf, size, chunk) != expected) {
+        printf("  %-10s ERROR: cantidad de líneas inesperada\n", name);
+        exit(1);
+    }
+
+    volatile size_t sink = 0;
+    double start = get_time_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        sink += count_lines(impl, buf, size, chunk);
+    }
+    double elapsed = get_time_ns() - start;
+    (void)sink;
+
+    printf("  %-10s %10.1f MB/s\n", name, (size * (double)ROUNDS) / (elapsed / 1e9) / 1e6);
+}
+
+static void run(const char *title, size_t min_len, size_t max_len) {
+    size_t lines;
+    uint8_t *buf = build_capture(CAPTURE_SIZE, min_len, max_len, &lines);
+    if (buf == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    printf("%s (%zu líneas)\n", title, lines);
+    for (int impl = LINESCAN_SCALAR; impl <= LINESCAN_AVX2; impl++) {
+        if (linescan_supported((enum linescan_impl)impl)) {
+            bench(linescan_impl_name((enum linescan_impl)impl), impl, buf, CAPTURE_SIZE, lines);
+        } else {
+            printf("  %-10s no soportado por esta CPU\n", linescan_impl_name((enum linescan_impl)impl));
+        }
+    }
+    bench("memchr", -1, buf, CAPTURE_SIZE, lines);
+    free(buf);
+}
+
+int main(void) {
+    srand(42);
+
+    printf("\n#### Benchmark de búsqueda de fin de línea ####\n");
+    printf("Captura: %d MB, %d pasadas, trozos de 4096 bytes\n", CAPTURE_SIZE / (1024 * 1024), ROUNDS);
+    printf("Implementación elegida: %s\n\n", linescan_impl_name(linescan_best()));
+
+    run("Comandos cortos (6-40 bytes)", 6, 40);
+    run("Cuerpo de mail (40-120 bytes)", 40, 120);
+    run("Líneas largas (1-8 KB)", 1024, 8192);
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/utils/buffer.h"
+#include "../src/socks5/handshake.h"
+#include "../src/socks5/request.h"
+#include "../src/auth/auth.h"
+
+#define ITERATIONS 2000000
+
+typedef int (*parse_fn)(const uint8_t *msg, size_t len, size_t chunk);
+
+static double get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Parser byte a byte previo a las tablas declarativas. Se conserva acá
+ * como referencia para comparar.
+ */
+struct legacy_request_parser {
+    int state;
+    uint8_t address_type;
+    uint8_t dst_addr[256];
+    uint8_t dst_addr_length;
+    uint16_t dst_port;
+    uint8_t bytes_read;
+};
+
+enum { L_VERSION, L_CMD, L_RSV, L_ATYP, L_DSTADDR, L_DSTPORT, L_DONE, L_ERROR };
+
+static int legacy_request_consume(struct legacy_request_parser *p, buffer *b) {
+    while (buffer_can_read(b) && p->state != L_DONE && p->state != L_ERROR) {
+        uint8_t c = buffer_read(b);
+        switch (p->state) {
+            case L_VERSION:
+                p->state = (c == 0x05) ? L_CMD : L_ERROR;
+                break;
+            case L_CMD:
+                p->state = (c == REQUEST_COMMAND_CONNECT) ? L_RSV : L_ERROR;
+                break;
+            case L_RSV:
+                p->state = (c == 0x00) ? L_ATYP : L_ERROR;
+                break;
+            case L_ATYP:
+                p->address_type = c;
+                p->bytes_read = 0;
+                if (c == ADDRESS_TYPE_IPV4) {
+                    p->dst_addr_length = IPV4_LENGTH;
+                } else if (c == ADDRESS_TYPE_IPV6) {
+                    p->dst_addr_length = IPV6_LENGTH;
+                } else if (c != ADDRESS_TYPE_DOMAIN) {
+                    p->state = L_ERROR;
+                    break;
+                }
+                p->state = L_DSTADDR;
+                break;
+            case L_DSTADDR:
+                if (p->address_type == ADDRESS_TYPE_DOMAIN && p->bytes_read == 0) {
+                    p->dst_addr_length = c;
+                    p->bytes_read++;
+                } else {
+                    size_t index = p->bytes_read - (p->address_type == ADDRESS_TYPE_DOMAIN ? 1 : 0);
+                    p->dst_addr[index] = c;
+                    p->bytes_read++;
+                    if ((p->address_type == ADDRESS_TYPE_DOMAIN && p->bytes_read == p->dst_addr_length + 1) ||
+                        (p->address_type != ADDRESS_TYPE_DOMAIN && p->bytes_read == p->dst_addr_length)) {
+                        p->dst_addr[p->dst_addr_length] = '\0';
+                        p->bytes_read = 0;
+                        p->state = L_DSTPORT;
+                    }
+                }
+                break;
+            case L_DSTPORT:
+                p->dst_port = (p->dst_port << 8) | c;
+                if (++p->bytes_read == 2) {
+                    p->state = L_DONE;
+                }
+                break;
+        }
+    }
+    return p->state;
+}
+
+/* alimenta el mensaje en trozos de `chunk' bytes, como llegaría de varios recv */
+static int run_legacy_request(const uint8_t *msg, size_t len, size_t chunk) {
+    uint8_t raw[512];
+    buffer b;
+    buffer_init(&b, sizeof(raw), raw);
+    struct legacy_request_parser p;
+    memset(&p, 0, sizeof(p));
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t wlimit;
+        uint8_t *w = buffer_write_ptr(&b, &wlimit);
+        memcpy(w, msg + off, n);
+        buffer_write_adv(&b, n);
+        legacy_request_consume(&p, &b);
+    }
+    return p.state == L_DONE ? p.dst_port : -1;
+}
+
+static int run_request(const uint8_t *msg, size_t len, size_t chunk) {
+    uint8_t raw[512];
+    buffer b;
+    buffer_init(&b, sizeof(raw), raw);
+    struct request_parser p;
+    request_parser_init(&p);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t wlimit;
+        uint8_t *w = buffer_write_ptr(&b, &wlimit);
+        memcpy(w, msg + off, n);
+        buffer_write_adv(&b, n);
+        request_parser_consume(&p, &b);
+    }
+    return p.state == REQUEST_DONE ? p.dst_port : -1;
+}
+
+static int run_hello(const uint8_t *msg, size_t len, size_t chunk) {
+    uint8_t raw[512];
+    buffer b;
+    buffer_init(&b, sizeof(raw), raw);
+    struct hello_parser p;
+    hello_parser_init(&p);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t wlimit;
+        uint8_t *w = buffer_write_ptr(&b, &wlimit);
+        memcpy(w, msg + off, n);
+        buffer_write_adv(&b, n);
+        hello_process(&p, &b);
+    }
+    return p.state == HELLO_DONE ? p.method : -1;
+}
+
+static int run_auth(const uint8_t *msg, size_t len, size_t chunk) {
+    uint8_t raw[1024];
+    buffer b;
+    buffer_init(&b, sizeof(raw), raw);
+    struct auth_parser p;
+    auth_parser_init(&p);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        size_t wlimit;
+        uint8_t *w = buffer_write_ptr(&b, &wlimit);
+        memcpy(w, msg + off, n);
+        buffer_write_adv(&b, n);
+        auth_parser_consume(&p, &b);
+    }
+    return p.state == AUTH_DONE ? p.plen : -1;
+}
+
+static void bench(const char *name, parse_fn fn, const uint8_t *msg, size_t len, size_t chunk, int expected) {
+    if (fn(msg, len, chunk) != expected) {
+        printf("  %-28s ERROR: resultado inesperado\n", name);
+        exit(1);
+    }
+
+    volatile int sink = 0;
+    double start = get_time_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += fn(msg, len, chunk);
+    }
+    double elapsed = get_time_ns() - start;
+    (void)sink;
+
+    printf("  %-28s chunk=%-4zu %8.1f ns/msg %10.1f MB/s\n", name, chunk,
+           elapsed / ITERATIONS, (len * (double)ITERATIONS) / (elapsed / 1e9) / 1e6);
+}
+
+int main(void) {
+    const uint8_t hello[] = {0x05, 0x03, 0x00, 0x01, 0x02};
+
+    const uint8_t req_ipv4[] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1, 0x1F, 0x90};
+
+    const uint8_t req_ipv6[] = {0x05, 0x01, 0x00, 0x04,
+                                0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+                                0x01, 0xBB};
+
+    uint8_t req_fqdn[300];
+    const char *host = "a-fairly-long-hostname.subdomain.example.com";
+    size_t hlen = strlen(host);
+    size_t fqdn_len = 0;
+    req_fqdn[fqdn_len++] = 0x05;
+    req_fqdn[fqdn_len++] = 0x01;
+    req_fqdn[fqdn_len++] = 0x00;
+    req_fqdn[fqdn_len++] = 0x03;
+    req_fqdn[fqdn_len++] = (uint8_t)hlen;
+    memcpy(req_fqdn + fqdn_len, host, hlen);
+    fqdn_len += hlen;
+    req_fqdn[fqdn_len++] = 0x00;
+    req_fqdn[fqdn_len++] = 0x50;
+
+    uint8_t auth[600];
+    size_t auth_len = 0;
+    const char *user = "someuser";
+    const char *pass = "a-reasonably-long-password";
+    auth[auth_len++] = 0x01;
+    auth[auth_len++] = (uint8_t)strlen(user);
+    memcpy(auth + auth_len, user, strlen(user));
+    auth_len += strlen(user);
+    auth[auth_len++] = (uint8_t)strlen(pass);
+    memcpy(auth + auth_len, pass, strlen(pass));
+    auth_len += strlen(pass);
+
+    printf("\n#### Microbenchmark de parsers SOCKS5 ####\n");
+    printf("Iteraciones: %d\n\n", ITERATIONS);
+
+    printf("HELLO\n");
+    bench("tabla", run_hello, hello, sizeof(hello), sizeof(hello), 0x02);
+    bench("tabla (1 byte por recv)", run_hello, hello, sizeof(hello), 1, 0x02);
+
+    printf("AUTH (RFC 1929)\n");
+    bench("tabla", run_auth, auth, auth_len, auth_len, (int)strlen(pass));
+    bench("tabla (1 byte por recv)", run_auth, auth, auth_len, 1, (int)strlen(pass));
+
+    printf("REQUEST IPv4\n");
+    bench("tabla", run_request, req_ipv4, sizeof(req_ipv4), sizeof(req_ipv4), 8080);
+    bench("byte a byte", run_legacy_request, req_ipv4, sizeof(req_ipv4), sizeof(req_ipv4), 8080);
+
+    printf("REQUEST IPv6\n");
+    bench("tabla", run_request, req_ipv6, sizeof(req_ipv6), sizeof(req_ipv6), 443);
+    bench("byte a byte", run_legacy_request, req_ipv6, sizeof(req_ipv6), sizeof(req_ipv6), 443);
+
+    printf("REQUEST FQDN\n");
+    bench("tabla", run_request, req_fqdn, fqdn_len, fqdn_len, 80);
+    bench("byte a byte", run_legacy_request, req_fqdn, fqdn_len, fqdn_len, 80);
+    bench("tabla (1 byte por recv)", run_request, req_fqdn, fqdn_len, 1, 80);
+    bench("byte a byte (1 byte por recv)", run_legacy_request, req_fqdn, fqdn_len, 1, 80);
+
+    return 0;
+}
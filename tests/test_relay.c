@@ -0,0 +1,285 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../src/utils/selector.h"
+#include "../src/utils/buffer.h"
+
+/*
+ * Relay en proceso con el selector del servidor: cada flujo es un productor
+ * que escribe en una conexión TCP por loopback, el relay que copia a otra
+ * conexión con la misma lógica de copy.c (un buffer por sentido, interés
+ * según haya lugar o datos) y un consumidor que lee y descarta.
+ *
+ * Por mecanismo reporta throughput, syscalls por GiB (recv/send del relay
+ * más las del selector) y CPU del hilo del relay por GiB.
+ */
+
+#define DEFAULT_STREAMS 8
+#define DEFAULT_MB 1024
+#define RELAY_BUFFER (16 * 1024)
+#define CHUNK (64 * 1024)
+
+struct stream {
+    int in;
+    int out;
+    buffer buf;
+    uint8_t raw[RELAY_BUFFER];
+    bool eof;
+    bool closed;
+};
+
+static uint64_t relay_syscalls;
+static int streams_done;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_s(void) {
+    struct rusage ru;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &ru);
+#else
+    getrusage(RUSAGE_SELF, &ru);
+#endif
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void update_interest(fd_selector s, struct stream *st) {
+    if (st->closed) {
+        return;
+    }
+    selector_set_interest(s, st->in, !st->eof && buffer_can_write(&st->buf) ? OP_READ : OP_NOOP);
+    selector_set_interest(s, st->out, buffer_can_read(&st->buf) ? OP_WRITE : OP_NOOP);
+}
+
+static void stream_finish(fd_selector s, struct stream *st) {
+    st->closed = true;
+    selector_unregister_fd(s, st->in);
+    selector_unregister_fd(s, st->out);
+    close(st->in);
+    close(st->out);
+    streams_done++;
+}
+
+static void relay_read(struct selector_key *key) {
+    struct stream *st = key->data;
+    size_t n;
+    uint8_t *p = buffer_write_ptr(&st->buf, &n);
+    relay_syscalls++;
+    ssize_t r = recv(key->fd, p, n, 0);
+    if (r > 0) {
+        buffer_write_adv(&st->buf, r);
+    } else if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        st->eof = true;
+        if (!buffer_can_read(&st->buf)) {
+            stream_finish(key->s, st);
+            return;
+        }
+    }
+    update_interest(key->s, st);
+}
+
+static void relay_write(struct selector_key *key) {
+    struct stream *st = key->data;
+    size_t n;
+    uint8_t *p = buffer_read_ptr(&st->buf, &n);
+    relay_syscalls++;
+    ssize_t w = send(key->fd, p, n, MSG_NOSIGNAL);
+    if (w > 0) {
+        buffer_read_adv(&st->buf, w);
+    } else if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        stream_finish(key->s, st);
+        return;
+    }
+    if (st->eof && !buffer_can_read(&st->buf)) {
+        stream_finish(key->s, st);
+        return;
+    }
+    update_interest(key->s, st);
+}
+
+static const struct fd_handler relay_handler = {
+    .handle_read  = relay_read,
+    .handle_write = relay_write,
+};
+
+struct endpoint {
+    int fd;
+    uint64_t bytes;
+};
+
+static void *producer(void *arg) {
+    struct endpoint *e = arg;
+    uint8_t *chunk = calloc(1, CHUNK);
+    uint64_t left = e->bytes;
+    while (left > 0) {
+        ssize_t w = send(e->fd, chunk, left < CHUNK ? left : CHUNK, MSG_NOSIGNAL);
+        if (w <= 0) {
+            break;
+        }
+        left -= (uint64_t)w;
+    }
+    free(chunk);
+    shutdown(e->fd, SHUT_WR);
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    struct endpoint *e = arg;
+    uint8_t *chunk = malloc(CHUNK);
+    ssize_t r;
+    e->bytes = 0;
+    while ((r = recv(e->fd, chunk, CHUNK, 0)) > 0) {
+        e->bytes += (uint64_t)r;
+    }
+    free(chunk);
+    return NULL;
+}
+
+/* par de sockets TCP conectados por loopback */
+static int tcp_pair(int listener, const struct sockaddr_in *addr, int out[2]) {
+    out[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (out[0] < 0 || connect(out[0], (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        return -1;
+    }
+    out[1] = accept(listener, NULL, NULL);
+    return out[1] < 0 ? -1 : 0;
+}
+
+static int run(enum selector_engine engine, int streams, uint64_t bytes_per_stream) {
+    const struct selector_init conf = {
+        .signal = SIGALRM,
+        .select_timeout = {.tv_sec = 1},
+        .engine = engine,
+    };
+    if (selector_init(&conf) != SELECTOR_SUCCESS) {
+        return -1;
+    }
+    fd_selector s = selector_new(1024);
+    if (s == NULL) {
+        return -1;
+    }
+    if (selector_get_engine(s) != engine) {
+        printf("  %-10s no soportado por este kernel\n", selector_engine_name(engine));
+        selector_destroy(s);
+        return 0;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, streams * 2) < 0
+        || getsockname(listener, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+    struct stream *st = calloc((size_t)streams, sizeof(*st));
+    struct endpoint *prod = calloc((size_t)streams, sizeof(*prod));
+    struct endpoint *cons = calloc((size_t)streams, sizeof(*cons));
+    pthread_t *threads = calloc((size_t)streams * 2, sizeof(*threads));
+    for (int i = 0; i < streams; i++) {
+        int a[2], b[2];
+        if (tcp_pair(listener, &addr, a) < 0 || tcp_pair(listener, &addr, b) < 0) {
+            perror("connect");
+            return -1;
+        }
+        // a[0] productor -> a[1] relay -> b[0] relay -> b[1] consumidor
+        st[i].in = a[1];
+        st[i].out = b[0];
+        buffer_init(&st[i].buf, sizeof(st[i].raw), st[i].raw);
+        selector_fd_set_nio(st[i].in);
+        selector_fd_set_nio(st[i].out);
+        selector_register(s, st[i].in, &relay_handler, OP_READ, &st[i]);
+        selector_register(s, st[i].out, &relay_handler, OP_NOOP, &st[i]);
+        prod[i] = (struct endpoint){.fd = a[0], .bytes = bytes_per_stream};
+        cons[i] = (struct endpoint){.fd = b[1]};
+    }
+    close(listener);
+
+    relay_syscalls = 0;
+    streams_done = 0;
+    for (int i = 0; i < streams; i++) {
+        pthread_create(&threads[2 * i], NULL, producer, &prod[i]);
+        pthread_create(&threads[2 * i + 1], NULL, consumer, &cons[i]);
+    }
+
+    const double cpu0 = thread_cpu_s();
+    const double t0 = now_s();
+    while (streams_done < streams) {
+        if (selector_select(s) != SELECTOR_SUCCESS) {
+            perror("selector_select");
+            return -1;
+        }
+    }
+    const double elapsed = now_s() - t0;
+    const double cpu = thread_cpu_s() - cpu0;
+
+    uint64_t total = 0;
+    for (int i = 0; i < streams; i++) {
+        pthread_join(threads[2 * i], NULL);
+        pthread_join(threads[2 * i + 1], NULL);
+        close(prod[i].fd);
+        close(cons[i].fd);
+        total += cons[i].bytes;
+    }
+    if (total != bytes_per_stream * (uint64_t)streams) {
+        printf("  %-10s ERROR: se relayaron %llu bytes de %llu\n", selector_engine_name(engine),
+               (unsigned long long)total, (unsigned long long)(bytes_per_stream * (uint64_t)streams));
+        return -1;
+    }
+
+    const double gib = total / (1024.0 * 1024.0 * 1024.0);
+    const uint64_t selector_calls = selector_syscalls(s);
+    printf("  %-10s %8.2f GiB/s %12.0f %12.0f %10.3f s\n", selector_engine_name(engine), gib / elapsed,
+           (relay_syscalls + selector_calls) / gib, selector_calls / gib, cpu / gib);
+
+    selector_destroy(s);
+    free(st);
+    free(prod);
+    free(cons);
+    free(threads);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int streams = argc > 1 ? atoi(argv[1]) : DEFAULT_STREAMS;
+    long mb = argc > 2 ? atol(argv[2]) : DEFAULT_MB;
+    if (streams <= 0 || mb <= 0) {
+        fprintf(stderr, "Uso: %s [flujos] [MB totales]\n", argv[0]);
+        return 1;
+    }
+    const uint64_t per_stream = (uint64_t)mb * 1024 * 1024 / (uint64_t)streams;
+
+    printf("\n#### Relay por loopback: %d flujos, %ld MB, buffer de %d KB ####\n", streams, mb, RELAY_BUFFER / 1024);
+    printf("  %-10s %13s %12s %12s %12s\n", "mecanismo", "throughput", "syscalls/GiB", "selector/GiB", "CPU/GiB");
+
+    const enum selector_engine engines[] = {
+        SELECTOR_ENGINE_SELECT, SELECTOR_ENGINE_EPOLL, SELECTOR_ENGINE_IO_URING,
+    };
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (run(engines[i], streams, per_stream) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
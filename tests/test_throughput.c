@@ -10,11 +10,14 @@
 #include <errno.h>
 #include <semaphore.h>
 #include <time.h>
+#include <stdint.h>
 
 #define PROXY_HOST "127.0.0.1"
 #define PROXY_PORT 1080
 #define MAX_CONCURRENT_THREADS 50
 #define RAMP_UP_DELAY_MS 10
+#define BULK_DEFAULT_MB 512
+#define BULK_CHUNK (256 * 1024)
 
 typedef struct {
     const char *username;
@@ -34,7 +37,8 @@ double get_time_ms() {
     return (tv.tv_sec) * 1000.0 + (tv.tv_usec) / 1000.0;
 }
 
-int socks5_connect(const char *username, const char *password, const char *target_host, int target_port) {
+/* túnel abierto hacia target_host (o 127.0.0.1 si es NULL); -1 si falla */
+int socks5_open(const char *username, const char *password, const char *target_host, int target_port) {
     int fd;
     struct sockaddr_in addr;
     unsigned char buffer[512];
@@ -100,15 +104,24 @@ int socks5_connect(const char *username, const char *password, const char *targe
     buffer[0] = 0x05;
     buffer[1] = 0x01;
     buffer[2] = 0x00;
-    buffer[3] = 0x03;
     
-    int target_len = strlen(target_host);
-    buffer[4] = (unsigned char)target_len;
-    memcpy(buffer + 5, target_host, target_len);
-    buffer[5 + target_len] = (target_port >> 8) & 0xFF;
-    buffer[6 + target_len] = target_port & 0xFF;
+    int request_len;
+    if (target_host != NULL) {
+        int target_len = strlen(target_host);
+        buffer[3] = 0x03;
+        buffer[4] = (unsigned char)target_len;
+        memcpy(buffer + 5, target_host, target_len);
+        request_len = 5 + target_len;
+    } else {
+        buffer[3] = 0x01;
+        inet_pton(AF_INET, "127.0.0.1", buffer + 4);
+        request_len = 8;
+    }
+    buffer[request_len] = (target_port >> 8) & 0xFF;
+    buffer[request_len + 1] = target_port & 0xFF;
+    request_len += 2;
     
-    if (write(fd, buffer, 7 + target_len) != (7 + target_len)) {
+    if (write(fd, buffer, request_len) != request_len) {
         close(fd);
         return -1;
     }
@@ -119,6 +132,17 @@ int socks5_connect(const char *username, const char *password, const char *targe
         return -1;
     }
     
+    return fd;
+}
+
+int socks5_connect(const char *username, const char *password, const char *target_host, int target_port) {
+    unsigned char buffer[512];
+    ssize_t n;
+    int fd = socks5_open(username, password, target_host, target_port);
+    if (fd < 0) {
+        return -1;
+    }
+    
     char http_request[256];
     snprintf(http_request, sizeof(http_request), 
              "GET / HTTP/1.0\r\nHost: %s\r\n\r\n", target_host);
@@ -219,13 +243,148 @@ void run_test(int num_connections, const char *username, const char *password) {
     sleep(2);
 }
 
+/*
+ * Modo --bulk: descargas masivas desde un destino local a través del proxy,
+ * con 1, 4 y 16 túneles a la vez. Muestra el efecto del tamaño de los
+ * buffers del túnel: comparar contra el servidor con `-S 2' (sin crecer) y
+ * ver la distribución de tamaños con el comando `metrics' del admin-client.
+ */
+
+static int bulk_target_fd = -1;
+static int bulk_target_port = 0;
+static uint64_t bulk_bytes = 0;
+
+static void *bulk_sender(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    char *chunk = calloc(1, BULK_CHUNK);
+    uint64_t left = bulk_bytes;
+    while (left > 0) {
+        ssize_t w = send(fd, chunk, left < BULK_CHUNK ? left : BULK_CHUNK, MSG_NOSIGNAL);
+        if (w <= 0) break;
+        left -= (uint64_t)w;
+    }
+    free(chunk);
+    close(fd);
+    return NULL;
+}
+
+static void *bulk_target_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(bulk_target_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        pthread_t t;
+        if (pthread_create(&t, NULL, bulk_sender, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(t);
+        } else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int bulk_start_target(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bulk_target_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bulk_target_fd < 0 || bind(bulk_target_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(bulk_target_fd, 64) < 0 || getsockname(bulk_target_fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("target");
+        return -1;
+    }
+    bulk_target_port = ntohs(addr.sin_port);
+    pthread_t t;
+    return pthread_create(&t, NULL, bulk_target_loop, NULL) == 0 ? 0 : -1;
+}
+
+typedef struct {
+    const char *username;
+    const char *password;
+    uint64_t received;
+} bulk_data_t;
+
+static void *bulk_thread(void *arg) {
+    bulk_data_t *data = arg;
+    data->received = 0;
+    // el pedido va por IPv4 a 127.0.0.1 y puerto del destino local
+    int fd = socks5_open(data->username, data->password, NULL, bulk_target_port);
+    if (fd < 0) {
+        return NULL;
+    }
+    char *chunk = malloc(BULK_CHUNK);
+    ssize_t r;
+    while ((r = recv(fd, chunk, BULK_CHUNK, 0)) > 0) {
+        data->received += (uint64_t)r;
+    }
+    free(chunk);
+    close(fd);
+    return NULL;
+}
+
+static int run_bulk(const char *username, const char *password, long mb) {
+    if (bulk_start_target() < 0) {
+        return 1;
+    }
+    printf("\n#### Test de Throughput de Descargas Masivas ####\n");
+    printf("Servidor: socks5://%s:%s@%s:%d\n", username, password, PROXY_HOST, PROXY_PORT);
+    printf("Destino local: 127.0.0.1:%d, %ld MB en total por corrida\n\n", bulk_target_port, mb);
+    printf("%-10s %-12s %-14s\n", "Túneles", "Tiempo(s)", "Throughput");
+
+    const int tunnels[] = {1, 4, 16};
+    for (size_t i = 0; i < sizeof(tunnels) / sizeof(tunnels[0]); i++) {
+        const int n = tunnels[i];
+        bulk_bytes = (uint64_t)mb * 1024 * 1024 / (uint64_t)n;
+        pthread_t threads[16];
+        bulk_data_t data[16];
+        double start = get_time_ms();
+        for (int t = 0; t < n; t++) {
+            data[t] = (bulk_data_t){.username = username, .password = password};
+            pthread_create(&threads[t], NULL, bulk_thread, &data[t]);
+        }
+        uint64_t total = 0;
+        for (int t = 0; t < n; t++) {
+            pthread_join(threads[t], NULL);
+            total += data[t].received;
+        }
+        double elapsed = (get_time_ms() - start) / 1000.0;
+        if (total != bulk_bytes * (uint64_t)n) {
+            printf("%-10d ERROR: llegaron %llu de %llu bytes\n", n, (unsigned long long)total,
+                   (unsigned long long)(bulk_bytes * (uint64_t)n));
+            return 1;
+        }
+        printf("%-10d %-12.2f %8.1f MB/s\n", n, elapsed, total / (1024.0 * 1024.0) / elapsed);
+    }
+    printf("\nComparar contra el servidor con `-S 2' (buffers fijos de 2 KiB).\n");
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     const char *username = "user";
     const char *password = "pass";
-    
-    if (argc >= 3) {
-        username = argv[1];
-        password = argv[2];
+    int bulk = 0;
+    long mb = BULK_DEFAULT_MB;
+
+    // --bulk puede ir en cualquier posición; el resto es posicional
+    int pos = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bulk") == 0) {
+            bulk = 1;
+            continue;
+        }
+        switch (pos++) {
+            case 0: username = argv[i]; break;
+            case 1: password = argv[i]; break;
+            case 2: mb = atol(argv[i]); break;
+        }
+    }
+    if (bulk) {
+        return run_bulk(username, password, mb > 0 ? mb : BULK_DEFAULT_MB);
     }
     
     printf("\n#### Test de Throughput vs Conexiones Concurrentes ####\n");
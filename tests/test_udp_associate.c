@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#define PROXY_HOST "127.0.0.1"
+#define PROXY_PORT 1080
+#define DURATION_S 5
+#define PAYLOAD_SIZE 64
+#define BATCH 32
+#define WINDOW 256
+
+static volatile int running = 1;
+
+static double get_time_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* servidor de eco UDP local, también por lotes */
+static void *echo_server(void *arg) {
+    int fd = *(int *)arg;
+    static uint8_t bufs[BATCH][2048];
+    struct sockaddr_in peers[BATCH];
+    struct iovec iovs[BATCH];
+    struct mmsghdr msgs[BATCH];
+
+    while (running) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < BATCH; i++) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = sizeof(bufs[i]);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            iovs[i].iov_len = msgs[i].msg_len;
+        }
+        sendmmsg(fd, msgs, n, 0);
+    }
+    return NULL;
+}
+
+static int socks5_udp_associate(const char *username, const char *password, int port,
+                                struct sockaddr_in *relay) {
+    unsigned char buffer[512];
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, PROXY_HOST, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    buffer[0] = 0x05;
+    buffer[1] = 0x01;
+    buffer[2] = 0x02;
+    if (write(fd, buffer, 3) != 3 || read(fd, buffer, 2) != 2 || buffer[1] != 0x02) {
+        close(fd);
+        return -1;
+    }
+
+    int ulen = strlen(username);
+    int plen = strlen(password);
+    buffer[0] = 0x01;
+    buffer[1] = (unsigned char)ulen;
+    memcpy(buffer + 2, username, ulen);
+    buffer[2 + ulen] = (unsigned char)plen;
+    memcpy(buffer + 3 + ulen, password, plen);
+    if (write(fd, buffer, 3 + ulen + plen) != 3 + ulen + plen || read(fd, buffer, 2) != 2 || buffer[1] != 0x00) {
+        close(fd);
+        return -1;
+    }
+
+    const unsigned char req[] = {0x05, 0x03, 0x00, 0x01, 0, 0, 0, 0, 0, 0};
+    if (write(fd, req, sizeof(req)) != sizeof(req)) {
+        close(fd);
+        return -1;
+    }
+    if (read(fd, buffer, 10) != 10 || buffer[1] != 0x00 || buffer[3] != 0x01) {
+        close(fd);
+        return -1;
+    }
+
+    memset(relay, 0, sizeof(*relay));
+    relay->sin_family = AF_INET;
+    memcpy(&relay->sin_addr, buffer + 4, 4);
+    memcpy(&relay->sin_port, buffer + 8, 2);
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *username = argc > 1 ? argv[1] : "admin";
+    const char *password = argc > 2 ? argv[2] : "1234";
+    int proxy_port = argc > 3 ? atoi(argv[3]) : PROXY_PORT;
+
+    printf("\n#### Test de UDP ASSOCIATE (eco local) ####\n");
+
+    int echo_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in echo_addr;
+    socklen_t echo_len = sizeof(echo_addr);
+    memset(&echo_addr, 0, sizeof(echo_addr));
+    echo_addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &echo_addr.sin_addr);
+    if (bind(echo_fd, (struct sockaddr *)&echo_addr, sizeof(echo_addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    getsockname(echo_fd, (struct sockaddr *)&echo_addr, &echo_len);
+
+    pthread_t echo_thread;
+    pthread_create(&echo_thread, NULL, echo_server, &echo_fd);
+
+    struct sockaddr_in relay;
+    int control = socks5_udp_associate(username, password, proxy_port, &relay);
+    if (control < 0) {
+        fprintf(stderr, "No se pudo establecer la asociación UDP con %s:%d\n", PROXY_HOST, proxy_port);
+        running = 0;
+        pthread_join(echo_thread, NULL);
+        return 1;
+    }
+
+    char relay_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &relay.sin_addr, relay_str, sizeof(relay_str));
+    printf("Relay UDP: %s:%d, eco en 127.0.0.1:%d\n", relay_str, ntohs(relay.sin_port), ntohs(echo_addr.sin_port));
+    printf("Payload: %d bytes, lotes de %d, ventana de %d datagramas, %d s\n\n",
+           PAYLOAD_SIZE, BATCH, WINDOW, DURATION_S);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    connect(fd, (struct sockaddr *)&relay, sizeof(relay));
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    /* datagrama con header RFC 1928 hacia el eco */
+    uint8_t datagram[10 + PAYLOAD_SIZE];
+    datagram[0] = 0x00;
+    datagram[1] = 0x00;
+    datagram[2] = 0x00;
+    datagram[3] = 0x01;
+    memcpy(datagram + 4, &echo_addr.sin_addr, 4);
+    memcpy(datagram + 8, &echo_addr.sin_port, 2);
+    memset(datagram + 10, 'x', PAYLOAD_SIZE);
+
+    struct iovec out_iov = {.iov_base = datagram, .iov_len = sizeof(datagram)};
+    struct mmsghdr out[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        memset(&out[i], 0, sizeof(out[i]));
+        out[i].msg_hdr.msg_iov = &out_iov;
+        out[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    static uint8_t in_bufs[BATCH][2048];
+    struct iovec in_iovs[BATCH];
+    struct mmsghdr in[BATCH];
+
+    unsigned long sent = 0, received = 0, lost = 0, malformed = 0;
+    double start = get_time_s();
+    double last_rx = start;
+
+    while (get_time_s() - start < DURATION_S) {
+        if (sent - received - lost < WINDOW) {
+            int n = sendmmsg(fd, out, BATCH, MSG_DONTWAIT);
+            if (n > 0) sent += n;
+        }
+
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 10) <= 0) {
+            // datagramas perdidos: se reabre la ventana
+            if (get_time_s() - last_rx > 0.05) {
+                lost = sent - received;
+            }
+            continue;
+        }
+        for (int i = 0; i < BATCH; i++) {
+            in_iovs[i].iov_base = in_bufs[i];
+            in_iovs[i].iov_len = sizeof(in_bufs[i]);
+            memset(&in[i], 0, sizeof(in[i]));
+            in[i].msg_hdr.msg_iov = &in_iovs[i];
+            in[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(fd, in, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) continue;
+        last_rx = get_time_s();
+        for (int i = 0; i < n; i++) {
+            if (in[i].msg_len != sizeof(datagram) || in_bufs[i][3] != 0x01) {
+                malformed++;
+            }
+        }
+        received += n;
+    }
+    double elapsed = get_time_s() - start;
+
+    printf("Datagramas enviados:   %lu\n", sent);
+    printf("Datagramas recibidos:  %lu\n", received);
+    printf("Perdidos (aprox.):     %lu\n", lost);
+    printf("Malformados:           %lu\n", malformed);
+    printf("Tasa (ida y vuelta):   %.0f paquetes/s\n", received / elapsed);
+    printf("Throughput de payload: %.2f MB/s\n", received * (double)PAYLOAD_SIZE / elapsed / 1e6);
+
+    close(fd);
+    close(control);
+    running = 0;
+    pthread_join(echo_thread, NULL);
+    close(echo_fd);
+    return malformed == 0 && received > 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * CPU por byte de send() común contra send() con MSG_ZEROCOPY, como los usa
+ * copy.c con -Z: se mandan N MB a un sumidero que lee y descarta, y se mide la
+ * CPU del hilo que envía. Con MSG_ZEROCOPY cada bloque queda retenido hasta
+ * que la cola de errores del socket confirma el envío.
+ *
+ * Por defecto el sumidero es un hilo local por loopback; ahí el kernel copia
+ * igual (lo avisa en cada confirmación) y se ve solo el costo extra de fijar
+ * páginas y leer los avisos. Para ver la diferencia real hay que apuntarlo a
+ * un sumidero en otra máquina (ej: `nc -l 9000 > /dev/null').
+ */
+
+#define DEFAULT_MB 2048
+#define DEFAULT_CHUNK_KB 64
+/* bloques en vuelo: uno no se reescribe hasta que el kernel lo libera */
+#define SLOTS 16
+#define SEQS 1024
+
+#ifndef MSG_ZEROCOPY
+int main(void) {
+    printf("MSG_ZEROCOPY no está soportado en este sistema\n");
+    return 0;
+}
+#else
+#include <linux/errqueue.h>
+
+struct zc_state {
+    uint8_t *slots[SLOTS];
+    /* envíos sin confirmar por bloque y a qué bloque pertenece cada envío */
+    unsigned pending[SLOTS];
+    unsigned seq_slot[SEQS];
+    uint32_t seq;
+    uint64_t notifications;
+    uint64_t copied;
+};
+
+static int sink_fd = -1;
+static uint64_t sink_bytes;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_s(void) {
+    struct rusage ru;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &ru);
+#else
+    getrusage(RUSAGE_SELF, &ru);
+#endif
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void *sink_loop(void *arg) {
+    (void)arg;
+    uint8_t *chunk = malloc(256 * 1024);
+    while (1) {
+        int fd = accept(sink_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        ssize_t r;
+        uint64_t total = 0;
+        while ((r = recv(fd, chunk, 256 * 1024, 0)) > 0) {
+            total += (uint64_t)r;
+        }
+        close(fd);
+        __atomic_store_n(&sink_bytes, total, __ATOMIC_RELEASE);
+    }
+    free(chunk);
+    return NULL;
+}
+
+static int start_sink(struct sockaddr_in *addr) {
+    socklen_t len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    sink_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sink_fd < 0 || bind(sink_fd, (struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+        listen(sink_fd, 4) < 0 || getsockname(sink_fd, (struct sockaddr *)addr, &len) < 0) {
+        perror("sink");
+        return -1;
+    }
+    pthread_t t;
+    return pthread_create(&t, NULL, sink_loop, NULL) == 0 ? 0 : -1;
+}
+
+/* lee los avisos pendientes; con `wait' espera hasta que llegue alguno */
+static int reap(int fd, struct zc_state *zc, bool wait) {
+    if (wait) {
+        struct pollfd pfd = {.fd = fd, .events = 0};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            return -1;
+        }
+    }
+    for (;;) {
+        uint8_t control[128];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            const struct sock_extended_err *ee = (const struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            zc->notifications++;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied++;
+            }
+            for (uint32_t s = ee->ee_info; s != ee->ee_data + 1; s++) {
+                zc->pending[zc->seq_slot[s % SEQS]]--;
+            }
+        }
+    }
+}
+
+/*
+ * Manda `bytes' por `fd' en envíos de `chunk'. Sin `zc' siempre desde el mismo
+ * bloque; con `zc' rota entre SLOTS bloques y no reescribe uno hasta que el
+ * kernel confirme sus envíos.
+ */
+static int send_all(int fd, uint64_t bytes, size_t chunk, uint8_t *plain, struct zc_state *zc) {
+    uint64_t left = bytes;
+    unsigned slot = 0;
+    while (left > 0) {
+        const size_t n = left < chunk ? left : chunk;
+        while (zc != NULL && zc->pending[slot] > 0) {
+            if (reap(fd, zc, true) < 0) {
+                return -1;
+            }
+        }
+        const uint8_t *p = zc != NULL ? zc->slots[slot] : plain;
+        size_t off = 0;
+        while (off < n) {
+            ssize_t w = send(fd, p + off, n - off, MSG_NOSIGNAL | (zc != NULL ? MSG_ZEROCOPY : 0));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                // sin memoria para fijar más páginas: se espera a que se liberen
+                if (zc != NULL && errno == ENOBUFS && reap(fd, zc, true) == 0) continue;
+                perror("send");
+                return -1;
+            }
+            if (zc != NULL) {
+                zc->seq_slot[zc->seq % SEQS] = slot;
+                zc->pending[slot]++;
+                zc->seq++;
+            }
+            off += (size_t)w;
+        }
+        left -= n;
+        if (zc != NULL) {
+            slot = (slot + 1) % SLOTS;
+            if (reap(fd, zc, false) < 0) {
+                return -1;
+            }
+        }
+    }
+    for (unsigned i = 0; zc != NULL && i < SLOTS; i++) {
+        while (zc->pending[i] > 0) {
+            if (reap(fd, zc, true) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int run(const char *name, const struct sockaddr *sink, socklen_t sink_len, bool local, uint64_t bytes,
+               size_t chunk, bool zerocopy) {
+    int fd = socket(sink->sa_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, sink, sink_len) < 0) {
+        perror("connect");
+        return -1;
+    }
+    const int one = 1;
+    if (zerocopy && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+        printf("  %-10s SO_ZEROCOPY no soportado: %s\n", name, strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    struct zc_state zc;
+    memset(&zc, 0, sizeof(zc));
+    uint8_t *plain = malloc(chunk);
+    memset(plain, 'x', chunk);
+    for (int i = 0; zerocopy && i < SLOTS; i++) {
+        zc.slots[i] = malloc(chunk);
+        memset(zc.slots[i], 'x', chunk);
+    }
+
+    __atomic_store_n(&sink_bytes, 0, __ATOMIC_RELEASE);
+    const double cpu0 = thread_cpu_s();
+    const double t0 = now_s();
+    const int ret = send_all(fd, bytes, chunk, plain, zerocopy ? &zc : NULL);
+    const double cpu = thread_cpu_s() - cpu0;
+    shutdown(fd, SHUT_WR);
+    // el sumidero termina de leer al ver el EOF
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {
+    }
+    const double elapsed = now_s() - t0;
+    close(fd);
+
+    free(plain);
+    for (int i = 0; zerocopy && i < SLOTS; i++) {
+        free(zc.slots[i]);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+    if (local) {
+        for (int i = 0; i < 100 && __atomic_load_n(&sink_bytes, __ATOMIC_ACQUIRE) == 0; i++) {
+            usleep(10000);
+        }
+        if (__atomic_load_n(&sink_bytes, __ATOMIC_ACQUIRE) != bytes) {
+            printf("  %-10s ERROR: el sumidero recibió %llu bytes de %llu\n", name,
+                   (unsigned long long)sink_bytes, (unsigned long long)bytes);
+            return -1;
+        }
+    }
+
+    const double gib = bytes / (1024.0 * 1024.0 * 1024.0);
+    printf("  %-10s %8.2f GiB/s %10.3f s %10llu %10llu\n", name, gib / elapsed, cpu / gib,
+           (unsigned long long)zc.notifications, (unsigned long long)zc.copied);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long mb = argc > 1 ? atol(argv[1]) : DEFAULT_MB;
+    long chunk_kb = argc > 2 ? atol(argv[2]) : DEFAULT_CHUNK_KB;
+    const char *remote = argc > 3 ? argv[3] : NULL;
+    if (mb <= 0 || chunk_kb <= 0) {
+        fprintf(stderr, "Uso: %s [MB] [KB por envío] [host:puerto del sumidero]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_storage sink;
+    socklen_t sink_len = sizeof(struct sockaddr_in);
+    if (remote == NULL) {
+        if (start_sink((struct sockaddr_in *)&sink) < 0) {
+            return 1;
+        }
+    } else {
+        char host[256];
+        const char *colon = strrchr(remote, ':');
+        if (colon == NULL || (size_t)(colon - remote) >= sizeof(host)) {
+            fprintf(stderr, "sumidero inválido: %s\n", remote);
+            return 1;
+        }
+        memcpy(host, remote, (size_t)(colon - remote));
+        host[colon - remote] = '\0';
+        struct addrinfo hints = {.ai_socktype = SOCK_STREAM}, *res;
+        if (getaddrinfo(host, colon + 1, &hints, &res) != 0) {
+            fprintf(stderr, "no se pudo resolver %s\n", remote);
+            return 1;
+        }
+        memcpy(&sink, res->ai_addr, res->ai_addrlen);
+        sink_len = res->ai_addrlen;
+        freeaddrinfo(res);
+    }
+
+    const uint64_t bytes = (uint64_t)mb * 1024 * 1024;
+    const size_t chunk = (size_t)chunk_kb * 1024;
+    printf("\n#### Envío a %s: %ld MB en bloques de %ld KB ####\n", remote != NULL ? remote : "sumidero local",
+           mb, chunk_kb);
+    printf("  %-10s %13s %12s %10s %10s\n", "modo", "throughput", "CPU/GiB", "avisos", "copiados");
+    if (run("send", (struct sockaddr *)&sink, sink_len, remote == NULL, bytes, chunk, false) < 0
+        || run("zerocopy", (struct sockaddr *)&sink, sink_len, remote == NULL, bytes, chunk, true) < 0) {
+        return 1;
+    }
+    if (remote == NULL) {
+        printf("\nPor loopback el kernel copia igual: la diferencia real se ve contra otra máquina.\n");
+    }
+    return 0;
+}
+#endif
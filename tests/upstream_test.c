@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "socks5/upstream.h"
+#include "socks5/request.h"
+
+static struct request_parser
+ipv4(const char *a, const char *b, const char *c, const char *d) {
+    struct request_parser p;
+    memset(&p, 0, sizeof(p));
+    p.command = REQUEST_COMMAND_CONNECT;
+    p.address_type = ADDRESS_TYPE_IPV4;
+    p.dst_addr[0] = atoi(a);
+    p.dst_addr[1] = atoi(b);
+    p.dst_addr[2] = atoi(c);
+    p.dst_addr[3] = atoi(d);
+    p.dst_port = 80;
+    return p;
+}
+
+static struct request_parser
+fqdn(const char *host) {
+    struct request_parser p;
+    memset(&p, 0, sizeof(p));
+    p.command = REQUEST_COMMAND_CONNECT;
+    p.address_type = ADDRESS_TYPE_DOMAIN;
+    p.dst_addr_length = strlen(host);
+    memcpy(p.dst_addr, host, p.dst_addr_length);
+    p.dst_port = 443;
+    return p;
+}
+
+START_TEST (test_disabled) {
+    ck_assert(upstream_init(NULL, NULL, NULL, 0, 0) == 0);
+    ck_assert(!upstream_enabled());
+    struct request_parser p = ipv4("10", "0", "0", "1");
+    ck_assert(!upstream_matches(&p));
+}
+END_TEST
+
+START_TEST (test_no_rules) {
+    ck_assert(upstream_init(NULL, "u:p@127.0.0.1:1080", NULL, 0, 0) == 0);
+    ck_assert(upstream_enabled());
+    struct request_parser p = fqdn("example.com");
+    ck_assert(upstream_matches(&p));
+
+    p.command = REQUEST_COMMAND_BIND;
+    ck_assert(!upstream_matches(&p));
+    upstream_destroy();
+}
+END_TEST
+
+START_TEST (test_cidr) {
+    char *rules[] = {"10.0.0.0/8", "192.168.1.7", "2001:db8::/32"};
+    ck_assert(upstream_init(NULL, "127.0.0.1:1080", rules, 3, 0) == 0);
+
+    struct request_parser p = ipv4("10", "200", "3", "4");
+    ck_assert(upstream_matches(&p));
+    p = ipv4("11", "0", "0", "1");
+    ck_assert(!upstream_matches(&p));
+    p = ipv4("192", "168", "1", "7");
+    ck_assert(upstream_matches(&p));
+    p = ipv4("192", "168", "1", "8");
+    ck_assert(!upstream_matches(&p));
+
+    memset(&p, 0, sizeof(p));
+    p.command = REQUEST_COMMAND_CONNECT;
+    p.address_type = ADDRESS_TYPE_IPV6;
+    p.dst_addr[0] = 0x20;
+    p.dst_addr[1] = 0x01;
+    p.dst_addr[2] = 0x0d;
+    p.dst_addr[3] = 0xb8;
+    ck_assert(upstream_matches(&p));
+    p.dst_addr[3] = 0xb9;
+    ck_assert(!upstream_matches(&p));
+    upstream_destroy();
+}
+END_TEST
+
+START_TEST (test_domain) {
+    char *rules[] = {".example.com"};
+    ck_assert(upstream_init(NULL, "[::1]:1080", rules, 1, 0) == 0);
+
+    struct request_parser p = fqdn("example.com");
+    ck_assert(upstream_matches(&p));
+    p = fqdn("WWW.Example.COM");
+    ck_assert(upstream_matches(&p));
+    p = fqdn("badexample.com");
+    ck_assert(!upstream_matches(&p));
+    p = fqdn("example.org");
+    ck_assert(!upstream_matches(&p));
+    upstream_destroy();
+}
+END_TEST
+
+START_TEST (test_invalid) {
+    char *bad_rule[] = {"10.0.0.0/33"};
+    ck_assert(upstream_init(NULL, "127.0.0.1:1080", bad_rule, 1, 0) != 0);
+    ck_assert(upstream_init(NULL, "127.0.0.1", NULL, 0, 0) != 0);
+    ck_assert(upstream_init(NULL, "nopass@127.0.0.1:1080", NULL, 0, 0) != 0);
+
+    // lo que no entra se rechaza en lugar de truncarlo
+    char spec[300], domain[300];
+    memset(spec, 'u', 256);
+    strcpy(spec + 256, ":p@127.0.0.1:1080");
+    ck_assert(upstream_init(NULL, spec, NULL, 0, 0) != 0);
+    memset(domain, 'd', 256);
+    domain[256] = '\0';
+    char *long_rule[] = {domain};
+    ck_assert(upstream_init(NULL, "127.0.0.1:1080", long_rule, 1, 0) != 0);
+    domain[255] = '\0';
+    ck_assert(upstream_init(NULL, "127.0.0.1:1080", long_rule, 1, 0) == 0);
+    upstream_destroy();
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("upstream");
+
+    /* Core test case */
+    tc = tcase_create("upstream");
+
+    tcase_add_test(tc, test_disabled);
+    tcase_add_test(tc, test_no_rules);
+    tcase_add_test(tc, test_cidr);
+    tcase_add_test(tc, test_domain);
+    tcase_add_test(tc, test_invalid);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <check.h>
+
+#include "users/userdb.h"
+
+#define DB_PATH "/tmp/userdb_test.db"
+#define MANY 5000
+
+static struct user
+make_user(const char *name, const char *pass) {
+    struct user u;
+    memset(&u, 0, sizeof(u));
+    strncpy(u.username, name, MAX_USERNAME - 1);
+    strncpy(u.password, pass, MAX_PASSWORD - 1);
+    return u;
+}
+
+static void
+add_many(int n) {
+    char name[32];
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        struct user u = make_user(name, "pw");
+        ck_assert_ptr_ne(NULL, userdb_put(&u));
+    }
+}
+
+START_TEST (test_memory) {
+    ck_assert_int_eq(0, userdb_open(NULL));
+    ck_assert(!userdb_persistent());
+
+    add_many(MANY);
+    ck_assert_uint_eq(MANY, userdb_count());
+    ck_assert_ptr_ne(NULL, userdb_find("user0"));
+    ck_assert_ptr_ne(NULL, userdb_find("user4999"));
+    ck_assert_ptr_eq(NULL, userdb_find("user5000"));
+
+    ck_assert(userdb_remove("user42"));
+    ck_assert(!userdb_remove("user42"));
+    ck_assert_ptr_eq(NULL, userdb_find("user42"));
+    ck_assert_uint_eq(MANY - 1, userdb_count());
+
+    userdb_clear();
+    ck_assert_uint_eq(0, userdb_count());
+    ck_assert_ptr_eq(NULL, userdb_find("user0"));
+    userdb_close();
+}
+END_TEST
+
+START_TEST (test_reopen) {
+    unlink(DB_PATH);
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert(userdb_persistent());
+    add_many(MANY);
+    ck_assert(userdb_remove("user7"));
+    userdb_find("user8")->total_connections = 3;
+    userdb_close();
+
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert_uint_eq(MANY - 1, userdb_count());
+    ck_assert_ptr_eq(NULL, userdb_find("user7"));
+    ck_assert_uint_eq(3, userdb_find("user8")->total_connections);
+    ck_assert_str_eq("pw", userdb_find("user4999")->password);
+    userdb_close();
+    unlink(DB_PATH);
+}
+END_TEST
+
+START_TEST (test_replace_compacts) {
+    unlink(DB_PATH);
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    struct user u = make_user("alice", "0");
+
+    // cada cambio agrega un registro; la capacidad no crece con uno solo vivo
+    char pass[16];
+    for (int i = 1; i <= 1000; i++) {
+        snprintf(pass, sizeof(pass), "%d", i);
+        strcpy(u.password, pass);
+        ck_assert_ptr_ne(NULL, userdb_put(&u));
+    }
+    ck_assert_uint_eq(1, userdb_count());
+    ck_assert(userdb_records() <= 64);
+    ck_assert_str_eq("1000", userdb_find("alice")->password);
+
+    int live = 0;
+    for (size_t i = 0; i < userdb_records(); i++) {
+        live += userdb_record(i)->active;
+    }
+    ck_assert_int_eq(1, live);
+    userdb_close();
+
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert_str_eq("1000", userdb_find("alice")->password);
+    userdb_close();
+    unlink(DB_PATH);
+}
+END_TEST
+
+START_TEST (test_single_owner) {
+    unlink(DB_PATH);
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    struct user u = make_user("alice", "pw");
+    ck_assert_ptr_ne(NULL, userdb_put(&u));
+
+    // otro proceso (otra descripción del archivo) no consigue el lock
+    int other = open(DB_PATH, O_RDWR);
+    ck_assert_int_ge(other, 0);
+    ck_assert_int_eq(-1, flock(other, LOCK_EX | LOCK_NB));
+    ck_assert_int_eq(EWOULDBLOCK, errno);
+    close(other);
+
+    // traspaso: el fd viaja con el lock y este proceso deja de cambiar la base
+    int handed = dup(userdb_fd());
+    userdb_freeze(true);
+    u = make_user("bob", "pw");
+    ck_assert_ptr_eq(NULL, userdb_put(&u));
+    ck_assert(!userdb_remove("alice"));
+
+    struct user *alice = userdb_find("alice");
+    userdb_detach();
+    ck_assert(!userdb_persistent());
+    ck_assert_int_eq(-1, userdb_fd());
+    ck_assert_ptr_eq(alice, userdb_find("alice"));
+    alice->bytes_transferred = 7;
+
+    // el proceso nuevo abre con el fd recibido; lo del viejo no llegó al archivo
+    userdb_inherit(handed);
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert(userdb_persistent());
+    ck_assert_ptr_ne(NULL, userdb_find("alice"));
+    ck_assert_uint_eq(0, userdb_find("alice")->bytes_transferred);
+    ck_assert_ptr_eq(NULL, userdb_find("bob"));
+    userdb_close();
+    unlink(DB_PATH);
+}
+END_TEST
+
+START_TEST (test_invalid_file) {
+    FILE *f = fopen(DB_PATH, "w");
+    ck_assert_ptr_ne(NULL, f);
+    fputs("not a user database", f);
+    fclose(f);
+
+    ck_assert_int_eq(-1, userdb_open(DB_PATH));
+    ck_assert_uint_eq(0, userdb_count());
+    unlink(DB_PATH);
+}
+END_TEST
+
+/* base con dos usuarios, abierta aparte para romperla; en `slots' el tamaño del índice */
+static int
+corruptible(uint32_t *slots) {
+    unlink(DB_PATH);
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    add_many(2);
+    userdb_close();
+
+    int fd = open(DB_PATH, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    uint32_t header[8];
+    ck_assert_int_eq(sizeof(header), pread(fd, header, sizeof(header), 0));
+    *slots = header[6];
+    return fd;
+}
+
+START_TEST (test_corrupt_file) {
+    // una entrada del índice que apunta más allá de los registros escritos
+    uint32_t slots;
+    int fd = corruptible(&slots);
+    uint32_t *index = malloc(slots * sizeof(uint32_t));
+    const off_t index_at = 8 * sizeof(uint32_t);
+    ck_assert_int_eq(slots * sizeof(uint32_t), pread(fd, index, slots * sizeof(uint32_t), index_at));
+    uint32_t i = 0;
+    while (index[i] == 0) {
+        i++;
+    }
+    const uint32_t bad = 3;
+    ck_assert_int_eq(sizeof(bad), pwrite(fd, &bad, sizeof(bad), index_at + i * sizeof(uint32_t)));
+    free(index);
+    close(fd);
+    ck_assert_int_eq(-1, userdb_open(DB_PATH));
+
+    // un nombre sin terminar
+    fd = corruptible(&slots);
+    const off_t record_at = 8 * sizeof(uint32_t) + slots * sizeof(uint32_t);
+    const char c = 'x';
+    ck_assert_int_eq(1, pwrite(fd, &c, 1, record_at + offsetof(struct user, username) + MAX_USERNAME - 1));
+    close(fd);
+    ck_assert_int_eq(-1, userdb_open(DB_PATH));
+    unlink(DB_PATH);
+}
+END_TEST
+
+START_TEST (test_migrate_short_records) {
+    // base de una versión anterior: registros sin los campos de límites
+    const size_t old_size = offsetof(struct user, limits);
+    const uint32_t capacity = 64, slots = 128, used = 3;
+    uint32_t header[8] = {0, 1, (uint32_t)old_size, capacity, used, 2, slots, 0};
+    memcpy(header, "S5DB", 4);
+
+    FILE *f = fopen(DB_PATH, "w");
+    ck_assert_ptr_ne(NULL, f);
+    fwrite(header, sizeof(header), 1, f);
+    uint32_t *index = calloc(slots, sizeof(uint32_t));
+    fwrite(index, sizeof(uint32_t), slots, f);
+    free(index);
+    const char *names[] = {"alice", "bob", "carol"};
+    for (uint32_t i = 0; i < capacity; i++) {
+        struct user u = make_user(i < used ? names[i] : "", "pw");
+        u.active = i < used && i != 1;
+        u.bytes_transferred = i + 10;
+        fwrite(&u, old_size, 1, f);
+    }
+    fclose(f);
+
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert_uint_eq(2, userdb_count());
+    ck_assert_ptr_eq(NULL, userdb_find("bob"));
+    struct user *carol = userdb_find("carol");
+    ck_assert_ptr_ne(NULL, carol);
+    ck_assert_uint_eq(12, carol->bytes_transferred);
+    ck_assert_uint_eq(0, carol->limits.max_sessions);
+    ck_assert_uint_eq(0, carol->bytes_day);
+    carol->limits.max_sessions = 5;
+    userdb_close();
+
+    // ya migrada se abre tal cual
+    ck_assert_int_eq(0, userdb_open(DB_PATH));
+    ck_assert_uint_eq(5, userdb_find("carol")->limits.max_sessions);
+    ck_assert_str_eq("pw", userdb_find("alice")->password);
+    userdb_close();
+    unlink(DB_PATH);
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("userdb");
+
+    /* Core test case */
+    tc = tcase_create("userdb");
+
+    tcase_add_test(tc, test_memory);
+    tcase_add_test(tc, test_reopen);
+    tcase_add_test(tc, test_replace_compacts);
+    tcase_add_test(tc, test_single_owner);
+    tcase_add_test(tc, test_invalid_file);
+    tcase_add_test(tc, test_corrupt_file);
+    tcase_add_test(tc, test_migrate_short_records);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
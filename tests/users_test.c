@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "users/users.h"
+
+static void
+setup(void) {
+    ck_assert_int_eq(0, users_init(NULL));
+    ck_assert(user_add("alice", "secreto", ROLE_USER));
+}
+
+START_TEST (test_no_limits) {
+    setup();
+    for (int i = 0; i < 100; i++) {
+        ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+    }
+    // sin usuario (método sin autenticación) no se cuenta nada
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit(""));
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("nadie"));
+    users_destroy();
+}
+END_TEST
+
+START_TEST (test_max_sessions) {
+    setup();
+    struct user_limits limits = {.max_sessions = 2};
+    ck_assert(user_set_limits("alice", &limits));
+    ck_assert(!user_set_limits("nadie", &limits));
+
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+    ck_assert_int_eq(USER_ADMIT_SESSIONS, user_session_admit("alice"));
+
+    struct user_usage usage;
+    ck_assert(user_get_limits("alice", NULL, &usage));
+    ck_assert_uint_eq(2, usage.active_sessions);
+
+    user_session_release("alice");
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+
+    // el contador no baja de cero
+    for (int i = 0; i < 5; i++) {
+        user_session_release("alice");
+    }
+    ck_assert(user_get_limits("alice", NULL, &usage));
+    ck_assert_uint_eq(0, usage.active_sessions);
+    users_destroy();
+}
+END_TEST
+
+START_TEST (test_rate) {
+    setup();
+    struct user_limits limits = {.max_rate = 3};
+    ck_assert(user_set_limits("alice", &limits));
+
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+        user_session_release("alice");
+    }
+    ck_assert_int_eq(USER_ADMIT_RATE, user_session_admit("alice"));
+    users_destroy();
+}
+END_TEST
+
+START_TEST (test_quota) {
+    setup();
+    struct user_limits limits = {.quota_daily = 1000, .quota_monthly = 5000};
+    ck_assert(user_set_limits("alice", &limits));
+
+    user_update_metrics("alice", 999);
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+    user_update_metrics("alice", 1);
+    ck_assert_int_eq(USER_ADMIT_QUOTA, user_session_admit("alice"));
+
+    struct user_limits got;
+    struct user_usage usage;
+    ck_assert(user_get_limits("alice", &got, &usage));
+    ck_assert_uint_eq(1000, got.quota_daily);
+    ck_assert_uint_eq(5000, got.quota_monthly);
+    ck_assert_uint_eq(1000, usage.bytes_day);
+    ck_assert_uint_eq(1000, usage.bytes_month);
+
+    // un día nuevo reinicia la cuota diaria pero no la mensual
+    struct user *u = user_find("alice");
+    u->day--;
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+    ck_assert(user_get_limits("alice", NULL, &usage));
+    ck_assert_uint_eq(0, usage.bytes_day);
+    ck_assert_uint_eq(1000, usage.bytes_month);
+    users_destroy();
+}
+END_TEST
+
+START_TEST (test_serialize_limits) {
+    setup();
+    struct user_limits limits = {.max_sessions = 4, .max_rate = 60, .quota_daily = 1 << 20};
+    ck_assert(user_set_limits("alice", &limits));
+    user_update_metrics("alice", 123);
+    ck_assert_int_eq(USER_ADMIT_OK, user_session_admit("alice"));
+
+    size_t cap = users_serialize_bound();
+    uint8_t *buf = malloc(cap);
+    size_t len = users_serialize(buf, cap);
+    ck_assert_uint_gt(len, 0);
+    users_destroy();
+
+    ck_assert_int_eq(0, users_init(NULL));
+    ck_assert(users_deserialize(buf, len));
+    struct user_limits got;
+    struct user_usage usage;
+    ck_assert(user_get_limits("alice", &got, &usage));
+    ck_assert_uint_eq(4, got.max_sessions);
+    ck_assert_uint_eq(60, got.max_rate);
+    ck_assert_uint_eq(1 << 20, got.quota_daily);
+    ck_assert_uint_eq(123, usage.bytes_day);
+    // las sesiones abiertas quedan en el proceso anterior
+    ck_assert_uint_eq(0, usage.active_sessions);
+    users_destroy();
+    free(buf);
+}
+END_TEST
+
+START_TEST (test_many_users) {
+    ck_assert_int_eq(0, users_init(NULL));
+    struct user_limits limits = {.max_sessions = 1};
+    char name[32];
+    // el estado de cada uno sobrevive a que la tabla crezca
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "u%d", i);
+        ck_assert(user_add(name, "pw", ROLE_USER));
+        ck_assert(user_set_limits(name, &limits));
+        ck_assert_int_eq(USER_ADMIT_OK, user_session_admit(name));
+    }
+    struct user_usage usage;
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "u%d", i);
+        ck_assert_int_eq(USER_ADMIT_SESSIONS, user_session_admit(name));
+        ck_assert(user_get_limits(name, NULL, &usage));
+        ck_assert_uint_eq(1, usage.active_sessions);
+        user_session_release(name);
+    }
+    ck_assert(user_get_limits("u99", NULL, &usage));
+    ck_assert_uint_eq(0, usage.active_sessions);
+    users_destroy();
+}
+END_TEST
+
+Suite *
+suite(void) {
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("users");
+
+    /* Core test case */
+    tc = tcase_create("users");
+
+    tcase_add_test(tc, test_no_limits);
+    tcase_add_test(tc, test_max_sessions);
+    tcase_add_test(tc, test_rate);
+    tcase_add_test(tc, test_quota);
+    tcase_add_test(tc, test_serialize_limits);
+    tcase_add_test(tc, test_many_users);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int
+main(void) {
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}